@@ -198,21 +198,14 @@ draw_logo:
         ldx #seq_logo
         jsr putstring
 
-        ldx #40
-        ldb #0
-.line_loop:
-        stb GRAPHICS_SET_ROW
+        clr GRAPHICS_SET_ROW
         clr GRAPHICS_SET_COLUMN
-.color_loop:
-        lda #COLOR_CYAN | COLOR_ADVANCE
-        sta GRAPHICS_SET_COLOR
-        dex
-        bne .color_loop
-
-        ldx #40
-        inc b
-        cmp b,#8
-        bne .line_loop
+        lda #40
+        sta GRAPHICS_SET_WIDTH
+        lda #8
+        sta GRAPHICS_SET_HEIGHT
+        lda #COLOR_CYAN
+        sta GRAPHICS_FILL_COLOR
 
         rts
 
@@ -0,0 +1,65 @@
+; Tests map_find from include/map.inc. Run it with the emulator's firmware_test
+; runner.
+        cpu 6301
+
+        org $8000
+
+        include ../include/debug_port
+        include ../include/map
+        include ../include/memory_map
+
+test_map:
+        adr +
+        byt "foo\0"
+        byt $01
++
+        adr +
+        byt "bar\0"
+        byt $02
++
+        adr $0000
+
+name_string:
+        byt "map_test\n\0"
+bar_string:
+        byt "bar baz\0"
+prefix_string:
+        byt "ba\0"
+missing_string:
+        byt "qux\0"
+
+start:
+        lds #USER_STACK_START
+        ldx #name_string
+        test_print
+
+        ; A key followed by a space matches, and the payload and the rest of
+        ; the input string are returned.
+        ldx #bar_string
+        pshx
+        ldx #test_map
+        jsr map_find
+        test_assert_cs 1
+        lda 0,x
+        test_assert_a $02, 2
+        pulx
+        test_assert_x bar_string+3, 3
+
+        ; A prefix of a key doesn't match.
+        ldx #prefix_string
+        pshx
+        ldx #test_map
+        jsr map_find
+        test_assert_cc 4
+
+        ; Neither does a missing key.
+        ldx #missing_string
+        pshx
+        ldx #test_map
+        jsr map_find
+        test_assert_cc 5
+
+        test_pass
+
+        org $fffe
+        adr start               ; Reset
@@ -0,0 +1,109 @@
+#include "asl_listing.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+
+namespace eight_bit {
+namespace {
+
+bool is_upper_hex(char c) {
+  return std::isdigit(c) || (c >= 'A' && c <= 'F');
+}
+
+// Source lines look like
+//   "      12/    D000 : 86 01               start:  lda #1"
+// with a "(nesting level)" in front for lines from included files. Returns
+// the address and the source text, minus the code bytes.
+bool split_line(std::string_view line, uint16_t& address,
+                std::string_view& source) {
+  const size_t separator = line.find(" : ");
+  if (separator == std::string_view::npos) {
+    return false;
+  }
+  std::string_view prefix = line.substr(0, separator);
+  const size_t slash = prefix.find('/');
+  if (slash == std::string_view::npos || slash == 0 ||
+      !std::isdigit(prefix[slash - 1])) {
+    return false;
+  }
+  prefix.remove_prefix(slash + 1);
+  while (!prefix.empty() && prefix.front() == ' ') {
+    prefix.remove_prefix(1);
+  }
+  unsigned int value = 0;
+  auto [end, error] =
+      std::from_chars(prefix.data(), prefix.data() + prefix.size(), value, 16);
+  if (error != std::errc() || end != prefix.data() + prefix.size() ||
+      value > 0xffff) {
+    return false;
+  }
+  address = value;
+
+  // Skip the code bytes, which ASL prints as upper case hex pairs.
+  source = line.substr(separator + 3);
+  while (source.size() >= 2 && is_upper_hex(source[0]) &&
+         is_upper_hex(source[1]) && (source.size() == 2 || source[2] == ' ')) {
+    source.remove_prefix(std::min<size_t>(3, source.size()));
+  }
+  while (!source.empty() && source.front() == ' ') {
+    source.remove_prefix(1);
+  }
+  return true;
+}
+
+}  // namespace
+
+std::map<std::string, uint16_t> parse_asl_listing_labels(
+    std::string_view listing) {
+  std::map<std::string, uint16_t> labels;
+  std::map<std::string, int> seen;
+  std::istringstream lines{std::string(listing)};
+  std::string line;
+  while (std::getline(lines, line)) {
+    uint16_t address = 0;
+    std::string_view source;
+    if (!split_line(line, address, source) || source.empty() ||
+        !(std::isalpha(source[0]) || source[0] == '_')) {
+      continue;
+    }
+    size_t length = 1;
+    while (length < source.size() &&
+           (std::isalnum(source[length]) || source[length] == '_')) {
+      ++length;
+    }
+    if (length == source.size() || source[length] != ':') {
+      continue;
+    }
+    const std::string label(source.substr(0, length));
+    if (++seen[label] > 1) {
+      labels.erase(label);
+      continue;
+    }
+    labels[label] = address;
+  }
+  return labels;
+}
+
+absl::StatusOr<std::map<std::string, uint16_t>> read_asl_listing_labels(
+    std::string_view path) {
+  std::ifstream file{std::string(path)};
+  if (!file.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to open file: ", path));
+  }
+  const std::string listing(std::istreambuf_iterator<char>(file), {});
+  return parse_asl_listing_labels(listing);
+}
+
+}  // namespace eight_bit
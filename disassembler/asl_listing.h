@@ -0,0 +1,25 @@
+#ifndef EIGHT_BIT_ASL_LISTING_H
+#define EIGHT_BIT_ASL_LISTING_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "absl/status/statusor.h"
+
+namespace eight_bit {
+
+// Returns the address of every global label in an ASL listing (.lst file), as
+// written with 'asl -L'. Local labels starting with a '.' are skipped, and so
+// are labels that come up a second time, e.g. from different sections.
+std::map<std::string, uint16_t> parse_asl_listing_labels(
+    std::string_view listing);
+
+// Like parse_asl_listing_labels, for the listing file at 'path'.
+absl::StatusOr<std::map<std::string, uint16_t>> read_asl_listing_labels(
+    std::string_view path);
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_ASL_LISTING_H
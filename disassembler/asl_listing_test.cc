@@ -0,0 +1,39 @@
+#include "asl_listing.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace eight_bit {
+namespace {
+
+TEST(AslListingTest, FindsGlobalLabels) {
+  const char* listing = R"(
+ AS V1.42 Beta [Bld 255] - Source File monitor.s - Page 1 - 10/19/2026
+
+
+       1/       0 :                             cpu 6301
+       3/    D000 :                             org $d000
+ (1)  12/    D000 :                     serial_init:
+ (1)  13/    D000 : 86 05                       lda #5
+ (1)  14/    D002 : 97 10               .loop:  sta TRMCR
+ (1)  15/    D004 : 39                          rts
+      20/    D005 : 7E D0 00            start:  jmp serial_init
+      21/    D008 :                     dup:
+      22/    D008 :                     dup:
+      23/    D008 : 48 65 6C 6C 6F      hello_string:
+      30/    D00D :                     ; comment: not a label
+
+ Symbol Table (* = unused):
+*START :                       D005 C |
+)";
+  EXPECT_EQ(parse_asl_listing_labels(listing),
+            (std::map<std::string, uint16_t>{{"serial_init", 0xd000},
+                                             {"start", 0xd005},
+                                             {"hello_string", 0xd008}}));
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -0,0 +1,177 @@
+#include "cycle_analysis.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <span>
+#include <stack>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "instructions6301.h"
+
+namespace eight_bit {
+
+CycleAnalysis::CycleAnalysis() : memory_(0x10000, 0), valid_(0x10000, false) {}
+
+absl::Status CycleAnalysis::set_data(uint16_t start_address,
+                                     std::span<const uint8_t> data) {
+  if (start_address + data.size() > memory_.size()) {
+    return absl::InvalidArgumentError("Data does not fit in memory");
+  }
+  std::copy(data.begin(), data.end(), memory_.begin() + start_address);
+  std::fill_n(valid_.begin() + start_address, data.size(), true);
+  results_.clear();
+  return absl::OkStatus();
+}
+
+std::optional<uint16_t> CycleAnalysis::vector_target(uint16_t vector) const {
+  if (vector == 0xffff || !check(vector) || !check(vector + 1)) {
+    return std::nullopt;
+  }
+  return memory_[vector] << 8 | memory_[vector + 1];
+}
+
+const CycleAnalysis::Result& CycleAnalysis::analyze(uint16_t address) {
+  if (auto it = results_.find(address); it != results_.end()) {
+    return it->second;
+  }
+  in_progress_.insert(address);
+
+  // A depth-first walk of the control flow graph that computes the longest
+  // path from each instruction to a return. An edge back to an instruction
+  // that's still on the walk's stack closes a loop, and isn't followed.
+  Result result;
+  std::map<uint16_t, int> longest;
+  std::set<uint16_t> on_stack;
+  struct Frame {
+    Node node;
+    size_t next_successor = 0;
+    int longest_successor = 0;
+  };
+  std::stack<Frame> stack;
+  stack.push({.node = make_node(address, result.findings)});
+  on_stack.insert(address);
+  while (!stack.empty()) {
+    Frame& frame = stack.top();
+    if (frame.next_successor < frame.node.successors.size()) {
+      const uint16_t successor =
+          frame.node.successors[frame.next_successor++];
+      if (auto it = longest.find(successor); it != longest.end()) {
+        frame.longest_successor = std::max(frame.longest_successor, it->second);
+      } else if (on_stack.contains(successor)) {
+        result.findings.insert({Finding::Kind::kLoop, successor});
+      } else {
+        // Invalidates 'frame'.
+        stack.push({.node = make_node(successor, result.findings)});
+        on_stack.insert(successor);
+      }
+      continue;
+    }
+    const int cycles = frame.node.cycles + frame.longest_successor;
+    const uint16_t node_address = frame.node.address;
+    longest[node_address] = cycles;
+    on_stack.erase(node_address);
+    stack.pop();
+    if (!stack.empty()) {
+      stack.top().longest_successor =
+          std::max(stack.top().longest_successor, cycles);
+    }
+  }
+  result.cycles = longest[address];
+
+  in_progress_.erase(address);
+  return results_[address] = std::move(result);
+}
+
+CycleAnalysis::Node CycleAnalysis::make_node(uint16_t address,
+                                             std::set<Finding>& findings) {
+  Node node = {.address = address, .cycles = 0, .successors = {}};
+  const Instruction& instruction = kInstructions6301[memory_[address]];
+  const uint16_t next = address + instruction.bytes;
+  bool complete = check(address) && instruction.mode != kILL;
+  for (int i = 1; complete && i < instruction.bytes; ++i) {
+    complete = address + i < 0x10000 && check(address + i);
+  }
+  if (!complete) {
+    findings.insert({Finding::Kind::kInvalidCode, address});
+    return node;
+  }
+  node.cycles = instruction.cycles;
+  const uint8_t operand = memory_[static_cast<uint16_t>(address + 1)];
+  const uint16_t operand16 =
+      operand << 8 | memory_[static_cast<uint16_t>(address + 2)];
+  const uint16_t relative = address + 2 + static_cast<int8_t>(operand);
+
+  const std::string_view name = instruction.name;
+  if (name == "rts" || name == "rti") {
+    return node;
+  }
+  if (name == "wai" || name == "slp") {
+    // How long it waits depends on when the next interrupt comes in.
+    findings.insert({Finding::Kind::kWait, address});
+  } else if (name == "swi") {
+    if (auto handler = vector_target(0xfffa)) {
+      add_call(node, *handler, findings);
+    } else {
+      findings.insert({Finding::Kind::kInvalidCode, 0xfffa});
+    }
+  } else if (name == "bsr") {
+    // Listed as immediate mode, but the operand is a relative address.
+    add_call(node, relative, findings);
+  } else if (name == "jsr") {
+    if (instruction.mode == kIDX) {
+      findings.insert({Finding::Kind::kIndirectJump, address});
+    } else {
+      add_call(node, instruction.mode == kDIR ? operand : operand16, findings);
+    }
+  } else if (name == "jmp") {
+    if (instruction.mode == kIDX) {
+      findings.insert({Finding::Kind::kIndirectJump, address});
+    } else {
+      node.successors.push_back(operand16);
+    }
+    return node;
+  } else if (instruction.mode == kREL) {
+    if (name != "brn") {
+      node.successors.push_back(relative);
+    }
+    if (name == "bra") {
+      return node;
+    }
+  }
+  node.successors.push_back(next);
+  return node;
+}
+
+void CycleAnalysis::add_call(Node& node, uint16_t callee,
+                             std::set<Finding>& findings) {
+  if (in_progress_.contains(callee)) {
+    findings.insert({Finding::Kind::kRecursion, node.address});
+    return;
+  }
+  const Result& result = analyze(callee);
+  node.cycles += result.cycles;
+  findings.insert(result.findings.begin(), result.findings.end());
+}
+
+const char* finding_kind_name(CycleAnalysis::Finding::Kind kind) {
+  switch (kind) {
+    case CycleAnalysis::Finding::Kind::kLoop:
+      return "loop";
+    case CycleAnalysis::Finding::Kind::kRecursion:
+      return "recursive call";
+    case CycleAnalysis::Finding::Kind::kIndirectJump:
+      return "indexed jump";
+    case CycleAnalysis::Finding::Kind::kWait:
+      return "wait for interrupt";
+    case CycleAnalysis::Finding::Kind::kInvalidCode:
+      return "invalid code";
+  }
+  return "unknown";
+}
+
+}  // namespace eight_bit
@@ -0,0 +1,92 @@
+#ifndef EIGHT_BIT_CYCLE_ANALYSIS_H
+#define EIGHT_BIT_CYCLE_ANALYSIS_H
+
+#include <compare>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <span>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "instructions6301.h"
+
+namespace eight_bit {
+
+// Computes worst-case cycle counts for routines in a ROM by walking their
+// control flow graph. Both sides of conditional branches are followed, called
+// routines are counted in full, and a routine ends at its rts or rti.
+//
+// Anything that can't be bounded statically is reported as a finding instead
+// of being guessed: loops, recursion, indexed jumps and calls, waits for
+// interrupts, and paths that run into invalid code.
+class CycleAnalysis {
+ public:
+  struct Finding {
+    enum class Kind {
+      kLoop,
+      kRecursion,
+      kIndirectJump,
+      kWait,
+      kInvalidCode,
+    };
+    Kind kind;
+    // The loop head, the recursive or indirect call, the wait, or the first
+    // invalid byte.
+    uint16_t address;
+
+    auto operator<=>(const Finding&) const = default;
+  };
+
+  struct Result {
+    // The longest path from the entry point to the return, with every loop
+    // taken at most once. Only an upper bound if there are no findings.
+    int cycles = 0;
+    // Includes the findings of called routines.
+    std::set<Finding> findings;
+
+    bool bounded() const { return findings.empty(); }
+  };
+
+  CycleAnalysis();
+
+  // Add code to analyze. Addresses that were never set are invalid code.
+  absl::Status set_data(uint16_t start_address, std::span<const uint8_t> data);
+
+  // Returns the worst case for the routine starting at 'address', from its
+  // first instruction up to and including its return. Results are cached until
+  // the next set_data().
+  const Result& analyze(uint16_t address);
+
+  // Returns the address stored in 'vector', if both its bytes are set.
+  std::optional<uint16_t> vector_target(uint16_t vector) const;
+
+ private:
+  // One instruction in the control flow graph of a routine.
+  struct Node {
+    uint16_t address;
+    // Cycles of the instruction itself plus any routine it calls.
+    int cycles = 0;
+    std::vector<uint16_t> successors;
+  };
+
+  // Decodes the instruction at 'address', analyzing any routine it calls.
+  Node make_node(uint16_t address, std::set<Finding>& findings);
+  void add_call(Node& node, uint16_t callee, std::set<Finding>& findings);
+
+  bool check(uint16_t address) const { return valid_[address]; }
+
+  std::vector<uint8_t> memory_;
+  std::vector<bool> valid_;
+  std::map<uint16_t, Result> results_;
+  // Routines whose analysis is underway, to catch recursion.
+  std::set<uint16_t> in_progress_;
+};
+
+// What kind of finding it is, e.g. "loop".
+const char* finding_kind_name(CycleAnalysis::Finding::Kind kind);
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_CYCLE_ANALYSIS_H
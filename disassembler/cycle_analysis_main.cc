@@ -0,0 +1,191 @@
+// Reports worst-case cycle counts for the interrupt handlers of a ROM, and for
+// any other routines asked for by name or address.
+//
+// Usage: cycle_analysis --rom_file=rom.bin [--listings=monitor.lst,...]
+//                       [--routines=putchar,$d000] [--max_cycles=N]
+
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/check.h"
+#include "absl/log/initialize.h"
+#include "absl/log/log.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "asl_listing.h"
+#include "cycle_analysis.h"
+#include "instructions6301.h"
+
+ABSL_FLAG(std::string, rom_file, "", "Path to the ROM file to analyze");
+ABSL_FLAG(std::vector<std::string>, listings, {},
+          "ASL listings (.lst) of the code in the ROM, to name routines");
+ABSL_FLAG(std::vector<std::string>, routines, {},
+          "Additional routines to analyze, by listing label or as $hex "
+          "address");
+ABSL_FLAG(int, max_cycles, 0,
+          "If set, fail if any analyzed routine can take more than this many "
+          "cycles. For handlers this is the latency from the interrupt to the "
+          "return: the entry, and for hardware interrupts the longest "
+          "instruction that can be running when they arrive");
+
+namespace {
+
+// Names addresses after the closest label at or before them.
+class Namer {
+ public:
+  static constexpr int kMaxLabelDistance = 0x100;
+
+  explicit Namer(const std::map<std::string, uint16_t>& labels) {
+    for (const auto& [label, address] : labels) {
+      names_[address] = label;
+    }
+  }
+
+  std::string name(uint16_t address) const {
+    std::string hex = absl::StrFormat("$%04x", address);
+    auto it = names_.upper_bound(address);
+    if (it == names_.begin()) {
+      return hex;
+    }
+    --it;
+    if (it->first == address) {
+      return absl::StrCat(hex, " (", it->second, ")");
+    }
+    // Far away labels are more likely to be for unrelated data than for the
+    // routine the address is in.
+    if (address - it->first >= kMaxLabelDistance) {
+      return hex;
+    }
+    return absl::StrFormat("%s (%s+%d)", hex, it->second,
+                           address - it->first);
+  }
+
+ private:
+  std::map<uint16_t, std::string> names_;
+};
+
+std::optional<uint16_t> parse_routine(
+    const std::string& routine,
+    const std::map<std::string, uint16_t>& labels) {
+  if (!routine.empty() && routine[0] == '$') {
+    uint16_t address = 0;
+    const char* end = routine.data() + routine.size();
+    auto result = std::from_chars(routine.data() + 1, end, address, 16);
+    if (result.ec != std::errc() || result.ptr != end) {
+      return std::nullopt;
+    }
+    return address;
+  }
+  auto it = labels.find(routine);
+  if (it == labels.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
+// Cycles from the interrupt request to the first instruction of the handler
+// behind 'vector'. SWI and TRAP are taken in place of an instruction, the
+// hardware interrupts wait for the current one to finish first.
+int handler_latency(uint16_t vector) {
+  if (vector == 0xfffa || vector == 0xffee) {
+    return eight_bit::kInterruptEntryCycles6301;
+  }
+  return eight_bit::kLongestInstructionCycles6301 +
+         eight_bit::kInterruptEntryCycles6301;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+
+  QCHECK(!absl::GetFlag(FLAGS_rom_file).empty()) << "No ROM file specified.";
+  const std::string rom_file_name = absl::GetFlag(FLAGS_rom_file);
+  std::ifstream rom_file(rom_file_name, std::ios::binary);
+  QCHECK(rom_file.is_open()) << "Failed to open file: " << rom_file_name;
+  std::vector<uint8_t> rom_data(std::istreambuf_iterator<char>(rom_file), {});
+  QCHECK(!rom_data.empty() && rom_data.size() <= 0x10000)
+      << "Invalid ROM size: " << rom_data.size();
+
+  std::map<std::string, uint16_t> labels;
+  for (const std::string& listing : absl::GetFlag(FLAGS_listings)) {
+    auto listing_labels = eight_bit::read_asl_listing_labels(listing);
+    QCHECK_OK(listing_labels);
+    labels.merge(*listing_labels);
+  }
+  const Namer namer(labels);
+
+  eight_bit::CycleAnalysis analysis;
+  QCHECK_OK(analysis.set_data(0x10000 - rom_data.size(), rom_data));
+
+  // What to analyze: the interrupt handlers first, then the routines asked
+  // for. Handlers that just point at the reset code, or are erased, aren't in
+  // use.
+  struct Routine {
+    std::string vector;
+    uint16_t address;
+    int latency = 0;
+  };
+  std::vector<Routine> routines;
+  const std::optional<uint16_t> reset = analysis.vector_target(0xfffe);
+  for (const auto& [name, vector] : eight_bit::kVectors6301) {
+    auto handler = analysis.vector_target(vector);
+    if (vector == 0xfffe || !handler || handler == reset ||
+        handler == 0xffff) {
+      continue;
+    }
+    routines.push_back({.vector = name,
+                        .address = *handler,
+                        .latency = handler_latency(vector)});
+  }
+  for (const std::string& routine : absl::GetFlag(FLAGS_routines)) {
+    auto address = parse_routine(routine, labels);
+    QCHECK(address.has_value()) << "Unknown routine: " << routine;
+    routines.push_back({.vector = "", .address = *address});
+  }
+
+  const int max_cycles = absl::GetFlag(FLAGS_max_cycles);
+  bool ok = true;
+  for (const Routine& routine : routines) {
+    const auto& result = analysis.analyze(routine.address);
+    // Handlers are reported with the cost of getting into them.
+    const int cycles = result.cycles + routine.latency;
+    std::cout << absl::StrFormat("%-21s %s\n", routine.vector,
+                                 namer.name(routine.address));
+    if (result.bounded()) {
+      std::cout << absl::StrFormat("    worst case: %d cycles\n", cycles);
+      if (routine.latency > 0) {
+        std::cout << absl::StrFormat(
+            "    including %d cycles before the handler starts\n",
+            routine.latency);
+      }
+    } else {
+      std::cout << absl::StrFormat(
+          "    unbounded, at least %d cycles with every loop taken once\n",
+          cycles);
+      for (const auto& finding : result.findings) {
+        std::cout << absl::StrFormat(
+            "    %s at %s\n",
+            eight_bit::finding_kind_name(finding.kind),
+            namer.name(finding.address));
+      }
+      ok = false;
+    }
+    if (max_cycles > 0 && cycles > max_cycles) {
+      std::cout << absl::StrFormat("    over the limit of %d cycles\n",
+                                   max_cycles);
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
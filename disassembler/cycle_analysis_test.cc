@@ -0,0 +1,97 @@
+#include "cycle_analysis.h"
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace eight_bit {
+namespace {
+
+using Finding = CycleAnalysis::Finding;
+
+constexpr uint16_t kStart = 0x8000;
+
+class CycleAnalysisTest : public ::testing::Test {
+ protected:
+  void set_code(const std::vector<uint8_t>& code) {
+    ASSERT_TRUE(analysis_.set_data(kStart, code).ok());
+  }
+
+  CycleAnalysis analysis_;
+};
+
+TEST_F(CycleAnalysisTest, TakesTheLongerSideOfABranch) {
+  set_code({
+      0x27, 0x02,  // beq +2, 3 cycles
+      0x01, 0x01,  // nop, nop, 1 cycle each
+      0x3b,        // rti, 10 cycles
+  });
+  const auto& result = analysis_.analyze(kStart);
+  EXPECT_TRUE(result.bounded());
+  EXPECT_EQ(result.cycles, 15);
+}
+
+TEST_F(CycleAnalysisTest, CountsCalledRoutines) {
+  set_code({
+      0xbd, 0x80, 0x08,  // jsr $8008, 6 cycles
+      0x8d, 0x03,        // bsr $8008, 5 cycles
+      0x3b,              // rti, 10 cycles
+      0x00, 0x00,        // Not code
+      0x01,              // $8008: nop, 1 cycle
+      0x39,              // rts, 5 cycles
+  });
+  const auto& result = analysis_.analyze(kStart);
+  EXPECT_TRUE(result.bounded());
+  EXPECT_EQ(result.cycles, 6 + 6 + 5 + 6 + 10);
+  EXPECT_EQ(analysis_.analyze(0x8008).cycles, 6);
+}
+
+TEST_F(CycleAnalysisTest, ReportsLoops) {
+  set_code({
+      0x5a,        // decb, 1 cycle
+      0x26, 0xfd,  // bne $8000, 3 cycles
+      0x39,        // rts, 5 cycles
+  });
+  const auto& result = analysis_.analyze(kStart);
+  EXPECT_FALSE(result.bounded());
+  EXPECT_EQ(result.findings,
+            (std::set<Finding>{{Finding::Kind::kLoop, kStart}}));
+  // One pass through the loop.
+  EXPECT_EQ(result.cycles, 9);
+}
+
+TEST_F(CycleAnalysisTest, ReportsWhatCantBeBounded) {
+  set_code({
+      0x3e,              // wai
+      0xbd, 0x80, 0x07,  // jsr $8007
+      0x6e, 0x00,        // jmp 0,x
+      0x00,              // Not code
+      0x8d, 0xfe,        // $8007: bsr $8007
+      0x01,              // nop, and then past the end of the data
+  });
+  const auto& result = analysis_.analyze(kStart);
+  EXPECT_EQ(result.findings, (std::set<Finding>{
+                                 {Finding::Kind::kWait, 0x8000},
+                                 {Finding::Kind::kIndirectJump, 0x8004},
+                                 {Finding::Kind::kRecursion, 0x8007},
+                                 {Finding::Kind::kInvalidCode, 0x800a},
+                             }));
+}
+
+TEST_F(CycleAnalysisTest, ReadsVectors) {
+  std::vector<uint8_t> vectors = {0xd0, 0x12, 0xd3};
+  ASSERT_TRUE(analysis_.set_data(0xfff8, vectors).ok());
+  EXPECT_EQ(analysis_.vector_target(0xfff8), 0xd012);
+  // Only one byte is set.
+  EXPECT_EQ(analysis_.vector_target(0xfffa), std::nullopt);
+  EXPECT_EQ(analysis_.vector_target(0xfffe), std::nullopt);
+}
+
+TEST(InstructionCyclesTest, LongestInstructionIsSwi) {
+  EXPECT_EQ(kLongestInstructionCycles6301, 12);
+}
+
+}  // namespace
+}  // namespace eight_bit
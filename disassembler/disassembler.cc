@@ -1,8 +1,8 @@
 #include "disassembler.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <optional>
-#include <ranges>
 #include <set>
 #include <span>
 #include <stack>
@@ -17,30 +17,43 @@
 
 namespace eight_bit {
 
-Disassembler::Disassembler()
-    : memory_(0x10000, 0),
-      annotations_(0x10000, std::nullopt),
-      disassembly_(0x10000) {}
+Disassembler::Disassembler() : memory_(0x10000, 0), flags_(0x10000, 0) {}
 
 absl::Status Disassembler::set_data(uint16_t start_address,
-                                    std::span<uint8_t> data) {
-  if (start_address + data.size() - 1 > memory_.size()) {
+                                    std::span<const uint8_t> data) {
+  if (start_address + data.size() > memory_.size()) {
     return absl::InvalidArgumentError("Data does not fit in memory");
   }
-  for (size_t i = start_address; i < start_address + data.size(); ++i) {
-    memory_[i] = data[i - start_address];
-    annotations_[i] = Annotation{};
+  if (data.empty()) {
+    return absl::OkStatus();
   }
+  // An instruction that only partly overlaps the new data isn't valid
+  // anymore either, so all of it is thrown away.
+  size_t begin = start_address;
+  size_t end = start_address + data.size();
+  while (begin > 0 && has(begin, kSkip)) {
+    --begin;
+  }
+  while (end < memory_.size() && has(end, kSkip)) {
+    ++end;
+  }
+  std::copy(data.begin(), data.end(), memory_.begin() + start_address);
+  for (size_t i = begin; i < end; ++i) {
+    // Labels are about the address, not what's there. Code elsewhere may
+    // still refer to them.
+    flags_[i] = kSet | (flags_[i] & kLabel);
+  }
+  mark_changed(begin, end - begin);
   return absl::OkStatus();
 }
 
 void Disassembler::set_instruction_boundary_hint(uint16_t address) {
-  if (annotations_[address]->instruction.has_value()) {
+  if (!check(address) || has(address, kInstruction)) {
     return;
   }
-  annotations_[address]->instruction = {.instruction = Instruction{}};
+  set(address, kInstruction);
   decode_instruction(address);
-  disassembly_[address] = print_annotation(address);
+  mark_changed(address, 1);
 }
 
 absl::Status Disassembler::disassemble() {
@@ -51,47 +64,58 @@ absl::Status Disassembler::disassemble() {
   while (!worklist_.empty()) {
     uint16_t address = worklist_.top();
     worklist_.pop();
-    if (annotations_[address]->decoded) {
+    if (has(address, kDecoded)) {
       continue;
     }
-    if (annotations_[address]->instruction.has_value()) {
+    if (has(address, kInstruction)) {
       decode_instruction(address);
     }
-    annotations_[address]->decoded = true;
-    disassembly_[address] = print_annotation(address);
+    set(address, kDecoded);
   }
-  print_unannotated();
+  split_data_lines();
   return absl::OkStatus();
 }
 
-std::string Disassembler::print_line(uint16_t address) {
-  return disassembly_[address];
+std::string Disassembler::print_line(uint16_t address) const {
+  if (!check(address) || has(address, kSkip)) {
+    return "";
+  }
+  if (is_undecoded_data(address)) {
+    return has(address, kDataLine) ? print_data_line(address) : "";
+  }
+  std::string line;
+  if (has(address, kLabel)) {
+    absl::StrAppend(&line, label(address), ":\n");
+  }
+  // Code can run into a vector, which is still printed as one.
+  if (has(address, kCodeAddress)) {
+    absl::StrAppend(&line, print_code_address(address));
+  } else if (has(address, kInstruction)) {
+    absl::StrAppend(&line, print_instruction(address));
+  }
+  return line;
 }
 
-std::string Disassembler::print() {
+std::string Disassembler::print() const {
   std::string disassembly;
   bool previous_has_value = false;
   for (size_t i = 0; i < memory_.size(); ++i) {
-    if (annotations_[i].has_value()) {
+    if (check(i)) {
       if (!previous_has_value) {
         // This is an org boundary.
         absl::StrAppend(&disassembly, "        org  $",
                         absl::Hex(i, absl::kZeroPad4), "\n");
         previous_has_value = true;
       }
-      absl::StrAppend(&disassembly, disassembly_[i]);
+      absl::StrAppend(&disassembly, print_line(i));
     }
   }
   return disassembly;
 }
 
-const std::vector<std::string>& Disassembler::disassembly() const {
-  return disassembly_;
-}
-
 uint8_t Disassembler::get(uint16_t address) const { return memory_[address]; }
 
-uint16_t Disassembler::get16(uint16_t address) {
+uint16_t Disassembler::get16(uint16_t address) const {
   if (address > 0xfffe) {
     LOG(ERROR) << absl::StreamFormat("Invalid 16-bit read from address %04x",
                                      address);
@@ -101,62 +125,76 @@ uint16_t Disassembler::get16(uint16_t address) {
 }
 
 bool Disassembler::check(uint16_t address) const {
-  return annotations_[address].has_value();
+  return has(address, kSet);
 }
 
 bool Disassembler::check16(uint16_t address) const {
   if (address + 1u >= memory_.size()) {
     return false;
   }
-  return annotations_[address].has_value() &&
-         annotations_[address + 1].has_value();
+  return check(address) && check(address + 1);
+}
+
+bool Disassembler::is_undecoded_data(size_t address) const {
+  return (flags_[address] & (kSet | kSkip | kDecoded)) == kSet;
+}
+
+void Disassembler::mark_changed(size_t address, size_t size) {
+  if (changed_begin_ >= changed_end_) {
+    changed_begin_ = address;
+    changed_end_ = address + size;
+    return;
+  }
+  changed_begin_ = std::min(changed_begin_, address);
+  changed_end_ = std::max(changed_end_, address + size);
 }
 
-void Disassembler::update_label(uint16_t address, std::string_view label) {
+void Disassembler::set_label(uint16_t address, std::string label) {
+  named_labels_[address] = std::move(label);
+  set(address, kLabel);
+}
+
+void Disassembler::add_generated_label(uint16_t address) {
   // We shouldn't update labels for addresses that have them already until we
   // implement a way to go fix the references.
-  if (!annotations_[address]->label.has_value()) {
-    annotations_[address]->label = std::string(label);
-    disassembly_[address] = print_annotation(address);
+  set(address, kLabel);
+}
+
+void Disassembler::queue_instruction(uint16_t address) {
+  // Decoded addresses keep what they were decoded as, so that kInstruction on
+  // them always means a valid instruction.
+  if (has(address, kInstruction) || has(address, kDecoded)) {
+    return;
   }
+  set(address, kInstruction);
+  worklist_.push(address);
 }
 
 absl::Status Disassembler::decode_vectors() {
-  const auto vectors = std::vector<std::pair<std::string, uint16_t>>{
-      {"start", 0xfffe},
-      {"nmi", 0xfffc},
-      {"swi", 0xfffa},
-      {"irq", 0xfff8},
-      {"timer_input_capture", 0xfff6},
-      {"timer_output_compare", 0xfff4},
-      {"timer_overflow", 0xfff2},
-      {"sci", 0xfff0},
-  };
-
-  for (const auto& [label, address] : vectors) {
+  for (const auto& [label, address] : kVectors6301) {
     if (!check16(address)) {
       continue;
     }
-    if (annotations_[address]->code_address.has_value()) {
+    if (has(address, kCodeAddress)) {
       // We already decoded at least one vector - likely this is a second
       // disassembly pass.
       continue;
     }
     uint16_t destination = get16(address);
-    if (!check(destination)) {
+    // An erased vector, like an unused trap vector, isn't in use.
+    if (!check(destination) || destination == 0xffff) {
       continue;
     }
-    annotations_[address]->code_address = {.address = destination};
+    set(address, kCodeAddress);
     if (address == 0xfff0) {
-      annotations_[address]->label = "startup_vectors";
+      set_label(address, "startup_vectors");
     }
-    annotations_[address]->decoded = true;
-    annotations_[address + 1]->skip = true;
-    disassembly_[address] = print_annotation(address);
+    set(address, kDecoded);
+    set(address + 1, kSkip);
+    mark_changed(address, 2);
 
-    annotations_[destination]->instruction = {.instruction = Instruction{}};
-    annotations_[destination]->label = absl::StrCat("vec_", label);
-    worklist_.push(destination);
+    queue_instruction(destination);
+    set_label(destination, absl::StrCat("vec_", label));
   }
   return absl::OkStatus();
 }
@@ -167,66 +205,38 @@ void Disassembler::decode_instruction(uint16_t address) {
   if (instruction.mode == kILL) {
     LOG(ERROR) << absl::StreamFormat("Illegal instruction %02x at address %04x",
                                      opcode, address);
-    annotations_[address]->instruction.reset();
+    clear(address, kInstruction);
     return;
   }
   if (address + instruction.bytes - 1u >= memory_.size()) {
     LOG(ERROR) << absl::StreamFormat(
         "Instruction %s at address %04x is too long", instruction.name,
         address);
-    annotations_[address]->instruction.reset();
+    clear(address, kInstruction);
     return;
   }
-  annotations_[address]->instruction = {.instruction = instruction};
   uint8_t length = instruction.bytes;
   for (uint8_t i = 1; i < length; ++i) {
     if (!check(address + i)) {
       LOG(ERROR) << absl::StreamFormat("Missing byte at %04x", address + i);
+      clear(address, kInstruction);
       return;
     }
   }
-  std::vector<uint8_t> data(memory_.begin() + address,
-                            memory_.begin() + address + length);
-  annotations_[address]->data = data;
-  annotations_[address]->decoded = true;
+  set(address, kInstruction);
+  set(address, kDecoded);
   for (uint8_t i = 1; i < length; ++i) {
-    annotations_[address + i] = {.decoded = true, .skip = true};
+    // Labels inside an instruction can't be printed, so they're dropped.
+    flags_[address + i] = kSet | kDecoded | kSkip;
+    named_labels_.erase(address + i);
   }
+  mark_changed(address, length);
 
-  // Handle instructions whose operands move the program counter - except
-  // indexed as we can't compute the value of X.
-  const std::set<std::string> dest_is_code = {"jmp", "jsr"};
-  if (instruction.mode != AddressingMode::kIDX &&
-      (instruction.mode == AddressingMode::kREL ||
-       dest_is_code.contains(instruction.name))) {
-    bool have_destination = true;
-    uint16_t destination = 0;
-    switch (instruction.mode) {
-      case kREL:
-        destination = address + 2 + (int8_t)data[1];
-        break;
-      case kDIR:
-        destination = data[1];
-        break;
-      case kEXT:
-        destination = (uint16_t)data[1] << 8 | data[2];
-        break;
-      default:
-        have_destination = false;
-        break;
-    }
-    if (have_destination && check(destination)) {
-      if (!annotations_[destination]->instruction.has_value()) {
-        annotations_[destination]->instruction = {.instruction = Instruction{}};
-        worklist_.push(destination);
-      }
-      if (!annotations_[destination]->label.has_value()) {
-        update_label(
-            destination,
-            absl::StrCat("loc_", absl::Hex(destination, absl::kZeroPad4)));
-      }
-      annotations_[address]->instruction->destination_address = destination;
-    }
+  std::optional<uint16_t> destination = this->destination(address);
+  if (destination.has_value() && check(*destination)) {
+    queue_instruction(*destination);
+    add_generated_label(*destination);
+    set(address, kDestination);
   }
 
   // The next bytes are also an instruction, except for always-taken branches,
@@ -235,55 +245,46 @@ void Disassembler::decode_instruction(uint16_t address) {
                                                          "rti"};
   uint16_t next = address + length;
   if (!next_is_not_always_code.contains(instruction.name) && check(next)) {
-    if (!annotations_[next]->instruction.has_value()) {
-      annotations_[next]->instruction = {.instruction = Instruction{}};
-      worklist_.push(next);
-    }
+    queue_instruction(next);
   }
 }
 
-std::string Disassembler::print_annotation(uint16_t address) {
-  if (!check(address) || annotations_[address]->skip) {
-    return "";
-  }
-  std::string annotation;
-  if (annotations_[address]->label.has_value()) {
-    absl::StrAppend(
-        &annotation,
-        absl::StrFormat("%s:\n", annotations_[address]->label.value()));
-  }
-  if (annotations_[address]->instruction.has_value()) {
-    absl::StrAppend(&annotation, print_instruction(address));
-    return annotation;
-  }
-  if (annotations_[address]->code_address.has_value()) {
-    absl::StrAppend(&annotation, print_code_address(address));
-    return annotation;
+std::optional<uint16_t> Disassembler::destination(uint16_t address) const {
+  // Handle instructions whose operands move the program counter - except
+  // indexed as we can't compute the value of X.
+  const Instruction& instruction = kInstructions6301[get(address)];
+  if (instruction.mode != kREL && instruction.name != "jmp" &&
+      instruction.name != "jsr") {
+    return std::nullopt;
   }
-  if (annotations_[address]->data_address.has_value()) {
-    absl::StrAppend(&annotation, print_data_address(address));
-    return annotation;
+  switch (instruction.mode) {
+    case kREL:
+      return address + 2 + (int8_t)get(address + 1);
+    case kDIR:
+      return get(address + 1);
+    case kEXT:
+      return get16(address + 1);
+    default:
+      return std::nullopt;
   }
-  absl::StrAppend(&annotation, print_data(address));
-  return annotation;
 }
 
-std::string Disassembler::print_instruction(uint16_t address) {
-  if (!annotations_[address]->instruction.has_value()) {
-    LOG(ERROR) << absl::StreamFormat(
-        "Unexpected call to print_instruction at %04x", address);
-    return "";
+std::string Disassembler::label(uint16_t address) const {
+  auto it = named_labels_.find(address);
+  if (it != named_labels_.end()) {
+    return it->second;
   }
-  const auto& instruction =
-      annotations_[address]->instruction.value().instruction;
-  const auto& data = annotations_[address]->data;
-  const auto& destination =
-      annotations_[address]->instruction.value().destination_address;
+  return absl::StrCat("loc_", absl::Hex(address, absl::kZeroPad4));
+}
+
+std::string Disassembler::print_instruction(uint16_t address) const {
+  const Instruction& instruction = kInstructions6301[get(address)];
+  std::span<const uint8_t> data(memory_.data() + address, instruction.bytes);
   std::string destination_label;
-  if (destination.has_value()) {
-    uint16_t dest = destination.value();
-    if (annotations_[dest]->label.has_value()) {
-      destination_label = annotations_[dest]->label.value();
+  if (has(address, kDestination)) {
+    uint16_t destination = *this->destination(address);
+    if (has(destination, kLabel)) {
+      destination_label = label(destination);
     }
   }
   std::string byte_string =
@@ -356,72 +357,56 @@ std::string Disassembler::print_instruction(uint16_t address) {
   return disassembly;
 }
 
-std::string Disassembler::print_code_address(uint16_t address) {
-  if (!annotations_[address]->code_address.has_value()) {
-    LOG(ERROR) << absl::StreamFormat(
-        "Unexpected call to print_code_address at %04x", address);
-    return "";
-  }
-  uint16_t destination = annotations_[address]->code_address->address;
+std::string Disassembler::print_code_address(uint16_t address) const {
+  uint16_t destination = get16(address);
   return absl::StrFormat("        adr $%04x            ; %04x: %02x %02x\n",
                          destination, address, destination >> 8,
                          destination % 256);
 }
 
-std::string Disassembler::print_data_address(uint16_t address) {
-  if (!annotations_[address]->data_address.has_value()) {
-    LOG(ERROR) << absl::StreamFormat(
-        "Unexpected call to print_data_address at %04x", address);
-    return "";
+std::string Disassembler::print_data_line(uint16_t address) const {
+  constexpr size_t kMaxBytesPerLine = 8;
+  std::string data_string = "        byt  ";
+  for (size_t i = address; i < address + kMaxBytesPerLine &&
+                           i < memory_.size() && is_undecoded_data(i);
+       ++i) {
+    if (i != address && has(i, kDataLine)) {
+      break;
+    }
+    absl::StrAppendFormat(&data_string, "%s$%02x", i == address ? "" : ",",
+                          memory_[i]);
   }
-  uint16_t destination = annotations_[address]->data_address->address;
-  return absl::StrFormat("        adr $%04x            ; %04x: %02x %02x\n",
-                         destination, address, destination >> 8,
-                         destination % 256);
+  absl::StrAppendFormat(&data_string, " ; %04x\n", address);
+  return data_string;
 }
 
-std::string Disassembler::print_data(uint16_t address) {
-  const auto& data = annotations_[address]->data;
-  std::string data_string;
-  for (size_t i = 0; i < data.size(); i += 8) {
-    std::ranges::subrange range{
-        data.data() + i,
-        data.data() + i + std::min<size_t>(8, data.size() - i)};
-
-    absl::StrAppendFormat(
-        &data_string, "        byt  %-20s ; %04x\n",
-        absl::StrJoin(range, ",",
-                      [](std::string* out, uint8_t byte) {
-                        absl::StrAppend(out, absl::Hex(byte, absl::kZeroPad2));
-                      }),
-        address + i);
+// Go over bytes that are set but not decoded and split them into data lines.
+void Disassembler::split_data_lines() {
+  constexpr size_t kMaxBytesPerLine = 8;
+  if (changed_begin_ >= changed_end_) {
+    return;
   }
-  return data_string;
-}
+  // Data lines are split up starting from the beginning of each run of data
+  // bytes, so whole runs around the changes are split again.
+  size_t begin = changed_begin_;
+  while (begin > 0 && is_undecoded_data(begin - 1)) {
+    --begin;
+  }
+  size_t end = changed_end_;
+  while (end < memory_.size() && is_undecoded_data(end)) {
+    ++end;
+  }
+  changed_begin_ = changed_end_ = 0;
 
-// Go over bytes that are set but not annotated and print them as data.
-void Disassembler::print_unannotated() {
-  constexpr int kMaxBytesPerLine = 8;
-  for (size_t i = 0; i < memory_.size(); ++i) {
-    if (!annotations_[i].has_value() || annotations_[i]->skip ||
-        annotations_[i]->decoded) {
-      continue;
-    }
-    std::string data_string = "        byt  ";
-    // Look ahead up to kMaxBytesPerLine bytes to see if they can be merged into
-    // this line.
-    size_t j = i;
-    for (; j < i + kMaxBytesPerLine && j < memory_.size(); ++j) {
-      if (annotations_[j].has_value() &&
-          (annotations_[j]->skip || annotations_[j]->decoded)) {
-        break;
-      }
-      absl::StrAppendFormat(&data_string, "%s$%02x", j == i ? "" : ",",
-                            memory_[j]);
+  size_t line_end = begin;
+  for (size_t i = begin; i < end; ++i) {
+    clear(i, kDataLine);
+    if (!is_undecoded_data(i)) {
+      line_end = i + 1;
+    } else if (i >= line_end) {
+      set(i, kDataLine);
+      line_end = i + kMaxBytesPerLine;
     }
-    absl::StrAppendFormat(&data_string, " ; %04x\n", i);
-    disassembly_[i] = data_string;
-    i = j - 1;
   }
 }
 
@@ -2,6 +2,7 @@
 #define EIGHT_BIT_DISASSEMBLER_H
 
 #include <cstdint>
+#include <map>
 #include <optional>
 #include <span>
 #include <stack>
@@ -18,8 +19,11 @@ class Disassembler {
   Disassembler();
   ~Disassembler() = default;
 
-  // Add data to disassemble
-  absl::Status set_data(uint16_t start_address, std::span<uint8_t> data);
+  // Add data to disassemble. Data that was set before in the same range is
+  // replaced, and its disassembly is thrown away, including instructions that
+  // only partly overlap the range. Labels are kept. Disassembly outside the
+  // range is kept too, so a few changed bytes can be set on their own.
+  absl::Status set_data(uint16_t start_address, std::span<const uint8_t> data);
 
   // Tell the disassembler that 'address' is the start of an instruction.
   // Disassembles that instruction during the call, but if more needs to be
@@ -27,80 +31,97 @@ class Disassembler {
   void set_instruction_boundary_hint(uint16_t address);
 
   // Begin (or continue) disassembly after calls to set_data or
-  // set_instruction_boundary_hint. Returns an error if nothing could be
-  // disassembled.
+  // set_instruction_boundary_hint. Only the code that became reachable since
+  // the last call, and the data around it, is disassembled again. Returns an
+  // error if nothing could be disassembled.
   absl::Status disassemble();
 
-  // Print the disassembled data at 'address'.
-  std::string print_line(uint16_t address);
+  // Print the disassembled line starting at 'address'. Empty for addresses
+  // without data or which are part of an earlier line. Lines are formatted on
+  // each call and not kept around.
+  std::string print_line(uint16_t address) const;
 
   // Return the full disassembly as a string.
-  std::string print();
-
-  // Return the full disassembly as a vector of 64k strings, one per address.
-  // Addresses without data or which are part of the disassembly of an earlier
-  // line are empty.
-  const std::vector<std::string>& disassembly() const;
+  std::string print() const;
 
  private:
-  struct Annotation {
-    // Bytes representing an address, annotated on the first byte
-    struct CodeAddress {
-      uint16_t address;
-    };
-    struct DataAddress {
-      uint16_t address;
-    };
-    struct InstructionAnnotation {
-      Instruction instruction;
-      std::optional<uint16_t> destination_address = std::nullopt;
-    };
-
-    std::optional<CodeAddress> code_address = std::nullopt;
-    std::optional<DataAddress> data_address = std::nullopt;
-    std::optional<InstructionAnnotation> instruction = std::nullopt;
-    std::optional<std::string> label = std::nullopt;
-
-    // Whether the data at this address has been fully decoded
-    bool decoded = false;
-    // Whether this address should be skipped when printing
-    bool skip = false;
-    // The bytes this decoding is made of
-    std::vector<uint8_t> data = {};
+  // What's known about each address, one byte per address.
+  enum Flags : uint8_t {
+    // There's data at this address.
+    kSet = 1 << 0,
+    // Fully decoded. Addresses that are set but not decoded are printed as
+    // data.
+    kDecoded = 1 << 1,
+    // Part of the line of an earlier address.
+    kSkip = 1 << 2,
+    // The start of an instruction, whose opcode is the byte in memory_.
+    kInstruction = 1 << 3,
+    // A vector: this byte and the next hold a code address.
+    kCodeAddress = 1 << 4,
+    // The instruction here has a known code destination, printed by label.
+    kDestination = 1 << 5,
+    // Has a label, either in named_labels_ or generated from the address.
+    kLabel = 1 << 6,
+    // The first byte of a line of data.
+    kDataLine = 1 << 7,
   };
 
+  bool has(uint16_t address, Flags flag) const {
+    return (flags_[address] & flag) != 0;
+  }
+  void set(uint16_t address, Flags flag) { flags_[address] |= flag; }
+  void clear(uint16_t address, Flags flag) { flags_[address] &= ~flag; }
+
   uint8_t get(uint16_t address) const;
-  uint16_t get16(uint16_t address);
+  uint16_t get16(uint16_t address) const;
 
-  // Check if the address has valid data (i.e. an annotation is set)
+  // Check if the address has valid data
   bool check(uint16_t address) const;
   // Like check, but checks for two bytes
   bool check16(uint16_t address) const;
 
-  // Set the label for the address.
-  void update_label(uint16_t address, std::string_view label);
+  // Names the address, replacing any label it had.
+  void set_label(uint16_t address, std::string label);
+  // Gives the address a loc_<address> label, unless it has one already.
+  void add_generated_label(uint16_t address);
+
+  // Whether 'address' is set, but not (yet) part of any decoded instruction.
+  bool is_undecoded_data(size_t address) const;
+  // Marks 'size' bytes from 'address' as changed since the last disassemble().
+  void mark_changed(size_t address, size_t size);
 
   // Use known 6301 vectors to identify instruction boundaries. Returns an error
   // if the vectors are unset.
   absl::Status decode_vectors();
 
+  // Marks 'address' as the start of an instruction to decode, unless it's
+  // been decoded already.
+  void queue_instruction(uint16_t address);
   void decode_instruction(uint16_t address);
 
-  std::string print_annotation(uint16_t address);
-  std::string print_code_address(uint16_t address);
-  std::string print_data_address(uint16_t address);
-  std::string print_instruction(uint16_t address);
-  std::string print_data(uint16_t address);
-  void print_unannotated();
+  // The destination of the branch or jump at 'address', if it has one that
+  // can be known without running the code.
+  std::optional<uint16_t> destination(uint16_t address) const;
+  std::string label(uint16_t address) const;
+
+  std::string print_code_address(uint16_t address) const;
+  std::string print_instruction(uint16_t address) const;
+  std::string print_data_line(uint16_t address) const;
+  // Splits the bytes that are set but not decoded into data lines, around the
+  // addresses changed since the last call.
+  void split_data_lines();
 
   // Memory holds the data to disassemble
   std::vector<uint8_t> memory_;
-  // annotations_ holds the annotations for each byte in memory_. Unset bytes
-  // were not set in memory_.
-  std::vector<std::optional<Annotation>> annotations_;
-  std::vector<std::string> disassembly_;
+  std::vector<uint8_t> flags_;
+  // Labels that aren't generated from their address. Most labels are.
+  std::map<uint16_t, std::string> named_labels_;
 
   std::stack<uint16_t> worklist_;
+  // The range of addresses changed since the last disassemble(), end
+  // exclusive. Empty if begin >= end.
+  size_t changed_begin_ = 0;
+  size_t changed_end_ = 0;
 };
 
 }  // namespace eight_bit
@@ -4,6 +4,7 @@
 #include <filesystem>
 #include <fstream>
 #include <string>
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/status/status.h"
@@ -107,6 +108,76 @@ loop:
   EXPECT_THAT(disassembler.print_line(2), testing::HasSubstr("bra  loc_0000"));
 }
 
+TEST(DisassemblerIncrementalTest, MatchesDisassemblingEverythingAtOnce) {
+  std::vector<uint8_t> data = {
+      0x01,              // nop
+      0x39,              // rts
+      0x48, 0x65,        // Data
+      0x86, 0x41,        // ldaa #$41
+      0x39,              // rts
+      0x00, 0x00, 0x00,  // Data
+  };
+
+  Disassembler incremental;
+  ASSERT_TRUE(incremental.set_data(0, data).ok());
+  incremental.set_instruction_boundary_hint(0);
+  ASSERT_TRUE(incremental.disassemble().ok());
+  EXPECT_THAT(incremental.print_line(2), testing::HasSubstr("$48,$65,$86"));
+  incremental.set_instruction_boundary_hint(4);
+  ASSERT_TRUE(incremental.disassemble().ok());
+
+  Disassembler at_once;
+  ASSERT_TRUE(at_once.set_data(0, data).ok());
+  at_once.set_instruction_boundary_hint(0);
+  at_once.set_instruction_boundary_hint(4);
+  ASSERT_TRUE(at_once.disassemble().ok());
+
+  EXPECT_THAT(incremental.print_line(2), testing::HasSubstr("$48,$65 "));
+  EXPECT_THAT(incremental.print_line(4), testing::HasSubstr("ldaa #$41"));
+  EXPECT_EQ(incremental.print(), at_once.print());
+}
+
+TEST(DisassemblerIncrementalTest, SetDataReplacesEarlierCode) {
+  Disassembler disassembler;
+  std::vector<uint8_t> data = {0x39, 0x00};  // rts
+  ASSERT_TRUE(disassembler.set_data(0x1000, data).ok());
+  disassembler.set_instruction_boundary_hint(0x1000);
+  ASSERT_TRUE(disassembler.disassemble().ok());
+  EXPECT_THAT(disassembler.print_line(0x1000), testing::HasSubstr("rts"));
+
+  data = {0x01, 0x39};  // nop, rts
+  ASSERT_TRUE(disassembler.set_data(0x1000, data).ok());
+  disassembler.set_instruction_boundary_hint(0x1000);
+  ASSERT_TRUE(disassembler.disassemble().ok());
+  EXPECT_THAT(disassembler.print_line(0x1000), testing::HasSubstr("nop"));
+  EXPECT_THAT(disassembler.print_line(0x1001), testing::HasSubstr("rts"));
+}
+
+TEST(DisassemblerIncrementalTest, SetDataKeepsCodeOutsideTheRange) {
+  Disassembler disassembler;
+  std::vector<uint8_t> data = {
+      0x86, 0x41,  // ldaa #$41
+      0x01,        // nop
+      0x39,        // rts
+  };
+  ASSERT_TRUE(disassembler.set_data(0x1000, data).ok());
+  disassembler.set_instruction_boundary_hint(0x1000);
+  ASSERT_TRUE(disassembler.disassemble().ok());
+
+  // Only the operand of the ldaa changes. All of the ldaa goes, the rest stays.
+  data = {0x42};
+  ASSERT_TRUE(disassembler.set_data(0x1001, data).ok());
+  ASSERT_TRUE(disassembler.disassemble().ok());
+  EXPECT_THAT(disassembler.print_line(0x1000), testing::HasSubstr("$86,$42"));
+  EXPECT_EQ(disassembler.print_line(0x1001), "");
+  EXPECT_THAT(disassembler.print_line(0x1002), testing::HasSubstr("nop"));
+  EXPECT_THAT(disassembler.print_line(0x1003), testing::HasSubstr("rts"));
+
+  disassembler.set_instruction_boundary_hint(0x1000);
+  ASSERT_TRUE(disassembler.disassemble().ok());
+  EXPECT_THAT(disassembler.print_line(0x1000), testing::HasSubstr("ldaa #$42"));
+}
+
 class DisassemblerTest
     : public ::testing::TestWithParam<std::filesystem::path> {};
 
@@ -57,7 +57,7 @@ constexpr std::array<Instruction, 256> kInstructions6301 = {
     {"tba", 1, 1, kACB},
     {"xgdx", 1, 2, kIMP},
     {"", 0, 0, kILL},
-    {"", 0, 0, kILL},
+    {"slp", 1, 4, kIMP},
     {"aba", 1, 1, kACB},
     {"", 0, 0, kILL},
     {"", 0, 0, kILL},
@@ -93,8 +93,8 @@ constexpr std::array<Instruction, 256> kInstructions6301 = {
     {"rti", 1, 10, kIMP},
     {"pshx", 1, 5, kIMP},
     {"mul", 1, 7, kIMP},
-    {"", 0, 0, kILL},
-    {"", 0, 0, kILL},
+    {"wai", 1, 9, kIMP},
+    {"swi", 1, 12, kIMP},
     {"nega", 1, 1, kACA},
     {"", 0, 0, kILL},
     {"", 0, 0, kILL},
@@ -288,6 +288,42 @@ constexpr std::array<Instruction, 256> kInstructions6301 = {
     {"ldx", 3, 5, kEXT},
     {"stx", 3, 5, kEXT}};
 
+struct Vector6301 {
+  const char* name;
+  uint16_t address;
+};
+
+// The interrupt and reset vectors, by the address they're stored at.
+constexpr std::array<Vector6301, 9> kVectors6301 = {{
+    {"start", 0xfffe},
+    {"nmi", 0xfffc},
+    {"swi", 0xfffa},
+    {"irq", 0xfff8},
+    {"timer_input_capture", 0xfff6},
+    {"timer_output_compare", 0xfff4},
+    {"timer_overflow", 0xfff2},
+    {"sci", 0xfff0},
+    // Taken on an illegal opcode or address error.
+    {"trap", 0xffee},
+}};
+
+// Cycles taken to enter an interrupt handler. Taken to be the same as SWI,
+// which stacks the same registers and fetches a vector too.
+constexpr int kInterruptEntryCycles6301 = 12;
+
+// The most cycles any instruction takes. A hardware interrupt is only taken
+// once the instruction it arrives during has finished, so this adds to the
+// worst-case delay before its handler starts.
+constexpr int kLongestInstructionCycles6301 = [] {
+  int cycles = 0;
+  for (const Instruction& instruction : kInstructions6301) {
+    if (instruction.cycles > cycles) {
+      cycles = instruction.cycles;
+    }
+  }
+  return cycles;
+}();
+
 }  // namespace eight_bit
 
 #endif  // EIGHT_BITS_INSTRUCTIONS6301_H
\ No newline at end of file
@@ -13,8 +13,9 @@
 namespace eight_bit {
 
 absl::Status AddressSpace::register_read(uint16_t start, uint16_t end,
-                                         read_callback callback) {
-  ReadAddressRange range = {start, end, std::move(callback)};
+                                         read_callback callback,
+                                         read_callback peek) {
+  ReadAddressRange range = {start, end, std::move(callback), std::move(peek)};
   for (const auto& r : read_ranges_) {
     if (r.start <= range.end && r.end >= range.start) {
       return absl::InvalidArgumentError(absl::StrFormat(
@@ -38,6 +39,12 @@ absl::Status AddressSpace::register_write(uint16_t start, uint16_t end,
   return absl::OkStatus();
 }
 
+void AddressSpace::set_stable_reads(uint16_t start, uint16_t end) {
+  for (int address = start; address <= end; ++address) {
+    stable_reads_[address] = true;
+  }
+}
+
 uint8_t AddressSpace::get(uint16_t address) {
   VLOG(5) << absl::StreamFormat("Reading from address %04x", address);
   for (const auto& r : read_ranges_) {
@@ -50,6 +57,15 @@ uint8_t AddressSpace::get(uint16_t address) {
   return 0;
 }
 
+uint8_t AddressSpace::peek(uint16_t address) {
+  for (const auto& r : read_ranges_) {
+    if (r.start <= address && r.end >= address) {
+      return r.peek ? r.peek(address) : r.callback(address);
+    }
+  }
+  return 0;
+}
+
 uint16_t AddressSpace::get16(uint16_t address) {
   if (address > 0xfffe) {
     LOG(ERROR) << absl::StreamFormat("Invalid 16-bit read from address %04x",
@@ -1,6 +1,7 @@
 #ifndef EIGHT_BIT_ADDRESS_SPACE_H
 #define EIGHT_BIT_ADDRESS_SPACE_H
 
+#include <bitset>
 #include <cstdint>
 #include <functional>
 #include <span>
@@ -24,9 +25,12 @@ class AddressSpace {
 
   // Registers a read callback for a given address range. Returns an error if
   // any part of the range is already registered for reads. Start and end are
-  // inclusive.
+  // inclusive. If reads have side effects, like clearing interrupt flags,
+  // 'peek' returns the same values without them. Otherwise it can be left
+  // out.
   absl::Status register_read(uint16_t start, uint16_t end,
-                             read_callback callback);
+                             read_callback callback,
+                             read_callback peek = nullptr);
 
   // Registers a write callback for a given address range. Returns an error if
   // any part of the range is already registered for reads. Start and end are
@@ -34,9 +38,23 @@ class AddressSpace {
   absl::Status register_write(uint16_t start, uint16_t end,
                               write_callback callback);
 
+  // Marks reads from the range as stable: a read returns the same as peek(),
+  // reading again has no further side effects, and the value only changes
+  // through writes or events on the device, not on every tick like a
+  // free-running counter. The CPU fast-forwards loops that read nothing else.
+  // Start and end are inclusive.
+  void set_stable_reads(uint16_t start, uint16_t end);
+  bool has_stable_reads(uint16_t address) const {
+    return stable_reads_[address];
+  }
+
   // Returns the byte at address `address`.
   uint8_t get(uint16_t address);
 
+  // Returns the byte at address `address` without any side effects on the
+  // device there, for debuggers. Unmapped addresses read as 0.
+  uint8_t peek(uint16_t address);
+
   // Returns the two bytes at address `address`, MSB first.
   uint16_t get16(uint16_t address);
 
@@ -51,6 +69,7 @@ class AddressSpace {
     uint16_t start;
     uint16_t end;
     read_callback callback;
+    read_callback peek;
   };
   struct WriteAddressRange {
     uint16_t start;
@@ -60,6 +79,7 @@ class AddressSpace {
 
   std::vector<ReadAddressRange> read_ranges_;
   std::vector<WriteAddressRange> write_ranges_;
+  std::bitset<0x10000> stable_reads_;
 };
 
 }  // namespace eight_bit
@@ -0,0 +1,172 @@
+#include "background_disassembler.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+
+namespace eight_bit {
+
+BackgroundDisassembler::~BackgroundDisassembler() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stopping_ = true;
+  }
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+absl::StatusOr<std::unique_ptr<BackgroundDisassembler>>
+BackgroundDisassembler::create(uint16_t rom_start, std::span<const uint8_t> rom,
+                               uint16_t ram_start,
+                               std::function<std::vector<uint8_t>()> read_ram,
+                               int pre_context, int post_context) {
+  std::unique_ptr<BackgroundDisassembler> disassembler(
+      new BackgroundDisassembler(ram_start, std::move(read_ram), pre_context,
+                                 post_context));
+  auto status = disassembler->disassembler_.set_data(rom_start, rom);
+  if (!status.ok()) {
+    return status;
+  }
+  disassembler->thread_ = std::thread(&BackgroundDisassembler::run,
+                                      disassembler.get());
+  return disassembler;
+}
+
+void BackgroundDisassembler::request(uint16_t pc) {
+  absl::MutexLock lock(&mutex_);
+  requested_pc_ = pc;
+}
+
+std::shared_ptr<const BackgroundDisassembler::Snapshot>
+BackgroundDisassembler::snapshot() const {
+  absl::MutexLock lock(&mutex_);
+  return snapshot_;
+}
+
+BackgroundDisassembler::BackgroundDisassembler(
+    uint16_t ram_start, std::function<std::vector<uint8_t>()> read_ram,
+    int pre_context, int post_context)
+    : ram_start_(ram_start),
+      read_ram_(std::move(read_ram)),
+      pre_context_(pre_context),
+      post_context_(post_context) {}
+
+void BackgroundDisassembler::run() {
+  // The bulk of the ROM is reachable from its vectors. Disassembling it here
+  // keeps it off the UI thread.
+  auto status = disassembler_.disassemble();
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to disassemble the ROM: " << status;
+  }
+
+  while (true) {
+    uint16_t pc;
+    {
+      absl::MutexLock lock(&mutex_);
+      mutex_.Await(absl::Condition(this, &BackgroundDisassembler::has_work));
+      if (stopping_) {
+        return;
+      }
+      pc = *requested_pc_;
+      requested_pc_.reset();
+    }
+
+    // Code loaded into RAM may have changed since the last request. Copying
+    // and comparing all of RAM is cheap next to disassembling it again.
+    update_ram();
+    disassembler_.set_instruction_boundary_hint(pc);
+    status = disassembler_.disassemble();
+    if (!status.ok()) {
+      VLOG(1) << "Failed to disassemble at " << pc << ": " << status;
+    }
+
+    auto snapshot = std::make_shared<const Snapshot>(make_snapshot(pc));
+    absl::MutexLock lock(&mutex_);
+    snapshot_ = std::move(snapshot);
+  }
+}
+
+bool BackgroundDisassembler::has_work() const {
+  return stopping_ || requested_pc_.has_value();
+}
+
+void BackgroundDisassembler::update_ram() {
+  std::vector<uint8_t> ram = read_ram_();
+  if (ram.size() != ram_.size()) {
+    set_ram(0, ram);
+    ram_ = std::move(ram);
+    return;
+  }
+  // Most steps only change a few bytes, like the stack. Only those are set
+  // again, so that code found in the rest of RAM stays disassembled.
+  size_t i = 0;
+  while (i < ram.size()) {
+    if (ram[i] == ram_[i]) {
+      ++i;
+      continue;
+    }
+    size_t end = i + 1;
+    while (end < ram.size() && ram[end] != ram_[end]) {
+      ++end;
+    }
+    set_ram(i, std::span<const uint8_t>(ram).subspan(i, end - i));
+    i = end;
+  }
+  ram_ = std::move(ram);
+}
+
+void BackgroundDisassembler::set_ram(size_t offset,
+                                     std::span<const uint8_t> data) {
+  // Throws away what was disassembled from the old contents, but keeps the
+  // labels.
+  auto status = disassembler_.set_data(ram_start_ + offset, data);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to set RAM contents: " << status;
+  }
+}
+
+BackgroundDisassembler::Snapshot BackgroundDisassembler::make_snapshot(
+    uint16_t pc) {
+  Snapshot snapshot = {.pc = pc,
+                       .pre_context = "",
+                       .line = disassembler_.print_line(pc),
+                       .post_context = ""};
+  // Find pre_context_ many non-empty lines before the PC. Lines are only
+  // formatted for the addresses looked at here.
+  std::vector<std::string> pre_lines;
+  for (int address = pc - 1;
+       address >= 0 && pre_lines.size() < size_t(pre_context_); --address) {
+    std::string line = disassembler_.print_line(address);
+    if (!line.empty()) {
+      pre_lines.push_back(std::move(line));
+    }
+  }
+  for (auto it = pre_lines.rbegin(); it != pre_lines.rend(); ++it) {
+    absl::StrAppend(&snapshot.pre_context, *it);
+  }
+  // And post_context_ many after it.
+  for (int address = pc + 1, found = 0;
+       address <= 0xffff && found < post_context_; ++address) {
+    std::string line = disassembler_.print_line(address);
+    if (!line.empty()) {
+      absl::StrAppend(&snapshot.post_context, line);
+      ++found;
+    }
+  }
+  return snapshot;
+}
+
+}  // namespace eight_bit
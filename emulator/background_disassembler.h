@@ -0,0 +1,89 @@
+#ifndef EIGHT_BIT_BACKGROUND_DISASSEMBLER_H
+#define EIGHT_BIT_BACKGROUND_DISASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../disassembler/disassembler.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+
+namespace eight_bit {
+
+// Keeps a disassembly of the ROM and of code running from RAM up to date on its
+// own thread, so that the UI never waits for it. The UI asks for the code
+// around a PC with request(), and picks up the result with snapshot() on a
+// later frame. Each request only disassembles what became reachable from the
+// new PC. RAM is read fresh for every request, and only the bytes that changed
+// since the last one are disassembled again.
+class BackgroundDisassembler {
+ public:
+  // An immutable view of the disassembly around 'pc'.
+  struct Snapshot {
+    uint16_t pc;
+    std::string pre_context;
+    std::string line;
+    std::string post_context;
+  };
+
+  BackgroundDisassembler(const BackgroundDisassembler&) = delete;
+  BackgroundDisassembler& operator=(const BackgroundDisassembler&) = delete;
+  ~BackgroundDisassembler();
+
+  // 'read_ram' returns a copy of the RAM at 'ram_start'. It's called on the
+  // disassembler thread. Snapshots have up to 'pre_context' lines before the
+  // PC and 'post_context' lines after it.
+  static absl::StatusOr<std::unique_ptr<BackgroundDisassembler>> create(
+      uint16_t rom_start, std::span<const uint8_t> rom, uint16_t ram_start,
+      std::function<std::vector<uint8_t>()> read_ram, int pre_context = 4,
+      int post_context = 7);
+
+  // Asks for a snapshot around 'pc'. Doesn't block. Requests that haven't
+  // been picked up yet are replaced by newer ones.
+  void request(uint16_t pc);
+
+  // The most recently published snapshot, or nullptr before the first one.
+  std::shared_ptr<const Snapshot> snapshot() const;
+
+ private:
+  BackgroundDisassembler(uint16_t ram_start,
+                         std::function<std::vector<uint8_t>()> read_ram,
+                         int pre_context, int post_context);
+
+  void run();
+  bool has_work() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Only called on the disassembler thread.
+  void update_ram();
+  // Sets 'data' at 'offset' bytes into RAM.
+  void set_ram(size_t offset, std::span<const uint8_t> data);
+  Snapshot make_snapshot(uint16_t pc);
+
+  const uint16_t ram_start_;
+  const std::function<std::vector<uint8_t>()> read_ram_;
+  const int pre_context_;
+  const int post_context_;
+
+  // Only touched by the disassembler thread once it runs.
+  Disassembler disassembler_;
+  // RAM as of the last time it was disassembled.
+  std::vector<uint8_t> ram_;
+
+  mutable absl::Mutex mutex_;
+  std::optional<uint16_t> requested_pc_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+  std::shared_ptr<const Snapshot> snapshot_ ABSL_GUARDED_BY(mutex_);
+
+  std::thread thread_;
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_BACKGROUND_DISASSEMBLER_H
@@ -0,0 +1,108 @@
+#include "background_disassembler.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace eight_bit {
+namespace {
+
+using ::testing::HasSubstr;
+
+class BackgroundDisassemblerTest : public ::testing::Test {
+ protected:
+  static constexpr uint16_t kRomStart = 0xff00;
+  static constexpr uint16_t kRamStart = 0x0020;
+
+  void SetUp() override {
+    std::vector<uint8_t> rom(0x100, 0x01);  // nop
+    rom[0x10] = 0x39;                        // rts
+    // Reset vector
+    rom[0xfe] = 0xff;
+    rom[0xff] = 0x00;
+    ram_.resize(0x100);
+    auto disassembler_or = BackgroundDisassembler::create(
+        kRomStart, rom, kRamStart, [this]() {
+          absl::MutexLock lock(&ram_mutex_);
+          return ram_;
+        });
+    ASSERT_TRUE(disassembler_or.ok());
+    disassembler_ = std::move(disassembler_or.value());
+  }
+
+  void set_ram(uint16_t address, std::vector<uint8_t> data) {
+    absl::MutexLock lock(&ram_mutex_);
+    std::copy(data.begin(), data.end(), ram_.begin() + address - kRamStart);
+  }
+
+  // Requests 'pc' and waits for its snapshot.
+  std::shared_ptr<const BackgroundDisassembler::Snapshot> snapshot_at(
+      uint16_t pc) {
+    disassembler_->request(pc);
+    for (int i = 0; i < 5000; ++i) {
+      auto snapshot = disassembler_->snapshot();
+      if (snapshot != nullptr && snapshot->pc == pc) {
+        return snapshot;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return nullptr;
+  }
+
+  absl::Mutex ram_mutex_;
+  std::vector<uint8_t> ram_ ABSL_GUARDED_BY(ram_mutex_);
+  std::unique_ptr<BackgroundDisassembler> disassembler_;
+};
+
+TEST_F(BackgroundDisassemblerTest, DisassemblesRom) {
+  EXPECT_EQ(disassembler_->snapshot(), nullptr);
+
+  auto snapshot = snapshot_at(0xff10);
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_THAT(snapshot->line, HasSubstr("rts"));
+  EXPECT_THAT(snapshot->pre_context, HasSubstr("nop"));
+}
+
+TEST_F(BackgroundDisassemblerTest, DisassemblesCodeLoadedIntoRam) {
+  set_ram(0x0100, {0x86, 0x12, 0x39});  // ldaa #$12, rts
+  auto snapshot = snapshot_at(0x0100);
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_THAT(snapshot->line, HasSubstr("ldaa #$12"));
+  EXPECT_THAT(snapshot->post_context, HasSubstr("rts"));
+
+  // Load different code at the same address.
+  set_ram(0x0100, {0xc6, 0x34, 0x39});  // ldab #$34, rts
+  ASSERT_NE(snapshot_at(0xff00), nullptr);
+  snapshot = snapshot_at(0x0100);
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_THAT(snapshot->line, HasSubstr("ldab #$34"));
+}
+
+TEST_F(BackgroundDisassemblerTest, KeepsRamCodeWhileTheStackChanges) {
+  // ldaa #$12, ldab #$34, rts
+  set_ram(0x0100, {0x86, 0x12, 0xc6, 0x34, 0x39});
+  set_ram(0x011e, {0xff, 0x05});  // Return address
+  ASSERT_NE(snapshot_at(0x0100), nullptr);
+
+  // Step out of the routine back into ROM, which pops the return address.
+  set_ram(0x011e, {0x00, 0x00});
+  ASSERT_NE(snapshot_at(0xff05), nullptr);
+
+  // Coming back to the end of the routine, the code before it is still known.
+  set_ram(0x011e, {0xff, 0x06});
+  auto snapshot = snapshot_at(0x0104);
+  ASSERT_NE(snapshot, nullptr);
+  EXPECT_THAT(snapshot->line, HasSubstr("rts"));
+  EXPECT_THAT(snapshot->pre_context, HasSubstr("ldaa #$12"));
+  EXPECT_THAT(snapshot->pre_context, HasSubstr("ldab #$34"));
+}
+
+}  // namespace
+}  // namespace eight_bit
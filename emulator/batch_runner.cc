@@ -0,0 +1,77 @@
+#include "batch_runner.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace eight_bit {
+
+BatchRunner::BatchRunner(int threads)
+    : thread_count_(threads > 0
+                        ? threads
+                        : std::max(1U, std::thread::hardware_concurrency())) {}
+
+void BatchRunner::run(std::vector<std::function<void()>> jobs) {
+  if (jobs.empty()) {
+    return;
+  }
+  const int threads =
+      std::min(thread_count_, static_cast<int>(jobs.size()));
+  queues_.clear();
+  for (int i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<WorkQueue>());
+  }
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    WorkQueue& queue = *queues_[i % threads];
+    absl::MutexLock lock(&queue.mutex);
+    queue.jobs.push_back(std::move(jobs[i]));
+  }
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back(&BatchRunner::worker, this, i);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  queues_.clear();
+}
+
+void BatchRunner::worker(int index) {
+  while (auto job = next_job(index)) {
+    job();
+  }
+}
+
+std::function<void()> BatchRunner::next_job(int index) {
+  {
+    WorkQueue& own = *queues_[index];
+    absl::MutexLock lock(&own.mutex);
+    if (!own.jobs.empty()) {
+      auto job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      return job;
+    }
+  }
+  // No new jobs get queued during a run, so once every queue has been seen
+  // empty there's nothing left to do.
+  const int threads = static_cast<int>(queues_.size());
+  for (int i = 1; i < threads; ++i) {
+    WorkQueue& victim = *queues_[(index + i) % threads];
+    absl::MutexLock lock(&victim.mutex);
+    if (!victim.jobs.empty()) {
+      auto job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      return job;
+    }
+  }
+  return {};
+}
+
+}  // namespace eight_bit
@@ -0,0 +1,52 @@
+#ifndef EIGHT_BIT_BATCH_RUNNER_H
+#define EIGHT_BIT_BATCH_RUNNER_H
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace eight_bit {
+
+// Runs many independent jobs, e.g. one headless machine each, on a fixed set
+// of threads. Jobs are dealt out round-robin to per-thread queues up front. A
+// thread works through its own queue from the back, and once that's empty it
+// steals from the front of the others, so a few long jobs don't leave the rest
+// of the threads idle.
+//
+// Jobs are expected to be coarse (milliseconds or more), so each queue is
+// simply guarded by its own mutex.
+class BatchRunner {
+ public:
+  // 'threads' of 0 uses one thread per hardware thread.
+  explicit BatchRunner(int threads = 0);
+  BatchRunner(const BatchRunner&) = delete;
+  BatchRunner& operator=(const BatchRunner&) = delete;
+
+  // Runs all 'jobs' and returns once they're all done. Jobs run concurrently
+  // with each other, so they must not share any unsynchronized state.
+  void run(std::vector<std::function<void()>> jobs);
+
+  int thread_count() const { return thread_count_; }
+
+ private:
+  struct WorkQueue {
+    absl::Mutex mutex;
+    std::deque<std::function<void()>> jobs ABSL_GUARDED_BY(mutex);
+  };
+
+  void worker(int index);
+  // Takes the next job for worker 'index', stealing if its own queue is empty.
+  // Returns an empty function once there's no work left anywhere.
+  std::function<void()> next_job(int index);
+
+  const int thread_count_;
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_BATCH_RUNNER_H
@@ -0,0 +1,95 @@
+#include "batch_runner.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "address_space.h"
+#include "sound_opl3.h"
+
+namespace eight_bit {
+namespace {
+
+TEST(BatchRunnerTest, RunsEveryJobOnce) {
+  BatchRunner runner(4);
+  std::vector<std::atomic<int>> runs(100);
+  std::vector<std::function<void()>> jobs;
+  for (auto& run : runs) {
+    jobs.emplace_back([&run]() { ++run; });
+  }
+  runner.run(std::move(jobs));
+  for (const auto& run : runs) {
+    EXPECT_EQ(run, 1);
+  }
+  // An empty batch is fine too.
+  runner.run({});
+}
+
+TEST(BatchRunnerTest, IdleThreadsStealQueuedJobs) {
+  BatchRunner runner(2);
+  std::atomic<bool> long_job_done = false;
+  std::atomic<int> short_jobs_done_early = 0;
+  std::vector<std::function<void()>> jobs;
+  // The long job ends up at the back of the first thread's queue, so that
+  // thread runs it first. Without stealing, the short jobs queued in front of
+  // it would have to wait for it.
+  for (int i = 0; i < 10; ++i) {
+    jobs.emplace_back([&]() {
+      if (!long_job_done) {
+        ++short_jobs_done_early;
+      }
+    });
+  }
+  jobs.emplace_back([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    long_job_done = true;
+  });
+  runner.run(std::move(jobs));
+  EXPECT_TRUE(long_job_done);
+  EXPECT_EQ(short_jobs_done_early, 10);
+}
+
+TEST(BatchRunnerTest, IndependentSoundChipsRenderIdentically) {
+  constexpr int kMachines = 8;
+  constexpr int kTicksPerSecond = 1000000;
+  std::vector<std::vector<int16_t>> samples(kMachines);
+  std::vector<std::function<void()>> jobs;
+  for (auto& machine_samples : samples) {
+    jobs.emplace_back([&machine_samples]() {
+      AddressSpace address_space;
+      uint64_t cycle = 0;
+      auto sound = SoundOPL3::create(
+          &address_space, 0x7f80, kTicksPerSecond,
+          [&cycle]() { return cycle; }, SoundOPL3::Output::kOffline);
+      ASSERT_TRUE(sound.ok());
+      // A sine on channel 0, with each register write interleaved with the
+      // other machines' writes.
+      const uint8_t registers[][2] = {{0x23, 0x01}, {0x43, 0x00},
+                                      {0x63, 0xf0}, {0x83, 0x00},
+                                      {0xa0, 0x41}, {0xc0, 0x30},
+                                      {0xb0, 0x32}};
+      for (const auto& reg : registers) {
+        address_space.set(0x7f80, reg[0]);
+        std::this_thread::yield();
+        address_space.set(0x7f81, reg[1]);
+        cycle += 1000;
+      }
+      (*sound)->advance_to(kTicksPerSecond / 10);
+      machine_samples = (*sound)->take_samples();
+    });
+  }
+  BatchRunner(4).run(std::move(jobs));
+  ASSERT_FALSE(samples[0].empty());
+  for (const auto& machine_samples : samples) {
+    EXPECT_EQ(machine_samples, samples[0]);
+  }
+}
+
+}  // namespace
+}  // namespace eight_bit
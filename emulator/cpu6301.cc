@@ -1,8 +1,12 @@
 #include "cpu6301.h"
 
+#include <algorithm>
+#include <array>
 #include <cstdio>
 #include <functional>
 #include <string>
+#include <tuple>
+#include <utility>
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
@@ -14,6 +18,112 @@
 #include "ioport.h"
 
 namespace eight_bit {
+namespace {
+// Instructions that only work on registers and flags, or read memory. Loops
+// made of these can't have side effects beyond the cycles they take, as long as
+// what they read is stable (see AddressSpace::set_stable_reads). Anything
+// writing memory, using the stack pointer or the interrupt mask, or reading
+// through X is left out.
+constexpr uint8_t kIdleLoopOpcodes[] = {
+    // nop, lsrd, asld, tpa, inx, dex, clv, sev, clc, sec
+    0x01, 0x04, 0x05, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d,
+    // sba, cba, tab, tba, xgdx, aba
+    0x10, 0x11, 0x16, 0x17, 0x18, 0x1b,
+    // Relative branches, but not bsr
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b,
+    0x2c, 0x2d, 0x2e, 0x2f,
+    // abx, mul
+    0x3a, 0x3d,
+    // Accumulator A and B operations
+    0x40, 0x43, 0x44, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4c, 0x4d, 0x4f, 0x50,
+    0x53, 0x54, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x5c, 0x5d, 0x5f,
+    // Immediate operations
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x88, 0x89, 0x8a, 0x8b, 0x8c,
+    0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc8, 0xc9, 0xca, 0xcb, 0xcc,
+    0xce,
+    // Direct and extended reads, but not stores, jsr or lds
+    0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x98, 0x99, 0x9a, 0x9b, 0x9c,
+    0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb8, 0xb9, 0xba, 0xbb, 0xbc,
+    0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd8, 0xd9, 0xda, 0xdb, 0xdc,
+    0xde, 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf8, 0xf9, 0xfa, 0xfb,
+    0xfc, 0xfe,
+    // tst extended
+    0x7d,
+};
+
+// The registers an instruction in kIdleLoopOpcodes uses, besides the flags.
+constexpr uint8_t kRegisterA = 1 << 0;
+constexpr uint8_t kRegisterB = 1 << 1;
+constexpr uint8_t kRegisterX = 1 << 2;
+
+// Whether the instruction works on 16 bits: subd, addd, cpx, ldd and ldx.
+bool is_16_bit_operation(uint8_t opcode) {
+  const uint8_t low = opcode & 0x0f;
+  return opcode >= 0x80 && (low == 0x03 || low == 0x0c || low == 0x0e);
+}
+
+uint8_t idle_loop_registers(uint8_t opcode) {
+  switch (opcode) {
+    case 0x04:  // lsrd
+    case 0x05:  // asld
+    case 0x10:  // sba
+    case 0x11:  // cba
+    case 0x16:  // tab
+    case 0x17:  // tba
+    case 0x1b:  // aba
+    case 0x3d:  // mul
+      return kRegisterA | kRegisterB;
+    case 0x07:  // tpa
+      return kRegisterA;
+    case 0x08:  // inx
+    case 0x09:  // dex
+      return kRegisterX;
+    case 0x18:  // xgdx
+      return kRegisterA | kRegisterB | kRegisterX;
+    case 0x3a:  // abx
+      return kRegisterB | kRegisterX;
+    default:
+      break;
+  }
+  if (opcode < 0x40 || opcode == 0x7d) {
+    return 0;
+  }
+  if (opcode < 0x50) {
+    return kRegisterA;
+  }
+  if (opcode < 0x60) {
+    return kRegisterB;
+  }
+  const uint8_t low = opcode & 0x0f;
+  if (low == 0x0c && opcode < 0xc0) {
+    return kRegisterX;  // cpx
+  }
+  if (low == 0x0e) {
+    return kRegisterX;  // ldx
+  }
+  if (is_16_bit_operation(opcode)) {
+    return kRegisterA | kRegisterB;
+  }
+  return opcode < 0xc0 ? kRegisterA : kRegisterB;
+}
+
+// +1 or -1 for the increments and decrements of a single register, which are
+// inx, dex, inca, deca, incb and decb. 0 for anything else.
+int counter_step(uint8_t opcode) {
+  switch (opcode) {
+    case 0x08:
+    case 0x4c:
+    case 0x5c:
+      return 1;
+    case 0x09:
+    case 0x4a:
+    case 0x5a:
+      return -1;
+    default:
+      return 0;
+  }
+}
+}  // namespace
 
 absl::StatusOr<std::unique_ptr<Cpu6301>> Cpu6301::create(AddressSpace* memory) {
   std::unique_ptr<Cpu6301> cpu(new Cpu6301(memory));
@@ -26,27 +136,40 @@ absl::StatusOr<std::unique_ptr<Cpu6301>> Cpu6301::create(AddressSpace* memory) {
 
 void Cpu6301::reset() {
   pc = memory_->get16(0xfffe);
+  sleep_mode_ = SleepMode::kAwake;
   LOG(INFO) << "Reset to start at " << absl::Hex(pc, absl::kZeroPad4);
 }
 
 Cpu6301::TickResult Cpu6301::tick(int cycles_to_run, bool ignore_breakpoint) {
   int cycles_run = 0;
   while (cycles_run < cycles_to_run) {
+    // SLP ends on any interrupt request, even a masked one.
+    if (sleep_mode_ == SleepMode::kSleep && wakes_up()) {
+      sleep_mode_ = SleepMode::kAwake;
+    }
     // We are always at instruction boundaries here, so we can check for
     // interrupts.
+    int interrupt_cycles = 0;
     if (interrupt_.has_interrupt() & !sr.I) {
       // Moves the PC to the relevant interrupt routine and masks interrupts.
-      cycles_run += enter_interrupt(0xfff8);
+      interrupt_cycles += enter_interrupt(0xfff8);
     }
     if (timer_interrupt_.has_interrupt() & !sr.I) {
-      cycles_run += enter_interrupt(0xfff2);
+      interrupt_cycles += enter_interrupt(0xfff2);
     }
     if (serial_interrupt_.has_interrupt() & !sr.I) {
-      cycles_run += enter_interrupt(0xfff0);
+      interrupt_cycles += enter_interrupt(0xfff0);
+    }
+    cycles_run += interrupt_cycles;
+    cycle_count_ += interrupt_cycles;
+    if (sleep_mode_ != SleepMode::kAwake) {
+      cycles_run += sleep(cycles_to_run - cycles_run);
+      continue;
     }
     if (!ignore_breakpoint && breakpoint_ && pc == breakpoint_) {
       return {.cycles_run = cycles_run, .breakpoint_hit = true};
     }
+    const uint16_t instruction_address = pc;
     uint8_t opcode = fetch();
     const auto& instruction = instructions_[opcode];
     if (instruction.mode == kILL) {
@@ -54,23 +177,327 @@ Cpu6301::TickResult Cpu6301::tick(int cycles_to_run, bool ignore_breakpoint) {
                  << absl::Hex(pc, absl::kZeroPad4);
       reset();
       cycles_run += 1;
+      ++cycle_count_;
       continue;
     }
-    for (int i = 0; i < instruction.cycles; ++i) {
-      timer_.tick();
-      serial_->tick();
-      for (const auto& callback : tick_callbacks_) {
-        callback();
-      }
-      cycles_run += 1;
-    }
+    tick_devices(instruction.cycles);
+    cycles_run += instruction.cycles;
     execute(instruction);
+    // A taken backward branch closes a loop. If it's an idle loop, run it from
+    // the decoded copy.
+    if (instruction.mode == kREL && pc <= instruction_address &&
+        fast_forward_idle_loops_ && cycles_run < cycles_to_run &&
+        (ignore_breakpoint || !breakpoint_ || *breakpoint_ < pc ||
+         *breakpoint_ > instruction_address) &&
+        decode_idle_loop(pc, instruction_address)) {
+      cycles_run += run_idle_loop(cycles_to_run - cycles_run);
+    }
   }
   return {.cycles_run = cycles_run, .breakpoint_hit = false};
 }
 
+void Cpu6301::tick_devices(int cycles) {
+  for (int i = 0; i < cycles; ++i) {
+    ++cycle_count_;
+    timer_.tick();
+    serial_->tick();
+    for (const auto& callback : tick_callbacks_) {
+      callback();
+    }
+  }
+}
+
+int Cpu6301::idle_device_cycles(int max_cycles) {
+  if (!devices_can_skip_) {
+    return 0;
+  }
+  int cycles = std::min(max_cycles, timer_.idle_ticks());
+  cycles = std::min(cycles, serial_->idle_ticks());
+  for (const auto& callbacks : skip_callbacks_) {
+    cycles = std::min(cycles, callbacks.idle_ticks());
+  }
+  return cycles;
+}
+
+void Cpu6301::skip_devices(int cycles) {
+  if (cycles == 0) {
+    return;
+  }
+  timer_.skip(cycles);
+  serial_->skip(cycles);
+  for (const auto& callbacks : skip_callbacks_) {
+    callbacks.skip(cycles);
+  }
+  cycle_count_ += cycles;
+}
+
+int Cpu6301::sleep(int max_cycles) {
+  int cycles_run = 0;
+  while (cycles_run < max_cycles && !wakes_up()) {
+    int cycles = idle_device_cycles(max_cycles - cycles_run);
+    if (cycles > 0) {
+      skip_devices(cycles);
+    } else {
+      // Something happens on the next tick.
+      cycles = 1;
+      tick_devices(1);
+    }
+    cycles_run += cycles;
+  }
+  return cycles_run;
+}
+
+bool Cpu6301::wakes_up() {
+  if (sleep_mode_ == SleepMode::kWait) {
+    return has_unmasked_interrupt();
+  }
+  return interrupt_.has_interrupt() || timer_interrupt_.has_interrupt() ||
+         serial_interrupt_.has_interrupt();
+}
+
+void Cpu6301::wai() {
+  psh16(pc);
+  psh16(x);
+  psh8(a);
+  psh8(b);
+  psh8(sr.as_integer());
+  sleep_mode_ = SleepMode::kWait;
+}
+
+bool Cpu6301::has_unmasked_interrupt() {
+  return !sr.I && (interrupt_.has_interrupt() ||
+                   timer_interrupt_.has_interrupt() ||
+                   serial_interrupt_.has_interrupt());
+}
+
+bool Cpu6301::decode_idle_loop(uint16_t start, uint16_t branch_address) {
+  if (rejected_loop_ == std::make_pair(start, branch_address)) {
+    return false;
+  }
+  const int length = branch_address + 2 - start;
+  if (length > kMaxIdleLoopBytes) {
+    rejected_loop_ = {start, branch_address};
+    return false;
+  }
+  idle_loop_.clear();
+  idle_loop_index_.fill(-1);
+  idle_loop_counters_.fill({});
+  // How many instructions use A, B and X.
+  std::array<int, 3> register_users = {};
+  uint16_t address = start;
+  while (address <= branch_address) {
+    const uint8_t opcode = memory_->get(address);
+    if (!idle_loop_opcodes_[opcode]) {
+      rejected_loop_ = {start, branch_address};
+      return false;
+    }
+    const Instruction& instruction = instructions_[opcode];
+    uint16_t operand = 0;
+    if (instruction.bytes == 2) {
+      operand = memory_->get(address + 1);
+    } else if (instruction.bytes == 3) {
+      operand = memory_->get16(address + 1);
+    }
+    if ((instruction.mode == kDIR || instruction.mode == kEXT) &&
+        (!memory_->has_stable_reads(operand) ||
+         (is_16_bit_operation(opcode) &&
+          !memory_->has_stable_reads(operand + 1)))) {
+      rejected_loop_ = {start, branch_address};
+      return false;
+    }
+    const uint8_t registers = idle_loop_registers(opcode);
+    for (int i = 0; i < 3; ++i) {
+      if (registers & (1 << i)) {
+        ++register_users[i];
+        idle_loop_counters_[i] = {.index = static_cast<int>(idle_loop_.size()),
+                                  .step = counter_step(opcode)};
+      }
+    }
+    idle_loop_index_[address - start] = idle_loop_.size();
+    idle_loop_.push_back(
+        {.instruction = &instruction, .address = address, .operand = operand});
+    address += instruction.bytes;
+  }
+  // Branches that stay inside the loop have to land on an instruction.
+  for (const LoopInstruction& loop_instruction : idle_loop_) {
+    if (loop_instruction.instruction->mode != kREL) {
+      continue;
+    }
+    const int target = loop_instruction.address + 2 +
+                       static_cast<int8_t>(loop_instruction.operand);
+    if (target >= start && target < start + length &&
+        idle_loop_index_[target - start] == -1) {
+      rejected_loop_ = {start, branch_address};
+      return false;
+    }
+  }
+  if (address != branch_address + 2) {
+    rejected_loop_ = {start, branch_address};
+    return false;
+  }
+  // A register is a counter if a single inc or dec is all that uses it.
+  for (int i = 0; i < 3; ++i) {
+    if (register_users[i] != 1 || idle_loop_counters_[i].step == 0) {
+      idle_loop_counters_[i] = {};
+    }
+  }
+  return true;
+}
+
+int Cpu6301::run_idle_loop(int max_cycles) {
+  const uint16_t start = idle_loop_.front().address;
+  const int length = idle_loop_.back().address + 2 - start;
+  int cycles_run = 0;
+  // The devices owe 'skipped' cycles, all of which are within the 'idle'
+  // cycles in which nothing happens on them. Interrupts can't come up in
+  // those either, and stable reads don't change, so nothing the loop does
+  // depends on them being ticked yet.
+  int idle = idle_device_cycles(max_cycles);
+  int skipped = 0;
+  // The registers at the start of the previous iteration, to spot a loop that
+  // goes around without changing anything, like 'bra *', or that only counts.
+  std::optional<CpuState> iteration_state;
+  int iteration_start = 0;
+  // Whether the devices were ticked for real during the iteration, which may
+  // have changed what it reads.
+  bool ticked = false;
+  // How often the inc or dec of each counter ran during the iteration.
+  std::array<int, 3> counter_runs = {};
+  while (cycles_run < max_cycles && pc >= start && pc < start + length &&
+         !has_unmasked_interrupt()) {
+    if (pc == start) {
+      const int iteration_cycles = cycles_run - iteration_start;
+      if (iteration_state.has_value() && iteration_cycles > 0 && !ticked) {
+        // Skip as many of the iterations that go the same way as the previous
+        // one as the devices and the budget allow.
+        const int iterations = skip_idle_iterations(
+            *iteration_state, counter_runs,
+            std::min(idle - skipped, max_cycles - cycles_run) /
+                iteration_cycles);
+        skipped += iterations * iteration_cycles;
+        cycles_run += iterations * iteration_cycles;
+      }
+      iteration_state = get_state();
+      iteration_start = cycles_run;
+      ticked = false;
+      counter_runs = {};
+      if (cycles_run >= max_cycles) {
+        // The skipped iterations used up the budget.
+        break;
+      }
+    }
+    const int index = idle_loop_index_[pc - start];
+    const LoopInstruction& loop_instruction = idle_loop_[index];
+    const Instruction& instruction = *loop_instruction.instruction;
+    // Same as execute(), minus the memory fetches.
+    uint16_t data = loop_instruction.operand;
+    if (instruction.mode == kACA) {
+      data = a;
+    } else if (instruction.mode == kACB) {
+      data = b;
+    } else if (instruction.mode == kACD) {
+      data = get_d();
+    }
+    pc = loop_instruction.address + instruction.bytes;
+    if (skipped + instruction.cycles <= idle) {
+      skipped += instruction.cycles;
+    } else {
+      // Something happens on the devices during this instruction, so they
+      // catch up and get ticked for real.
+      skip_devices(skipped);
+      tick_devices(instruction.cycles);
+      skipped = 0;
+      idle = idle_device_cycles(max_cycles);
+      ticked = true;
+    }
+    if (instruction.mode == kDIR || instruction.mode == kEXT) {
+      // The read sees the devices at the same cycle as in regular execution.
+      skip_devices(skipped);
+      skipped = 0;
+      idle = idle_device_cycles(max_cycles);
+    }
+    for (int i = 0; i < 3; ++i) {
+      if (idle_loop_counters_[i].index == index) {
+        ++counter_runs[i];
+      }
+    }
+    cycles_run += instruction.cycles;
+    instruction.exec(data);
+  }
+  skip_devices(skipped);
+  return cycles_run;
+}
+
+int Cpu6301::skip_idle_iterations(const CpuState& previous,
+                                  const std::array<int, 3>& counter_runs,
+                                  int max_iterations) {
+  const CpuState current = get_state();
+  if (current == previous) {
+    // Every further iteration is the same.
+    return max_iterations;
+  }
+  // Otherwise only a counter may have changed, by its inc or dec running once.
+  // The following iterations go the same way for as long as that sets the
+  // same flags.
+  for (int i = 0; i < 3; ++i) {
+    const LoopCounter& counter = idle_loop_counters_[i];
+    if (counter.step == 0 || counter_runs[i] != 1) {
+      continue;
+    }
+    CpuState uncounted = current;
+    if (i == 0) {
+      uncounted.a = previous.a;
+    } else if (i == 1) {
+      uncounted.b = previous.b;
+    } else {
+      uncounted.x = previous.x;
+    }
+    if (uncounted != previous) {
+      continue;
+    }
+    int iterations = 0;
+    if (i == 2) {
+      // inx and dex only set Z, so they go the same way until X gets to 0.
+      if (x != 0) {
+        iterations = std::min(counter.step < 0 ? x - 1 : 0xffff - x,
+                              max_iterations);
+      }
+      x = static_cast<uint16_t>(x + iterations * counter.step);
+    } else {
+      // inc and dec set N, Z, and V when going from 0x7f to 0x80 or back.
+      uint8_t& value = i == 0 ? a : b;
+      const uint8_t overflow = counter.step < 0 ? 0x7f : 0x80;
+      const auto flags = [overflow](uint8_t result) {
+        return std::make_tuple(result & 0x80, result == 0, result == overflow);
+      };
+      while (iterations < max_iterations &&
+             flags(static_cast<uint8_t>(value + (iterations + 1) *
+                                                    counter.step)) ==
+                 flags(value)) {
+        ++iterations;
+      }
+      value = static_cast<uint8_t>(value + iterations * counter.step);
+    }
+    return iterations;
+  }
+  return 0;
+}
+
 void Cpu6301::register_tick_callback(std::function<void()> callback) {
   tick_callbacks_.push_back(std::move(callback));
+  devices_can_skip_ = false;
+}
+
+void Cpu6301::register_tick_callback(std::function<void()> callback,
+                                     std::function<int()> idle_ticks,
+                                     std::function<void(int)> skip) {
+  tick_callbacks_.push_back(std::move(callback));
+  skip_callbacks_.push_back(
+      {.idle_ticks = std::move(idle_ticks), .skip = std::move(skip)});
+}
+
+void Cpu6301::set_fast_forward_idle_loops(bool enabled) {
+  fast_forward_idle_loops_ = enabled;
 }
 
 void Cpu6301::set_breakpoint(uint16_t address) { breakpoint_ = address; }
@@ -427,6 +854,13 @@ void Cpu6301::jsr(uint16_t address) {
 // Returns the number of cycles taken.
 int Cpu6301::enter_interrupt(uint16_t vector) {
   VLOG(3) << "Entering interrupt at " << absl::Hex(vector, absl::kZeroPad4);
+  if (sleep_mode_ == SleepMode::kWait) {
+    // WAI already stacked the registers, only the vector fetch is left.
+    sleep_mode_ = SleepMode::kAwake;
+    sr.I = 1;
+    pc = memory_->get16(vector);
+    return 2;
+  }
   psh16(pc);
   psh16(x);
   psh8(a);
@@ -508,7 +942,8 @@ Cpu6301::Cpu6301(AddressSpace* memory)
   instructions_[0x17] = {"tba", 1, 1, kACB, OP(a = d COMMA nzv_sr(a))};
   instructions_[0x18] = {"xgdx", 1, 2, kIMP, OP(xgdx())};
   // instructions_[0x19] = {"daa", 1, 2, kACA, OP() };
-  // instructions_[0x1a] = {"slp", 1, 2, kIMP, OP() }; // sleep
+  instructions_[0x1a] = {"slp", 1, 4, kIMP,
+                         OP(sleep_mode_ = SleepMode::kSleep)};
   instructions_[0x1b] = {"aba", 1, 1, kACB, OP(add(a, 0, d))};
 
   // Branching
@@ -544,7 +979,7 @@ Cpu6301::Cpu6301(AddressSpace* memory)
   instructions_[0x3b] = {"rti", 1, 10, kIMP, OP(rti())};
   instructions_[0x3c] = {"pshx", 1, 5, kIMP, OP(psh16(x))};
   instructions_[0x3d] = {"mul", 1, 7, kIMP, OP(mul())};
-  // instructions_[0x3e] = {"wai", 1, 9, kIMP, [this](uint16_t) { }};
+  instructions_[0x3e] = {"wai", 1, 9, kIMP, OP(wai())};
   // instructions_[0x3f] = {"swi", 1, 12, kIMP, [this](uint16_t) { }};
   // NEG
   instructions_[0x40] = {"nega", 1, 1, kACA, OP(neg(a))};
@@ -792,10 +1227,15 @@ Cpu6301::Cpu6301(AddressSpace* memory)
   instructions_[0xff] = {"stx", 3, 5, kEXT, OP(set16(d, x) COMMA nzv_sr16(x))};
 #undef OP
 #undef COMMA
+
+  for (uint8_t opcode : kIdleLoopOpcodes) {
+    idle_loop_opcodes_[opcode] = true;
+  }
 }
 
 absl::Status Cpu6301::initialize() {
-  auto serial = HD6301Serial::create(memory_, 0x0010, &serial_interrupt_);
+  auto serial = HD6301Serial::create(memory_, 0x0010, &serial_interrupt_,
+                                     [this]() { return cycle_count_; });
   if (!serial.ok()) {
     return serial.status();
   }
@@ -1,10 +1,14 @@
 #ifndef EIGHT_BIT_CPU6301_H
 #define EIGHT_BIT_CPU6301_H
 
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
@@ -39,6 +43,35 @@ class Cpu6301 {
   // Registers a tick callback that will be called after each tick.
   void register_tick_callback(std::function<void()> callback);
 
+  // Same as above, for devices that can skip ahead while nothing happens on
+  // them. 'idle_ticks' returns how many of the upcoming ticks can't do anything
+  // but advance the device's own counters, and 'skip' advances the device by up
+  // to that many ticks at once. While any device is registered without these,
+  // all devices are ticked one cycle at a time.
+  void register_tick_callback(std::function<void()> callback,
+                              std::function<int()> idle_ticks,
+                              std::function<void(int)> skip);
+
+  // The total number of cycles run since the CPU was created. Devices can use
+  // this as a timestamp for emulated time. In a tick callback it's the cycle
+  // being ticked. During execution of an instruction it already includes all
+  // of that instruction's cycles.
+  uint64_t cycle_count() const { return cycle_count_; }
+
+  // Tight loops that only touch registers and read stable memory, like the
+  // ones in delay routines and polling loops, are run from a decoded copy
+  // without fetching from memory on every instruction. The devices are skipped
+  // through their idle_ticks() instead of ticked, iterations that leave the
+  // registers unchanged, like 'bra *', are skipped as a whole, and counter
+  // loops jump ahead to their last iteration. What the loop reads can't change
+  // while the devices are idle, and they catch up before anything happens on
+  // them, so the result is identical to regular execution. On by default.
+  void set_fast_forward_idle_loops(bool enabled);
+
+  // True while the CPU waits for an interrupt after WAI or SLP. The devices
+  // keep running, but sleeping cycles skip straight to the next device event.
+  bool is_sleeping() const { return sleep_mode_ != SleepMode::kAwake; }
+
   // Set a breakpoint to stop execution if the PC reaches the given address.
   // 'address' has to be at an instruction boundary. If a breakpoint is already
   // set, it will be replaced.
@@ -190,6 +223,41 @@ class Cpu6301 {
   // Enters an interrupt handler at the given vector address. Returns the number
   // of cycles entering the interrupt takes.
   int enter_interrupt(uint16_t vector);
+  bool has_unmasked_interrupt();
+  // Ticks the devices for 'cycles' cycles, advancing cycle_count_ by one before
+  // each tick.
+  void tick_devices(int cycles);
+  // The number of upcoming cycles, up to 'max_cycles', in which the devices do
+  // nothing but advance their own counters. 0 if a device can't tell.
+  int idle_device_cycles(int max_cycles);
+  // Advances the devices by that many cycles at once.
+  void skip_devices(int cycles);
+
+  // Lets the devices run while the CPU sleeps, until it's woken up or at least
+  // 'max_cycles' have run. Returns the number of cycles run.
+  int sleep(int max_cycles);
+  bool wakes_up();
+  void wai();
+
+  // Decodes the loop from 'start' to the backward branch at 'branch_address'
+  // into idle_loop_, and finds the registers it counts with. Returns false if
+  // the loop is too long, contains instructions that aren't in
+  // kIdleLoopOpcodes, or reads memory without stable reads.
+  bool decode_idle_loop(uint16_t start, uint16_t branch_address);
+  // Runs the decoded idle loop from the current PC until the PC leaves the
+  // loop, an interrupt is pending, or at least 'max_cycles' have run. Returns
+  // the number of cycles run. The loop can't observe the devices, so they're
+  // skipped ahead through their idle cycles instead of ticked, and iterations
+  // that go the same way as the previous one are skipped as a whole.
+  int run_idle_loop(int max_cycles);
+  // Skips up to 'max_iterations' iterations of the idle loop, if they go the
+  // same way as the one that just went from 'previous' to the current state:
+  // either nothing changed, or only a counter that ran once, and will set the
+  // same flags again. 'counter_runs' are how often each counter ran. Returns
+  // the number of iterations skipped.
+  int skip_idle_iterations(const CpuState& previous,
+                           const std::array<int, 3>& counter_runs,
+                           int max_iterations);
   uint8_t execute(const Instruction& instruction);
 
   Interrupt interrupt_;
@@ -200,6 +268,13 @@ class Cpu6301 {
   Timer timer_;
   std::unique_ptr<HD6301Serial> serial_;
   std::vector<std::function<void()>> tick_callbacks_;
+  struct SkipCallbacks {
+    std::function<int()> idle_ticks;
+    std::function<void(int)> skip;
+  };
+  std::vector<SkipCallbacks> skip_callbacks_;
+  // Whether all tick callbacks have skip callbacks too.
+  bool devices_can_skip_ = true;
 
   uint8_t a = 0;
   uint8_t b = 0;
@@ -208,6 +283,42 @@ class Cpu6301 {
   uint16_t pc = 0xfffe;
   StatusRegister sr;
   std::optional<uint16_t> breakpoint_;
+  uint64_t cycle_count_ = 0;
+
+  enum class SleepMode {
+    kAwake,
+    // After WAI. The registers are already stacked, and only an unmasked
+    // interrupt wakes the CPU up.
+    kWait,
+    // After SLP. Any interrupt request wakes the CPU up. If it's masked,
+    // execution continues after the SLP.
+    kSleep,
+  };
+  SleepMode sleep_mode_ = SleepMode::kAwake;
+
+  struct LoopInstruction {
+    const Instruction* instruction;
+    uint16_t address;
+    uint16_t operand;
+  };
+  static constexpr int kMaxIdleLoopBytes = 32;
+  bool fast_forward_idle_loops_ = true;
+  std::array<bool, 256> idle_loop_opcodes_ = {};
+  std::vector<LoopInstruction> idle_loop_;
+  // Maps an offset from the loop start to an index into idle_loop_, or -1 if
+  // there's no instruction starting there.
+  std::array<int8_t, kMaxIdleLoopBytes> idle_loop_index_;
+  // For A, B and X, the inc or dec in idle_loop_ that is the only instruction
+  // using the register, if there is one.
+  struct LoopCounter {
+    int index = -1;
+    // +1 or -1, or 0 if the register isn't a counter.
+    int step = 0;
+  };
+  std::array<LoopCounter, 3> idle_loop_counters_;
+  // The last loop that failed to decode, as {start, branch address}. Saves
+  // decoding the same busy loop with side effects on every iteration.
+  std::pair<uint16_t, uint16_t> rejected_loop_ = {0, 0};
 
   AddressSpace* memory_ = nullptr;
   std::array<Instruction, 256> instructions_;
@@ -1593,5 +1593,364 @@ TEST_F(Cpu6301Test, ADCB_Immediate) {
   EXPECT_EQ(final_state, expected_state);
 }
 
+TEST_F(Cpu6301Test, TickCallbacksSeeTheCycleTheyTick) {
+  test_memory_[kProgramStart] = 0x01;      // NOP, 1 cycle
+  test_memory_[kProgramStart + 1] = 0x86;  // LDA #data8, 2 cycles
+  test_memory_[kProgramStart + 2] = 0x42;
+  std::vector<uint64_t> cycles;
+  cpu_->register_tick_callback(
+      [this, &cycles]() { cycles.push_back(cpu_->cycle_count()); });
+
+  cpu_->tick(3);
+
+  EXPECT_EQ(cycles, (std::vector<uint64_t>{1, 2, 3}));
+  EXPECT_EQ(cpu_->cycle_count(), 3);
+}
+
+
+// Runs the same program on two CPUs, one with idle loop fast-forwarding and one
+// without, and checks that they stay in lockstep.
+class Cpu6301IdleLoopTest : public ::testing::Test {
+ protected:
+  struct Machine {
+    AddressSpace memory;
+    std::unique_ptr<Cpu6301> cpu;
+    std::array<uint8_t, 65536> ram = {0};
+    int ticks = 0;
+    // Calls to the tick callback, as opposed to ticks skipped.
+    int tick_calls = 0;
+    // The device does something every 'device_event' ticks, and can be skipped
+    // in between.
+    int device_event = 64;
+    // Reads from kData.
+    int data_reads = 0;
+  };
+  // Where the programs below read their data from.
+  static constexpr uint16_t kData = 0x0080;
+
+  void SetUp() override {
+    // delay_xx from asm/include/delays.inc with a 3 x 8 loop, then 'bra *'.
+    const std::vector<uint8_t> program = {
+        0xce, 0x00, 0x03,  // ldx #3
+        0xc6, 0x00,        // xloop: ldab #0
+        0xc6, 0x08,        // ldab #8
+        0x01,              // nop
+        0x01,              // bloop: nop
+        0x5a,              // decb
+        0x26, 0xfc,        // bne bloop
+        0x09,              // dex
+        0x01,              // nop
+        0x26, 0xf3,        // bne xloop
+        0x20, 0xfe,        // bra *
+    };
+    for (auto* machine : {&fast_, &slow_}) {
+      *machine = std::make_unique<Machine>();
+      Machine* m = machine->get();
+      m->cpu = Cpu6301::create(&m->memory).value();
+      ASSERT_THAT(m->memory.register_read(0x0020, 0xffff,
+                                          [m](uint16_t address) {
+                                            if (address == kData) {
+                                              ++m->data_reads;
+                                            }
+                                            return m->ram[address];
+                                          }),
+                  IsOk());
+      ASSERT_THAT(m->memory.register_write(0x0020, 0xffff,
+                                           [m](uint16_t address, uint8_t data) {
+                                             m->ram[address] = data;
+                                           }),
+                  IsOk());
+      m->memory.set_stable_reads(0x0020, 0xffff);
+      // The interrupt handler at 0x0100 is another 'bra *'.
+      m->ram[0xfff8] = 0x01;
+      m->ram[0xfff9] = 0x00;
+      m->ram[0x0100] = 0x20;
+      m->ram[0x0101] = 0xfe;
+      m->cpu->register_tick_callback(
+          [m]() {
+            ++m->ticks;
+            ++m->tick_calls;
+          },
+          [m]() { return m->device_event - m->ticks % m->device_event - 1; },
+          [m](int ticks) { m->ticks += ticks; });
+      m->cpu->set_state({.a = 0,
+                         .b = 0,
+                         .x = 0,
+                         .sp = kStackTop,
+                         .pc = kProgramStart,
+                         .sr = 0,
+                         .breakpoint = std::nullopt});
+    }
+    slow_->cpu->set_fast_forward_idle_loops(false);
+    load(program);
+  }
+
+  // Loads 'program' into both machines, to run from kProgramStart.
+  void load(const std::vector<uint8_t>& program) {
+    for (Machine* m : {fast_.get(), slow_.get()}) {
+      std::copy(program.begin(), program.end(), m->ram.begin() + kProgramStart);
+    }
+  }
+
+  // Ticks both machines in slices and compares them after each one.
+  void run_and_compare(int cycles, int slice = 7) {
+    for (int cycles_run = 0; cycles_run < cycles; cycles_run += slice) {
+      auto fast_result = fast_->cpu->tick(slice);
+      auto slow_result = slow_->cpu->tick(slice);
+      ASSERT_EQ(fast_result.cycles_run, slow_result.cycles_run);
+      ASSERT_EQ(fast_result.breakpoint_hit, slow_result.breakpoint_hit);
+      ASSERT_EQ(fast_->cpu->get_state(), slow_->cpu->get_state());
+      ASSERT_EQ(fast_->cpu->cycle_count(), slow_->cpu->cycle_count());
+      ASSERT_EQ(fast_->ticks, slow_->ticks);
+      ASSERT_EQ(fast_->ram, slow_->ram);
+    }
+  }
+
+  std::unique_ptr<Machine> fast_;
+  std::unique_ptr<Machine> slow_;
+};
+
+TEST_F(Cpu6301IdleLoopTest, DelayLoopMatchesRegularExecution) {
+  run_and_compare(500);
+  EXPECT_EQ(fast_->cpu->get_state().pc, kProgramStart + 16);
+  EXPECT_EQ(fast_->cpu->get_state().x, 0);
+}
+
+TEST_F(Cpu6301IdleLoopTest, InterruptsAreTakenAtTheSameInstruction) {
+  for (Machine* m : {fast_.get(), slow_.get()}) {
+    m->cpu->register_tick_callback([m]() {
+      if (m->ticks == 101) {
+        m->cpu->get_irq()->set_interrupt();
+      }
+    });
+  }
+  run_and_compare(300);
+  EXPECT_EQ(fast_->cpu->get_state().pc, 0x0100);
+}
+
+TEST_F(Cpu6301IdleLoopTest, SkipsDevicesThroughTheirIdleTicks) {
+  run_and_compare(500);
+  // Now in the 'bra *', which goes around without changing anything.
+  for (int i = 0; i < 10; ++i) {
+    auto fast_result = fast_->cpu->tick(1000);
+    auto slow_result = slow_->cpu->tick(1000);
+    ASSERT_EQ(fast_result.cycles_run, slow_result.cycles_run);
+    ASSERT_EQ(fast_->cpu->get_state(), slow_->cpu->get_state());
+    ASSERT_EQ(fast_->cpu->cycle_count(), slow_->cpu->cycle_count());
+    ASSERT_EQ(fast_->ticks, slow_->ticks);
+  }
+  EXPECT_LT(fast_->tick_calls * 10, slow_->tick_calls);
+}
+
+TEST_F(Cpu6301IdleLoopTest, StopsAtBreakpointsInTheLoop) {
+  fast_->cpu->set_breakpoint(kProgramStart + 12);
+  slow_->cpu->set_breakpoint(kProgramStart + 12);
+  run_and_compare(100);
+  EXPECT_EQ(fast_->cpu->get_state().pc, kProgramStart + 12);
+}
+
+TEST_F(Cpu6301IdleLoopTest, CountsThroughLoopsThatReadMemory) {
+  load({
+      0xce, 0x04, 0x00,  // ldx #$0400
+      0x96, 0x80,        // loop: ldaa kData
+      0x09,              // dex
+      0x26, 0xfb,        // bne loop
+      0x20, 0xfe,        // bra *
+  });
+  fast_->device_event = slow_->device_event = 100000;
+  run_and_compare(10000, 1000);
+  EXPECT_EQ(fast_->cpu->get_state().pc, kProgramStart + 8);
+  EXPECT_EQ(fast_->cpu->get_state().x, 0);
+  EXPECT_EQ(slow_->data_reads, 0x400);
+  EXPECT_LT(fast_->data_reads * 10, slow_->data_reads);
+}
+
+TEST_F(Cpu6301IdleLoopTest, CountsAccumulatorsThroughTheOverflow) {
+  load({
+      0x86, 0x00,  // ldaa #0
+      0xd6, 0x80,  // loop: ldab kData
+      0x4a,        // deca
+      0x26, 0xfb,  // bne loop
+      0x20, 0xfe,  // bra *
+  });
+  fast_->device_event = slow_->device_event = 100000;
+  run_and_compare(3000, 500);
+  EXPECT_EQ(fast_->cpu->get_state().pc, kProgramStart + 7);
+  EXPECT_EQ(fast_->cpu->get_state().a, 0);
+  EXPECT_LT(fast_->data_reads * 10, slow_->data_reads);
+}
+
+TEST_F(Cpu6301IdleLoopTest, SkipsPollingLoopsUntilTheDataChanges) {
+  load({
+      0x96, 0x80,  // loop: ldaa kData
+      0x84, 0x01,  // anda #1
+      0x27, 0xfa,  // beq loop
+      0x20, 0xfe,  // bra *
+  });
+  fast_->device_event = slow_->device_event = 100000;
+  run_and_compare(5000, 1000);
+  EXPECT_LT(fast_->cpu->get_state().pc, kProgramStart + 6);
+  EXPECT_LT(fast_->data_reads * 10, slow_->data_reads);
+
+  fast_->ram[kData] = slow_->ram[kData] = 0x01;
+  run_and_compare(2000, 1000);
+  EXPECT_EQ(fast_->cpu->get_state().pc, kProgramStart + 6);
+}
+
+// Runs programs that end up in WAI or SLP, woken up by the timer overflow
+// interrupt.
+class Cpu6301SleepTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    cpu_ = Cpu6301::create(&memory_).value();
+    ASSERT_THAT(memory_.register_read(
+                    0x0020, 0xffff,
+                    [this](uint16_t address) { return ram_[address]; }),
+                IsOk());
+    ASSERT_THAT(memory_.register_write(0x0020, 0xffff,
+                                       [this](uint16_t address, uint8_t data) {
+                                         ram_[address] = data;
+                                       }),
+                IsOk());
+    // The timer interrupt handler at 0x0100 is a 'bra *'.
+    ram_[0xfff2] = 0x01;
+    ram_[0xfff3] = 0x00;
+    ram_[0x0100] = 0x20;
+    ram_[0x0101] = 0xfe;
+  }
+
+  // Loads 'program' after code that enables the timer overflow interrupt.
+  void load(const std::vector<uint8_t>& program) {
+    const std::vector<uint8_t> enable_timer_interrupt = {
+        0x86, 0x04,  // ldaa #ETOI
+        0x97, 0x08,  // staa TCSR
+    };
+    std::copy(enable_timer_interrupt.begin(), enable_timer_interrupt.end(),
+              ram_.begin() + kProgramStart);
+    std::copy(program.begin(), program.end(),
+              ram_.begin() + kProgramStart + enable_timer_interrupt.size());
+    cpu_->set_state({.a = 0,
+                     .b = 0,
+                     .x = 0,
+                     .sp = kStackTop,
+                     .pc = kProgramStart,
+                     .sr = 0,
+                     .breakpoint = std::nullopt});
+  }
+
+  // Runs for at least 'cycles' cycles in 1000 cycle slices.
+  void run(int cycles) {
+    for (int cycles_run = 0; cycles_run < cycles;) {
+      cycles_run += cpu_->tick(1000).cycles_run;
+    }
+  }
+
+  AddressSpace memory_;
+  std::unique_ptr<Cpu6301> cpu_;
+  std::array<uint8_t, 65536> ram_ = {0};
+};
+
+TEST_F(Cpu6301SleepTest, WaiStacksRegistersAndWakesUpOnInterrupt) {
+  load({
+      0xce, 0x12, 0x34,  // ldx #$1234
+      0x3e,              // wai
+      0x20, 0xfe,        // bra *
+  });
+  // Runs up to the WAI.
+  cpu_->tick(10);
+  const uint16_t after_wai = kProgramStart + 8;
+  EXPECT_EQ(cpu_->get_state().pc, after_wai);
+  EXPECT_TRUE(cpu_->is_sleeping());
+  EXPECT_EQ(kStackTop - cpu_->get_state().sp, 7);
+  EXPECT_EQ(ram_[kStackTop], after_wai & 0xff);
+  EXPECT_EQ(ram_[kStackTop - 1], after_wai >> 8);
+  EXPECT_EQ(ram_[kStackTop - 2], 0x34);
+  EXPECT_EQ(ram_[kStackTop - 3], 0x12);
+
+  // The timer overflows after 0x10000 cycles. Waking up doesn't stack the
+  // registers again.
+  run(70000);
+  EXPECT_FALSE(cpu_->is_sleeping());
+  EXPECT_EQ(cpu_->get_state().pc, 0x0100);
+  EXPECT_EQ(kStackTop - cpu_->get_state().sp, 7);
+  EXPECT_TRUE(Cpu6301::StatusRegister(cpu_->get_state().sr).I);
+}
+
+TEST_F(Cpu6301SleepTest, WaiIgnoresMaskedInterrupts) {
+  load({
+      0x0f,        // sei
+      0x3e,        // wai
+      0x20, 0xfe,  // bra *
+  });
+  run(140000);
+  EXPECT_TRUE(cpu_->is_sleeping());
+  EXPECT_EQ(cpu_->get_state().pc, kProgramStart + 6);
+}
+
+TEST_F(Cpu6301SleepTest, SlpWithMaskedInterruptContinuesAfterSlp) {
+  load({
+      0x0f,        // sei
+      0x1a,        // slp
+      0x86, 0x42,  // ldaa #$42
+      0x20, 0xfe,  // bra *
+  });
+  run(70000);
+  EXPECT_FALSE(cpu_->is_sleeping());
+  EXPECT_EQ(cpu_->get_state().a, 0x42);
+  EXPECT_EQ(cpu_->get_state().sp, kStackTop);
+}
+
+TEST_F(Cpu6301SleepTest, SleepingMatchesTickingEveryCycle) {
+  // A device with an event every 1000 ticks.
+  int ticks = 0;
+  int countdown = 1000;
+  cpu_->register_tick_callback(
+      [&]() {
+        ++ticks;
+        if (--countdown == 0) {
+          countdown = 1000;
+        }
+      },
+      [&]() { return countdown - 1; },
+      [&](int skipped) { countdown -= skipped; });
+  load({
+      0x0e,        // cli
+      0x1a,        // slp
+      0x20, 0xfe,  // bra *
+  });
+  // A second CPU with a device that can't skip, so it sees every cycle.
+  AddressSpace slow_memory;
+  auto slow_cpu = Cpu6301::create(&slow_memory).value();
+  std::array<uint8_t, 65536> slow_ram = ram_;
+  ASSERT_THAT(slow_memory.register_read(
+                  0x0020, 0xffff,
+                  [&](uint16_t address) { return slow_ram[address]; }),
+              IsOk());
+  ASSERT_THAT(slow_memory.register_write(0x0020, 0xffff,
+                                         [&](uint16_t address, uint8_t data) {
+                                           slow_ram[address] = data;
+                                         }),
+              IsOk());
+  slow_cpu->register_tick_callback([]() {});
+  slow_cpu->set_state(cpu_->get_state());
+
+  // Runs up to the SLP.
+  cpu_->tick(10);
+  slow_cpu->tick(10);
+  int sleeping_ticks = 0;
+  while (cpu_->is_sleeping()) {
+    sleeping_ticks = ticks;
+    ASSERT_EQ(cpu_->tick(1000).cycles_run, slow_cpu->tick(1000).cycles_run);
+    ASSERT_EQ(cpu_->is_sleeping(), slow_cpu->is_sleeping());
+    ASSERT_EQ(cpu_->get_state(), slow_cpu->get_state());
+    ASSERT_EQ(cpu_->cycle_count(), slow_cpu->cycle_count());
+    ASSERT_LT(cpu_->cycle_count(), 70000);
+  }
+  EXPECT_EQ(cpu_->get_state().pc, 0x0100);
+  EXPECT_EQ(ram_, slow_ram);
+  // Only the cycles with device events were ticked one by one.
+  EXPECT_LT(sleeping_ticks, 200);
+}
+
 }  // namespace
 }  // namespace eight_bit
\ No newline at end of file
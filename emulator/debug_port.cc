@@ -0,0 +1,83 @@
+#include "debug_port.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "address_space.h"
+
+namespace eight_bit {
+namespace {
+constexpr uint16_t kOutputRegister = 0;
+constexpr uint16_t kExitRegister = 1;
+constexpr uint16_t kAssertRegister = 2;
+constexpr uint16_t kSignatureRegister = 3;
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<DebugPort>> DebugPort::create(
+    AddressSpace* address_space, uint16_t base_address,
+    std::function<uint64_t()> cycle_count) {
+  std::unique_ptr<DebugPort> debug_port(
+      new DebugPort(address_space, base_address, std::move(cycle_count)));
+  auto status = debug_port->initialize();
+  if (!status.ok()) {
+    return status;
+  }
+  return debug_port;
+}
+
+DebugPort::DebugPort(AddressSpace* address_space, uint16_t base_address,
+                     std::function<uint64_t()> cycle_count)
+    : address_space_(address_space),
+      base_address_(base_address),
+      cycle_count_(std::move(cycle_count)) {}
+
+absl::Status DebugPort::initialize() {
+  auto status = address_space_->register_read(
+      base_address_, base_address_ + kSignatureRegister,
+      [this](uint16_t address) { return read(address); });
+  if (!status.ok()) {
+    return status;
+  }
+  return address_space_->register_write(
+      base_address_, base_address_ + kSignatureRegister,
+      [this](uint16_t address, uint8_t data) { write(address, data); });
+}
+
+uint8_t DebugPort::read(uint16_t address) {
+  if (address - base_address_ == kSignatureRegister) {
+    return kSignature;
+  }
+  return 0;
+}
+
+void DebugPort::write(uint16_t address, uint8_t data) {
+  if (result_.exited) {
+    // Whatever the firmware does after exiting isn't part of the test.
+    return;
+  }
+  switch (address - base_address_) {
+    case kOutputRegister:
+      result_.output.push_back(static_cast<char>(data));
+      break;
+    case kExitRegister:
+      exit(data);
+      break;
+    case kAssertRegister:
+      result_.failed_assertion = data;
+      exit(kAssertionFailedExitCode);
+      break;
+    default:
+      break;
+  }
+}
+
+void DebugPort::exit(int exit_code) {
+  result_.exited = true;
+  result_.exit_code = exit_code;
+  result_.exit_cycle = cycle_count_();
+}
+
+}  // namespace eight_bit
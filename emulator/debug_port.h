@@ -0,0 +1,68 @@
+#ifndef EIGHT_BIT_DEBUG_PORT_H
+#define EIGHT_BIT_DEBUG_PORT_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "address_space.h"
+
+namespace eight_bit {
+
+// A device that only exists in the emulator. Firmware tests write their
+// output, failed assertions and an exit code to it, and a test runner reports
+// them. Registers, relative to the base address:
+//   0 (write) Append a character to the output.
+//   1 (write) Exit with the written exit code.
+//   2 (write) Fail the assertion with the written id, and exit.
+//   3 (read)  Always kSignature, so that firmware can tell that it runs under
+//             the emulator.
+class DebugPort {
+ public:
+  static constexpr uint8_t kSignature = 0xdb;
+  // The exit code reported when the firmware fails an assertion.
+  static constexpr int kAssertionFailedExitCode = 0x100;
+
+  struct Result {
+    bool exited = false;
+    int exit_code = 0;
+    // The id of the assertion that failed, if any.
+    std::optional<uint8_t> failed_assertion;
+    // The cycle the firmware exited at.
+    uint64_t exit_cycle = 0;
+    std::string output;
+  };
+
+  DebugPort(const DebugPort&) = delete;
+  DebugPort& operator=(const DebugPort&) = delete;
+
+  // 'cycle_count' returns the current emulated cycle.
+  static absl::StatusOr<std::unique_ptr<DebugPort>> create(
+      AddressSpace* address_space, uint16_t base_address,
+      std::function<uint64_t()> cycle_count);
+
+  const Result& result() const { return result_; }
+  bool exited() const { return result_.exited; }
+
+ private:
+  DebugPort(AddressSpace* address_space, uint16_t base_address,
+            std::function<uint64_t()> cycle_count);
+  absl::Status initialize();
+
+  uint8_t read(uint16_t address);
+  void write(uint16_t address, uint8_t data);
+  void exit(int exit_code);
+
+  AddressSpace* address_space_;
+  const uint16_t base_address_;
+  const std::function<uint64_t()> cycle_count_;
+  Result result_;
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_DEBUG_PORT_H
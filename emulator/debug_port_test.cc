@@ -0,0 +1,63 @@
+#include "debug_port.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "address_space.h"
+
+namespace eight_bit {
+namespace {
+
+class DebugPortTest : public ::testing::Test {
+ protected:
+  static constexpr uint16_t kBaseAddress = 0x7f00;
+
+  void SetUp() override {
+    auto debug_port = DebugPort::create(&address_space_, kBaseAddress,
+                                        [this]() { return cycle_; });
+    ASSERT_TRUE(debug_port.ok());
+    debug_port_ = std::move(debug_port.value());
+  }
+
+  AddressSpace address_space_;
+  uint64_t cycle_ = 0;
+  std::unique_ptr<DebugPort> debug_port_;
+};
+
+TEST_F(DebugPortTest, CollectsOutputAndExitCode) {
+  EXPECT_EQ(address_space_.get(kBaseAddress + 3), DebugPort::kSignature);
+  for (char c : std::string("ok\n")) {
+    address_space_.set(kBaseAddress, c);
+  }
+  EXPECT_FALSE(debug_port_->exited());
+  cycle_ = 1234;
+  address_space_.set(kBaseAddress + 1, 3);
+
+  const DebugPort::Result& result = debug_port_->result();
+  EXPECT_TRUE(result.exited);
+  EXPECT_EQ(result.exit_code, 3);
+  EXPECT_EQ(result.exit_cycle, 1234);
+  EXPECT_EQ(result.output, "ok\n");
+  EXPECT_FALSE(result.failed_assertion.has_value());
+}
+
+TEST_F(DebugPortTest, FailedAssertionExits) {
+  cycle_ = 99;
+  address_space_.set(kBaseAddress + 2, 7);
+  // Anything written after exiting is ignored.
+  address_space_.set(kBaseAddress, 'x');
+  address_space_.set(kBaseAddress + 1, 0);
+
+  const DebugPort::Result& result = debug_port_->result();
+  EXPECT_TRUE(result.exited);
+  EXPECT_EQ(result.exit_code, DebugPort::kAssertionFailedExitCode);
+  EXPECT_EQ(result.failed_assertion, 7);
+  EXPECT_EQ(result.exit_cycle, 99);
+  EXPECT_EQ(result.output, "");
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -1,15 +1,19 @@
 #include <SDL3/SDL.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <optional>
 #include <print>
 #include <thread>
 #include <vector>
 
-#include "../disassembler/disassembler.h"
 #include "absl/cleanup/cleanup.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
@@ -18,9 +22,16 @@
 #include "absl/log/log.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
+#include "background_disassembler.h"
 #include "cpu6301.h"
 #include "graphics.h"
 #include "hd6301_thing.h"
+#include "input_log.h"
+#include "loop_telemetry.h"
+#include "memory_viewer.h"
+#include "pacer.h"
+#include "sd_card_image.h"
+#include "sound_opl3.h"
 #include "imgui.h"
 #include "imgui_impl_sdl3.h"
 #include "imgui_impl_sdlrenderer3.h"
@@ -36,6 +47,45 @@ ABSL_FLAG(
     bool, sd_image_persist_writes, false,
     "If true, writes to the SD card image are persisted in the image file");
 ABSL_FLAG(int, ticks_per_second, 1000000, "Number of CPU ticks per second");
+ABSL_FLAG(std::string, record_inputs, "",
+          "Path to write all keyboard, serial and MIDI input to on exit, "
+          "stamped with the emulated cycle it arrived at");
+ABSL_FLAG(std::string, replay_inputs, "",
+          "Path to inputs recorded with --record_inputs to replay instead of "
+          "taking live input. Needs the same ROM, SD card image and "
+          "--ticks_per_second as the recording");
+ABSL_FLAG(std::string, midi_file, "",
+          "Path to a Standard MIDI File to play into the UART once the CPU "
+          "runs");
+ABSL_FLAG(int, slice_us, 1000,
+          "Length of the slices the emulator thread runs in, in microseconds. "
+          "Shorter slices give steadier timing for input and sound, at some "
+          "cost in CPU time");
+ABSL_FLAG(int, spin_us, 0,
+          "Sleep until this many microseconds before the start of a slice, "
+          "then spin. Trades CPU time for less jitter, 0 only sleeps");
+ABSL_FLAG(std::string, drift_policy, "catch_up",
+          "What to do when the emulator falls behind real time: 'catch_up' "
+          "runs at full speed until it's back on schedule, 'drop' skips the "
+          "missed time, 'slew' catches up at most 25% faster than real time");
+ABSL_FLAG(int, realtime_priority, 0,
+          "If positive, run the emulator thread with SCHED_FIFO at this "
+          "priority. Needs the right permissions (e.g. CAP_SYS_NICE)");
+ABSL_FLAG(int, cpu_affinity, -1,
+          "If not negative, pin the emulator thread to this CPU");
+ABSL_FLAG(double, speed, 1.0,
+          "How many times faster than real time to run, 0 for as fast as "
+          "possible. Can be changed in the UI, and holding F12 runs as fast "
+          "as possible");
+ABSL_FLAG(std::string, speed_audio, "keep_pitch",
+          "What audio does when not running at real time: 'mute' turns it "
+          "off, 'resample' plays it faster and higher or slower and lower, "
+          "'keep_pitch' keeps the pitch by skipping or repeating bits of it");
+ABSL_FLAG(std::string, metrics_file, "",
+          "Path to append emulator loop timing metrics to, one line per "
+          "--metrics_interval_ms");
+ABSL_FLAG(int, metrics_interval_ms, 1000,
+          "How often to write a line to --metrics_file");
 ABSL_FLAG(
     int, display_scale, 0,
     "Scale factor for the display. 1 = no scaling, 2 = double size, etc.");
@@ -43,6 +93,62 @@ ABSL_FLAG(
 constexpr int kDebugWindowWidth = 400;
 constexpr int kGraphicsFrameWidth = 800;
 constexpr int kGraphicsFrameHeight = 600;
+// Runs the emulator as fast as possible while held down.
+constexpr SDL_Scancode kTurboKey = SDL_SCANCODE_F12;
+constexpr float kMinSpeed = 0.1F;
+constexpr float kMaxSpeed = 10.0F;
+
+namespace {
+
+void draw_histogram(const char* label,
+                    const eight_bit::LoopTelemetry::Histogram& histogram) {
+  ImGui::SeparatorText(label);
+  ImGui::Text("mean %.1fus  p50 <%lldus  p99 <%lldus  max %.1fus",
+              histogram.mean().count() / 1000.0,
+              (long long)histogram.quantile(0.5).count(),
+              (long long)histogram.quantile(0.99).count(),
+              histogram.max.count() / 1000.0);
+  // Log scale counts, so that the rare slow outliers are still visible.
+  float buckets[eight_bit::LoopTelemetry::kNumBuckets];
+  for (int i = 0; i < eight_bit::LoopTelemetry::kNumBuckets; ++i) {
+    buckets[i] = std::log10(1.0F + histogram.buckets[i]);
+  }
+  ImGui::PushID(label);
+  ImGui::PlotHistogram("", buckets, eight_bit::LoopTelemetry::kNumBuckets, 0,
+                       "<1us .. >1s, log2 buckets", 0.0F, FLT_MAX,
+                       ImVec2(-1, ImGui::GetTextLineHeight() * 4));
+  ImGui::PopID();
+}
+
+// Shows the emulator loop timing, updated twice a second.
+void draw_telemetry_window(const eight_bit::LoopTelemetry& telemetry,
+                           bool* open) {
+  static auto previous = telemetry.snapshot();
+  static auto current = previous;
+  static double cycles_per_ms = 0;
+  if (std::chrono::steady_clock::now() - current.time >=
+      std::chrono::milliseconds(500)) {
+    previous = std::move(current);
+    current = telemetry.snapshot();
+    cycles_per_ms = eight_bit::LoopTelemetry::cycles_per_ms(previous, current);
+  }
+  ImGui::Begin("Timing", open);
+  ImGui::Text("Emulated cycles per ms: %.1f", cycles_per_ms);
+  ImGui::Text("Slices: %llu, late: %llu (%llu in the last update)",
+              (unsigned long long)current.slices,
+              (unsigned long long)current.late_slices,
+              (unsigned long long)(current.late_slices - previous.late_slices));
+  ImGui::Text("Overshoot: %llu cycles total, %d max",
+              (unsigned long long)current.overshoot_cycles,
+              current.max_overshoot_cycles);
+  draw_histogram("Slice run time", current.slice_time);
+  draw_histogram("Emulator mutex wait", current.mutex_wait);
+  draw_histogram("Lag behind real time", current.lag);
+  draw_histogram("Frame time", current.frame_time);
+  ImGui::End();
+}
+
+}  // namespace
 
 int main(int argc, char* argv[]) {
   absl::ParseCommandLine(argc, argv);
@@ -126,10 +232,36 @@ int main(int argc, char* argv[]) {
   absl::Cleanup imgui_renderer_cleanup(
       [] { ImGui_ImplSDLRenderer3_Shutdown(); });
 
-  auto hd6301_thing =
-      eight_bit::HD6301Thing::create(absl::GetFlag(FLAGS_ticks_per_second),
-                                     eight_bit::HD6301Thing::kKeyboard65C22);
+  eight_bit::HD6301Thing::Options options;
+  options.ticks_per_second = absl::GetFlag(FLAGS_ticks_per_second);
+  options.pacing.slice =
+      std::chrono::microseconds(absl::GetFlag(FLAGS_slice_us));
+  options.pacing.spin = std::chrono::microseconds(absl::GetFlag(FLAGS_spin_us));
+  auto drift_policy =
+      eight_bit::parse_drift_policy(absl::GetFlag(FLAGS_drift_policy));
+  QCHECK_OK(drift_policy);
+  options.pacing.drift_policy = *drift_policy;
+  options.realtime_priority = absl::GetFlag(FLAGS_realtime_priority);
+  options.cpu_affinity = absl::GetFlag(FLAGS_cpu_affinity);
+  const double speed_flag = absl::GetFlag(FLAGS_speed);
+  QCHECK(speed_flag >= 0) << "--speed can't be negative";
+  options.speed =
+      speed_flag == 0 ? eight_bit::HD6301Thing::kUnlimitedSpeed : speed_flag;
+  auto speed_audio =
+      eight_bit::parse_speed_audio(absl::GetFlag(FLAGS_speed_audio));
+  QCHECK_OK(speed_audio);
+  options.speed_audio = *speed_audio;
+  if (!absl::GetFlag(FLAGS_replay_inputs).empty()) {
+    auto inputs =
+        eight_bit::read_input_log(absl::GetFlag(FLAGS_replay_inputs));
+    QCHECK_OK(inputs);
+    options.replay_inputs = std::move(inputs.value());
+  }
+  auto hd6301_thing = eight_bit::HD6301Thing::create(std::move(options));
   QCHECK_OK(hd6301_thing);
+  if (!absl::GetFlag(FLAGS_record_inputs).empty()) {
+    (*hd6301_thing)->start_recording_inputs();
+  }
 
   // Prepare ROM image file
   QCHECK(!absl::GetFlag(FLAGS_rom_file).empty()) << "No ROM file specified.";
@@ -146,28 +278,43 @@ int main(int argc, char* argv[]) {
   if (!absl::GetFlag(FLAGS_sd_image_file).empty()) {
     const std::string image_file_name = absl::GetFlag(FLAGS_sd_image_file);
     bool persist_writes = absl::GetFlag(FLAGS_sd_image_persist_writes);
-    auto file_stream = std::make_unique<std::fstream>();
-    file_stream->open(std::string(image_file_name),
-                      std::ios::in | std::ios::out | std::ios::binary);
-    QCHECK(file_stream->is_open())
-        << "Failed to open file: " << image_file_name;
     if (persist_writes) {
       LOG(WARNING) << "Persisting writes to the SD card image file";
-      (*hd6301_thing)->load_sd_image(std::move(file_stream));
-    } else {
-      auto string_stream = std::make_unique<std::stringstream>();
-      (*string_stream) << file_stream->rdbuf();
-      file_stream->close();
-      (*hd6301_thing)->load_sd_image(std::move(string_stream));
     }
+    auto image =
+        eight_bit::SDCardImage::create(image_file_name, persist_writes);
+    QCHECK_OK(image);
+    (*hd6301_thing)->load_sd_image(std::move(image.value()));
   }
 
-  eight_bit::Disassembler disassembler;
-  QCHECK_OK(disassembler.set_data(rom_start + rom_load_address, rom_data));
-  QCHECK_OK(disassembler.disassemble());
+  eight_bit::HD6301Thing* machine = hd6301_thing->get();
+  auto disassembler = eight_bit::BackgroundDisassembler::create(
+      rom_start + rom_load_address, rom_data,
+      eight_bit::HD6301Thing::kRamStart,
+      [machine]() { return machine->get_ram(); });
+  QCHECK_OK(disassembler);
 
   (*hd6301_thing)->run();
 
+  if (!absl::GetFlag(FLAGS_midi_file).empty()) {
+    QCHECK_OK((*hd6301_thing)->play_midi_file(absl::GetFlag(FLAGS_midi_file)));
+  }
+
+  std::ofstream metrics_file;
+  if (!absl::GetFlag(FLAGS_metrics_file).empty()) {
+    metrics_file.open(absl::GetFlag(FLAGS_metrics_file), std::ios::app);
+    QCHECK(metrics_file.is_open())
+        << "Failed to open metrics file: " << absl::GetFlag(FLAGS_metrics_file);
+  }
+  const auto metrics_interval =
+      std::chrono::milliseconds(absl::GetFlag(FLAGS_metrics_interval_ms));
+  auto last_metrics = (*hd6301_thing)->telemetry().snapshot();
+
+  // The speed picked in the UI, and whether the turbo key is held down.
+  float speed = std::clamp<float>(speed_flag, kMinSpeed, kMaxSpeed);
+  bool unlimited_speed = speed_flag == 0;
+  bool turbo = false;
+
   // Main loop
   SDL_Event event;
   bool running = true;
@@ -180,6 +327,11 @@ int main(int argc, char* argv[]) {
         running = false;
       }
       if (event.type == SDL_EVENT_KEY_DOWN || event.type == SDL_EVENT_KEY_UP) {
+        if (event.key.scancode == kTurboKey) {
+          // The emulated machine never sees the turbo key.
+          turbo = event.type == SDL_EVENT_KEY_DOWN;
+          continue;
+        }
         // Only pass keyboard events if Dear ImGui doesn't want them
         if (!io.WantCaptureKeyboard) {
           (*hd6301_thing)->handle_keyboard_event(event.key);
@@ -187,6 +339,15 @@ int main(int argc, char* argv[]) {
       }
     }
 
+    if (metrics_file.is_open() &&
+        std::chrono::steady_clock::now() - last_metrics.time >=
+            metrics_interval) {
+      auto metrics = (*hd6301_thing)->telemetry().snapshot();
+      metrics_file << eight_bit::LoopTelemetry::format(last_metrics, metrics)
+                   << std::flush;
+      last_metrics = std::move(metrics);
+    }
+
     ImGui_ImplSDLRenderer3_NewFrame();
     ImGui_ImplSDL3_NewFrame();
     ImGui::NewFrame();
@@ -206,6 +367,10 @@ int main(int argc, char* argv[]) {
     static bool cpu_running = true;
 
     cpu_running = (*hd6301_thing)->is_cpu_running();
+    // Published by the emulator after every slice, so reading it never waits
+    // and the registers stay live while the CPU runs.
+    const auto machine_state = (*hd6301_thing)->machine_state();
+    cpu_state = machine_state.cpu;
     if (ImGui::Button(button_text.c_str(), ImVec2(-1, 0))) {
       if (cpu_running) {
         (*hd6301_thing)->stop();
@@ -226,10 +391,24 @@ int main(int argc, char* argv[]) {
         button_text = "Pause";
       } else {
         button_text = "Run";
-        cpu_state = (*hd6301_thing)->get_cpu_state();
       }
       ui_in_running_state = cpu_running;
     }
+
+    // Speed
+    ImGui::BeginDisabled(unlimited_speed || turbo);
+    ImGui::SliderFloat("Speed", &speed, kMinSpeed, kMaxSpeed, "%.2fx",
+                       ImGuiSliderFlags_Logarithmic);
+    ImGui::EndDisabled();
+    ImGui::SameLine();
+    ImGui::Checkbox("Unlimited", &unlimited_speed);
+    const double target_speed = unlimited_speed || turbo
+                                    ? eight_bit::HD6301Thing::kUnlimitedSpeed
+                                    : speed;
+    if (target_speed != (*hd6301_thing)->speed()) {
+      (*hd6301_thing)->set_speed(target_speed);
+    }
+
     ImGui::BeginDisabled(cpu_running);
     if (ImGui::Button("Step", ImVec2(-1, 0))) {
       (*hd6301_thing)->tick(1, true /* ignore_breakpoint */);
@@ -281,81 +460,58 @@ int main(int argc, char* argv[]) {
                 (sr & 0x02) >> 1, sr & 0x01);
     ImGui::SameLine();
     ImGui::Text("SP: 0x%04X", cpu_state.sp);
+    ImGui::Text("Cycles: %llu", (unsigned long long)machine_state.cycle_count);
 
     // Disassembly
     ImGui::SeparatorText("Disassembly");
-    static std::string pre_context;
-    static std::string disassembly;
-    static std::string post_context;
     if (!cpu_running) {
-      constexpr int kPreContext = 4;
-      constexpr int kPostContext = 7;
-
       static uint16_t last_pc = 0;
       if (last_pc != cpu_state.pc) {
         last_pc = cpu_state.pc;
-        disassembler.set_instruction_boundary_hint(cpu_state.pc);
-        QCHECK_OK(disassembler.disassemble());
-        const auto& disassembly_vector = disassembler.disassembly();
-        pre_context.clear();
-        // Find kPreContext many non-empty lines before the current PC
-        for (size_t i = 1, found = 0; found < kPreContext; ++i) {
-          if (i > last_pc) {
-            break;
-          }
-          if (!disassembly_vector[last_pc - i].empty()) {
-            // Not the most efficient way to do this, but good enough.
-            pre_context =
-                absl::StrCat(disassembly_vector[last_pc - i], pre_context);
-            ++found;
-          }
-        }
-        disassembly = disassembly_vector[last_pc];
-        post_context.clear();
-        // Find kPostContext many non-empty lines after the current PC
-        for (size_t i = 1, found = 0; found < kPostContext; ++i) {
-          if (last_pc + i >= disassembly_vector.size()) {
-            break;
-          }
-          if (!disassembly_vector[last_pc + i].empty()) {
-            absl::StrAppend(&post_context, disassembly_vector[last_pc + i]);
-            ++found;
-          }
-        }
+        (*disassembler)->request(cpu_state.pc);
       }
     }
-    ImGui::Text("%s", pre_context.c_str());
-    ImGui::TextColored(ImVec4(1.0F, 1.0F, 0.0F, 1.0F), "%s",
-                       disassembly.c_str());
-    ImGui::Text("%s", post_context.c_str());
+    // Shows the last finished disassembly until the one for the new PC is
+    // ready.
+    if (auto snapshot = (*disassembler)->snapshot(); snapshot != nullptr) {
+      ImGui::Text("%s", snapshot->pre_context.c_str());
+      ImGui::TextColored(ImVec4(1.0F, 1.0F, 0.0F, 1.0F), "%s",
+                         snapshot->line.c_str());
+      ImGui::Text("%s", snapshot->post_context.c_str());
+    }
 
     ImGui::SetCursorPosY(ImGui::GetWindowSize().y -
-                         ImGui::GetFrameHeightWithSpacing() * 2 -
+                         ImGui::GetFrameHeightWithSpacing() * 3 -
                          ImGui::GetStyle().ItemSpacing.y);
-    static bool show_ram_hexdump = false;
-    if (ImGui::Button("RAM Hexdump", ImVec2(-1, 0))) {
-      show_ram_hexdump = true;
+    static bool show_telemetry = false;
+    // Stays enabled while the CPU runs, which is when timing and live memory
+    // matter.
+    ImGui::EndDisabled();
+    if (ImGui::Button("Timing", ImVec2(-1, 0))) {
+      show_telemetry = true;
+    }
+    static bool show_memory = false;
+    if (ImGui::Button("Memory", ImVec2(-1, 0))) {
+      show_memory = true;
     }
+    ImGui::BeginDisabled(cpu_running);
     if (ImGui::Button("Reset", ImVec2(-1, 0))) {
       (*hd6301_thing)->reset();
       cpu_state = (*hd6301_thing)->get_cpu_state();
     }
-    if (show_ram_hexdump) {
-      static std::string ram_hexdump;
-      static uint16_t last_pc = 0;
-      if (last_pc != cpu_state.pc) {
-        last_pc = cpu_state.pc;
-        ram_hexdump = (*hd6301_thing)->get_ram_hexdump();
-      }
-      ImGui::Begin("RAM Hexdump", &show_ram_hexdump);
-      ImGui::Text("%s", ram_hexdump.c_str());
-      ImGui::End();
-    }
 
     ImGui::EndDisabled();
 
     ImGui::End();
 
+    if (show_telemetry) {
+      draw_telemetry_window((*hd6301_thing)->telemetry(), &show_telemetry);
+    }
+    if (show_memory) {
+      static eight_bit::MemoryViewer memory_viewer;
+      memory_viewer.draw((*hd6301_thing)->get_memory(), &show_memory);
+    }
+
     ImGui::Render();
 
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
@@ -371,5 +527,14 @@ int main(int argc, char* argv[]) {
     ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
     SDL_RenderPresent(renderer);
   }
+
+  if (!absl::GetFlag(FLAGS_record_inputs).empty()) {
+    auto status =
+        eight_bit::write_input_log(absl::GetFlag(FLAGS_record_inputs),
+                                   (*hd6301_thing)->take_recorded_inputs());
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+    }
+  }
   return 0;
 }
@@ -0,0 +1,129 @@
+// Runs firmware test ROMs headless and unthrottled, and reports whether they
+// passed. A test passes if it exits through the debug port with exit code 0.
+//
+// Usage: firmware_test [--max_cycles=N] rom.bin [rom.bin...]
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/initialize.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "batch_runner.h"
+#include "debug_port.h"
+#include "hd6301_thing.h"
+
+ABSL_FLAG(uint64_t, max_cycles, 100'000'000,
+          "Number of cycles after which a test that hasn't exited fails");
+ABSL_FLAG(int, threads, 0,
+          "Number of tests to run in parallel. 0 uses all hardware threads");
+
+namespace {
+
+constexpr size_t kRomSize = 0x8000;
+
+absl::StatusOr<eight_bit::DebugPort::Result> run_test(
+    const std::string& rom_file_name, uint64_t max_cycles) {
+  std::ifstream rom_file(rom_file_name, std::ios::binary);
+  if (!rom_file.is_open()) {
+    return absl::NotFoundError(
+        absl::StrCat("Failed to open file: ", rom_file_name));
+  }
+  std::vector<uint8_t> rom_data(std::istreambuf_iterator<char>(rom_file), {});
+  if (rom_data.size() > kRomSize) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(rom_file_name, " is larger than the ROM"));
+  }
+
+  eight_bit::HD6301Thing::Options options;
+  options.open_ptys = false;
+  options.audio_output = eight_bit::SoundOPL3::Output::kNone;
+  options.midi_input = false;
+  options.emulator_thread = false;
+  options.debug_port = true;
+  auto thing = eight_bit::HD6301Thing::create(std::move(options));
+  if (!thing.ok()) {
+    return thing.status();
+  }
+  // Like the real ROM, images are aligned to the end of the address space so
+  // that they contain the vectors.
+  (*thing)->load_rom(kRomSize - rom_data.size(), rom_data);
+  (*thing)->reset();
+  return (*thing)->run_until_exit(max_cycles);
+}
+
+// Returns the report for one test, and whether it passed.
+std::pair<std::string, bool> report(
+    const std::string& rom_file_name,
+    const absl::StatusOr<eight_bit::DebugPort::Result>& result) {
+  if (!result.ok()) {
+    return {absl::StrCat("ERROR ", rom_file_name, ": ",
+                         result.status().message(), "\n"),
+            false};
+  }
+  std::string output = result->output;
+  if (!output.empty() && output.back() != '\n') {
+    output += '\n';
+  }
+  if (!result->exited) {
+    return {absl::StrCat(output, "FAIL ", rom_file_name, ": no exit after ",
+                         absl::GetFlag(FLAGS_max_cycles), " cycles\n"),
+            false};
+  }
+  if (result->failed_assertion) {
+    return {absl::StrCat(output, "FAIL ", rom_file_name, ": assertion ",
+                         *result->failed_assertion, " failed at cycle ",
+                         result->exit_cycle, "\n"),
+            false};
+  }
+  if (result->exit_code != 0) {
+    return {absl::StrCat(output, "FAIL ", rom_file_name, ": exit code ",
+                         result->exit_code, " at cycle ", result->exit_cycle,
+                         "\n"),
+            false};
+  }
+  return {absl::StrCat(output, "PASS ", rom_file_name, " (",
+                       result->exit_cycle, " cycles)\n"),
+          true};
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<char*> args = absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+  if (args.size() < 2) {
+    std::cerr << "Usage: " << args[0] << " [flags] rom.bin [rom.bin...]\n";
+    return 2;
+  }
+
+  const std::vector<std::string> rom_files(args.begin() + 1, args.end());
+  const uint64_t max_cycles = absl::GetFlag(FLAGS_max_cycles);
+  std::vector<std::pair<std::string, bool>> reports(rom_files.size());
+  std::vector<std::function<void()>> jobs;
+  for (size_t i = 0; i < rom_files.size(); ++i) {
+    jobs.emplace_back([&, i]() {
+      reports[i] = report(rom_files[i], run_test(rom_files[i], max_cycles));
+    });
+  }
+  eight_bit::BatchRunner(absl::GetFlag(FLAGS_threads)).run(std::move(jobs));
+
+  int failed = 0;
+  for (const auto& [text, passed] : reports) {
+    std::cout << text;
+    failed += passed ? 0 : 1;
+  }
+  if (rom_files.size() > 1) {
+    std::cout << rom_files.size() - failed << " of " << rom_files.size()
+              << " tests passed\n";
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -7,8 +7,15 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "scanline_renderer.h"
 
 namespace eight_bit {
+namespace {
+
+// Keeps the pending command queue bounded when nothing renders for a while.
+constexpr size_t kMaxPendingCommands = 4096;
+
+}  // namespace
 
 Graphics::~Graphics() {
   if (palette_) {
@@ -68,6 +75,7 @@ absl::Status Graphics::render(SDL_Renderer* renderer,
                               SDL_FRect* destination_rect) {
   {
     absl::MutexLock lock(&graphics_state_mutex_);
+    apply_pending_commands();
     if (graphics_state_dirty_) {
       render_console();
     }
@@ -92,50 +100,27 @@ Graphics::Graphics(AddressSpace* address_space, uint16_t base_address)
 void Graphics::write(uint16_t address, uint8_t data) {
   const uint8_t command = address - base_address_;
   absl::MutexLock lock(&graphics_state_mutex_);
-  graphics_state_.HandleCommand(command, data);
-  graphics_state_dirty_ = true;
+  pending_commands_.push_back({.command = command, .data = data});
+  if (pending_commands_.size() >= kMaxPendingCommands) {
+    apply_pending_commands();
+  }
 }
 
-inline void Graphics::draw_character(int position) {
-  const int row = position / kNumColumns;
-  const int col = position % kNumColumns;
-  const int row_roll = graphics_state_.GetRowRoll();
-  const int x = col * kFontCharWidth;
-  // The + kFrameHeight is to ensure that the modulo operation is positive.
-  const int y =
-      ((row + row_roll) * kFontCharHeight + kFrameHeight) % kFrameHeight;
-
-  const char* characters = graphics_state_.GetCharBuf();
-  uint8_t foreground_color = graphics_state_.GetForegroundColor(position);
-  uint8_t background_color = graphics_state_.GetBackgroundColor(position);
-
-  SDL_Rect rect = {x, y, kFontCharWidth, kFontCharHeight};
-  SDL_FillSurfaceRect(frame_surface_, &rect, background_color);
-
-  const uint8_t character = characters[position];
-  // This simplifies the code below as we can just read a single byte.
-  static_assert(kFontCharWidth == 8);
-  // The font is stored as a 1bpp bitmap of size kFontNumChars*kFontCharHeight,
-  // with each byte representing a row of 8 pixels.
-  const uint8_t* font_data = font + character;
-  auto* pixels = static_cast<uint8_t*>(frame_surface_->pixels);
-  for (int i = 0; i < kFontCharHeight; ++i) {
-    for (int j = 0; j < kFontCharWidth; ++j) {
-      if ((font_data[i * kFontNumChars] & (1 << j))) {
-        pixels[(y + i) * kFrameWidth + x + j] = foreground_color;
-      }
-    }
+void Graphics::apply_pending_commands() {
+  if (pending_commands_.empty()) {
+    return;
   }
+  graphics_state_.HandleCommands(pending_commands_.data(),
+                                 pending_commands_.size());
+  pending_commands_.clear();
+  graphics_state_dirty_ = true;
 }
 
 void Graphics::render_console() {
   SDL_LockSurface(frame_surface_);
-  for (int i = 0; i < kNumRows; ++i) {
-    for (int j = 0; j < kNumColumns; ++j) {
-      const int position = i * kNumColumns + j;
-      draw_character(position);
-    }
-  }
+  RenderFrame(graphics_state_, font,
+              static_cast<uint8_t*>(frame_surface_->pixels),
+              frame_surface_->pitch);
   SDL_UnlockSurface(frame_surface_);
 }
 
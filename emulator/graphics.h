@@ -37,7 +37,7 @@ class Graphics {
 
   void write(uint16_t address, uint8_t data)
       ABSL_LOCKS_EXCLUDED(graphics_state_mutex_);
-  void draw_character(int position)
+  void apply_pending_commands()
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(graphics_state_mutex_);
   void render_console() ABSL_EXCLUSIVE_LOCKS_REQUIRED(graphics_state_mutex_);
 
@@ -50,6 +50,10 @@ class Graphics {
   absl::Mutex graphics_state_mutex_;
   GraphicsState graphics_state_ ABSL_GUARDED_BY(graphics_state_mutex_);
   bool graphics_state_dirty_ ABSL_GUARDED_BY(graphics_state_mutex_) = false;
+  // Commands written since the last render. They're applied in one batch
+  // when the frame is drawn, or when too many have piled up.
+  std::vector<GraphicsCommand> pending_commands_
+      ABSL_GUARDED_BY(graphics_state_mutex_);
 };
 
 }  // namespace eight_bit
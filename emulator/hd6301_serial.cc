@@ -1,20 +1,24 @@
 #include "hd6301_serial.h"
 
 #include <fcntl.h>
-#include <poll.h>
 #include <pty.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <functional>
+#include <limits>
+#include <span>
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
-#include "absl/synchronization/mutex.h"
 #include "address_space.h"
+#include "io_reactor.h"
 
 namespace eight_bit {
 namespace {
@@ -81,13 +85,11 @@ absl::StatusOr<int> get_open_pty() {
 }  // namespace
 
 HD6301Serial::~HD6301Serial() {
-  // Signal the read thread to stop.
-  if (shutdown_fd_[1] != 0) {
-    uint8_t data = 0;
-    ::write(shutdown_fd_[1], &data, 1);
-  }
-  if (read_thread_.joinable()) {
-    read_thread_.join();
+  if (io_reactor_ != nullptr) {
+    auto status = io_reactor_->remove(our_fd_);
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+    }
   }
   if (our_fd_ != 0) {
     close(our_fd_);
@@ -95,18 +97,13 @@ HD6301Serial::~HD6301Serial() {
   if (their_fd_ != 0) {
     close(their_fd_);
   }
-  if (shutdown_fd_[0] != 0) {
-    close(shutdown_fd_[0]);
-  }
-  if (shutdown_fd_[1] != 0) {
-    close(shutdown_fd_[1]);
-  }
 }
 
 absl::StatusOr<std::unique_ptr<HD6301Serial>> HD6301Serial::create(
-    AddressSpace* address_space, uint16_t base_address, Interrupt* interrupt) {
-  std::unique_ptr<HD6301Serial> hd6301_serial(
-      new HD6301Serial(address_space, base_address, interrupt));
+    AddressSpace* address_space, uint16_t base_address, Interrupt* interrupt,
+    std::function<uint64_t()> cycle_count) {
+  std::unique_ptr<HD6301Serial> hd6301_serial(new HD6301Serial(
+      address_space, base_address, interrupt, std::move(cycle_count)));
   auto status = hd6301_serial->initialize();
   if (!status.ok()) {
     return status;
@@ -127,24 +124,77 @@ void HD6301Serial::tick() {
   if (receive_register_full_countdown_ > 0) {
     receive_register_full_countdown_ -= 1;
   }
-  if (receive_register_full_countdown_ == 0 &&
-      !rx_fifo_empty_.test(std::memory_order_relaxed)) {
-    absl::MutexLock lock(&mutex_);
-    if (!rx_fifo_.empty()) {
-      receive_data_register_ = rx_fifo_.front();
+  if (receive_register_full_countdown_ == 0) {
+    if (const uint8_t* data = rx_fifo_.front()) {
+      const uint8_t byte = *data;
       rx_fifo_.pop();
-      trcsr_ |= kReceiveDataRegisterFull;
-      if (trcsr_ & kReceiveInterruptEnable && receive_interrupt_id_ == 0) {
-        receive_interrupt_id_ = interrupt_->set_interrupt();
+      if (rx_paused_.exchange(false)) {
+        io_reactor_->resume(our_fd_);
       }
-      receive_register_full_countdown_ = ticks_per_bit(rmcr_) * 10;
-    }
-    if (rx_fifo_.empty()) {
-      rx_fifo_empty_.test_and_set();
+      load_receive_data_register(byte);
+    } else if (const TimedByte* next = injected_rx_.front();
+               next != nullptr && next->cycle <= cycle_count_()) {
+      const uint8_t byte = next->data;
+      injected_rx_.pop();
+      load_receive_data_register(byte);
     }
   }
 }
 
+void HD6301Serial::load_receive_data_register(uint8_t data) {
+  receive_data_register_ = data;
+  trcsr_ |= kReceiveDataRegisterFull;
+  if (trcsr_ & kReceiveInterruptEnable && receive_interrupt_id_ == 0) {
+    receive_interrupt_id_ = interrupt_->set_interrupt();
+  }
+  receive_register_full_countdown_ = ticks_per_bit(rmcr_) * 10;
+  if (receive_callback_) {
+    receive_callback_(data);
+  }
+}
+
+int HD6301Serial::idle_ticks() const {
+  int ticks = std::numeric_limits<int>::max();
+  if (transmit_register_empty_countdown_ > 0) {
+    ticks = transmit_register_empty_countdown_ - 1;
+  }
+  if (receive_register_full_countdown_ > 0) {
+    ticks = std::min(ticks, receive_register_full_countdown_ - 1);
+  } else if (rx_fifo_.front() != nullptr) {
+    ticks = 0;
+  } else if (const TimedByte* next = injected_rx_.front()) {
+    const uint64_t cycle = cycle_count_();
+    ticks = next->cycle <= cycle + 1
+                ? 0
+                : std::min<uint64_t>(ticks, next->cycle - cycle - 1);
+  }
+  return ticks;
+}
+
+void HD6301Serial::skip(int ticks) {
+  if (transmit_register_empty_countdown_ > 0) {
+    transmit_register_empty_countdown_ -= ticks;
+  }
+  if (receive_register_full_countdown_ > 0) {
+    receive_register_full_countdown_ -= ticks;
+  }
+}
+
+bool HD6301Serial::inject(std::span<const uint8_t> data, uint64_t cycle) {
+  if (injected_rx_.capacity() - injected_rx_.size() < data.size()) {
+    return false;
+  }
+  for (uint8_t byte : data) {
+    injected_rx_.push({.cycle = cycle, .data = byte});
+  }
+  return true;
+}
+
+void HD6301Serial::set_receive_callback(
+    std::function<void(uint8_t)> callback) {
+  receive_callback_ = std::move(callback);
+}
+
 void HD6301Serial::write(uint16_t address, uint8_t data) {
   uint16_t offset = address - base_address_;
   switch (offset) {
@@ -156,10 +206,12 @@ void HD6301Serial::write(uint16_t address, uint8_t data) {
       trcsr_ = (trcsr_ & 0b11100000) | (data & 0b00011111);
       // Clear the queue if we just enabled receiving
       if (!receive_enabled && trcsr_ & kReceiveEnable) {
-        std::queue<uint8_t> empty;
-        absl::MutexLock lock(&mutex_);
-        std::swap(rx_fifo_, empty);
-        rx_fifo_empty_.test_and_set();
+        std::array<uint8_t, 256> discarded;
+        while (rx_fifo_.pop(std::span(discarded)) > 0) {
+        }
+        if (rx_paused_.exchange(false)) {
+          io_reactor_->resume(our_fd_);
+        }
       }
     } break;
     case 2:
@@ -178,8 +230,9 @@ void HD6301Serial::write(uint16_t address, uint8_t data) {
       if ((trcsr_ & kTransmitEnable) && (trcsr_ & kTransmitDataRegisterEmpty)) {
         // Clear out the transmit data register empty bit
         trcsr_ &= ~kTransmitDataRegisterEmpty;
-        absl::MutexLock lock(&mutex_);
-        ::write(our_fd_, &data, 1);
+        if (our_fd_ != 0) {
+          ::write(our_fd_, &data, 1);
+        }
         // Sending 10 bits: Start bit, 8 data bits, stop bit
         transmit_register_empty_countdown_ = ticks_per_bit(rmcr_) * 10;
       }
@@ -193,38 +246,88 @@ void HD6301Serial::write(uint16_t address, uint8_t data) {
 
 uint8_t HD6301Serial::read(uint16_t address) {
   uint16_t offset = address - base_address_;
-  switch (offset) {
-    case 0:
-      // rmcr_ is not readable
-      return 0;
+  if (offset > 3) {
+    LOG(ERROR) << "Read from invalid HD6301Serial address: "
+               << absl::Hex(offset, absl::kZeroPad4);
+    return 0;
+  }
+  if (offset == 2 && receive_interrupt_id_ != 0) {
+    interrupt_->clear_interrupt(receive_interrupt_id_);
+    receive_interrupt_id_ = 0;
+  }
+  return peek(address);
+}
+
+uint8_t HD6301Serial::peek(uint16_t address) const {
+  switch (address - base_address_) {
     case 1:
       return trcsr_;
-    case 2: {
-      if (receive_interrupt_id_ != 0) {
-        interrupt_->clear_interrupt(receive_interrupt_id_);
-        receive_interrupt_id_ = 0;
-      }
+    case 2:
       return receive_data_register_;
-    }
-    case 3:
-      return 0;
     default:
-      LOG(ERROR) << "Read from invalid HD6301Serial address: "
-                 << absl::Hex(offset, absl::kZeroPad4);
+      // rmcr_ is not readable, and neither is the transmit data register.
+      return 0;
   }
-  return 0;
 }
 
 std::string HD6301Serial::get_pty_name() {
-  absl::MutexLock lock(&mutex_);
+  if (our_fd_ == 0) {
+    return "";
+  }
   return ptsname(our_fd_);
 }
 
+absl::Status HD6301Serial::connect_pty(IoReactor* io_reactor) {
+  if (our_fd_ != 0) {
+    return absl::FailedPreconditionError("PTY is already connected");
+  }
+  auto pty_fd = get_open_pty();
+  if (!pty_fd.ok()) {
+    return pty_fd.status();
+  }
+  our_fd_ = pty_fd.value();
+  // Keep the other end open as well. Otherwise the PTY hangs up whenever a
+  // terminal program disconnects from it, and has to be replaced by one with a
+  // different name.
+  their_fd_ = open(ptsname(our_fd_), O_RDWR | O_NOCTTY);
+  if (their_fd_ == -1) {
+    their_fd_ = 0;
+    return absl::InternalError(
+        absl::StrCat("Failed to open PTY sub: ", strerror(errno)));
+  }
+
+  auto status = io_reactor->add(our_fd_, [this]() { return receive(); });
+  if (!status.ok()) {
+    return status;
+  }
+  io_reactor_ = io_reactor;
+  return absl::OkStatus();
+}
+
+bool HD6301Serial::receive() {
+  std::array<uint8_t, 256> buffer;
+  // Don't read more than fits. The rest stays in the PTY until tick() makes
+  // room and resumes reading.
+  const size_t space = rx_fifo_.capacity() - rx_fifo_.size();
+  if (space == 0) {
+    rx_paused_ = true;
+    return false;
+  }
+  ssize_t count =
+      ::read(our_fd_, buffer.data(), std::min(buffer.size(), space));
+  if (count > 0) {
+    rx_fifo_.push(std::span<const uint8_t>(buffer.data(), count));
+  }
+  return true;
+}
+
 HD6301Serial::HD6301Serial(AddressSpace* address_space, uint16_t base_address,
-                           Interrupt* interrupt)
+                           Interrupt* interrupt,
+                           std::function<uint64_t()> cycle_count)
     : address_space_(address_space),
       base_address_(base_address),
-      interrupt_(interrupt) {}
+      interrupt_(interrupt),
+      cycle_count_(std::move(cycle_count)) {}
 
 absl::Status HD6301Serial::initialize() {
   auto status = address_space_->register_write(
@@ -235,66 +338,13 @@ absl::Status HD6301Serial::initialize() {
   }
   status = address_space_->register_read(
       base_address_, base_address_ + 3,
-      [this](uint16_t address) { return read(address); });
+      [this](uint16_t address) { return read(address); },
+      [this](uint16_t address) { return peek(address); });
   if (!status.ok()) {
     return status;
   }
-
-  auto pty_fd = get_open_pty();
-  if (!pty_fd.ok()) {
-    return pty_fd.status();
-  }
-  our_fd_ = pty_fd.value();
-
-  // Create a pipe to signal the read thread to stop.
-  if (pipe(shutdown_fd_.data()) != 0) {
-    return absl::InternalError(
-        absl::StrCat("Failed to create pipe: ", strerror(errno)));
-  }
-  read_thread_ = std::thread([this]() {
-    while (true) {
-      std::array<struct pollfd, 2> fds;
-      fds[0].fd = our_fd_;
-      fds[0].events = POLLIN | POLLHUP;
-      // The read end of the pipe for the shutdown signal.
-      fds[1].fd = shutdown_fd_[0];
-      fds[1].events = POLLIN;
-
-      int retval = poll(fds.data(), fds.size(), -1);  // -1 means no timeout
-      if (retval == -1) {
-        perror("poll");
-        continue;
-      }
-      if (retval > 0) {
-        if (fds[0].revents & POLLIN) {
-          uint8_t data;
-          if (::read(our_fd_, &data, 1) > 0) {
-            absl::MutexLock lock(&mutex_);
-            rx_fifo_.push(data);
-            rx_fifo_empty_.clear();
-          }
-        }
-        if (fds[0].revents & POLLHUP) {
-          // The other side of our PTY has been closed. It can't be reopened so
-          // we create a new one.
-          absl::MutexLock lock(&mutex_);
-          close(our_fd_);
-          auto pty_fd = get_open_pty();
-          if (!pty_fd.ok()) {
-            LOG(ERROR) << "Failed to open PTY: " << pty_fd.status()
-                       << ". Disabling serial port.";
-            break;
-          }
-          our_fd_ = pty_fd.value();
-        }
-        if (fds[1].revents & POLLIN) {
-          // We've been woken up by a write on the shutdown pipe. Stop the
-          // thread.
-          break;
-        }
-      }
-    }
-  });
+  // Reading TRCSR arms clearing its flags, which reading again doesn't change.
+  address_space_->set_stable_reads(base_address_ + 1, base_address_ + 1);
 
   return absl::OkStatus();
 }
@@ -1,15 +1,18 @@
 #ifndef EIGHT_BIT_HD6301_SERIAL_H
 #define EIGHT_BIT_HD6301_SERIAL_H
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <memory>
-#include <queue>
-#include <thread>
+#include <span>
+#include <string>
 
 #include "absl/status/statusor.h"
-#include "absl/synchronization/mutex.h"
 #include "address_space.h"
 #include "interrupt.h"
+#include "io_reactor.h"
+#include "spsc_queue.h"
 
 namespace eight_bit {
 
@@ -22,21 +25,57 @@ class HD6301Serial {
   HD6301Serial& operator=(const HD6301Serial&) = delete;
   ~HD6301Serial();
 
+  // 'cycle_count' returns the emulated cycle being ticked, and is only called
+  // from the emulator thread.
   static absl::StatusOr<std::unique_ptr<HD6301Serial>> create(
-      AddressSpace* address_space, uint16_t base_address, Interrupt* interrupt);
+      AddressSpace* address_space, uint16_t base_address, Interrupt* interrupt,
+      std::function<uint64_t()> cycle_count);
 
   void tick();
 
+  // The number of upcoming ticks that only count down. skip() advances by up
+  // to that many ticks at once. Data that arrives in the RX FIFO during a skip
+  // is received on the first tick after it.
+  int idle_ticks() const;
+  void skip(int ticks);
+
+  // Queues 'data' to be received no earlier than emulated cycle 'cycle',
+  // bypassing the PTY. Returns false if there isn't enough room for all of it.
+  // Only one thread may call this.
+  bool inject(std::span<const uint8_t> data, uint64_t cycle);
+
+  // 'callback' is called on the emulator thread with every byte as it moves
+  // into the receive data register.
+  void set_receive_callback(std::function<void(uint8_t)> callback);
+
   uint8_t read(uint16_t address);
+  // Like read(), but leaves the receive interrupt alone.
+  uint8_t peek(uint16_t address) const;
   void write(uint16_t address, uint8_t data);
 
+  // Empty if there's no PTY.
   std::string get_pty_name();
 
+  // Opens a PTY for the host side of the port, and starts receiving what's
+  // written to it on the reactor thread. Without a PTY, transmitted data is
+  // dropped and only injected data is received. 'io_reactor' has to outlive
+  // this object.
+  absl::Status connect_pty(IoReactor* io_reactor);
+
  private:
+  struct TimedByte {
+    uint64_t cycle;
+    uint8_t data;
+  };
+
   HD6301Serial(AddressSpace* address_space, uint16_t base_address,
-               Interrupt* interrupt);
+               Interrupt* interrupt, std::function<uint64_t()> cycle_count);
   absl::Status initialize();
 
+  // Moves 'data' into the receive data register and starts the countdown until
+  // the next byte can be received.
+  void load_receive_data_register(uint8_t data);
+
   AddressSpace* address_space_;
   uint16_t base_address_;
 
@@ -53,20 +92,26 @@ class HD6301Serial {
   uint8_t transmit_register_empty_countdown_ = 0;
   uint8_t receive_register_full_countdown_ = 0;
 
+  // Reads whatever is available on the PTY into rx_fifo_. Runs on the reactor
+  // thread. Returns false once rx_fifo_ is full.
+  bool receive();
+
   // FD 0 is stdin, so it's usable here as a sentinel value for "not open".
   int our_fd_ = 0;
   int their_fd_ = 0;
 
-  // Used to signal the read thread to stop.
-  std::array<int, 2> shutdown_fd_ = {0, 0};
-  std::thread read_thread_;
+  IoReactor* io_reactor_ = nullptr;
+
+  // Reactor thread to emulator thread. Checking for an empty queue on every
+  // tick is a single atomic load.
+  SpscQueue<uint8_t, 4096> rx_fifo_;
+  // Set by receive() when rx_fifo_ was full and the reactor stopped reading.
+  std::atomic<bool> rx_paused_ = false;
 
-  absl::Mutex mutex_;
-  // The queue is empty almost all of the time. Locking the mutex on each tick
-  // just to find out the queue is empty is expensive enough to show up on
-  // CPU profiles. This atomic flag is much cheaper for this.
-  std::atomic_flag rx_fifo_empty_ = ATOMIC_FLAG_INIT;
-  std::queue<uint8_t> rx_fifo_ ABSL_GUARDED_BY(mutex_);
+  const std::function<uint64_t()> cycle_count_;
+  // Bytes from inject(), received once their cycle has come.
+  SpscQueue<TimedByte, 4096> injected_rx_;
+  std::function<void(uint8_t)> receive_callback_;
 };
 
 }  // namespace eight_bit
@@ -0,0 +1,157 @@
+#include "hd6301_serial.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status_matchers.h"
+#include "address_space.h"
+#include "interrupt.h"
+#include "io_reactor.h"
+
+namespace eight_bit {
+namespace {
+
+using ::absl_testing::IsOk;
+
+constexpr uint16_t kBaseAddress = 0x0010;
+constexpr uint8_t kReceiveEnable = 0b00001000;
+constexpr uint8_t kReceiveInterruptEnable = 0b00010000;
+
+class HD6301SerialTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto io_reactor = IoReactor::create();
+    ASSERT_THAT(io_reactor.status(), IsOk());
+    io_reactor_ = std::move(io_reactor.value());
+    auto serial =
+        HD6301Serial::create(&address_space_, kBaseAddress, &interrupt_,
+                             [this]() { return cycle_; });
+    ASSERT_THAT(serial.status(), IsOk());
+    serial_ = std::move(serial.value());
+    ASSERT_THAT(serial_->connect_pty(io_reactor_.get()), IsOk());
+    serial_->write(kBaseAddress + 1, kReceiveEnable | kReceiveInterruptEnable);
+
+    pty_fd_ = open(serial_->get_pty_name().c_str(), O_RDWR | O_NOCTTY);
+    ASSERT_NE(pty_fd_, -1);
+  }
+
+  void TearDown() override { close(pty_fd_); }
+
+  // Ticks until a byte is received, and returns it. Returns -1 if nothing
+  // arrives for a few seconds.
+  int receive_byte() {
+    for (int i = 0; i < 3'000'000; ++i) {
+      serial_->tick();
+      if (interrupt_.has_interrupt()) {
+        // Reading the data register clears the interrupt.
+        return serial_->read(kBaseAddress + 2);
+      }
+      if (i % 1000 == 0) {
+        std::this_thread::yield();
+      }
+    }
+    return -1;
+  }
+
+  uint64_t cycle_ = 0;
+  AddressSpace address_space_;
+  Interrupt interrupt_;
+  std::unique_ptr<IoReactor> io_reactor_;
+  std::unique_ptr<HD6301Serial> serial_;
+  int pty_fd_ = -1;
+};
+
+TEST_F(HD6301SerialTest, ReceivesBytesWrittenToThePty) {
+  ASSERT_EQ(::write(pty_fd_, "hi", 2), 2);
+  EXPECT_EQ(receive_byte(), 'h');
+  EXPECT_EQ(receive_byte(), 'i');
+}
+
+TEST_F(HD6301SerialTest, ReceivesMoreThanTheQueueHoldsInOrder) {
+  std::string data;
+  for (int i = 0; i < 10000; ++i) {
+    data.push_back('a' + i % 26);
+  }
+  // The writer blocks whenever the PTY buffer is full, until the emulated side
+  // has made room.
+  std::thread writer([&]() {
+    for (size_t written = 0; written < data.size();) {
+      ssize_t count =
+          ::write(pty_fd_, data.data() + written, data.size() - written);
+      ASSERT_GT(count, 0);
+      written += count;
+    }
+  });
+  std::string received;
+  for (size_t i = 0; i < data.size(); ++i) {
+    int byte = receive_byte();
+    if (byte == -1) {
+      break;
+    }
+    received.push_back(byte);
+  }
+  writer.join();
+  EXPECT_EQ(received, data);
+}
+
+TEST_F(HD6301SerialTest, ReenablingTheReceiverResumesReading) {
+  serial_->write(kBaseAddress + 1, 0);
+  // More than the receive queue holds, so the reactor stops reading from the
+  // PTY once the queue is full.
+  std::string data(4096, 'a');
+  data.append(100, 'b');
+  std::thread writer([&]() {
+    for (size_t written = 0; written < data.size();) {
+      ssize_t count =
+          ::write(pty_fd_, data.data() + written, data.size() - written);
+      ASSERT_GT(count, 0);
+      written += count;
+    }
+  });
+  writer.join();
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  // Enabling the receiver throws away what's queued, and has to make the
+  // reactor read the rest.
+  serial_->write(kBaseAddress + 1, kReceiveEnable | kReceiveInterruptEnable);
+  EXPECT_NE(receive_byte(), -1);
+}
+
+TEST_F(HD6301SerialTest, InjectedBytesAreReceivedAtTheirCycle) {
+  std::vector<std::pair<uint64_t, uint8_t>> received;
+  serial_->set_receive_callback(
+      [&](uint8_t data) { received.push_back({cycle_, data}); });
+  const std::vector<uint8_t> data = {'o', 'k'};
+  ASSERT_TRUE(serial_->inject(data, 50));
+  EXPECT_EQ(serial_->idle_ticks(), 49);
+
+  while (!interrupt_.has_interrupt() && cycle_ < 1000) {
+    ++cycle_;
+    serial_->tick();
+  }
+  EXPECT_EQ(cycle_, 50);
+  EXPECT_EQ(serial_->read(kBaseAddress + 2), 'o');
+
+  // The next byte waits until the first one has been shifted in, 10 bits of 16
+  // ticks each.
+  while (!interrupt_.has_interrupt() && cycle_ < 1000) {
+    ++cycle_;
+    serial_->tick();
+  }
+  EXPECT_EQ(cycle_, 50 + 160);
+  EXPECT_EQ(serial_->read(kBaseAddress + 2), 'k');
+  EXPECT_EQ(received, (std::vector<std::pair<uint64_t, uint8_t>>{
+                          {50, 'o'}, {210, 'k'}}));
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -1,8 +1,18 @@
 #include "hd6301_thing.h"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
@@ -10,10 +20,16 @@
 #include "absl/synchronization/mutex.h"
 #include "address_space.h"
 #include "cpu6301.h"
+#include "debug_port.h"
 #include "graphics.h"
+#include "hexdump.h"
+#include "input_log.h"
+#include "io_reactor.h"
+#include "midi_file.h"
 #include "ps2_keyboard_6301.h"
 #include "ram.h"
 #include "rom.h"
+#include "sd_card_image.h"
 #include "sound_opl3.h"
 #include "spi.h"
 #include "tl16c2550.h"
@@ -33,23 +49,43 @@ HD6301Thing::~HD6301Thing() {
 }
 
 absl::StatusOr<std::unique_ptr<HD6301Thing>> HD6301Thing::create(
-    int ticks_per_second, KeyboardType keyboard_type) {
+    Options options) {
   auto hd6301_thing = std::unique_ptr<HD6301Thing>(
-      new HD6301Thing(ticks_per_second, keyboard_type));
+      new HD6301Thing(options));
   absl::MutexLock lock(&hd6301_thing->emulator_mutex_);
 
-  constexpr uint rom_start = 0x8000;
-  constexpr uint rom_size = 0x8000;
-  auto rom_or = eight_bit::Rom::create(&hd6301_thing->address_space_, rom_start,
-                                       rom_size);
+  if (options.replay_inputs) {
+    hd6301_thing->replaying_ = true;
+    for (const InputEvent& event : *options.replay_inputs) {
+      if (event.type == InputEvent::Type::kKeyDown ||
+          event.type == InputEvent::Type::kKeyUp) {
+        hd6301_thing->replay_keys_.push_back(event);
+      } else {
+        hd6301_thing->replay_bytes_.push_back(event);
+      }
+    }
+  }
+
+  // Replays don't take any input from the PTYs, so they don't get any.
+  const bool open_ptys = options.open_ptys && !hd6301_thing->replaying_;
+  if (open_ptys) {
+    auto io_reactor = IoReactor::create();
+    if (!io_reactor.ok()) {
+      return io_reactor.status();
+    }
+    hd6301_thing->io_reactor_ = std::move(io_reactor.value());
+  }
+
+  auto rom_or = eight_bit::Rom::create(&hd6301_thing->address_space_,
+                                       kRomStart, kRomSize);
   if (!rom_or.ok()) {
     return rom_or.status();
   }
   hd6301_thing->rom_ = std::move(rom_or.value());
 
   // Addresses 0..1f are reserved internal CPU registers.
-  auto ram_or = eight_bit::Ram::create(&hd6301_thing->address_space_, 0x0020,
-                                       0x7f00 - 0x0020);
+  auto ram_or = eight_bit::Ram::create(&hd6301_thing->address_space_,
+                                       kRamStart, kRamSize);
   if (!ram_or.ok()) {
     return ram_or.status();
   }
@@ -68,26 +104,59 @@ absl::StatusOr<std::unique_ptr<HD6301Thing>> HD6301Thing::create(
   }
   hd6301_thing->cpu_ = std::move(cpu_or.value());
   hd6301_thing->cpu_->reset();
-  std::cout << "CPU serial port: "
-            << hd6301_thing->cpu_->get_serial()->get_pty_name() << std::endl;
+  auto* thing = hd6301_thing.get();
+  hd6301_thing->cpu_->get_serial()->set_receive_callback([thing](uint8_t data) {
+    thing->emulator_mutex_.AssertHeld();
+    thing->record_input(InputEvent::Type::kSerial, data);
+  });
+  if (open_ptys) {
+    auto status = hd6301_thing->cpu_->get_serial()->connect_pty(
+        hd6301_thing->io_reactor_.get());
+    if (!status.ok()) {
+      return status;
+    }
+    std::cout << "CPU serial port: "
+              << hd6301_thing->cpu_->get_serial()->get_pty_name() << std::endl;
+  }
 
   hd6301_thing->keyboard_6301_ = std::make_unique<PS2Keyboard6301>(
       hd6301_thing->cpu_->get_irq(), hd6301_thing->cpu_->get_port1(),
       hd6301_thing->cpu_->get_port2());
 
-  auto sound_opl3 =
-      eight_bit::SoundOPL3::create(&hd6301_thing->address_space_, 0x7f80);
+  auto* cpu_ptr = hd6301_thing->cpu_.get();
+  auto sound_opl3 = eight_bit::SoundOPL3::create(
+      &hd6301_thing->address_space_, 0x7f80, options.ticks_per_second,
+      [cpu_ptr]() { return cpu_ptr->cycle_count(); }, options.audio_output,
+      options.speed_audio);
   if (!sound_opl3.ok()) {
     return sound_opl3.status();
   }
   hd6301_thing->sound_opl3_ = std::move(sound_opl3.value());
+  hd6301_thing->sound_opl3_->set_speed(options.speed);
 
   auto tl16c2550 = eight_bit::TL16C2550::create(
-      &hd6301_thing->address_space_, 0x7f40, hd6301_thing->cpu_->get_irq());
+      &hd6301_thing->address_space_, 0x7f40, hd6301_thing->cpu_->get_irq(),
+      [cpu_ptr]() { return cpu_ptr->cycle_count(); });
   if (!tl16c2550.ok()) {
     return tl16c2550.status();
   }
   hd6301_thing->tl16c2550_ = std::move(tl16c2550.value());
+  auto* tl16c2550_ptr = hd6301_thing->tl16c2550_.get();
+  hd6301_thing->cpu_->register_tick_callback(
+      [tl16c2550_ptr]() { tl16c2550_ptr->tick(); },
+      [tl16c2550_ptr]() { return tl16c2550_ptr->idle_ticks(); },
+      [tl16c2550_ptr](int ticks) { tl16c2550_ptr->skip(ticks); });
+  tl16c2550_ptr->set_receive_callback([thing](uint8_t data) {
+    thing->emulator_mutex_.AssertHeld();
+    thing->record_input(InputEvent::Type::kUart, data);
+  });
+  if (open_ptys) {
+    auto status =
+        tl16c2550_ptr->connect_pty(hd6301_thing->io_reactor_.get());
+    if (!status.ok()) {
+      return status;
+    }
+  }
 
   auto w65c22_or = eight_bit::W65C22::Create(
       &hd6301_thing->address_space_, 0x7f20, hd6301_thing->cpu_->get_irq());
@@ -100,7 +169,9 @@ absl::StatusOr<std::unique_ptr<HD6301Thing>> HD6301Thing::create(
   // tick, which is expensive.
   auto* w65c22_ptr = hd6301_thing->w65c22_.get();
   hd6301_thing->cpu_->register_tick_callback(
-      [w65c22_ptr]() { w65c22_ptr->tick(); });
+      [w65c22_ptr]() { w65c22_ptr->tick(); },
+      [w65c22_ptr]() { return w65c22_ptr->idle_ticks(); },
+      [w65c22_ptr](int ticks) { w65c22_ptr->skip(ticks); });
 
   auto w65c22_to_spi_glue = eight_bit::W65C22ToSPIGlue::create(
       w65c22_ptr->port_cb(), W65C22::kCb1Pin, hd6301_thing->w65c22_->port_a(),
@@ -111,7 +182,13 @@ absl::StatusOr<std::unique_ptr<HD6301Thing>> HD6301Thing::create(
   hd6301_thing->w65c22_to_spi_glue_ = std::move(w65c22_to_spi_glue.value());
   auto* w65c22_to_spi_glue_ptr = hd6301_thing->w65c22_to_spi_glue_.get();
   hd6301_thing->cpu_->register_tick_callback(
-      [w65c22_to_spi_glue_ptr]() { w65c22_to_spi_glue_ptr->tick(); });
+      [w65c22_to_spi_glue_ptr]() { w65c22_to_spi_glue_ptr->tick(); },
+      [w65c22_to_spi_glue_ptr]() {
+        return w65c22_to_spi_glue_ptr->idle_ticks();
+      },
+      [w65c22_to_spi_glue_ptr](int ticks) {
+        w65c22_to_spi_glue_ptr->skip(ticks);
+      });
 
   auto spi = eight_bit::SPI::create(
       hd6301_thing->w65c22_->port_ca(), W65C22::kCa2Pin /* CS */,
@@ -124,31 +201,59 @@ absl::StatusOr<std::unique_ptr<HD6301Thing>> HD6301Thing::create(
     return spi.status();
   }
   hd6301_thing->spi_ = std::move(spi.value());
-
-  // Create an empty 4MB stream for the SD card.
-  auto stream = std::make_unique<std::stringstream>(
-      std::string(4 * 1024 * 1024, '\0'),
-      std::ios::in | std::ios::out | std::ios::binary);
+  // Move whole bytes from the shift register to the SD card instead of going
+  // through every clock edge on the ports.
+  w65c22_to_spi_glue_ptr->set_spi(hd6301_thing->spi_.get());
+  w65c22_ptr->set_shift_out_callback([w65c22_to_spi_glue_ptr](uint8_t data) {
+    w65c22_to_spi_glue_ptr->transfer_byte(data);
+  });
+
+  // Create an empty 4MB image for the SD card.
+  auto image = SDCardImage::create_empty(4 * 1024 * 1024);
+  if (!image.ok()) {
+    return image.status();
+  }
   auto sd_card_spi =
-      SDCardSPI::create(hd6301_thing->spi_.get(), std::move(stream));
+      SDCardSPI::create(hd6301_thing->spi_.get(), std::move(image.value()));
   if (!sd_card_spi.ok()) {
     return sd_card_spi.status();
   }
   hd6301_thing->sd_card_spi_ = std::move(sd_card_spi.value());
 
+  if (options.debug_port) {
+    auto debug_port = DebugPort::create(
+        &hd6301_thing->address_space_, 0x7f00,
+        [cpu_ptr]() { return cpu_ptr->cycle_count(); });
+    if (!debug_port.ok()) {
+      return debug_port.status();
+    }
+    hd6301_thing->debug_port_ = std::move(debug_port.value());
+  }
+
 #ifdef HAVE_MIDI
-  auto midi_to_serial = eight_bit::MidiToSerial::create(
-      hd6301_thing->tl16c2550_->get_pty_name(0));
-  if (!midi_to_serial.ok()) {
-    return midi_to_serial.status();
+  if (options.midi_input && !hd6301_thing->replaying_) {
+    auto* published_cycle_count = &hd6301_thing->published_cycle_count_;
+    auto midi_to_serial = eight_bit::MidiToSerial::create(
+        tl16c2550_ptr, options.ticks_per_second, [published_cycle_count]() {
+          return published_cycle_count->load(std::memory_order_relaxed);
+        });
+    if (!midi_to_serial.ok()) {
+      return midi_to_serial.status();
+    }
+    hd6301_thing->midi_to_serial_ = std::move(midi_to_serial.value());
+    hd6301_thing->midi_to_serial_->set_speed(options.speed);
   }
-  hd6301_thing->midi_to_serial_ = std::move(midi_to_serial.value());
 #endif
 
+  hd6301_thing->published_rom_.store_bytes(std::span<const uint8_t, kRomSize>(
+      hd6301_thing->rom_->data().data(), kRomSize));
+  hd6301_thing->publish_state();
   hd6301_thing->emulator_running_ = true;
   hd6301_thing->cpu_running_ = false;
-  hd6301_thing->emulator_thread_ =
-      std::thread(&HD6301Thing::emulator_loop, hd6301_thing.get());
+  if (options.emulator_thread) {
+    hd6301_thing->emulator_thread_ =
+        std::thread(&HD6301Thing::emulator_loop, hd6301_thing.get());
+  }
 
   return hd6301_thing;
 }
@@ -156,97 +261,400 @@ absl::StatusOr<std::unique_ptr<HD6301Thing>> HD6301Thing::create(
 void HD6301Thing::load_rom(uint16_t address, std::span<uint8_t> data) {
   absl::MutexLock lock(&emulator_mutex_);
   rom_->load(address, data);
+  published_rom_.store_bytes(
+      std::span<const uint8_t, kRomSize>(rom_->data().data(), kRomSize));
 }
 
-void HD6301Thing::load_sd_image(
-    std::unique_ptr<std::basic_iostream<char>> image) {
+void HD6301Thing::load_sd_image(std::unique_ptr<SDCardImage> image) {
   absl::MutexLock lock(&emulator_mutex_);
   sd_card_spi_->set_image(std::move(image));
 }
 
+absl::Status HD6301Thing::play_midi_file(std::string_view path) {
+  auto events = read_midi_file(path);
+  if (!events.ok()) {
+    return events.status();
+  }
+  absl::MutexLock lock(&emulator_mutex_);
+  if (replaying_) {
+    return absl::FailedPreconditionError(
+        "Can't play a MIDI file while replaying inputs");
+  }
+  midi_file_events_ = std::move(events.value());
+  next_midi_file_event_ = 0;
+  midi_file_start_cycle_ = cpu_->cycle_count();
+  return absl::OkStatus();
+}
+
 void HD6301Thing::handle_keyboard_event(SDL_KeyboardEvent event) {
-  switch (KeyboardType(keyboard_type_)) {
-    case kKeyboard6301:
-      if (keyboard_6301_) {
-        keyboard_6301_->handle_keyboard_event(event);
-      }
-      break;
-    case kKeyboard65C22:
-      if (w65c22_to_spi_glue_) {
-        w65c22_to_spi_glue_->handle_keyboard_event(event);
-      }
-      break;
+  if (!keyboard_events_.push(event)) {
+    LOG_EVERY_N_SEC(WARNING, 1) << "Keyboard event queue full, dropping event";
   }
 }
 
+void HD6301Thing::start_recording_inputs() {
+  absl::MutexLock lock(&emulator_mutex_);
+  recording_inputs_ = true;
+  recorded_inputs_.clear();
+}
+
+std::vector<InputEvent> HD6301Thing::take_recorded_inputs() {
+  absl::MutexLock lock(&emulator_mutex_);
+  return std::exchange(recorded_inputs_, {});
+}
+
 bool HD6301Thing::is_cpu_running() const { return cpu_running_; }
 
+void HD6301Thing::set_speed(double speed) {
+  speed_.store(speed, std::memory_order_relaxed);
+  absl::MutexLock lock(&emulator_mutex_);
+  sound_opl3_->set_speed(speed);
+#ifdef HAVE_MIDI
+  if (midi_to_serial_) {
+    midi_to_serial_->set_speed(speed);
+  }
+#endif
+}
+
+double HD6301Thing::speed() const {
+  return speed_.load(std::memory_order_relaxed);
+}
+
 void HD6301Thing::run() { cpu_running_ = true; }
 
 void HD6301Thing::stop() { cpu_running_ = false; }
 
 void HD6301Thing::tick(int ticks, bool ignore_breakpoint) {
   absl::MutexLock lock(&emulator_mutex_);
-  cpu_->tick(ticks, ignore_breakpoint);
+  run_cycles(ticks, ignore_breakpoint);
 }
 
-Cpu6301::CpuState HD6301Thing::get_cpu_state() {
+absl::StatusOr<DebugPort::Result> HD6301Thing::run_until_exit(
+    uint64_t max_cycles) {
+  // Short enough that not much runs past the exit, long enough that the
+  // per-slice work doesn't matter.
+  constexpr uint64_t kSliceCycles = 10000;
+
+  if (emulator_thread_.joinable()) {
+    return absl::FailedPreconditionError(
+        "Can't run until exit next to the emulator thread");
+  }
   absl::MutexLock lock(&emulator_mutex_);
-  return cpu_->get_state();
+  if (debug_port_ == nullptr) {
+    return absl::FailedPreconditionError("There is no debug port");
+  }
+  while (!debug_port_->exited() && cpu_->cycle_count() < max_cycles) {
+    const uint64_t cycles =
+        std::min(kSliceCycles, max_cycles - cpu_->cycle_count());
+    run_cycles(static_cast<int>(cycles), /*ignore_breakpoint=*/true);
+  }
+  return debug_port_->result();
+}
+
+uint64_t HD6301Thing::cycle_count() const {
+  return published_cycle_count_.load(std::memory_order_relaxed);
+}
+
+HD6301Thing::MachineState HD6301Thing::machine_state() const {
+  return published_state_.load();
+}
+
+Cpu6301::CpuState HD6301Thing::get_cpu_state() const {
+  return machine_state().cpu;
 }
 
 void HD6301Thing::set_breakpoint(uint16_t address) {
   absl::MutexLock lock(&emulator_mutex_);
   cpu_->set_breakpoint(address);
+  publish_state();
 }
 
 void HD6301Thing::clear_breakpoint() {
   absl::MutexLock lock(&emulator_mutex_);
   cpu_->clear_breakpoint();
+  publish_state();
 }
 
 void HD6301Thing::reset() {
   absl::MutexLock lock(&emulator_mutex_);
   cpu_->reset();
+  publish_state();
 }
 
-std::string HD6301Thing::get_ram_hexdump() {
-  absl::MutexLock lock(&emulator_mutex_);
-  return ram_->hexdump();
+std::string HD6301Thing::get_ram_hexdump() const {
+  ram_wanted_.store(true, std::memory_order_relaxed);
+  return hexdump(published_ram_.load(), kRamStart);
+}
+
+std::vector<uint8_t> HD6301Thing::get_ram() const {
+  ram_wanted_.store(true, std::memory_order_relaxed);
+  const auto ram = published_ram_.load();
+  return std::vector<uint8_t>(ram.begin(), ram.end());
+}
+
+std::vector<uint8_t> HD6301Thing::get_memory() const {
+  registers_wanted_.store(true, std::memory_order_relaxed);
+  ram_wanted_.store(true, std::memory_order_relaxed);
+  std::vector<uint8_t> memory(0x10000);
+  const auto registers = published_registers_.load();
+  const auto ram = published_ram_.load();
+  const auto rom = published_rom_.load();
+  std::copy_n(registers.begin(), kRamStart, memory.begin());
+  std::copy(ram.begin(), ram.end(), memory.begin() + kRamStart);
+  std::copy(registers.begin() + kRamStart, registers.end(),
+            memory.begin() + kIoStart);
+  std::copy(rom.begin(), rom.end(), memory.begin() + kRomStart);
+  return memory;
 }
 
 absl::Status HD6301Thing::render_graphics(SDL_Renderer* renderer,
                                           SDL_FRect* destination_rect) {
-  absl::MutexLock lock(&emulator_mutex_);
+  const auto now = std::chrono::steady_clock::now();
+  if (last_render_time_.has_value()) {
+    telemetry_.record_frame(now - *last_render_time_);
+  }
+  last_render_time_ = now;
   return graphics_->render(renderer, destination_rect);
 }
 
-HD6301Thing::HD6301Thing(int ticks_per_second, KeyboardType keyboard_type)
-    : keyboard_type_(keyboard_type), ticks_per_ms_(ticks_per_second / 1000) {}
+namespace {
+
+// The number of cycles in a slice of about 'slice' length.
+int cycles_per_slice(int ticks_per_second, std::chrono::nanoseconds slice) {
+  return std::max<int64_t>(1, int64_t{ticks_per_second} * slice.count() /
+                                  1'000'000'000);
+}
+
+// Rounds the slice to a whole number of cycles, so that the emulated clock
+// doesn't drift against the wall clock.
+Pacer::Options exact_slice(Pacer::Options pacing, int ticks_per_second) {
+  pacing.slice = std::chrono::nanoseconds(
+      int64_t{cycles_per_slice(ticks_per_second, pacing.slice)} *
+      1'000'000'000 / ticks_per_second);
+  return pacing;
+}
+
+}  // namespace
+
+HD6301Thing::HD6301Thing(const Options& options)
+    : keyboard_type_(options.keyboard_type),
+      ticks_per_second_(options.ticks_per_second),
+      realtime_priority_(options.realtime_priority),
+      cpu_affinity_(options.cpu_affinity),
+      speed_(options.speed),
+      ticks_per_slice_(
+          cycles_per_slice(options.ticks_per_second, options.pacing.slice)),
+      pacer_(exact_slice(options.pacing, options.ticks_per_second)) {
+  pacer_.set_speed(options.speed);
+}
+
+Cpu6301::TickResult HD6301Thing::run_cycles(int cycles,
+                                             bool ignore_breakpoint) {
+  Cpu6301::TickResult result;
+  while (result.cycles_run < cycles) {
+    deliver_inputs();
+    int slice = cycles - result.cycles_run;
+    // End the slice at the next replayed key event, so that it's delivered at
+    // exactly the cycle it was recorded at.
+    if (next_replay_key_ < replay_keys_.size()) {
+      slice = std::min<uint64_t>(
+          slice, replay_keys_[next_replay_key_].cycle - cpu_->cycle_count());
+    }
+    auto slice_result = cpu_->tick(slice, ignore_breakpoint);
+    result.cycles_run += slice_result.cycles_run;
+    if (slice_result.breakpoint_hit) {
+      result.breakpoint_hit = true;
+      break;
+    }
+  }
+  after_tick();
+  return result;
+}
+
+void HD6301Thing::deliver_inputs() {
+  const uint64_t cycle = cpu_->cycle_count();
+  while (const SDL_KeyboardEvent* event = keyboard_events_.front()) {
+    // A replay only gets the recorded key events.
+    if (!replaying_) {
+      deliver_keyboard_event(*event);
+    }
+    keyboard_events_.pop();
+  }
+  while (next_replay_key_ < replay_keys_.size() &&
+         replay_keys_[next_replay_key_].cycle <= cycle) {
+    const InputEvent& input = replay_keys_[next_replay_key_];
+    if (input.cycle != cycle) {
+      LOG_EVERY_N_SEC(WARNING, 1)
+          << "Replay diverged: key event recorded at cycle " << input.cycle
+          << " delivered at cycle " << cycle;
+    }
+    SDL_KeyboardEvent event = {};
+    event.type = input.type == InputEvent::Type::kKeyDown ? SDL_EVENT_KEY_DOWN
+                                                          : SDL_EVENT_KEY_UP;
+    event.scancode = static_cast<SDL_Scancode>(input.value);
+    deliver_keyboard_event(event);
+    ++next_replay_key_;
+  }
+  // Received bytes are queued two slices ahead, and the devices pick them up at
+  // their exact cycle.
+  const uint64_t horizon = cycle + 2 * ticks_per_slice_;
+  while (next_replay_byte_ < replay_bytes_.size() &&
+         replay_bytes_[next_replay_byte_].cycle <= horizon) {
+    const InputEvent& input = replay_bytes_[next_replay_byte_];
+    const uint8_t data = input.value;
+    const bool queued =
+        input.type == InputEvent::Type::kSerial
+            ? cpu_->get_serial()->inject(std::span(&data, 1), input.cycle)
+            : tl16c2550_->inject(std::span(&data, 1), input.cycle);
+    if (!queued) {
+      // Try again after the next slice.
+      break;
+    }
+    ++next_replay_byte_;
+  }
+}
+
+void HD6301Thing::deliver_keyboard_event(SDL_KeyboardEvent event) {
+  record_input(event.type == SDL_EVENT_KEY_DOWN ? InputEvent::Type::kKeyDown
+                                                : InputEvent::Type::kKeyUp,
+               event.scancode);
+  switch (KeyboardType(keyboard_type_)) {
+    case kKeyboard6301:
+      if (keyboard_6301_) {
+        keyboard_6301_->handle_keyboard_event(event);
+      }
+      break;
+    case kKeyboard65C22:
+      if (w65c22_to_spi_glue_) {
+        w65c22_to_spi_glue_->handle_keyboard_event(event);
+      }
+      break;
+  }
+}
+
+void HD6301Thing::record_input(InputEvent::Type type, uint32_t value) {
+  if (recording_inputs_) {
+    recorded_inputs_.push_back(
+        {.cycle = cpu_->cycle_count(), .type = type, .value = value});
+  }
+}
+
+void HD6301Thing::after_tick() {
+  const uint64_t cycle_count = cpu_->cycle_count();
+  sound_opl3_->advance_to(cycle_count);
+  published_cycle_count_.store(cycle_count, std::memory_order_relaxed);
+  publish_state();
+  feed_midi_file();
+}
+
+void HD6301Thing::publish_state() {
+  published_state_.store(
+      {.cpu = cpu_->get_state(), .cycle_count = cpu_->cycle_count()});
+  if (ram_wanted_.exchange(false, std::memory_order_relaxed) ||
+      !emulator_thread_.joinable()) {
+    published_ram_.store_bytes(
+        std::span<const uint8_t, kRamSize>(ram_->data().data(), kRamSize));
+  }
+  if (registers_wanted_.exchange(false, std::memory_order_relaxed)) {
+    std::array<uint8_t, kRamStart + kRomStart - kIoStart> registers;
+    for (uint16_t i = 0; i < kRamStart; ++i) {
+      registers[i] = address_space_.peek(i);
+    }
+    for (uint16_t address = kIoStart; address < kRomStart; ++address) {
+      registers[kRamStart + address - kIoStart] = address_space_.peek(address);
+    }
+    published_registers_.store(registers);
+  }
+}
+
+void HD6301Thing::feed_midi_file() {
+  // Two slices ahead, so that events due early in the next slice are already
+  // queued when it starts.
+  const uint64_t horizon = cpu_->cycle_count() + 2 * ticks_per_slice_;
+  while (next_midi_file_event_ < midi_file_events_.size()) {
+    const MidiEvent& event = midi_file_events_[next_midi_file_event_];
+    const uint64_t cycle =
+        midi_file_start_cycle_ +
+        static_cast<uint64_t>(std::llround(event.seconds * ticks_per_second_));
+    if (cycle > horizon) {
+      break;
+    }
+    if (!tl16c2550_->inject(event.data, cycle)) {
+      // The UART queue is full, try again after the next slice.
+      break;
+    }
+    ++next_midi_file_event_;
+  }
+}
 
 void HD6301Thing::emulator_loop() {
-  next_loop_time_ = std::chrono::steady_clock::now();
+  if (realtime_priority_ > 0) {
+    auto status = set_realtime_priority(realtime_priority_);
+    if (!status.ok()) {
+      LOG(WARNING) << status;
+    }
+  }
+  if (cpu_affinity_ >= 0) {
+    auto status = set_cpu_affinity(cpu_affinity_);
+    if (!status.ok()) {
+      LOG(WARNING) << status;
+    }
+  }
+
+  pacer_.start(std::chrono::steady_clock::now());
   while (emulator_running_) {
+    const auto slice_start = std::chrono::steady_clock::now();
+    std::optional<Cpu6301::TickResult> result;
+    std::chrono::steady_clock::time_point run_start;
     if (cpu_running_) {
       absl::MutexLock lock(&emulator_mutex_);
-      auto result = cpu_->tick(ticks_per_ms_ - extra_ticks_);
-      extra_ticks_ = result.cycles_run - ticks_per_ms_;
-      if (result.breakpoint_hit) {
+      run_start = std::chrono::steady_clock::now();
+      result = run_cycles(ticks_per_slice_ - extra_ticks_);
+      extra_ticks_ = result->cycles_run - ticks_per_slice_;
+      if (result->breakpoint_hit) {
         cpu_running_ = false;
       }
+    } else if (keyboard_events_.front() != nullptr ||
+               registers_wanted_.load(std::memory_order_relaxed) ||
+               ram_wanted_.load(std::memory_order_relaxed)) {
+      absl::MutexLock lock(&emulator_mutex_);
+      deliver_inputs();
+      // Device registers can still change while the CPU is stopped, e.g. the
+      // UARTs receiving data, and RAM may not have been published yet.
+      publish_state();
+    }
+    const auto slice_end = std::chrono::steady_clock::now();
+    const double speed = speed_.load(std::memory_order_relaxed);
+    if (speed != pacer_.speed()) {
+      // Start over at the new pace rather than make up for the old one.
+      pacer_.set_speed(speed);
+      pacer_.start(slice_end);
+    }
+    Pacer::Clock::time_point next_slice;
+    if (result.has_value()) {
+      next_slice = pacer_.next(slice_start, slice_end);
+      telemetry_.record_slice(result->cycles_run, extra_ticks_,
+                              slice_end - run_start, run_start - slice_start,
+                              pacer_.behind(slice_end), pacer_.slice());
+    } else {
+      // There's nothing to pace while the CPU is stopped. Wait one nominal
+      // slice whatever the speed, so unlimited speed doesn't spin a core, and
+      // restart the schedule so there's no lag to catch up on later.
+      next_slice = slice_end + pacer_.options().slice;
+      pacer_.start(next_slice);
     }
-    next_loop_time_ += std::chrono::milliseconds(1);
     // Warn if the emulator can't keep up with real time.
-    if (next_loop_time_ <
-        std::chrono::steady_clock::now() - std::chrono::milliseconds(100)) {
+    if (pacer_.behind(slice_end) > std::chrono::milliseconds(100)) {
       LOG_EVERY_N_SEC(ERROR, 1)
           << "Emulator is running behind real time by "
           << std::chrono::duration_cast<std::chrono::milliseconds>(
-                 std::chrono::steady_clock::now() - next_loop_time_)
+                 pacer_.behind(slice_end))
                  .count()
           << "ms";
     }
-    std::this_thread::sleep_until(next_loop_time_);
+    // A CPU sleeping in WAI or SLP gets through its slice in a few device
+    // skips, so the thread spends nearly all of the slice here.
+    pacer_.wait_until(next_slice);
   }
 }
 
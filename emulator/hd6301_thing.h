@@ -1,24 +1,39 @@
 #ifndef EIGHT_BIT_HD6301_THING_H
 #define EIGHT_BIT_HD6301_THING_H
 
+#include <array>
+#include <atomic>
 #include <chrono>
-#include <iostream>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <span>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "address_space.h"
 #include "cpu6301.h"
+#include "debug_port.h"
 #include "graphics.h"
+#include "input_log.h"
+#include "io_reactor.h"
+#include "loop_telemetry.h"
+#include "midi_file.h"
+#include "pacer.h"
 #include "ps2_keyboard_6301.h"
 #include "ram.h"
 #include "rom.h"
+#include "sd_card_image.h"
 #include "sd_card_spi.h"
+#include "seqlock.h"
 #include "sound_opl3.h"
 #include "spi.h"
+#include "spsc_queue.h"
 #include "tl16c2550.h"
 #include "w65c22.h"
 #include "w65c22_to_spi_glue.h"
@@ -40,40 +55,157 @@ class HD6301Thing {
     kKeyboard65C22,
   };
 
+  // RAM covers kRamStart up to the I/O area at 0x7f00.
+  static constexpr uint16_t kRamStart = 0x0020;
+  static constexpr uint16_t kRamSize = 0x7f00 - kRamStart;
+  // Device registers live between RAM and ROM.
+  static constexpr uint16_t kIoStart = 0x7f00;
+  static constexpr uint16_t kRomStart = 0x8000;
+  static constexpr uint16_t kRomSize = 0x8000;
+  // Runs the emulator thread as fast as it can go.
+  static constexpr double kUnlimitedSpeed =
+      std::numeric_limits<double>::infinity();
+
+  struct Options {
+    int ticks_per_second = 1000000;
+    KeyboardType keyboard_type = kKeyboard65C22;
+    // With replay inputs, the machine gets exactly those inputs at their
+    // recorded cycles, and ignores the keyboard, the PTYs and MIDI.
+    std::optional<std::vector<InputEvent>> replay_inputs;
+
+    // Host resources. A machine without any of them is self-contained, and
+    // any number of them can run side by side.
+    //
+    // Opens PTYs for the CPU serial port and the UART.
+    bool open_ptys = true;
+    SoundOPL3::Output audio_output = SoundOPL3::Output::kRealTime;
+    // Opens a virtual MIDI input port, if built with MIDI support.
+    bool midi_input = true;
+    // Runs the emulation on its own thread, paced to real time. Without it, the
+    // machine only runs inside tick().
+    bool emulator_thread = true;
+    // How the emulator thread keeps to real time. The slice is rounded to a
+    // whole number of cycles.
+    Pacer::Options pacing;
+    // SCHED_FIFO priority for the emulator thread, 0 to leave it alone.
+    int realtime_priority = 0;
+    // CPU to pin the emulator thread to, -1 to let it float.
+    int cpu_affinity = -1;
+    // How many times faster than real time the emulator thread runs, see
+    // set_speed().
+    double speed = 1.0;
+    // What real-time audio does when the speed isn't 1.
+    SoundOPL3::SpeedAudio speed_audio = SoundOPL3::SpeedAudio::kKeepPitch;
+
+    // Adds the emulator-only DebugPort at 0x7f00, for firmware tests.
+    bool debug_port = false;
+  };
+
+  // The state of the machine as of the end of a slice of emulation.
+  struct MachineState {
+    Cpu6301::CpuState cpu;
+    uint64_t cycle_count;
+  };
+
   static absl::StatusOr<std::unique_ptr<HD6301Thing>> create(
-      int ticks_per_second, KeyboardType keyboard_type);
+      Options options);
 
   void load_rom(uint16_t address, std::span<uint8_t> data);
-  void load_sd_image(std::unique_ptr<std::basic_iostream<char>> image);
+  void load_sd_image(std::unique_ptr<SDCardImage> image);
+  // Plays the Standard MIDI File at 'path' into the UART's receive path, timed
+  // in emulated cycles starting now. Replaces any file that's still playing.
+  absl::Status play_midi_file(std::string_view path);
+  // The event reaches the emulated keyboard at the start of the next slice of
+  // emulation, so that it lands on a well-defined cycle. Call it from one
+  // thread only.
   void handle_keyboard_event(SDL_KeyboardEvent event);
+  // Starts recording every keyboard event and every byte received by the
+  // serial port and the UART, stamped with the cycle it arrived at. Call before
+  // run() to capture a whole run.
+  void start_recording_inputs();
+  // Returns and clears what has been recorded so far.
+  std::vector<InputEvent> take_recorded_inputs();
   bool is_cpu_running() const;
+  // Runs the emulator thread at 'speed' times real time, or as fast as possible
+  // with kUnlimitedSpeed. Cycle-timed devices like the serial ports keep their
+  // timing in emulated cycles, so they scale along. MIDI input is rescaled to
+  // keep its real time spacing, and audio follows Options::speed_audio.
+  void set_speed(double speed);
+  double speed() const;
   void run();
   void stop();
   void tick(int ticks, bool ignore_breakpoint = false);
-  Cpu6301::CpuState get_cpu_state();
+  // Runs on the calling thread, as fast as possible, until the firmware exits
+  // through the debug port or 'max_cycles' cycles have run. Breakpoints are
+  // ignored. Needs Options::debug_port and no emulator thread.
+  absl::StatusOr<DebugPort::Result> run_until_exit(uint64_t max_cycles);
+  // The number of cycles run so far, as of the end of the last slice.
+  uint64_t cycle_count() const;
+
+  // The state getters below read what the emulator publishes at the end of
+  // every slice, and never wait for the emulator. They're safe to call from
+  // any thread, and up to date as of the end of the last slice.
+  MachineState machine_state() const;
+  Cpu6301::CpuState get_cpu_state() const;
+  // RAM is only published by the emulator thread while someone asks for it, so
+  // the first of these calls after a while can return RAM from an older slice.
+  std::string get_ram_hexdump() const;
+  // A copy of RAM, which starts at kRamStart.
+  std::vector<uint8_t> get_ram() const;
+  // A copy of the whole 64k address space, indexed by address. CPU and device
+  // registers are read without side effects, and only published while someone
+  // asks for them, so they can be a slice older than the rest.
+  std::vector<uint8_t> get_memory() const;
+
   void set_breakpoint(uint16_t address);
   void clear_breakpoint();
   void reset();
-  std::string get_ram_hexdump();
+  // Doesn't wait for the emulator either, as the graphics have their own lock.
+  // Also counts as a frame for the telemetry, so call it from one thread only.
   absl::Status render_graphics(SDL_Renderer* renderer,
                                SDL_FRect* destination_rect = nullptr);
+  // Timing of the emulator loop and of rendering. Thread safe.
+  const LoopTelemetry& telemetry() const { return telemetry_; }
 
  private:
-  HD6301Thing(int ticks_per_second, KeyboardType keyboard_type);
+  explicit HD6301Thing(const Options& options);
 
   void emulator_loop();
+  // Runs the CPU for 'cycles' cycles, delivering inputs on the way.
+  Cpu6301::TickResult run_cycles(int cycles, bool ignore_breakpoint = false)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(emulator_mutex_);
+  // Delivers pending keyboard events, and replayed inputs that are due.
+  void deliver_inputs() ABSL_EXCLUSIVE_LOCKS_REQUIRED(emulator_mutex_);
+  void deliver_keyboard_event(SDL_KeyboardEvent event)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(emulator_mutex_);
+  void record_input(InputEvent::Type type, uint32_t value)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(emulator_mutex_);
+  // Called after every slice of emulation.
+  void after_tick() ABSL_EXCLUSIVE_LOCKS_REQUIRED(emulator_mutex_);
+  // Makes the current state visible to the getters.
+  void publish_state() ABSL_EXCLUSIVE_LOCKS_REQUIRED(emulator_mutex_);
+  // Injects the MIDI file events that come due before the end of the next
+  // slice.
+  void feed_midi_file() ABSL_EXCLUSIVE_LOCKS_REQUIRED(emulator_mutex_);
 
   // Which kind of keyboard connection to emulate.
   const KeyboardType keyboard_type_;
+  const int ticks_per_second_;
+  const int realtime_priority_;
+  const int cpu_affinity_;
 
   // Protects access to the emulator state for parts that aren't already
   // thread-safe.
   absl::Mutex emulator_mutex_;
 
+  // Thread safe. Reads the host side of all PTYs, if there are any. Declared
+  // before the devices so that it outlives them.
+  std::unique_ptr<IoReactor> io_reactor_;
   AddressSpace address_space_ ABSL_GUARDED_BY(emulator_mutex_);
   std::unique_ptr<Rom> rom_ ABSL_GUARDED_BY(emulator_mutex_);
   std::unique_ptr<Ram> ram_ ABSL_GUARDED_BY(emulator_mutex_);
-  std::unique_ptr<Graphics> graphics_ ABSL_GUARDED_BY(emulator_mutex_);
+  // Thread safe, and never replaced after create().
+  std::unique_ptr<Graphics> graphics_;
   std::unique_ptr<Cpu6301> cpu_ ABSL_GUARDED_BY(emulator_mutex_);
   // Thread safe. For the responsiveness of the UI, we don't want to block
   // keycode handling on the emulator running a large number of cycles.
@@ -85,22 +217,63 @@ class HD6301Thing {
       ABSL_GUARDED_BY(emulator_mutex_);
   std::unique_ptr<SPI> spi_ ABSL_GUARDED_BY(emulator_mutex_);
   std::unique_ptr<SDCardSPI> sd_card_spi_ ABSL_GUARDED_BY(emulator_mutex_);
+  std::unique_ptr<DebugPort> debug_port_ ABSL_GUARDED_BY(emulator_mutex_);
 #ifdef HAVE_MIDI
   std::unique_ptr<MidiToSerial> midi_to_serial_
       ABSL_GUARDED_BY(emulator_mutex_);
 #endif
 
+  // Keyboard events waiting for the start of the next slice.
+  SpscQueue<SDL_KeyboardEvent, 256> keyboard_events_;
+
+  bool recording_inputs_ ABSL_GUARDED_BY(emulator_mutex_) = false;
+  std::vector<InputEvent> recorded_inputs_ ABSL_GUARDED_BY(emulator_mutex_);
+  // Inputs to replay, split so that received bytes can be queued ahead of time
+  // while key events are delivered between slices.
+  bool replaying_ ABSL_GUARDED_BY(emulator_mutex_) = false;
+  std::vector<InputEvent> replay_keys_ ABSL_GUARDED_BY(emulator_mutex_);
+  size_t next_replay_key_ ABSL_GUARDED_BY(emulator_mutex_) = 0;
+  std::vector<InputEvent> replay_bytes_ ABSL_GUARDED_BY(emulator_mutex_);
+  size_t next_replay_byte_ ABSL_GUARDED_BY(emulator_mutex_) = 0;
+
+  // The MIDI file being played, and the cycle it started at.
+  std::vector<MidiEvent> midi_file_events_ ABSL_GUARDED_BY(emulator_mutex_);
+  size_t next_midi_file_event_ ABSL_GUARDED_BY(emulator_mutex_) = 0;
+  uint64_t midi_file_start_cycle_ ABSL_GUARDED_BY(emulator_mutex_) = 0;
+
   // Locking the mutex to read these is expensive enough to show up on profiles.
   // These atomic booelans are significantly faster.
   std::atomic<bool> cpu_running_ = false;
   std::atomic<bool> emulator_running_ = true;
+  // Picked up by the emulator thread at the end of the next slice.
+  std::atomic<double> speed_;
+  // The CPU cycle count as of the end of the last slice, for threads that
+  // can't take the mutex just to know roughly where the emulation is.
+  std::atomic<uint64_t> published_cycle_count_ = 0;
+  // Written at the end of every slice, read by the UI.
+  Seqlock<MachineState> published_state_;
+  Seqlock<std::array<uint8_t, kRamSize>> published_ram_;
+  Seqlock<std::array<uint8_t, kRomSize>> published_rom_;
+  // The CPU's internal registers below kRamStart, followed by the device page
+  // at kIoStart. Reading them takes a lookup per byte, so they're only
+  // published when registers_wanted_ says someone's looking.
+  Seqlock<std::array<uint8_t, kRamStart + kRomStart - kIoStart>>
+      published_registers_;
+  mutable std::atomic<bool> registers_wanted_ = false;
+  // Same for RAM, which is a 32k copy. Without an emulator thread it's
+  // published after every tick(), for the caller to read right away.
+  mutable std::atomic<bool> ram_wanted_ = false;
+
+  LoopTelemetry telemetry_;
+  // Only touched by the thread calling render_graphics().
+  std::optional<std::chrono::steady_clock::time_point> last_render_time_;
 
   std::thread emulator_thread_;
   // variables used only in the emulator thread. Don't touch them outside as
   // they are not mutex-protected.
-  const int ticks_per_ms_ = 1000;
+  const int ticks_per_slice_;
   int extra_ticks_ = 0;
-  std::chrono::time_point<std::chrono::steady_clock> next_loop_time_;
+  Pacer pacer_;
 };
 
 }  // namespace eight_bit
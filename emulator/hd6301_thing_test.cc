@@ -0,0 +1,165 @@
+#include "hd6301_thing.h"
+
+#include <SDL3/SDL.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/log_severity.h"
+#include "absl/log/scoped_mock_log.h"
+#include "absl/status/status_matchers.h"
+#include "input_log.h"
+
+namespace eight_bit {
+namespace {
+
+using ::absl_testing::IsOk;
+using ::testing::_;
+using ::testing::HasSubstr;
+
+constexpr int kSliceCycles = 1000;
+constexpr int kSlices = 200;
+// Where the program below stores what it receives.
+constexpr uint16_t kBuffer = 0x1000;
+
+// Stores every keyboard byte and every UART byte it receives at kBuffer, each
+// followed by a free-running counter, so that RAM depends on the cycle each
+// input arrived at.
+const std::vector<uint8_t> kProgram = {
+    0x8e, 0x0e, 0xff,  // lds #$0eff
+    0x86, 0x04,        // ldaa #$04
+    0xb7, 0x7f, 0x23,  // staa $7f23  ; VIA DDRA
+    0xb7, 0x7f, 0x21,  // staa $7f21  ; VIA ORA, keyboard data on port B
+    0xce, 0x10, 0x00,  // ldx #kBuffer
+    0x7c, 0x0f, 0x00,  // loop: inc $0f00
+    0xb6, 0x7f, 0x2d,  // ldaa $7f2d  ; VIA IFR
+    0x84, 0x02,        // anda #$02   ; CA1, a keyboard byte is there
+    0x27, 0x08,        // beq uart
+    0xb6, 0x7f, 0x20,  // ldaa $7f20  ; VIA port B
+    0x8d, 0x11,        // bsr store
+    0xb6, 0x7f, 0x21,  // ldaa $7f21  ; clears CA1
+    0xb6, 0x7f, 0x45,  // uart: ldaa $7f45  ; UART LSR
+    0x84, 0x01,        // anda #$01   ; data ready
+    0x27, 0xe7,        // beq loop
+    0xb6, 0x7f, 0x40,  // ldaa $7f40  ; UART RBR
+    0x8d, 0x02,        // bsr store
+    0x20, 0xe0,        // bra loop
+    0xa7, 0x00,        // store: staa 0,x
+    0xf6, 0x0f, 0x00,  // ldab $0f00
+    0xe7, 0x01,        // stab 1,x
+    0x08,              // inx
+    0x08,              // inx
+    0x39,              // rts
+};
+
+// A MIDI file with a note on, and a note off 10 ticks (about 52ms) later.
+const std::vector<uint8_t> kMidiFile = {
+    'M',  'T',  'h',  'd',  0,    0,    0,    6,    0,    0,    0,
+    1,    0,    96,   'M',  'T',  'r',  'k',  0,    0,    0,    12,
+    0x00, 0x90, 0x3c, 0x40, 0x0a, 0x80, 0x3c, 0x00, 0x00, 0xff, 0x2f,
+    0x00,
+};
+
+std::unique_ptr<HD6301Thing> create_machine(
+    std::optional<std::vector<InputEvent>> replay_inputs) {
+  HD6301Thing::Options options;
+  options.replay_inputs = std::move(replay_inputs);
+  options.open_ptys = false;
+  options.audio_output = SoundOPL3::Output::kNone;
+  options.midi_input = false;
+  options.emulator_thread = false;
+  auto thing = HD6301Thing::create(std::move(options));
+  EXPECT_THAT(thing.status(), IsOk());
+  if (!thing.ok()) {
+    return nullptr;
+  }
+  std::vector<uint8_t> rom(HD6301Thing::kRomSize, 0xff);
+  std::copy(kProgram.begin(), kProgram.end(), rom.begin());
+  // Reset vector.
+  rom[rom.size() - 2] = HD6301Thing::kRomStart >> 8;
+  rom[rom.size() - 1] = HD6301Thing::kRomStart & 0xff;
+  (*thing)->load_rom(0, rom);
+  (*thing)->reset();
+  return std::move(thing.value());
+}
+
+SDL_KeyboardEvent key_event(SDL_EventType type, SDL_Scancode scancode) {
+  SDL_KeyboardEvent event = {};
+  event.type = type;
+  event.scancode = scancode;
+  return event;
+}
+
+// The bytes the program stored, without the counters.
+std::vector<uint8_t> received_bytes(const HD6301Thing& thing) {
+  const std::vector<uint8_t> ram = thing.get_ram();
+  std::vector<uint8_t> bytes;
+  for (uint16_t address = kBuffer; address < thing.get_cpu_state().x;
+       address += 2) {
+    bytes.push_back(ram[address - HD6301Thing::kRamStart]);
+  }
+  return bytes;
+}
+
+TEST(HD6301ThingTest, ReplayReproducesARecordedRun) {
+  const std::string midi_path = testing::TempDir() + "/replay_test.mid";
+  {
+    std::ofstream file(midi_path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(kMidiFile.data()),
+               kMidiFile.size());
+  }
+
+  auto recorder = create_machine(std::nullopt);
+  ASSERT_NE(recorder, nullptr);
+  recorder->start_recording_inputs();
+  ASSERT_THAT(recorder->play_midi_file(midi_path), IsOk());
+  for (int slice = 0; slice < kSlices; ++slice) {
+    if (slice == 20) {
+      recorder->handle_keyboard_event(
+          key_event(SDL_EVENT_KEY_DOWN, SDL_SCANCODE_A));
+    } else if (slice == 60) {
+      recorder->handle_keyboard_event(
+          key_event(SDL_EVENT_KEY_UP, SDL_SCANCODE_A));
+    }
+    recorder->tick(kSliceCycles);
+  }
+  const std::vector<InputEvent> inputs = recorder->take_recorded_inputs();
+  const auto has_type = [&inputs](InputEvent::Type type) {
+    return std::any_of(inputs.begin(), inputs.end(),
+                       [type](const InputEvent& e) { return e.type == type; });
+  };
+  EXPECT_TRUE(has_type(InputEvent::Type::kKeyDown));
+  EXPECT_TRUE(has_type(InputEvent::Type::kKeyUp));
+  EXPECT_TRUE(has_type(InputEvent::Type::kUart));
+  // The note on, the key down, the note off, and the key up.
+  EXPECT_EQ(received_bytes(*recorder),
+            (std::vector<uint8_t>{0x90, 0x3c, 0x40, 0x1c, 0x80, 0x3c, 0x00,
+                                  0xf0, 0x1c}));
+
+  absl::ScopedMockLog log(absl::MockLogDefault::kIgnoreUnexpected);
+  EXPECT_CALL(log, Log(_, _, HasSubstr("Replay diverged"))).Times(0);
+  log.StartCapturingLogs();
+
+  auto replayer = create_machine(inputs);
+  ASSERT_NE(replayer, nullptr);
+  replayer->start_recording_inputs();
+  for (int slice = 0; slice < kSlices; ++slice) {
+    replayer->tick(kSliceCycles);
+  }
+  EXPECT_EQ(replayer->cycle_count(), recorder->cycle_count());
+  EXPECT_EQ(replayer->get_cpu_state(), recorder->get_cpu_state());
+  EXPECT_EQ(replayer->get_ram(), recorder->get_ram());
+  // Every input reached the replaying machine at its recorded cycle.
+  EXPECT_EQ(replayer->take_recorded_inputs(), inputs);
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -1,94 +1,197 @@
 #include "hexdump.h"
 
 #include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <span>
 #include <string>
-#include <vector>
+#include <string_view>
 
-#include "absl/strings/str_cat.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace eight_bit {
+namespace {
 
-std::string hexdump(std::span<const uint8_t> data, unsigned int base_address) {
-  std::string output;
-  const int bytes_per_line = 16;
-
-  std::vector<uint8_t> prev_line(bytes_per_line, 0);
-  bool is_repeated = true;
-
-  // We want to have everything aligned at bytes_per_line boundaries. We may
-  // need to offset the data at the beginning of the first line due to
-  // non-aligned base_address.
-  int bytes_to_offset = base_address % bytes_per_line;
-
-  for (int i = 0; i < data.size(); i += bytes_per_line) {
-    // Check if the current line is repeated. The first condition makes sure
-    // that the first line is not marked as repeated, or the first two if we
-    // have an offset.
-    if (i >= bytes_per_line && i + bytes_per_line <= data.size() &&
-        std::equal(data.begin() + i, data.begin() + i + bytes_per_line,
-                   prev_line.begin())) {
-      if (!is_repeated) {
-        is_repeated = true;
-        absl::StrAppend(&output, "*\n");
-      }
-      continue;
-    }
-    is_repeated = false;
+constexpr size_t kBytesPerLine = 16;
 
-    // Copy current line to prev_line
-    if (i + bytes_per_line < data.size()) {
-      std::copy(data.begin() + i, data.begin() + i + bytes_per_line,
-                prev_line.begin());
-    }
+// A line is "00000000  ", 16 "xx " with an extra space after the 8th, " |",
+// up to 16 characters and "|\n".
+constexpr size_t kHexColumn = 10;
+constexpr size_t kAsciiColumn = kHexColumn + 3 * kBytesPerLine + 3;
+constexpr size_t kMaxLineLength = kAsciiColumn + kBytesPerLine + 2;
 
-    // The index into the data buffer and the 'logical' address that determines
-    // where we are in the hexdump can differ if the base_address is not 0.
-    int line_address = i + base_address - (i + base_address) % bytes_per_line;
-    absl::StrAppend(&output, absl::Hex(line_address, absl::kZeroPad8), "  ");
+// Lines are formatted into a buffer this many at a time before they're passed
+// on.
+constexpr size_t kBufferLines = 256;
 
-    for (size_t j = 0; j < bytes_per_line; ++j) {
-      if (j == 8) {
-        absl::StrAppend(&output, " ");
-      }
-      if (j >= bytes_to_offset && i + j - bytes_to_offset < data.size()) {
-        absl::StrAppend(
-            &output, absl::Hex(data[i + j - bytes_to_offset], absl::kZeroPad2),
-            " ");
-      } else {
-        absl::StrAppend(&output, "   ");
-      }
-    }
+constexpr char kHexDigits[] = "0123456789abcdef";
 
-    absl::StrAppend(&output, " |");
+// A full line with the address, hex and ASCII columns still blank.
+constexpr std::string_view kBlankLine =
+    "                                                            "
+    "|                |\n";
+static_assert(kBlankLine.size() == kMaxLineLength);
 
-    // Print bytes in ASCII format
-    for (size_t j = 0; j < bytes_per_line; ++j) {
-      if (j < bytes_to_offset) {
-        absl::StrAppend(&output, " ");
-        continue;
-      }
-      if (i + j - bytes_to_offset >= data.size()) {
-        break;
-      }
-      char d = data[i + j - bytes_to_offset];
-      if (d >= 32 && d <= 126) {
-        absl::string_view c(&d, 1);
-        absl::StrAppend(&output, c);
-      } else {
-        absl::StrAppend(&output, ".");
-      }
-    }
-    absl::StrAppend(&output, "|\n");
+constexpr size_t hex_column(size_t column) {
+  return kHexColumn + 3 * column + (column >= 8 ? 1 : 0);
+}
+
+void format_address(unsigned int address, char* out) {
+  for (int i = 7; i >= 0; --i) {
+    out[i] = kHexDigits[address & 0x0f];
+    address >>= 4;
+  }
+}
+
+// Fills in the hex and ASCII columns of a line from 16 bytes of data.
+#if defined(__SSE2__)
+void format_full_line(const uint8_t* bytes, char* out) {
+  const __m128i data =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+  const __m128i low_mask = _mm_set1_epi8(0x0f);
+  const auto to_hex = [](__m128i nibbles) {
+    // '0' + n, plus the distance from '9' + 1 to 'a' for n > 9.
+    const __m128i letters =
+        _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)),
+                      _mm_set1_epi8('a' - '9' - 1));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+  };
+  const __m128i high = to_hex(_mm_and_si128(_mm_srli_epi16(data, 4), low_mask));
+  const __m128i low = to_hex(_mm_and_si128(data, low_mask));
+  // SSE2 can't spread pairs out to every third byte, so the digit pairs get
+  // copied to their columns one by one.
+  std::array<char, 2 * kBytesPerLine> digits;
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(digits.data()),
+                   _mm_unpacklo_epi8(high, low));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(digits.data() + 16),
+                   _mm_unpackhi_epi8(high, low));
+  for (size_t i = 0; i < kBytesPerLine; ++i) {
+    std::memcpy(out + hex_column(i), digits.data() + 2 * i, 2);
+  }
+
+  // Signed compares, so bytes >= 0x80 are negative and not printable.
+  const __m128i printable =
+      _mm_and_si128(_mm_cmpgt_epi8(data, _mm_set1_epi8(0x1f)),
+                    _mm_cmplt_epi8(data, _mm_set1_epi8(0x7f)));
+  const __m128i ascii =
+      _mm_or_si128(_mm_and_si128(printable, data),
+                   _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + kAsciiColumn), ascii);
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+void format_full_line(const uint8_t* bytes, char* out) {
+  const uint8x16_t data = vld1q_u8(bytes);
+  const uint8x16_t digits =
+      vld1q_u8(reinterpret_cast<const uint8_t*>(kHexDigits));
+  const uint8x16_t high = vqtbl1q_u8(digits, vshrq_n_u8(data, 4));
+  const uint8x16_t low = vqtbl1q_u8(digits, vandq_u8(data, vdupq_n_u8(0x0f)));
+  // Interleaving with spaces writes "xx " for 8 bytes at a time.
+  const uint8x8_t spaces = vdup_n_u8(' ');
+  auto* hex = reinterpret_cast<uint8_t*>(out);
+  vst3_u8(hex + hex_column(0),
+          uint8x8x3_t{{vget_low_u8(high), vget_low_u8(low), spaces}});
+  vst3_u8(hex + hex_column(8),
+          uint8x8x3_t{{vget_high_u8(high), vget_high_u8(low), spaces}});
+
+  const uint8x16_t printable = vandq_u8(vcgeq_u8(data, vdupq_n_u8(0x20)),
+                                        vcleq_u8(data, vdupq_n_u8(0x7e)));
+  vst1q_u8(reinterpret_cast<uint8_t*>(out + kAsciiColumn),
+           vbslq_u8(printable, data, vdupq_n_u8('.')));
+}
+#endif
 
-    if (bytes_to_offset > 0) {
-      // We didn't print bytes_per_line many bytes, we need to skip fewer bytes
-      // for the next iteration.
-      i -= bytes_to_offset;
-      bytes_to_offset = 0;
+// Formats one line into 'out', which needs room for kMaxLineLength characters,
+// and returns its length. 'bytes' go into the columns starting at 'first', the
+// ones before are left blank.
+size_t format_line(unsigned int address, std::span<const uint8_t> bytes,
+                   size_t first, char* out) {
+  std::memcpy(out, kBlankLine.data(), kBlankLine.size());
+  format_address(address, out);
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+  if (bytes.size() == kBytesPerLine) {
+    format_full_line(bytes.data(), out);
+    return kMaxLineLength;
+  }
+#endif
+  for (size_t i = 0; i < bytes.size(); ++i) {
+    const uint8_t byte = bytes[i];
+    char* hex = out + hex_column(first + i);
+    hex[0] = kHexDigits[byte >> 4];
+    hex[1] = kHexDigits[byte & 0x0f];
+    out[kAsciiColumn + first + i] = byte >= 32 && byte <= 126 ? byte : '.';
+  }
+  // The ASCII column is only as wide as the data in it.
+  const size_t end = kAsciiColumn + first + bytes.size();
+  out[end] = '|';
+  out[end + 1] = '\n';
+  return end + 2;
+}
+
+// Formats 'data' into a fixed size buffer and calls 'sink' with the text each
+// time the buffer fills up, and once more at the end.
+template <typename Sink>
+void format_hexdump(std::span<const uint8_t> data, unsigned int base_address,
+                    Sink sink) {
+  std::array<char, kBufferLines * kMaxLineLength> buffer;
+  size_t used = 0;
+
+  // Lines are aligned at kBytesPerLine boundaries, so the first one may start
+  // with some blank columns.
+  size_t first_column = base_address % kBytesPerLine;
+  unsigned int address = base_address - first_column;
+  // The previous line if it was a full one. Full lines that repeat it are
+  // replaced by a single "*".
+  const uint8_t* previous = nullptr;
+  bool is_repeated = false;
+
+  for (size_t i = 0; i < data.size();) {
+    const auto line = data.subspan(
+        i, std::min(kBytesPerLine - first_column, data.size() - i));
+    if (used + kMaxLineLength > buffer.size()) {
+      sink(std::string_view(buffer.data(), used));
+      used = 0;
     }
+    if (line.size() == kBytesPerLine && previous != nullptr &&
+        std::memcmp(line.data(), previous, kBytesPerLine) == 0) {
+      if (!is_repeated) {
+        is_repeated = true;
+        buffer[used++] = '*';
+        buffer[used++] = '\n';
+      }
+    } else {
+      is_repeated = false;
+      used += format_line(address, line, first_column, buffer.data() + used);
+    }
+    previous = line.size() == kBytesPerLine ? line.data() : nullptr;
+    i += line.size();
+    address += kBytesPerLine;
+    first_column = 0;
+  }
+  if (used > 0) {
+    sink(std::string_view(buffer.data(), used));
   }
+}
+
+}  // namespace
+
+std::string hexdump(std::span<const uint8_t> data, unsigned int base_address) {
+  std::string output;
+  format_hexdump(data, base_address,
+                 [&output](std::string_view text) { output.append(text); });
   return output;
 }
 
-}  // namespace eight_bit
\ No newline at end of file
+void write_hexdump(std::ostream& output, std::span<const uint8_t> data,
+                   unsigned int base_address) {
+  format_hexdump(data, base_address, [&output](std::string_view text) {
+    output.write(text.data(), text.size());
+  });
+}
+
+}  // namespace eight_bit
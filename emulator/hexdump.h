@@ -2,6 +2,7 @@
 #define EIGHT_BIT_HEXDUMP_H
 
 #include <cstdint>
+#include <iosfwd>
 #include <span>
 #include <string>
 
@@ -12,6 +13,11 @@ namespace eight_bit {
 std::string hexdump(std::span<const uint8_t> data,
                     unsigned int base_address = 0);
 
+// Writes the same hexdump to 'output' as it's formatted, without building it
+// all up in memory first. Meant for dumping large images to a file or pipe.
+void write_hexdump(std::ostream& output, std::span<const uint8_t> data,
+                   unsigned int base_address = 0);
+
 }  // namespace eight_bit
 
 #endif  // EIGHT_BIT_HEXDUMP_H
\ No newline at end of file
@@ -2,6 +2,11 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
 namespace eight_bit {
 namespace {
 
@@ -123,5 +128,46 @@ TEST(HexdumpTest, OffsetRepeatedLinesAreNotReplacedByStar) {
             "|MNO|\n");
 }
 
+TEST(HexdumpTest, PrintableRangeEdges) {
+  std::vector<uint8_t> data(48);
+  for (int i = 0; i < data.size(); ++i) {
+    data[i] = 0x70 + i;
+  }
+
+  std::string result = hexdump(data, 0x70);
+  EXPECT_EQ(result,
+            "00000070  70 71 72 73 74 75 76 77  78 79 7a 7b 7c 7d 7e 7f  "
+            "|pqrstuvwxyz{|}~.|\n"
+            "00000080  80 81 82 83 84 85 86 87  88 89 8a 8b 8c 8d 8e 8f  "
+            "|................|\n"
+            "00000090  90 91 92 93 94 95 96 97  98 99 9a 9b 9c 9d 9e 9f  "
+            "|................|\n");
+  data.assign(16, 0);
+  for (int i = 0; i < data.size(); ++i) {
+    data[i] = 0x18 + i;
+  }
+  EXPECT_EQ(hexdump(data, 0x18),
+            "00000010                           18 19 1a 1b 1c 1d 1e 1f  "
+            "|        ........|\n"
+            "00000020  20 21 22 23 24 25 26 27                           "
+            "| !\"#$%&'|\n");
+}
+
+TEST(HexdumpTest, WriteHexdumpMatchesHexdump) {
+  // Large enough to go through the internal buffer several times, with some
+  // repeated stretches.
+  std::vector<uint8_t> data(100003);
+  uint32_t state = 1;
+  for (int i = 0; i < data.size(); ++i) {
+    state = state * 1103515245 + 12345;
+    data[i] = (i / 4096) % 2 == 0 ? state >> 24 : 0xaa;
+  }
+
+  std::ostringstream output;
+  write_hexdump(output, data, 0x1235);
+  EXPECT_EQ(output.str(), hexdump(data, 0x1235));
+  EXPECT_EQ(output.str().substr(0, 10), "00001230  ");
+}
+
 }  // namespace
 }  // namespace eight_bit
\ No newline at end of file
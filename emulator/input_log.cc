@@ -0,0 +1,121 @@
+#include "input_log.h"
+
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+
+namespace eight_bit {
+namespace {
+
+constexpr std::array<std::pair<InputEvent::Type, std::string_view>, 4>
+    kTypeNames = {{
+        {InputEvent::Type::kKeyDown, "key_down"},
+        {InputEvent::Type::kKeyUp, "key_up"},
+        {InputEvent::Type::kSerial, "serial"},
+        {InputEvent::Type::kUart, "uart"},
+    }};
+
+std::string_view type_name(InputEvent::Type type) {
+  for (const auto& [named_type, name] : kTypeNames) {
+    if (named_type == type) {
+      return name;
+    }
+  }
+  return "unknown";
+}
+
+template <typename T>
+bool parse_number(std::string_view text, T& value) {
+  const char* end = text.data() + text.size();
+  auto result = std::from_chars(text.data(), end, value);
+  return result.ec == std::errc() && result.ptr == end;
+}
+
+}  // namespace
+
+std::string format_input_log(std::span<const InputEvent> events) {
+  std::string text;
+  for (const InputEvent& event : events) {
+    absl::StrAppend(&text, event.cycle, " ", type_name(event.type), " ",
+                    event.value, "\n");
+  }
+  return text;
+}
+
+absl::StatusOr<std::vector<InputEvent>> parse_input_log(std::string_view text) {
+  std::vector<InputEvent> events;
+  std::istringstream stream{std::string(text)};
+  std::string line;
+  int line_number = 0;
+  while (std::getline(stream, line)) {
+    ++line_number;
+    std::istringstream line_stream(line);
+    std::vector<std::string> fields;
+    for (std::string field; line_stream >> field;) {
+      fields.push_back(std::move(field));
+    }
+    if (fields.empty() || fields[0].front() == '#') {
+      continue;
+    }
+    InputEvent event;
+    bool known_type = false;
+    if (fields.size() == 3) {
+      for (const auto& [type, name] : kTypeNames) {
+        if (fields[1] == name) {
+          event.type = type;
+          known_type = true;
+        }
+      }
+    }
+    if (!known_type || !parse_number(fields[0], event.cycle) ||
+        !parse_number(fields[2], event.value)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid input log line ", line_number, ": ", line));
+    }
+    if (!events.empty() && event.cycle < events.back().cycle) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Input log line ", line_number, " goes back in time: ", line));
+    }
+    events.push_back(event);
+  }
+  return events;
+}
+
+absl::Status write_input_log(std::string_view path,
+                             std::span<const InputEvent> events) {
+  std::ofstream file{std::string(path)};
+  if (!file.is_open()) {
+    return absl::InternalError(
+        absl::StrCat("Failed to open input log ", path, " for writing"));
+  }
+  file << format_input_log(events);
+  if (!file.good()) {
+    return absl::InternalError(
+        absl::StrCat("Failed to write input log ", path));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<InputEvent>> read_input_log(std::string_view path) {
+  std::ifstream file{std::string(path)};
+  if (!file.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to open input log ", path));
+  }
+  std::string text(std::istreambuf_iterator<char>(file), {});
+  return parse_input_log(text);
+}
+
+}  // namespace eight_bit
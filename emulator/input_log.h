@@ -0,0 +1,47 @@
+#ifndef EIGHT_BIT_INPUT_LOG_H
+#define EIGHT_BIT_INPUT_LOG_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace eight_bit {
+
+// An external input, stamped with the emulated cycle at which it reached the
+// emulated hardware.
+struct InputEvent {
+  enum class Type : uint8_t {
+    kKeyDown,
+    kKeyUp,
+    // A byte received by the CPU's serial port.
+    kSerial,
+    // A byte received by the TL16C2550 UART.
+    kUart,
+  };
+
+  uint64_t cycle = 0;
+  Type type = Type::kKeyDown;
+  // The SDL scancode for key events, the byte for everything else.
+  uint32_t value = 0;
+
+  bool operator==(const InputEvent&) const = default;
+};
+
+// Input logs are text files with one event per line, in the form
+// "<cycle> <type> <value>", e.g. "1234567 key_down 4". The types are key_down,
+// key_up, serial and uart. Empty lines and lines starting with '#' are ignored.
+std::string format_input_log(std::span<const InputEvent> events);
+absl::StatusOr<std::vector<InputEvent>> parse_input_log(std::string_view text);
+
+absl::Status write_input_log(std::string_view path,
+                             std::span<const InputEvent> events);
+absl::StatusOr<std::vector<InputEvent>> read_input_log(std::string_view path);
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_INPUT_LOG_H
@@ -0,0 +1,49 @@
+#include "input_log.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "absl/status/status_matchers.h"
+
+namespace eight_bit {
+namespace {
+
+using ::absl_testing::IsOk;
+
+TEST(InputLogTest, FormatsAndParsesBack) {
+  const std::vector<InputEvent> events = {
+      {.cycle = 0, .type = InputEvent::Type::kKeyDown, .value = 4},
+      {.cycle = 1000, .type = InputEvent::Type::kKeyUp, .value = 4},
+      {.cycle = 1000, .type = InputEvent::Type::kSerial, .value = 'a'},
+      {.cycle = 123456789012, .type = InputEvent::Type::kUart, .value = 0x90},
+  };
+  const std::string text = format_input_log(events);
+  EXPECT_EQ(text,
+            "0 key_down 4\n"
+            "1000 key_up 4\n"
+            "1000 serial 97\n"
+            "123456789012 uart 144\n");
+  auto parsed = parse_input_log(text);
+  ASSERT_THAT(parsed.status(), IsOk());
+  EXPECT_EQ(*parsed, events);
+}
+
+TEST(InputLogTest, SkipsCommentsAndEmptyLines) {
+  auto parsed = parse_input_log("# Recorded run\n\n  42 serial 13  \n");
+  ASSERT_THAT(parsed.status(), IsOk());
+  const InputEvent expected = {
+      .cycle = 42, .type = InputEvent::Type::kSerial, .value = 13};
+  EXPECT_EQ(*parsed, std::vector<InputEvent>{expected});
+}
+
+TEST(InputLogTest, RejectsInvalidLines) {
+  EXPECT_FALSE(parse_input_log("42 mouse 1\n").ok());
+  EXPECT_FALSE(parse_input_log("42 serial\n").ok());
+  EXPECT_FALSE(parse_input_log("-1 serial 13\n").ok());
+  // Events have to be in cycle order.
+  EXPECT_FALSE(parse_input_log("42 serial 13\n41 serial 10\n").ok());
+}
+
+}  // namespace
+}  // namespace eight_bit
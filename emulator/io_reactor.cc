@@ -0,0 +1,132 @@
+#include "io_reactor.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+
+namespace eight_bit {
+
+IoReactor::~IoReactor() {
+  if (thread_.joinable()) {
+    uint64_t value = 1;
+    ::write(shutdown_fd_, &value, sizeof(value));
+    thread_.join();
+  }
+  if (shutdown_fd_ != -1) {
+    close(shutdown_fd_);
+  }
+  if (epoll_fd_ != -1) {
+    close(epoll_fd_);
+  }
+}
+
+absl::StatusOr<std::unique_ptr<IoReactor>> IoReactor::create() {
+  std::unique_ptr<IoReactor> io_reactor(new IoReactor());
+  auto status = io_reactor->initialize();
+  if (!status.ok()) {
+    return status;
+  }
+  return io_reactor;
+}
+
+absl::Status IoReactor::add(int fd, std::function<bool()> on_readable) {
+  absl::MutexLock lock(&mutex_);
+  if (handlers_.contains(fd)) {
+    return absl::AlreadyExistsError(
+        absl::StrCat("fd ", fd, " is already watched"));
+  }
+  // One-shot, so that the fd is disarmed before its handler runs. That way a
+  // resume() while the handler is still running can't get lost.
+  struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                              .data = {.fd = fd}};
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+    return absl::InternalError(
+        absl::StrCat("Failed to watch fd ", fd, ": ", strerror(errno)));
+  }
+  handlers_[fd] = std::move(on_readable);
+  return absl::OkStatus();
+}
+
+void IoReactor::resume(int fd) {
+  struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                              .data = {.fd = fd}};
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == -1) {
+    LOG(ERROR) << "Failed to resume watching fd " << fd << ": "
+               << strerror(errno);
+  }
+}
+
+absl::Status IoReactor::remove(int fd) {
+  absl::MutexLock lock(&mutex_);
+  if (handlers_.erase(fd) == 0) {
+    return absl::NotFoundError(absl::StrCat("fd ", fd, " isn't watched"));
+  }
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr) == -1) {
+    return absl::InternalError(
+        absl::StrCat("Failed to stop watching fd ", fd, ": ", strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status IoReactor::initialize() {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ == -1) {
+    return absl::InternalError(
+        absl::StrCat("Failed to create epoll fd: ", strerror(errno)));
+  }
+  shutdown_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (shutdown_fd_ == -1) {
+    return absl::InternalError(
+        absl::StrCat("Failed to create eventfd: ", strerror(errno)));
+  }
+  struct epoll_event event = {.events = EPOLLIN, .data = {.fd = shutdown_fd_}};
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, shutdown_fd_, &event) == -1) {
+    return absl::InternalError(
+        absl::StrCat("Failed to watch eventfd: ", strerror(errno)));
+  }
+  thread_ = std::thread(&IoReactor::run, this);
+  return absl::OkStatus();
+}
+
+void IoReactor::run() {
+  std::array<struct epoll_event, 16> events;
+  while (true) {
+    int count = epoll_wait(epoll_fd_, events.data(), events.size(), -1);
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // Anything else won't go away by retrying.
+      LOG(ERROR) << "epoll_wait failed, stopping: " << strerror(errno);
+      return;
+    }
+    absl::MutexLock lock(&mutex_);
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == shutdown_fd_) {
+        return;
+      }
+      // The fd may have been removed after epoll_wait returned.
+      auto it = handlers_.find(fd);
+      if (it != handlers_.end() && it->second()) {
+        resume(fd);
+      }
+    }
+  }
+}
+
+}  // namespace eight_bit
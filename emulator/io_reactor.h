@@ -0,0 +1,62 @@
+#ifndef EIGHT_BIT_IO_REACTOR_H
+#define EIGHT_BIT_IO_REACTOR_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+
+namespace eight_bit {
+
+// Waits on the file descriptors of all host-facing devices on a single epoll
+// thread, and calls a device's handler on that thread when its fd becomes
+// readable. Handlers are expected to read everything that's available in as few
+// read() calls as possible and hand it to the emulator thread through a
+// lock-free queue.
+class IoReactor {
+ public:
+  IoReactor(const IoReactor&) = delete;
+  IoReactor& operator=(const IoReactor&) = delete;
+  ~IoReactor();
+
+  static absl::StatusOr<std::unique_ptr<IoReactor>> create();
+
+  // Calls 'on_readable' on the reactor thread whenever 'fd' has data to read or
+  // has been hung up. The fd is watched level-triggered, so a handler that
+  // leaves data behind gets called again. A handler that can't take any more
+  // data returns false, and 'fd' isn't watched again until resume(fd). That
+  // leaves the data in the kernel buffers, which pushes back on the writer.
+  absl::Status add(int fd, std::function<bool()> on_readable);
+
+  // Watches 'fd' again after its handler returned false. Safe to call from any
+  // thread.
+  void resume(int fd);
+
+  // Stops watching 'fd'. Once this returns, its handler isn't running and won't
+  // be called again. Must not be called from a handler.
+  absl::Status remove(int fd);
+
+ private:
+  IoReactor() = default;
+  absl::Status initialize();
+
+  void run();
+
+  int epoll_fd_ = -1;
+  // An eventfd used to stop the thread.
+  int shutdown_fd_ = -1;
+  std::thread thread_;
+
+  // Held while a handler runs.
+  absl::Mutex mutex_;
+  std::map<int, std::function<bool()>> handlers_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_IO_REACTOR_H
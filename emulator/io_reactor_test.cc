@@ -0,0 +1,118 @@
+#include "io_reactor.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status_matchers.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace eight_bit {
+namespace {
+
+using ::absl_testing::IsOk;
+
+class IoReactorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(pipe(pipe_fd_.data()), 0);
+    auto io_reactor = IoReactor::create();
+    ASSERT_THAT(io_reactor.status(), IsOk());
+    io_reactor_ = std::move(io_reactor.value());
+  }
+
+  void TearDown() override {
+    io_reactor_.reset();
+    close(pipe_fd_[0]);
+    close(pipe_fd_[1]);
+  }
+
+  // Reads everything available and returns 'keep_reading_'.
+  bool on_readable() {
+    std::array<char, 64> buffer;
+    absl::MutexLock lock(&mutex_);
+    ++calls_;
+    if (!keep_reading_) {
+      return false;
+    }
+    ssize_t count = ::read(pipe_fd_[0], buffer.data(), buffer.size());
+    if (count > 0) {
+      received_.append(buffer.data(), count);
+    }
+    return true;
+  }
+
+  void send(const std::string& data) {
+    ASSERT_EQ(::write(pipe_fd_[1], data.data(), data.size()), data.size());
+  }
+
+  // Waits until 'received_' has 'size' bytes, or gives up after a second.
+  bool wait_for_received(size_t size) {
+    absl::MutexLock lock(&mutex_);
+    auto received_enough = [this, size]() ABSL_NO_THREAD_SAFETY_ANALYSIS {
+      return received_.size() >= size;
+    };
+    return mutex_.AwaitWithTimeout(absl::Condition(&received_enough),
+                                   absl::Seconds(1));
+  }
+
+  std::array<int, 2> pipe_fd_;
+  std::unique_ptr<IoReactor> io_reactor_;
+  absl::Mutex mutex_;
+  int calls_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool keep_reading_ ABSL_GUARDED_BY(mutex_) = true;
+  std::string received_ ABSL_GUARDED_BY(mutex_);
+};
+
+TEST_F(IoReactorTest, CallsHandlerWhenReadable) {
+  ASSERT_THAT(io_reactor_->add(pipe_fd_[0], [this]() { return on_readable(); }),
+              IsOk());
+  send("hello");
+  ASSERT_TRUE(wait_for_received(5));
+  send(" world");
+  ASSERT_TRUE(wait_for_received(11));
+  absl::MutexLock lock(&mutex_);
+  EXPECT_EQ(received_, "hello world");
+}
+
+TEST_F(IoReactorTest, PausedFdIsOnlyWatchedAfterResume) {
+  {
+    absl::MutexLock lock(&mutex_);
+    keep_reading_ = false;
+  }
+  ASSERT_THAT(io_reactor_->add(pipe_fd_[0], [this]() { return on_readable(); }),
+              IsOk());
+  send("data");
+  absl::SleepFor(absl::Milliseconds(50));
+  {
+    absl::MutexLock lock(&mutex_);
+    // Called once, then no more even though the data is still there.
+    EXPECT_EQ(calls_, 1);
+    EXPECT_TRUE(received_.empty());
+    keep_reading_ = true;
+  }
+  io_reactor_->resume(pipe_fd_[0]);
+  ASSERT_TRUE(wait_for_received(4));
+  absl::MutexLock lock(&mutex_);
+  EXPECT_EQ(received_, "data");
+}
+
+TEST_F(IoReactorTest, RemovedFdIsNotWatched) {
+  ASSERT_THAT(io_reactor_->add(pipe_fd_[0], [this]() { return on_readable(); }),
+              IsOk());
+  EXPECT_FALSE(io_reactor_->add(pipe_fd_[0], []() { return true; }).ok());
+  ASSERT_THAT(io_reactor_->remove(pipe_fd_[0]), IsOk());
+  send("data");
+  absl::SleepFor(absl::Milliseconds(50));
+  absl::MutexLock lock(&mutex_);
+  EXPECT_EQ(calls_, 0);
+  EXPECT_FALSE(io_reactor_->remove(pipe_fd_[0]).ok());
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -15,24 +15,27 @@ uint8_t IOPort::read_input_register() {
   uint8_t read_data = input_register_;
   // Bits set as outputs are returned as the last written data.
   read_data |= output_register_ & data_direction_;
-  VLOG(4) << "Read from " << name_ << ": "
-          << absl::Hex(read_data, absl::kZeroPad2);
   return read_data;
 }
 
 uint8_t IOPort::read_output_register() { return output_register_; }
 
 void IOPort::write_output_register(uint8_t data) {
+  const uint8_t output = data & data_direction_;
+  if (data != output_register_) {
+    VLOG(4) << "Write to " << name_ << ": "
+            << absl::Hex(output, absl::kZeroPad2);
+  }
   output_register_ = data;
-  VLOG(4) << "Write to " << name_ << ": "
-          << absl::Hex(data & data_direction_, absl::kZeroPad2);
+  notify_listeners(output_listeners_, output);
   for (const auto& callback : output_change_callbacks_) {
-    callback(data & data_direction_);
+    callback(output);
   }
 }
 
 void IOPort::provide_inputs(uint8_t data, uint8_t mask) {
   input_register_ = (input_register_ & ~mask) | data;
+  notify_listeners(input_listeners_, input_register_);
   for (const auto& callback : input_change_callbacks_) {
     callback(input_register_);
   }
@@ -56,4 +59,14 @@ void IOPort::register_input_change_callback(
   input_change_callbacks_.push_back(callback);
 }
 
+void IOPort::notify_listeners(std::vector<Listener>& listeners, uint8_t data) {
+  for (auto& listener : listeners) {
+    const uint8_t masked_data = data & listener.mask;
+    if (masked_data != listener.last_data) {
+      listener.last_data = masked_data;
+      listener.notify(listener.listener, data);
+    }
+  }
+}
+
 }  // namespace eight_bit
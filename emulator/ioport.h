@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <vector>
 
 namespace eight_bit {
 
@@ -19,6 +20,10 @@ namespace eight_bit {
 // callback-driven API to either register for output pin changes, or to provide
 // data on-the-fly for input pins. There are also APIs to drive outputs (from
 // "inside" the chip) or inputs (from "outside" the chip).
+//
+// Listeners are a cheaper alternative to callbacks for the hot paths. They bind
+// a member function at compile time, and are only notified when one of the
+// pins they are interested in actually changed.
 class IOPort {
  public:
   typedef std::function<uint8_t()> input_read_callback;
@@ -59,8 +64,41 @@ class IOPort {
   // provide_inputs().
   void register_input_change_callback(const input_change_callback& callback);
 
+  // Registers `listener->*Method` to be called with the same data as output
+  // change callbacks, but only when a bit in `mask` differs from what the
+  // listener saw last. The first write always notifies. Example:
+  //   port->add_output_listener<&SPI::clk_data_in>(this, clk_mask_);
+  template <auto Method, typename T>
+  void add_output_listener(T* listener, uint8_t mask) {
+    output_listeners_.push_back({&notify<Method, T>, listener, mask});
+  }
+
+  // Like add_output_listener(), for changes made via provide_inputs().
+  template <auto Method, typename T>
+  void add_input_listener(T* listener, uint8_t mask) {
+    input_listeners_.push_back({&notify<Method, T>, listener, mask});
+  }
+
  private:
+  struct Listener {
+    void (*notify)(void* listener, uint8_t data);
+    void* listener;
+    uint8_t mask;
+    // The masked data passed on the last notification. Starts out of range so
+    // that the first change always notifies.
+    uint16_t last_data = 0x100;
+  };
+
+  template <auto Method, typename T>
+  static void notify(void* listener, uint8_t data) {
+    (static_cast<T*>(listener)->*Method)(data);
+  }
+
+  static void notify_listeners(std::vector<Listener>& listeners, uint8_t data);
+
   std::string name_;
+  std::vector<Listener> output_listeners_;
+  std::vector<Listener> input_listeners_;
   // Callbacks for event-driven reaction to changes.
   std::vector<output_change_callback> output_change_callbacks_;
   std::vector<input_change_callback> input_change_callbacks_;
@@ -0,0 +1,58 @@
+#include "ioport.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace eight_bit {
+namespace {
+
+class Recorder {
+ public:
+  void record(uint8_t data) { data_.push_back(data); }
+
+  std::vector<uint8_t> data_;
+};
+
+TEST(IOPortTest, OutputListenerOnlySeesMaskedChanges) {
+  IOPort port("Test");
+  port.write_data_direction_register(0x0f);
+  Recorder recorder;
+  port.add_output_listener<&Recorder::record>(&recorder, 0x01);
+
+  port.write_output_register(0x00);  // First write always notifies.
+  port.write_output_register(0x00);
+  port.write_output_register(0x02);  // Not in the listener mask.
+  port.write_output_register(0x03);
+  port.write_output_register(0x13);  // Not an output.
+  port.write_output_register(0x02);
+  EXPECT_EQ(recorder.data_, (std::vector<uint8_t>{0x00, 0x03, 0x02}));
+}
+
+TEST(IOPortTest, CallbacksSeeEveryWrite) {
+  IOPort port("Test");
+  port.write_data_direction_register(0xff);
+  Recorder recorder;
+  port.register_output_change_callback(
+      [&recorder](uint8_t data) { recorder.record(data); });
+
+  port.write_output_register(0x01);
+  port.write_output_register(0x01);
+  EXPECT_EQ(recorder.data_, (std::vector<uint8_t>{0x01, 0x01}));
+}
+
+TEST(IOPortTest, InputListenerOnlySeesMaskedChanges) {
+  IOPort port("Test");
+  Recorder recorder;
+  port.add_input_listener<&Recorder::record>(&recorder, 0x80);
+
+  port.provide_inputs(0x80, 0x80);
+  port.provide_inputs(0x01, 0x01);  // Not in the listener mask.
+  port.provide_inputs(0x00, 0x80);
+  port.provide_inputs(0x00, 0x80);
+  EXPECT_EQ(recorder.data_, (std::vector<uint8_t>{0x80, 0x01}));
+}
+
+}  // namespace
+}  // namespace eight_bit
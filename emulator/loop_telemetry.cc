@@ -0,0 +1,160 @@
+#include "loop_telemetry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+
+namespace eight_bit {
+namespace {
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+
+int bucket(nanoseconds duration) {
+  const auto us = duration_cast<microseconds>(duration).count();
+  if (us <= 0) {
+    return 0;
+  }
+  return std::min<int>(std::bit_width(static_cast<uint64_t>(us)),
+                       LoopTelemetry::kNumBuckets - 1);
+}
+
+// Keeps the larger value. Safe because each histogram has a single writer.
+template <typename T>
+void store_max(std::atomic<T>& max, T value) {
+  if (value > max.load(std::memory_order_relaxed)) {
+    max.store(value, std::memory_order_relaxed);
+  }
+}
+
+std::string format_histogram(std::string_view name,
+                             const LoopTelemetry::Histogram& previous,
+                             const LoopTelemetry::Histogram& current) {
+  LoopTelemetry::Histogram delta;
+  delta.count = current.count - previous.count;
+  delta.total = current.total - previous.total;
+  for (int i = 0; i < LoopTelemetry::kNumBuckets; ++i) {
+    delta.buckets[i] = current.buckets[i] - previous.buckets[i];
+  }
+  return absl::StrFormat(
+      " %s_mean_us=%.1f %s_p50_us=%d %s_p99_us=%d %s_max_us=%d", name,
+      delta.mean().count() / 1000.0, name, delta.quantile(0.5).count(), name,
+      delta.quantile(0.99).count(), name,
+      duration_cast<microseconds>(current.max).count());
+}
+
+}  // namespace
+
+microseconds LoopTelemetry::Histogram::quantile(double fraction) const {
+  if (count == 0) {
+    return microseconds(0);
+  }
+  const uint64_t target = std::max<uint64_t>(1, fraction * count);
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += buckets[i];
+    if (seen >= target) {
+      return microseconds(i == 0 ? 1 : uint64_t{1} << i);
+    }
+  }
+  return microseconds(uint64_t{1} << (kNumBuckets - 1));
+}
+
+nanoseconds LoopTelemetry::Histogram::mean() const {
+  return count == 0 ? nanoseconds(0) : total / static_cast<int64_t>(count);
+}
+
+void LoopTelemetry::record_slice(int cycles, int overshoot_cycles,
+                                 nanoseconds slice_time,
+                                 nanoseconds mutex_wait, nanoseconds lag,
+                                 nanoseconds slice_length) {
+  slices_.fetch_add(1, std::memory_order_relaxed);
+  cycles_.fetch_add(cycles, std::memory_order_relaxed);
+  if (lag > slice_length) {
+    late_slices_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (overshoot_cycles > 0) {
+    overshoot_cycles_.fetch_add(overshoot_cycles, std::memory_order_relaxed);
+    store_max(max_overshoot_cycles_, overshoot_cycles);
+  }
+  slice_time_.record(slice_time);
+  mutex_wait_.record(mutex_wait);
+  lag_.record(std::max(lag, nanoseconds(0)));
+}
+
+void LoopTelemetry::record_frame(nanoseconds frame_time) {
+  frame_time_.record(frame_time);
+}
+
+LoopTelemetry::Snapshot LoopTelemetry::snapshot() const {
+  return {.time = std::chrono::steady_clock::now(),
+          .wall_time = std::chrono::system_clock::now(),
+          .slices = slices_.load(std::memory_order_relaxed),
+          .cycles = cycles_.load(std::memory_order_relaxed),
+          .late_slices = late_slices_.load(std::memory_order_relaxed),
+          .overshoot_cycles = overshoot_cycles_.load(std::memory_order_relaxed),
+          .max_overshoot_cycles =
+              max_overshoot_cycles_.load(std::memory_order_relaxed),
+          .slice_time = slice_time_.load(),
+          .mutex_wait = mutex_wait_.load(),
+          .lag = lag_.load(),
+          .frame_time = frame_time_.load()};
+}
+
+double LoopTelemetry::cycles_per_ms(const Snapshot& previous,
+                                    const Snapshot& current) {
+  const auto elapsed =
+      duration_cast<microseconds>(current.time - previous.time).count();
+  if (elapsed <= 0) {
+    return 0;
+  }
+  return (current.cycles - previous.cycles) * 1000.0 / elapsed;
+}
+
+std::string LoopTelemetry::format(const Snapshot& previous,
+                                  const Snapshot& current) {
+  std::string line = absl::StrFormat(
+      "unix_time_ms=%d cycles_per_ms=%.1f slices=%d late_slices=%d "
+      "overshoot_cycles=%d max_overshoot_cycles=%d",
+      duration_cast<std::chrono::milliseconds>(
+          current.wall_time.time_since_epoch())
+          .count(),
+      cycles_per_ms(previous, current), current.slices - previous.slices,
+      current.late_slices - previous.late_slices,
+      current.overshoot_cycles - previous.overshoot_cycles,
+      current.max_overshoot_cycles);
+  absl::StrAppend(
+      &line, format_histogram("slice", previous.slice_time, current.slice_time),
+      format_histogram("mutex_wait", previous.mutex_wait, current.mutex_wait),
+      format_histogram("lag", previous.lag, current.lag),
+      format_histogram("frame", previous.frame_time, current.frame_time), "\n");
+  return line;
+}
+
+void LoopTelemetry::AtomicHistogram::record(nanoseconds duration) {
+  buckets_[bucket(duration)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  total_ns_.fetch_add(duration.count(), std::memory_order_relaxed);
+  store_max(max_ns_, static_cast<int64_t>(duration.count()));
+}
+
+LoopTelemetry::Histogram LoopTelemetry::AtomicHistogram::load() const {
+  Histogram histogram;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    histogram.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+  }
+  histogram.count = count_.load(std::memory_order_relaxed);
+  histogram.total = nanoseconds(total_ns_.load(std::memory_order_relaxed));
+  histogram.max = nanoseconds(max_ns_.load(std::memory_order_relaxed));
+  return histogram;
+}
+
+}  // namespace eight_bit
@@ -0,0 +1,107 @@
+#ifndef EIGHT_BIT_LOOP_TELEMETRY_H
+#define EIGHT_BIT_LOOP_TELEMETRY_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace eight_bit {
+
+// Timing statistics for the emulator loop, to see when and why it misses real
+// time. The emulator thread records one entry per slice and the UI thread one
+// per frame. Any thread can take a snapshot at any time. Recording is a few
+// relaxed atomic adds, so it's cheap enough to leave on.
+class LoopTelemetry {
+ public:
+  // Durations go into power of two buckets of microseconds: bucket 0 counts
+  // everything below 1us, bucket i counts [2^(i-1), 2^i)us and the last bucket
+  // everything from about 1s up.
+  static constexpr int kNumBuckets = 22;
+
+  struct Histogram {
+    std::array<uint64_t, kNumBuckets> buckets = {};
+    uint64_t count = 0;
+    std::chrono::nanoseconds total{0};
+    std::chrono::nanoseconds max{0};
+
+    // An upper bound for the 'fraction' quantile, from the bucket bounds.
+    std::chrono::microseconds quantile(double fraction) const;
+    std::chrono::nanoseconds mean() const;
+  };
+
+  struct Snapshot {
+    std::chrono::steady_clock::time_point time;
+    std::chrono::system_clock::time_point wall_time;
+    uint64_t slices = 0;
+    uint64_t cycles = 0;
+    // Slices that ended more than one slice behind their deadline.
+    uint64_t late_slices = 0;
+    // Cycles run past the end of slices, because instructions don't stop at
+    // the slice boundary.
+    uint64_t overshoot_cycles = 0;
+    // Maxima are over the whole run.
+    int max_overshoot_cycles = 0;
+    // Time spent running a slice, with the emulator mutex held.
+    Histogram slice_time;
+    // Time spent waiting for the emulator mutex before a slice.
+    Histogram mutex_wait;
+    // How far behind its deadline a slice finished.
+    Histogram lag;
+    // Time between rendered frames.
+    Histogram frame_time;
+  };
+
+  LoopTelemetry() = default;
+  LoopTelemetry(const LoopTelemetry&) = delete;
+  LoopTelemetry& operator=(const LoopTelemetry&) = delete;
+
+  // Emulator thread only. 'lag' is negative when the slice finished early.
+  void record_slice(int cycles, int overshoot_cycles,
+                    std::chrono::nanoseconds slice_time,
+                    std::chrono::nanoseconds mutex_wait,
+                    std::chrono::nanoseconds lag,
+                    std::chrono::nanoseconds slice_length);
+  // Render thread only.
+  void record_frame(std::chrono::nanoseconds frame_time);
+
+  Snapshot snapshot() const;
+
+  // One line of "key=value" pairs describing what happened between
+  // 'previous' and 'current', for the metrics file. Maxima are over the whole
+  // run.
+  static std::string format(const Snapshot& previous, const Snapshot& current);
+
+  // Emulated cycles per wall clock millisecond between the two snapshots.
+  static double cycles_per_ms(const Snapshot& previous,
+                              const Snapshot& current);
+
+ private:
+  // Only written by one thread, read by any.
+  class AtomicHistogram {
+   public:
+    void record(std::chrono::nanoseconds duration);
+    Histogram load() const;
+
+   private:
+    std::array<std::atomic<uint64_t>, kNumBuckets> buckets_ = {};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<int64_t> total_ns_ = 0;
+    std::atomic<int64_t> max_ns_ = 0;
+  };
+
+  std::atomic<uint64_t> slices_ = 0;
+  std::atomic<uint64_t> cycles_ = 0;
+  std::atomic<uint64_t> late_slices_ = 0;
+  std::atomic<uint64_t> overshoot_cycles_ = 0;
+  std::atomic<int> max_overshoot_cycles_ = 0;
+  AtomicHistogram slice_time_;
+  AtomicHistogram mutex_wait_;
+  AtomicHistogram lag_;
+  AtomicHistogram frame_time_;
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_LOOP_TELEMETRY_H
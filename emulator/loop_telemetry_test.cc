@@ -0,0 +1,90 @@
+#include "loop_telemetry.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+
+namespace eight_bit {
+namespace {
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using ::testing::HasSubstr;
+
+TEST(LoopTelemetryTest, BucketsByPowersOfTwoMicroseconds) {
+  LoopTelemetry telemetry;
+  telemetry.record_frame(nanoseconds(500));
+  telemetry.record_frame(microseconds(1));
+  telemetry.record_frame(microseconds(3));
+  telemetry.record_frame(microseconds(900));
+  telemetry.record_frame(std::chrono::seconds(100));
+
+  const auto frames = telemetry.snapshot().frame_time;
+  EXPECT_EQ(frames.count, 5u);
+  EXPECT_EQ(frames.buckets[0], 1u);
+  EXPECT_EQ(frames.buckets[1], 1u);
+  EXPECT_EQ(frames.buckets[2], 1u);
+  EXPECT_EQ(frames.buckets[10], 1u);
+  EXPECT_EQ(frames.buckets[LoopTelemetry::kNumBuckets - 1], 1u);
+  EXPECT_EQ(frames.max, std::chrono::seconds(100));
+}
+
+TEST(LoopTelemetryTest, Quantiles) {
+  LoopTelemetry telemetry;
+  for (int i = 0; i < 98; ++i) {
+    telemetry.record_frame(microseconds(10));
+  }
+  telemetry.record_frame(milliseconds(5));
+  telemetry.record_frame(milliseconds(5));
+
+  const auto frames = telemetry.snapshot().frame_time;
+  EXPECT_EQ(frames.quantile(0.5), microseconds(16));
+  EXPECT_EQ(frames.quantile(0.99), microseconds(8192));
+  EXPECT_EQ(frames.mean(), nanoseconds((98 * 10'000 + 2 * 5'000'000) / 100));
+}
+
+TEST(LoopTelemetryTest, CountsLateSlicesAndOvershoot) {
+  LoopTelemetry telemetry;
+  const auto slice = milliseconds(1);
+  telemetry.record_slice(1000, 0, microseconds(300), nanoseconds(50),
+                         -microseconds(700), slice);
+  telemetry.record_slice(1003, 3, microseconds(300), nanoseconds(50),
+                         microseconds(200), slice);
+  telemetry.record_slice(998, -2, microseconds(300), milliseconds(3),
+                         milliseconds(3), slice);
+
+  const auto snapshot = telemetry.snapshot();
+  EXPECT_EQ(snapshot.slices, 3u);
+  EXPECT_EQ(snapshot.cycles, 3001u);
+  EXPECT_EQ(snapshot.late_slices, 1u);
+  EXPECT_EQ(snapshot.overshoot_cycles, 3u);
+  EXPECT_EQ(snapshot.max_overshoot_cycles, 3);
+  // Early slices count as no lag.
+  EXPECT_EQ(snapshot.lag.buckets[0], 1u);
+  EXPECT_EQ(snapshot.mutex_wait.max, milliseconds(3));
+}
+
+TEST(LoopTelemetryTest, FormatsTheDifferenceBetweenSnapshots) {
+  LoopTelemetry telemetry;
+  telemetry.record_slice(1000, 0, microseconds(300), nanoseconds(0),
+                         nanoseconds(0), milliseconds(1));
+  auto previous = telemetry.snapshot();
+  telemetry.record_slice(1000, 0, microseconds(300), nanoseconds(0),
+                         milliseconds(2), milliseconds(1));
+  telemetry.record_slice(1000, 0, microseconds(300), nanoseconds(0),
+                         milliseconds(2), milliseconds(1));
+  auto current = telemetry.snapshot();
+  current.time = previous.time + milliseconds(4);
+
+  EXPECT_DOUBLE_EQ(LoopTelemetry::cycles_per_ms(previous, current), 500.0);
+  const std::string line = LoopTelemetry::format(previous, current);
+  EXPECT_THAT(line, HasSubstr("cycles_per_ms=500.0 slices=2 late_slices=2 "));
+  EXPECT_THAT(line, HasSubstr(" slice_mean_us=300.0 "));
+  EXPECT_THAT(line, HasSubstr(" lag_p50_us=2048 "));
+  EXPECT_EQ(line.back(), '\n');
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -0,0 +1,103 @@
+#include "memory_viewer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "absl/strings/numbers.h"
+#include "imgui.h"
+
+namespace eight_bit {
+namespace {
+
+constexpr int kBytesPerRow = 16;
+
+bool parse_address(const std::string& text, int* address) {
+  // The buffer is fixed size, so what was typed ends at the first NUL.
+  return absl::SimpleHexAtoi(text.c_str(), address) && *address >= 0 &&
+         *address <= 0xffff;
+}
+
+}  // namespace
+
+void MemoryViewer::draw(std::span<const uint8_t> memory, bool* open) {
+  track_changes(memory);
+
+  ImGui::Begin("Memory", open);
+  ImGui::Text("From");
+  ImGui::SameLine();
+  ImGui::InputText("##from", start_text_.data(), start_text_.size() + 1,
+                   ImGuiInputTextFlags_CharsHexadecimal);
+  ImGui::SameLine();
+  ImGui::Text("to");
+  ImGui::SameLine();
+  ImGui::InputText("##to", end_text_.data(), end_text_.size() + 1,
+                   ImGuiInputTextFlags_CharsHexadecimal);
+  int start = 0;
+  int end = 0;
+  if (parse_address(start_text_, &start) && parse_address(end_text_, &end) &&
+      start <= end) {
+    start_ = start;
+    end_ = end;
+  }
+
+  ImGui::BeginChild("rows", ImVec2(0, 0), 0,
+                    ImGuiWindowFlags_HorizontalScrollbar);
+  const int first_row = start_ / kBytesPerRow;
+  ImGuiListClipper clipper;
+  clipper.Begin(end_ / kBytesPerRow - first_row + 1);
+  while (clipper.Step()) {
+    for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row) {
+      draw_row(memory, (first_row + row) * kBytesPerRow);
+    }
+  }
+  clipper.End();
+  ImGui::EndChild();
+  ImGui::End();
+}
+
+void MemoryViewer::track_changes(std::span<const uint8_t> memory) {
+  if (previous_.size() != memory.size()) {
+    previous_.assign(memory.begin(), memory.end());
+    highlight_.assign(memory.size(), 0);
+    return;
+  }
+  for (size_t i = 0; i < memory.size(); ++i) {
+    if (memory[i] != previous_[i]) {
+      highlight_[i] = kHighlightFrames;
+    } else if (highlight_[i] > 0) {
+      --highlight_[i];
+    }
+  }
+  std::copy(memory.begin(), memory.end(), previous_.begin());
+}
+
+void MemoryViewer::draw_row(std::span<const uint8_t> memory, int row_address) {
+  ImGui::Text("%04X ", row_address);
+  std::string ascii(kBytesPerRow, ' ');
+  for (int i = 0; i < kBytesPerRow; ++i) {
+    const int address = row_address + i;
+    ImGui::SameLine();
+    if (address < start_ || address > end_ ||
+        address >= static_cast<int>(memory.size())) {
+      ImGui::TextUnformatted("  ");
+      continue;
+    }
+    const uint8_t value = memory[address];
+    ascii[i] = value >= 0x20 && value < 0x7f ? value : '.';
+    if (highlight_[address] > 0) {
+      const float fade =
+          static_cast<float>(highlight_[address]) / kHighlightFrames;
+      // Fades from orange back to the normal white.
+      ImGui::TextColored(ImVec4(1.0F, 1.0F - 0.6F * fade, 1.0F - fade, 1.0F),
+                         "%02X", value);
+    } else {
+      ImGui::Text("%02X", value);
+    }
+  }
+  ImGui::SameLine();
+  ImGui::Text(" |%s|", ascii.c_str());
+}
+
+}  // namespace eight_bit
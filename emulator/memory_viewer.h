@@ -0,0 +1,42 @@
+#ifndef EIGHT_BIT_MEMORY_VIEWER_H
+#define EIGHT_BIT_MEMORY_VIEWER_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace eight_bit {
+
+// An ImGui window showing a range of the address space as a hexdump. Only the
+// rows that are on screen get formatted, so it stays cheap for the whole 64k
+// even when redrawn every frame. Bytes that changed since the previous frame
+// are highlighted, and the highlight fades out over kHighlightFrames.
+class MemoryViewer {
+ public:
+  static constexpr int kHighlightFrames = 30;
+
+  // Draws the window for this frame. 'memory' is the whole address space,
+  // indexed by address.
+  void draw(std::span<const uint8_t> memory, bool* open);
+
+ private:
+  // Compares 'memory' to the previous frame and updates the highlights.
+  void track_changes(std::span<const uint8_t> memory);
+  void draw_row(std::span<const uint8_t> memory, int row_address);
+
+  // The range being shown, inclusive.
+  int start_ = 0x0000;
+  int end_ = 0xffff;
+  // What's typed into the range inputs, applied once it's a valid range.
+  std::string start_text_ = "0000";
+  std::string end_text_ = "ffff";
+
+  std::vector<uint8_t> previous_;
+  // Frames left of highlighting for every address.
+  std::vector<uint8_t> highlight_;
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_MEMORY_VIEWER_H
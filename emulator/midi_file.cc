@@ -0,0 +1,230 @@
+#include "midi_file.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+
+namespace eight_bit {
+namespace {
+
+constexpr uint8_t kMetaEvent = 0xff;
+constexpr uint8_t kMetaSetTempo = 0x51;
+constexpr uint8_t kSysex = 0xf0;
+constexpr uint8_t kSysexEscape = 0xf7;
+// 120 beats per minute, the default until the first tempo event.
+constexpr uint32_t kDefaultMicrosecondsPerBeat = 500000;
+
+// An event with its time still in MIDI ticks. Tempo changes are kept as
+// events until the times are converted to seconds.
+struct TickEvent {
+  uint64_t tick;
+  std::optional<uint32_t> tempo = std::nullopt;
+  std::vector<uint8_t> data = {};
+};
+
+// Reads big-endian numbers and variable-length quantities from a span, keeping
+// track of overruns.
+class Reader {
+ public:
+  explicit Reader(std::span<const uint8_t> data) : data_(data) {}
+
+  bool at_end() const { return position_ >= data_.size(); }
+  bool overrun() const { return overrun_; }
+
+  uint8_t byte() {
+    if (at_end()) {
+      overrun_ = true;
+      return 0;
+    }
+    return data_[position_++];
+  }
+
+  uint32_t big_endian(int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+      value = value << 8 | byte();
+    }
+    return value;
+  }
+
+  uint32_t variable_length() {
+    uint32_t value = 0;
+    // At most 4 bytes.
+    for (int i = 0; i < 4; ++i) {
+      uint8_t next = byte();
+      value = value << 7 | (next & 0x7f);
+      if ((next & 0x80) == 0) {
+        break;
+      }
+    }
+    return value;
+  }
+
+  std::span<const uint8_t> bytes(size_t count) {
+    if (count > data_.size() - std::min(position_, data_.size())) {
+      overrun_ = true;
+      position_ = data_.size();
+      return {};
+    }
+    auto result = data_.subspan(position_, count);
+    position_ += count;
+    return result;
+  }
+
+ private:
+  std::span<const uint8_t> data_;
+  size_t position_ = 0;
+  bool overrun_ = false;
+};
+
+// Number of data bytes following a channel message status byte.
+size_t data_bytes(uint8_t status) {
+  switch (status & 0xf0) {
+    case 0xc0:  // Program change
+    case 0xd0:  // Channel pressure
+      return 1;
+    default:
+      return 2;
+  }
+}
+
+absl::Status parse_track(std::span<const uint8_t> track,
+                         std::vector<TickEvent>& events) {
+  Reader reader(track);
+  uint64_t tick = 0;
+  uint8_t running_status = 0;
+  while (!reader.at_end()) {
+    tick += reader.variable_length();
+    uint8_t status = reader.byte();
+    if (status == kMetaEvent) {
+      uint8_t type = reader.byte();
+      auto data = reader.bytes(reader.variable_length());
+      if (type == kMetaSetTempo && data.size() == 3) {
+        events.push_back({.tick = tick,
+                          .tempo = static_cast<uint32_t>(
+                              data[0] << 16 | data[1] << 8 | data[2])});
+      }
+      running_status = 0;
+    } else if (status == kSysex || status == kSysexEscape) {
+      auto data = reader.bytes(reader.variable_length());
+      TickEvent event = {.tick = tick};
+      // An escape sends its bytes as they are. A regular sysex message gets
+      // its leading F0 back.
+      if (status == kSysex) {
+        event.data.push_back(kSysex);
+      }
+      event.data.insert(event.data.end(), data.begin(), data.end());
+      events.push_back(std::move(event));
+      running_status = 0;
+    } else {
+      TickEvent event = {.tick = tick};
+      if (status & 0x80) {
+        running_status = status;
+        event.data.push_back(status);
+      } else {
+        // Running status: this is already the first data byte.
+        if (running_status == 0) {
+          return absl::InvalidArgumentError(
+              "MIDI data byte without a running status");
+        }
+        event.data.push_back(running_status);
+        event.data.push_back(status);
+      }
+      while (event.data.size() < 1 + data_bytes(running_status)) {
+        event.data.push_back(reader.byte());
+      }
+      events.push_back(std::move(event));
+    }
+    if (reader.overrun()) {
+      return absl::InvalidArgumentError("Truncated MIDI track");
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<MidiEvent>> parse_midi_file(
+    std::span<const uint8_t> data) {
+  Reader reader(data);
+  if (reader.big_endian(4) != 0x4d546864 /* MThd */) {
+    return absl::InvalidArgumentError("Not a Standard MIDI File");
+  }
+  const uint32_t header_length = reader.big_endian(4);
+  const uint16_t format = reader.big_endian(2);
+  const uint16_t track_count = reader.big_endian(2);
+  const uint16_t division = reader.big_endian(2);
+  reader.bytes(header_length - std::min<uint32_t>(header_length, 6));
+  if (reader.overrun()) {
+    return absl::InvalidArgumentError("Truncated MIDI file header");
+  }
+  if (format > 1) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported MIDI file format ", format));
+  }
+  if (division & 0x8000) {
+    return absl::InvalidArgumentError("SMPTE time division isn't supported");
+  }
+  if (division == 0) {
+    return absl::InvalidArgumentError("Invalid MIDI time division");
+  }
+
+  std::vector<TickEvent> tick_events;
+  for (int i = 0; i < track_count; ++i) {
+    const uint32_t chunk_type = reader.big_endian(4);
+    auto chunk = reader.bytes(reader.big_endian(4));
+    if (reader.overrun()) {
+      return absl::InvalidArgumentError("Truncated MIDI file");
+    }
+    // Skip unknown chunks, they don't count as tracks.
+    if (chunk_type != 0x4d54726b /* MTrk */) {
+      --i;
+      continue;
+    }
+    auto status = parse_track(chunk, tick_events);
+    if (!status.ok()) {
+      return status;
+    }
+  }
+
+  // Merge the tracks. Events at the same tick stay in track order.
+  std::stable_sort(
+      tick_events.begin(), tick_events.end(),
+      [](const TickEvent& a, const TickEvent& b) { return a.tick < b.tick; });
+  std::vector<MidiEvent> events;
+  uint32_t microseconds_per_beat = kDefaultMicrosecondsPerBeat;
+  uint64_t last_tick = 0;
+  double seconds = 0;
+  for (TickEvent& event : tick_events) {
+    seconds += static_cast<double>(event.tick - last_tick) *
+               microseconds_per_beat / division / 1e6;
+    last_tick = event.tick;
+    if (event.tempo) {
+      microseconds_per_beat = *event.tempo;
+      continue;
+    }
+    events.push_back({.seconds = seconds, .data = std::move(event.data)});
+  }
+  return events;
+}
+
+absl::StatusOr<std::vector<MidiEvent>> read_midi_file(std::string_view path) {
+  std::ifstream file{std::string(path), std::ios::binary};
+  if (!file.is_open()) {
+    return absl::NotFoundError(absl::StrCat("Failed to open MIDI file ", path));
+  }
+  std::vector<uint8_t> data(std::istreambuf_iterator<char>(file), {});
+  return parse_midi_file(data);
+}
+
+}  // namespace eight_bit
@@ -0,0 +1,34 @@
+#ifndef EIGHT_BIT_MIDI_FILE_H
+#define EIGHT_BIT_MIDI_FILE_H
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "absl/status/statusor.h"
+
+namespace eight_bit {
+
+// A MIDI message from a Standard MIDI File, as it would arrive on a MIDI
+// input.
+struct MidiEvent {
+  // Time since the start of the file.
+  double seconds = 0;
+  std::vector<uint8_t> data;
+
+  bool operator==(const MidiEvent&) const = default;
+};
+
+// Parses a format 0 or 1 Standard MIDI File into a single time-ordered list of
+// channel and sysex messages, with running status expanded. Meta events are
+// dropped after applying tempo changes. SMPTE time division isn't supported.
+absl::StatusOr<std::vector<MidiEvent>> parse_midi_file(
+    std::span<const uint8_t> data);
+
+// Reads and parses the Standard MIDI File at 'path'.
+absl::StatusOr<std::vector<MidiEvent>> read_midi_file(std::string_view path);
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_MIDI_FILE_H
@@ -0,0 +1,99 @@
+#include "midi_file.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "absl/status/status_matchers.h"
+
+namespace eight_bit {
+namespace {
+
+using ::absl_testing::IsOk;
+
+// A file header with 96 ticks per beat.
+std::vector<uint8_t> header(uint16_t format, uint16_t track_count) {
+  return {'M',
+          'T',
+          'h',
+          'd',
+          0,
+          0,
+          0,
+          6,
+          0,
+          static_cast<uint8_t>(format),
+          0,
+          static_cast<uint8_t>(track_count),
+          0,
+          96};
+}
+
+void append_track(std::vector<uint8_t>& file,
+                  std::initializer_list<uint8_t> events) {
+  const uint32_t length = events.size();
+  file.insert(file.end(),
+              {'M', 'T', 'r', 'k', static_cast<uint8_t>(length >> 24),
+               static_cast<uint8_t>(length >> 16),
+               static_cast<uint8_t>(length >> 8),
+               static_cast<uint8_t>(length)});
+  file.insert(file.end(), events);
+}
+
+TEST(MidiFileTest, ParsesRunningStatusAndTempo) {
+  auto file = header(0, 1);
+  append_track(file, {
+                         // Note on at tick 0, at the default 120 bpm.
+                         0x00, 0x90, 0x3c, 0x40,
+                         // Running status note on, one beat later.
+                         0x60, 0x3e, 0x40,
+                         // Tempo change to 60 bpm.
+                         0x00, 0xff, 0x51, 0x03, 0x0f, 0x42, 0x40,
+                         // Program change one beat later, with a
+                         // variable-length delta of 96.
+                         0x60, 0xc0, 0x05,
+                         // End of track.
+                         0x00, 0xff, 0x2f, 0x00,
+                     });
+  auto events = parse_midi_file(file);
+  ASSERT_THAT(events.status(), IsOk());
+  ASSERT_EQ(events->size(), 3);
+  EXPECT_EQ((*events)[0],
+            (MidiEvent{.seconds = 0, .data = {0x90, 0x3c, 0x40}}));
+  EXPECT_EQ((*events)[1],
+            (MidiEvent{.seconds = 0.5, .data = {0x90, 0x3e, 0x40}}));
+  EXPECT_EQ((*events)[2], (MidiEvent{.seconds = 1.5, .data = {0xc0, 0x05}}));
+}
+
+TEST(MidiFileTest, MergesTracksInTimeOrder) {
+  auto file = header(1, 2);
+  append_track(file, {0x00, 0x90, 0x3c, 0x40, 0x81, 0x40, 0x80, 0x3c, 0x00});
+  append_track(file, {0x30, 0xf0, 0x03, 0x7d, 0x01, 0xf7});
+  auto events = parse_midi_file(file);
+  ASSERT_THAT(events.status(), IsOk());
+  ASSERT_EQ(events->size(), 3);
+  EXPECT_EQ((*events)[0].data, (std::vector<uint8_t>{0x90, 0x3c, 0x40}));
+  // Sysex messages get their F0 back.
+  EXPECT_EQ((*events)[1],
+            (MidiEvent{.seconds = 0.25, .data = {0xf0, 0x7d, 0x01, 0xf7}}));
+  // 0x81 0x40 is a delta of 192 ticks.
+  EXPECT_EQ((*events)[2],
+            (MidiEvent{.seconds = 1.0, .data = {0x80, 0x3c, 0x00}}));
+}
+
+TEST(MidiFileTest, RejectsBadFiles) {
+  EXPECT_FALSE(parse_midi_file(std::vector<uint8_t>{'R', 'I', 'F', 'F'}).ok());
+
+  auto truncated = header(0, 1);
+  append_track(truncated, {0x00, 0x90, 0x3c});
+  EXPECT_FALSE(parse_midi_file(truncated).ok());
+
+  auto no_status = header(0, 1);
+  append_track(no_status, {0x00, 0x3c, 0x40});
+  EXPECT_FALSE(parse_midi_file(no_status).ok());
+}
+
+}  // namespace
+}  // namespace eight_bit
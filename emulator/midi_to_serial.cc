@@ -1,48 +1,50 @@
 #include "midi_to_serial.h"
 
-#include <fcntl.h>
 #include <rtmidi/RtMidi.h>
-#include <unistd.h>
 
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "tl16c2550.h"
 
 namespace eight_bit {
 
-MidiToSerial::~MidiToSerial() {
-  if (fd_ != -1) {
-    close(fd_);
-  }
-}
-
 absl::StatusOr<std::unique_ptr<MidiToSerial>> eight_bit::MidiToSerial::create(
-    std::string_view pty_name) {
-  std::unique_ptr<MidiToSerial> midi_to_serial(new MidiToSerial());
-  auto status = midi_to_serial->initialize(pty_name);
+    TL16C2550* uart, int ticks_per_second,
+    std::function<uint64_t()> cycle_count) {
+  std::unique_ptr<MidiToSerial> midi_to_serial(
+      new MidiToSerial(uart, ticks_per_second, std::move(cycle_count)));
+  auto status = midi_to_serial->initialize();
   if (!status.ok()) {
     return status;
   }
   return midi_to_serial;
 }
 
-absl::Status eight_bit::MidiToSerial::initialize(std::string_view pty_name) {
-  fd_ = open(pty_name.data(), O_WRONLY | O_NOCTTY);
-  if (fd_ == -1) {
-    return absl::InternalError(
-        absl::StrCat("Failed to open pty ", pty_name, " for writing"));
-  }
+MidiToSerial::MidiToSerial(TL16C2550* uart, int ticks_per_second,
+                           std::function<uint64_t()> cycle_count)
+    : uart_(uart),
+      ticks_per_second_(ticks_per_second),
+      cycle_count_(std::move(cycle_count)) {}
 
+absl::Status eight_bit::MidiToSerial::initialize() {
   try {
     midi_in_ = std::make_unique<RtMidiIn>(RtMidi::UNSPECIFIED, "Emulator MIDI");
     midi_in_->openVirtualPort("Emulator MIDI in");
     midi_in_->setCallback(
-        [](double /* timestamp */, std::vector<unsigned char>* message,
+        [](double timestamp, std::vector<unsigned char>* message,
            void* user_data) {
-          int fd = *static_cast<int*>(user_data);
-          ::write(fd, message->data(), message->size());
+          static_cast<MidiToSerial*>(user_data)->handle_message(timestamp,
+                                                                *message);
         },
-        &fd_);
+        this);
   } catch (RtMidiError& error) {
     return absl::InternalError(
         absl::StrCat("Failed to open virtual MIDI port: ", error.what()));
@@ -50,4 +52,26 @@ absl::Status eight_bit::MidiToSerial::initialize(std::string_view pty_name) {
   return absl::OkStatus();
 }
 
-}  // namespace eight_bit
\ No newline at end of file
+void MidiToSerial::handle_message(double timestamp,
+                                  const std::vector<uint8_t>& message) {
+  const uint64_t now = cycle_count_();
+  // Timestamps are in real time, and the emulation runs at 'speed' times that.
+  const double speed = speed_.load(std::memory_order_relaxed);
+  uint64_t cycle = now;
+  if (std::isfinite(speed)) {
+    const double cycles_per_second = ticks_per_second_ * speed;
+    // Don't let the messages get more than 10ms ahead of the emulator, e.g.
+    // after it's been paused.
+    const auto max_lead = static_cast<uint64_t>(cycles_per_second / 100);
+    cycle = last_cycle_ + std::llround(timestamp * cycles_per_second);
+    if (cycle < now || cycle > now + max_lead) {
+      cycle = now;
+    }
+  }
+  last_cycle_ = cycle;
+  if (!uart_->inject(message, cycle)) {
+    LOG_EVERY_N_SEC(WARNING, 1) << "UART receive queue full, MIDI data lost";
+  }
+}
+
+}  // namespace eight_bit
@@ -3,34 +3,63 @@
 
 #include <rtmidi/RtMidi.h>
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
-#include <string_view>
+#include <vector>
 
 #include "absl/status/statusor.h"
+#include "tl16c2550.h"
 
 namespace eight_bit {
 
-// A class that creates a virtual MIDI port and forwards incoming MIDI bytes to
-// a PTY
+// A class that creates a virtual MIDI port and injects incoming MIDI bytes
+// straight into the receive queue of a TL16C2550.
+//
+// Messages are delivered at the emulated cycle that matches their RtMidi
+// timestamp, so the spacing between messages is kept at a finer resolution
+// than the emulator's 1ms slices. A message that would be due in the past, or
+// too far ahead of the emulator, is delivered as soon as possible instead.
 class MidiToSerial {
  public:
   MidiToSerial(const MidiToSerial&) = delete;
   MidiToSerial& operator=(const MidiToSerial&) = delete;
-  ~MidiToSerial();
+  ~MidiToSerial() = default;
 
-  // pty_name is the name of the pseudo-terminal to write to.
+  // 'cycle_count' returns the latest emulated cycle, and is called from the
+  // RtMidi thread. It doesn't need to be exact, as long as it doesn't lag the
+  // emulator by more than a millisecond or so.
   static absl::StatusOr<std::unique_ptr<MidiToSerial>> create(
-      std::string_view pty_name);
+      TL16C2550* uart, int ticks_per_second,
+      std::function<uint64_t()> cycle_count);
+
+  // How many times faster than real time the emulation runs, so that the gaps
+  // between messages stay the same in real time. At an infinite speed messages
+  // are delivered as soon as they arrive. Thread safe.
+  void set_speed(double speed) {
+    speed_.store(speed, std::memory_order_relaxed);
+  }
 
  private:
-  MidiToSerial() = default;
+  MidiToSerial(TL16C2550* uart, int ticks_per_second,
+               std::function<uint64_t()> cycle_count);
+
+  absl::Status initialize();
 
-  absl::Status initialize(std::string_view pty_name);
+  // 'timestamp' is the time in seconds since the previous message.
+  void handle_message(double timestamp, const std::vector<uint8_t>& message);
 
-  int fd_ = -1;
+  TL16C2550* const uart_;
+  const int ticks_per_second_;
+  const std::function<uint64_t()> cycle_count_;
+  std::atomic<double> speed_ = 1.0;
+  // The cycle the previous message was delivered at. Only used on the RtMidi
+  // thread.
+  uint64_t last_cycle_ = 0;
   std::unique_ptr<RtMidiIn> midi_in_;
 };
 
 }  // namespace eight_bit
 
-#endif  // EIGHT_BIT_MIDI_TO_SERIAL_H
\ No newline at end of file
+#endif  // EIGHT_BIT_MIDI_TO_SERIAL_H
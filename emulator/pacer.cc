@@ -0,0 +1,112 @@
+#include "pacer.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+#include <thread>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+
+namespace eight_bit {
+
+void Pacer::start(Clock::time_point now) { schedule_ = now; }
+
+Pacer::Clock::time_point Pacer::next(Clock::time_point slice_start,
+                                     Clock::time_point now) {
+  if (!std::isfinite(speed_)) {
+    schedule_ = now;
+    return now;
+  }
+  schedule_ += slice_;
+  const auto lag = now - schedule_;
+  switch (options_.drift_policy) {
+    case DriftPolicy::kCatchUp:
+      return schedule_;
+    case DriftPolicy::kDrop:
+      if (lag > options_.max_lag) {
+        dropped_ += lag;
+        schedule_ = now;
+      }
+      return schedule_;
+    case DriftPolicy::kSlew: {
+      if (lag > options_.max_lag) {
+        dropped_ += lag - options_.max_lag;
+        schedule_ = now - options_.max_lag;
+      }
+      // Each slice still takes at least this long, so the backlog shrinks by
+      // the difference to a full slice every time.
+      const auto fastest =
+          slice_start +
+          std::chrono::duration_cast<Clock::duration>(
+              slice_ / (1.0 + options_.slew_rate));
+      return std::max(schedule_, fastest);
+    }
+  }
+  return schedule_;
+}
+
+void Pacer::set_speed(double speed) {
+  speed_ = speed;
+  slice_ = std::isfinite(speed)
+               ? std::chrono::duration_cast<Clock::duration>(
+                     options_.slice / speed)
+               : Clock::duration::zero();
+}
+
+void Pacer::wait_until(Clock::time_point deadline) const {
+  if (options_.spin > Clock::duration::zero()) {
+    std::this_thread::sleep_until(deadline - options_.spin);
+    while (Clock::now() < deadline) {
+    }
+  } else {
+    std::this_thread::sleep_until(deadline);
+  }
+}
+
+absl::StatusOr<Pacer::DriftPolicy> parse_drift_policy(std::string_view name) {
+  if (name == "catch_up") {
+    return Pacer::DriftPolicy::kCatchUp;
+  }
+  if (name == "drop") {
+    return Pacer::DriftPolicy::kDrop;
+  }
+  if (name == "slew") {
+    return Pacer::DriftPolicy::kSlew;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown drift policy: ", name,
+                   ". Expected catch_up, drop or slew."));
+}
+
+absl::Status set_realtime_priority(int priority) {
+  sched_param param = {};
+  param.sched_priority = priority;
+  const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+  if (error != 0) {
+    return absl::PermissionDeniedError(absl::StrCat(
+        "Failed to set SCHED_FIFO priority ", priority, ": ", strerror(error)));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status set_cpu_affinity(int cpu) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  const int error =
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (error != 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Failed to pin thread to CPU ", cpu, ": ", strerror(error)));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace eight_bit
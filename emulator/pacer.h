@@ -0,0 +1,92 @@
+#ifndef EIGHT_BIT_PACER_H
+#define EIGHT_BIT_PACER_H
+
+#include <chrono>
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace eight_bit {
+
+// Paces a loop of fixed length slices against the wall clock. After each slice
+// next() says when the next one should start, and wait_until() gets there with
+// a sleep that's optionally finished off by spinning, since sleeps on a busy
+// host tend to overshoot by tens or hundreds of microseconds.
+//
+// When the loop falls behind, the drift policy decides what happens to the
+// missed time:
+//  - kCatchUp runs slices back to back until the schedule is met again. No
+//    emulated time is lost, but it all happens in a burst.
+//  - kDrop gives up on the missed time once it's more than max_lag, and
+//    continues from the current time.
+//  - kSlew catches up at most slew_rate faster than real time, and drops what's
+//    beyond max_lag.
+//
+// The schedule can run faster or slower than real time with set_speed().
+class Pacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class DriftPolicy {
+    kCatchUp,
+    kDrop,
+    kSlew,
+  };
+
+  struct Options {
+    std::chrono::nanoseconds slice = std::chrono::milliseconds(1);
+    // Sleep until this long before a deadline, then spin. 0 only sleeps.
+    std::chrono::nanoseconds spin{0};
+    DriftPolicy drift_policy = DriftPolicy::kCatchUp;
+    std::chrono::nanoseconds max_lag = std::chrono::milliseconds(100);
+    double slew_rate = 0.25;
+  };
+
+  explicit Pacer(const Options& options)
+      : options_(options), slice_(options.slice) {}
+
+  // Starts the schedule at 'now'.
+  void start(Clock::time_point now);
+  // Called when the slice that started at 'slice_start' is done at 'now'.
+  // Returns when the next slice should start, which may be in the past.
+  Clock::time_point next(Clock::time_point slice_start, Clock::time_point now);
+  // How far 'now' is past the end of the current slice on the schedule.
+  Clock::duration behind(Clock::time_point now) const {
+    return now - schedule_;
+  }
+  // Total time given up on by the drift policy.
+  Clock::duration dropped() const { return dropped_; }
+
+  void wait_until(Clock::time_point deadline) const;
+
+  const Options& options() const { return options_; }
+
+  // Each slice takes options().slice / 'speed' of real time from the next one
+  // on. An infinite speed runs slices back to back and never falls behind.
+  void set_speed(double speed);
+  double speed() const { return speed_; }
+  // The real time length of a slice at the current speed.
+  Clock::duration slice() const { return slice_; }
+
+ private:
+  const Options options_;
+  double speed_ = 1.0;
+  Clock::duration slice_;
+  // The end of the current slice if the loop kept up perfectly.
+  Clock::time_point schedule_;
+  Clock::duration dropped_{0};
+};
+
+// "catch_up", "drop" or "slew".
+absl::StatusOr<Pacer::DriftPolicy> parse_drift_policy(std::string_view name);
+
+// Runs the calling thread with SCHED_FIFO at 'priority'. Needs CAP_SYS_NICE or
+// a high enough RLIMIT_RTPRIO.
+absl::Status set_realtime_priority(int priority);
+// Pins the calling thread to 'cpu'.
+absl::Status set_cpu_affinity(int cpu);
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_PACER_H
@@ -0,0 +1,125 @@
+#include "pacer.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <limits>
+
+namespace eight_bit {
+namespace {
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using Clock = Pacer::Clock;
+
+Pacer::Options options_with(Pacer::DriftPolicy policy) {
+  Pacer::Options options;
+  options.slice = microseconds(100);
+  options.drift_policy = policy;
+  options.max_lag = milliseconds(1);
+  options.slew_rate = 0.25;
+  return options;
+}
+
+TEST(PacerTest, KeepsToTheScheduleWhenOnTime) {
+  Pacer pacer(options_with(Pacer::DriftPolicy::kCatchUp));
+  const Clock::time_point t0;
+  pacer.start(t0);
+  // Slices finish early, the next one starts at the end of the scheduled one.
+  EXPECT_EQ(pacer.next(t0, t0 + microseconds(30)), t0 + microseconds(100));
+  EXPECT_EQ(pacer.next(t0 + microseconds(120), t0 + microseconds(150)),
+            t0 + microseconds(200));
+  EXPECT_EQ(pacer.behind(t0 + microseconds(150)), microseconds(-50));
+}
+
+TEST(PacerTest, CatchUpRunsMissedSlicesBackToBack) {
+  Pacer pacer(options_with(Pacer::DriftPolicy::kCatchUp));
+  const Clock::time_point t0;
+  pacer.start(t0);
+  const auto now = t0 + milliseconds(5);
+  EXPECT_EQ(pacer.next(t0, now), t0 + microseconds(100));
+  EXPECT_EQ(pacer.next(now, now), t0 + microseconds(200));
+  EXPECT_EQ(pacer.dropped(), Clock::duration::zero());
+}
+
+TEST(PacerTest, DropSkipsTimeBeyondMaxLag) {
+  Pacer pacer(options_with(Pacer::DriftPolicy::kDrop));
+  const Clock::time_point t0;
+  pacer.start(t0);
+  // Within max lag, it catches up.
+  EXPECT_EQ(pacer.next(t0, t0 + microseconds(900)), t0 + microseconds(100));
+  // Beyond it, the schedule restarts from now.
+  const auto now = t0 + milliseconds(5);
+  EXPECT_EQ(pacer.next(t0 + microseconds(900), now), now);
+  EXPECT_EQ(pacer.dropped(), milliseconds(5) - microseconds(200));
+  EXPECT_EQ(pacer.next(now, now + microseconds(10)), now + microseconds(100));
+}
+
+TEST(PacerTest, SlewCatchesUpGradually) {
+  Pacer pacer(options_with(Pacer::DriftPolicy::kSlew));
+  const Clock::time_point t0;
+  pacer.start(t0);
+  // 500us behind, and slices take no time. Every slice starts 80us after the
+  // previous one rather than right away, gaining 20us on the schedule.
+  auto start = t0 + microseconds(500);
+  for (int i = 0; i < 25; ++i) {
+    const auto next = pacer.next(start, start);
+    EXPECT_EQ(next, start + microseconds(80)) << i;
+    start = next;
+  }
+  EXPECT_LE(pacer.behind(start), Clock::duration::zero());
+  EXPECT_EQ(pacer.next(start, start), start + microseconds(100));
+  EXPECT_EQ(pacer.dropped(), Clock::duration::zero());
+}
+
+TEST(PacerTest, SlewDropsTimeBeyondMaxLag) {
+  Pacer pacer(options_with(Pacer::DriftPolicy::kSlew));
+  const Clock::time_point t0;
+  pacer.start(t0);
+  const auto now = t0 + milliseconds(10);
+  pacer.next(t0, now);
+  EXPECT_EQ(pacer.behind(now), milliseconds(1));
+  EXPECT_EQ(pacer.dropped(), milliseconds(9) - microseconds(100));
+}
+
+TEST(PacerTest, SpeedScalesTheSlices) {
+  Pacer pacer(options_with(Pacer::DriftPolicy::kCatchUp));
+  const Clock::time_point t0;
+  pacer.start(t0);
+  pacer.set_speed(4);
+  EXPECT_EQ(pacer.slice(), microseconds(25));
+  EXPECT_EQ(pacer.next(t0, t0), t0 + microseconds(25));
+  pacer.set_speed(0.5);
+  EXPECT_EQ(pacer.next(t0, t0), t0 + microseconds(225));
+}
+
+TEST(PacerTest, UnlimitedSpeedNeverWaits) {
+  Pacer pacer(options_with(Pacer::DriftPolicy::kCatchUp));
+  const Clock::time_point t0;
+  pacer.start(t0);
+  pacer.set_speed(std::numeric_limits<double>::infinity());
+  const auto now = t0 + milliseconds(5);
+  EXPECT_EQ(pacer.next(t0, now), now);
+  EXPECT_EQ(pacer.behind(now), Clock::duration::zero());
+  EXPECT_EQ(pacer.dropped(), Clock::duration::zero());
+}
+
+TEST(PacerTest, WaitUntilSpinsToTheDeadline) {
+  Pacer::Options options;
+  options.spin = microseconds(200);
+  Pacer pacer(options);
+  const auto deadline = Clock::now() + milliseconds(2);
+  pacer.wait_until(deadline);
+  EXPECT_GE(Clock::now(), deadline);
+}
+
+TEST(PacerTest, ParseDriftPolicy) {
+  EXPECT_EQ(*parse_drift_policy("catch_up"), Pacer::DriftPolicy::kCatchUp);
+  EXPECT_EQ(*parse_drift_policy("drop"), Pacer::DriftPolicy::kDrop);
+  EXPECT_EQ(*parse_drift_policy("slew"), Pacer::DriftPolicy::kSlew);
+  EXPECT_FALSE(parse_drift_policy("fast").ok());
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -14,33 +14,36 @@ PS2Keyboard6301::PS2Keyboard6301(Interrupt* irq, IOPort* data_port,
     : irq_(irq), data_port_(data_port), irq_status_port_(irq_status_port) {
   // Bit 0 on the irq status port can be written to and is used to clear the
   // keyboard interrupt by being pulled low then high again.
-  irq_status_port_->register_output_change_callback([this](uint8_t data) {
-    absl::MutexLock lock(&mutex_);
-    data = data & kIrqClearMask;
-    // We saw a 0->1 transition on the interrupt clear bit. Clear the
-    // interrupt.
-    if (data == kIrqClearMask && interrupt_clear_ == 0) {
-      VLOG(1) << "Clearing keyboard interrupt";
-      if (interrupt_id_ != 0) {
-        irq_->clear_interrupt(interrupt_id_);
-        interrupt_id_ = 0;
-      }
-      irq_status_port_->provide_inputs(kIrqStatusMask, kIrqStatusMask);
-      // TODO: This should really happen after some given amount of time
-      // corresponding to ps2 data rates, but for now just assume that the
-      // interrupt is cleared after reading keyboard data.
-      if (!data_.empty()) {
-        data_.pop();
-      }
-      if (!data_.empty()) {
-        data_port_->provide_inputs(data_.front());
-        // The status pin is active low
-        irq_status_port_->provide_inputs(0, kIrqStatusMask);
-        interrupt_id_ = irq_->set_interrupt();
-      }
+  irq_status_port_->add_output_listener<&PS2Keyboard6301::irq_clear_in>(
+      this, kIrqClearMask);
+}
+
+void PS2Keyboard6301::irq_clear_in(uint8_t data) {
+  absl::MutexLock lock(&mutex_);
+  data = data & kIrqClearMask;
+  // We saw a 0->1 transition on the interrupt clear bit. Clear the
+  // interrupt.
+  if (data == kIrqClearMask && interrupt_clear_ == 0) {
+    VLOG(1) << "Clearing keyboard interrupt";
+    if (interrupt_id_ != 0) {
+      irq_->clear_interrupt(interrupt_id_);
+      interrupt_id_ = 0;
     }
-    interrupt_clear_ = data;
-  });
+    irq_status_port_->provide_inputs(kIrqStatusMask, kIrqStatusMask);
+    // TODO: This should really happen after some given amount of time
+    // corresponding to ps2 data rates, but for now just assume that the
+    // interrupt is cleared after reading keyboard data.
+    if (!data_.empty()) {
+      data_.pop();
+    }
+    if (!data_.empty()) {
+      data_port_->provide_inputs(data_.front());
+      // The status pin is active low
+      irq_status_port_->provide_inputs(0, kIrqStatusMask);
+      interrupt_id_ = irq_->set_interrupt();
+    }
+  }
+  interrupt_clear_ = data;
 }
 
 // Translates the SDL keyboard event into a sequence of PS/2 data bytes to be
@@ -31,6 +31,9 @@ class PS2Keyboard6301 {
   const uint8_t kIrqStatusMask = 1 << kIrqStatusPin;
 
  private:
+  // Output listener for the interrupt clear bit on the irq status port.
+  void irq_clear_in(uint8_t data);
+
   Interrupt* irq_ = nullptr;
   IOPort* data_port_ = nullptr;
   IOPort* irq_status_port_ = nullptr;
@@ -42,6 +42,8 @@ absl::Status Ram::initialize() {
   if (!status.ok()) {
     return status;
   }
+  address_space_->set_stable_reads(base_address_,
+                                   base_address_ + data_.size() - 1);
   status = address_space_->register_write(
       base_address_, base_address_ + data_.size() - 1,
       [this](uint16_t address, uint8_t data) {
@@ -22,6 +22,9 @@ class Ram {
   // Return RAM contents as a hexdump.
   std::string hexdump() const;
 
+  // RAM contents, starting at the base address.
+  const std::vector<uint8_t>& data() const { return data_; }
+
  private:
   Ram(AddressSpace* address_space, uint16_t base_address, uint16_t size,
       uint8_t fill_byte = 0);
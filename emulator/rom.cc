@@ -34,7 +34,8 @@ void Rom::load(uint16_t address, std::span<uint8_t> data) {
 }
 
 void Rom::hexdump() const {
-  std::cout << eight_bit::hexdump(data_, base_address_) << "\n";
+  write_hexdump(std::cout, data_, base_address_);
+  std::cout << "\n";
 }
 
 Rom::Rom(AddressSpace* address_space, uint16_t base_address, uint16_t size,
@@ -49,7 +50,12 @@ absl::Status Rom::initialize() {
       [this](uint16_t address) -> uint8_t {
         return data_[address - base_address_];
       });
-  return status;
+  if (!status.ok()) {
+    return status;
+  }
+  address_space_->set_stable_reads(base_address_,
+                                   base_address_ + data_.size() - 1);
+  return absl::OkStatus();
 }
 
 }  // namespace eight_bit
\ No newline at end of file
@@ -28,6 +28,9 @@ class Rom {
   // Print ROM contents to stdout
   void hexdump() const;
 
+  // ROM contents, starting at the base address.
+  const std::vector<uint8_t>& data() const { return data_; }
+
  private:
   Rom(AddressSpace* address_space, uint16_t base_address, uint16_t size,
       uint8_t fill_byte = 0);
@@ -0,0 +1,138 @@
+#include "sd_card_image.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+
+namespace eight_bit {
+
+SDCardImage::~SDCardImage() {
+  if (shared_) {
+    auto status = sync();
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+    }
+  }
+  munmap(data_, size_);
+}
+
+absl::StatusOr<std::unique_ptr<SDCardImage>> SDCardImage::create(
+    std::string_view path, bool persist_writes) {
+  const std::string path_string(path);
+  // A private mapping is copy-on-write, so it doesn't need write access to the
+  // file.
+  int fd = open(path_string.c_str(), persist_writes ? O_RDWR : O_RDONLY);
+  if (fd == -1) {
+    return absl::NotFoundError(absl::StrCat(
+        "Failed to open SD card image ", path, ": ", strerror(errno)));
+  }
+  // The mapping keeps its own reference to the file.
+  absl::Cleanup close_fd = [fd] { close(fd); };
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) == -1) {
+    return absl::InternalError(absl::StrCat(
+        "Failed to stat SD card image ", path, ": ", strerror(errno)));
+  }
+  const size_t size = file_stat.st_size;
+  if (size < kBlockSize) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("SD card image ", path, " is smaller than one block"));
+  }
+
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    persist_writes ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    return absl::InternalError(absl::StrCat("Failed to map SD card image ",
+                                            path, ": ", strerror(errno)));
+  }
+  return std::unique_ptr<SDCardImage>(
+      new SDCardImage(static_cast<uint8_t*>(data), size, persist_writes));
+}
+
+absl::StatusOr<std::unique_ptr<SDCardImage>> SDCardImage::create_empty(
+    size_t size) {
+  if (size < kBlockSize) {
+    return absl::InvalidArgumentError(
+        "SD card image must be at least one block");
+  }
+  // Anonymous mappings are zero-filled on first touch, so unused blocks don't
+  // cost any memory.
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    return absl::InternalError(
+        absl::StrCat("Failed to map empty SD card image: ", strerror(errno)));
+  }
+  return std::unique_ptr<SDCardImage>(
+      new SDCardImage(static_cast<uint8_t*>(data), size, false));
+}
+
+absl::StatusOr<std::span<const uint8_t>> SDCardImage::read_block(
+    uint32_t block) const {
+  if (block >= block_count_) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Block ", block, " is past the end of the SD card image"));
+  }
+  return std::span<const uint8_t>(data_ + block * kBlockSize, kBlockSize);
+}
+
+absl::Status SDCardImage::write_block(uint32_t block,
+                                      std::span<const uint8_t> data) {
+  if (block >= block_count_) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Block ", block, " is past the end of the SD card image"));
+  }
+  if (data.size() != kBlockSize) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid block size: ", data.size()));
+  }
+  uint8_t* destination = data_ + block * kBlockSize;
+  std::memcpy(destination, data.data(), kBlockSize);
+  if (shared_) {
+    // Schedule write-back of the touched page without waiting for it. msync
+    // needs a page-aligned start address.
+    static const uintptr_t page_mask = ~(sysconf(_SC_PAGESIZE) - 1);
+    auto* page = reinterpret_cast<uint8_t*>(
+        reinterpret_cast<uintptr_t>(destination) & page_mask);
+    if (msync(page, destination + kBlockSize - page, MS_ASYNC) == -1) {
+      return absl::InternalError(
+          absl::StrCat("Failed to sync SD card image: ", strerror(errno)));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SDCardImage::sync() {
+  if (!shared_) {
+    return absl::OkStatus();
+  }
+  if (msync(data_, size_, MS_SYNC) == -1) {
+    return absl::InternalError(
+        absl::StrCat("Failed to sync SD card image: ", strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+SDCardImage::SDCardImage(uint8_t* data, size_t size, bool shared)
+    : data_(data),
+      size_(size),
+      shared_(shared),
+      block_count_(size / kBlockSize) {}
+
+}  // namespace eight_bit
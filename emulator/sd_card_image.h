@@ -0,0 +1,59 @@
+#ifndef EIGHT_BIT_SD_CARD_IMAGE_H
+#define EIGHT_BIT_SD_CARD_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+
+namespace eight_bit {
+
+// A block device backed by a memory mapping. Image files are mapped directly
+// instead of being read into memory, so large images load instantly and only
+// the blocks that are actually touched get paged in.
+class SDCardImage {
+ public:
+  static constexpr size_t kBlockSize = 512;
+
+  ~SDCardImage();
+  SDCardImage(const SDCardImage&) = delete;
+  SDCardImage& operator=(const SDCardImage&) = delete;
+
+  // Map the image file at `path`. If `persist_writes` is true the file is
+  // mapped shared and writes end up in the file. Otherwise the mapping is
+  // private and writes are discarded when the image is destroyed.
+  static absl::StatusOr<std::unique_ptr<SDCardImage>> create(
+      std::string_view path, bool persist_writes);
+
+  // Create a zero-filled, memory-only image of `size` bytes.
+  static absl::StatusOr<std::unique_ptr<SDCardImage>> create_empty(size_t size);
+
+  uint32_t block_count() const { return block_count_; }
+
+  // Returns a view of the given block. The view stays valid for the lifetime of
+  // the image.
+  absl::StatusOr<std::span<const uint8_t>> read_block(uint32_t block) const;
+
+  // Overwrite the given block with `data`, which must be kBlockSize bytes.
+  absl::Status write_block(uint32_t block, std::span<const uint8_t> data);
+
+  // Flush all writes to the backing file. A no-op for non-persistent images.
+  absl::Status sync();
+
+ private:
+  SDCardImage(uint8_t* data, size_t size, bool shared);
+
+  uint8_t* const data_;
+  const size_t size_;
+  // Whether writes are shared with the backing file.
+  const bool shared_;
+  const uint32_t block_count_;
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_SD_CARD_IMAGE_H
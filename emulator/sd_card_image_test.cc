@@ -0,0 +1,109 @@
+#include "sd_card_image.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace eight_bit {
+namespace {
+
+class SDCardImageTest : public ::testing::Test {
+ protected:
+  static constexpr int kBlockCount = 4;
+
+  void SetUp() override {
+    char path[] = "/tmp/sd_card_image_test_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    close(fd);
+    path_ = path;
+    // Fill every block with its block number.
+    std::ofstream file(path_, std::ios::binary);
+    for (int i = 0; i < kBlockCount; ++i) {
+      std::string block(SDCardImage::kBlockSize, static_cast<char>(i));
+      file.write(block.data(), block.size());
+    }
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  std::vector<uint8_t> read_file() {
+    std::ifstream file(path_, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+  }
+
+  std::string path_;
+};
+
+TEST_F(SDCardImageTest, ReadsBlocksFromFile) {
+  auto image = SDCardImage::create(path_, /*persist_writes=*/false);
+  ASSERT_TRUE(image.ok());
+  EXPECT_EQ((*image)->block_count(), kBlockCount);
+
+  auto block = (*image)->read_block(2);
+  ASSERT_TRUE(block.ok());
+  ASSERT_EQ(block->size(), SDCardImage::kBlockSize);
+  EXPECT_EQ((*block)[0], 2);
+  EXPECT_EQ((*block)[SDCardImage::kBlockSize - 1], 2);
+
+  EXPECT_FALSE((*image)->read_block(kBlockCount).ok());
+}
+
+TEST_F(SDCardImageTest, PrivateWritesAreNotPersisted) {
+  {
+    auto image = SDCardImage::create(path_, /*persist_writes=*/false);
+    ASSERT_TRUE(image.ok());
+    std::vector<uint8_t> data(SDCardImage::kBlockSize, 0xaa);
+    ASSERT_TRUE((*image)->write_block(1, data).ok());
+    auto block = (*image)->read_block(1);
+    ASSERT_TRUE(block.ok());
+    EXPECT_EQ((*block)[0], 0xaa);
+  }
+  EXPECT_EQ(read_file()[SDCardImage::kBlockSize], 1);
+}
+
+TEST_F(SDCardImageTest, SharedWritesArePersisted) {
+  {
+    auto image = SDCardImage::create(path_, /*persist_writes=*/true);
+    ASSERT_TRUE(image.ok());
+    std::vector<uint8_t> data(SDCardImage::kBlockSize, 0xaa);
+    ASSERT_TRUE((*image)->write_block(1, data).ok());
+  }
+  auto contents = read_file();
+  EXPECT_EQ(contents[SDCardImage::kBlockSize - 1], 0);
+  EXPECT_EQ(contents[SDCardImage::kBlockSize], 0xaa);
+  EXPECT_EQ(contents[2 * SDCardImage::kBlockSize - 1], 0xaa);
+  EXPECT_EQ(contents[2 * SDCardImage::kBlockSize], 2);
+}
+
+TEST_F(SDCardImageTest, RejectsInvalidWrites) {
+  auto image = SDCardImage::create(path_, /*persist_writes=*/false);
+  ASSERT_TRUE(image.ok());
+  std::vector<uint8_t> short_data(10);
+  EXPECT_FALSE((*image)->write_block(0, short_data).ok());
+  std::vector<uint8_t> data(SDCardImage::kBlockSize);
+  EXPECT_FALSE((*image)->write_block(kBlockCount, data).ok());
+}
+
+TEST(SDCardImageEmptyTest, EmptyImageIsZeroFilled) {
+  auto image = SDCardImage::create_empty(4 * SDCardImage::kBlockSize);
+  ASSERT_TRUE(image.ok());
+  EXPECT_EQ((*image)->block_count(), 4);
+  auto block = (*image)->read_block(3);
+  ASSERT_TRUE(block.ok());
+  for (uint8_t byte : *block) {
+    EXPECT_EQ(byte, 0);
+  }
+}
+
+TEST(SDCardImageEmptyTest, MissingFileIsAnError) {
+  EXPECT_FALSE(SDCardImage::create("/nonexistent/sd_card.img", false).ok());
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -1,9 +1,7 @@
 #include "sd_card_spi.h"
 
-#include <fstream>
-#include <istream>
 #include <memory>
-#include <spanstream>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -12,6 +10,7 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "sd_card_image.h"
 #include "spi.h"
 
 namespace eight_bit {
@@ -33,27 +32,33 @@ uint8_t kR1ParameterError = 0x40;
 uint8_t kDataErrorTokenError = 0x01;
 // uint8_t kDataErrorTokenCCError = 0x02;
 // uint8_t kDataErrorTokenECCFailed = 0x04;
-// uint8_t kDataErrorTokenOutOfRange = 0x08;
+uint8_t kDataErrorTokenOutOfRange = 0x08;
 
-constexpr int kBlockSize = 512;
+//
+// Data tokens
+//
+uint8_t kStartBlockToken = 0xfe;
+uint8_t kStartBlockMultipleWriteToken = 0xfc;
+uint8_t kStopTranToken = 0xfd;
+
+//
+// Data response tokens
+//
+uint8_t kDataResponseAccepted = 0b0000'0101;
+uint8_t kDataResponseWriteError = 0b0000'1101;
+
+constexpr int kBlockSize = SDCardImage::kBlockSize;
 }  // namespace
 
 absl::StatusOr<std::unique_ptr<SDCardSPI>> SDCardSPI::create(
-    SPI* spi, std::unique_ptr<std::basic_iostream<char>> image) {
+    SPI* spi, std::unique_ptr<SDCardImage> image) {
   auto sd_card_spi = std::unique_ptr<SDCardSPI>(new SDCardSPI(spi));
   sd_card_spi->set_image(std::move(image));
   return sd_card_spi;
 }
 
-void SDCardSPI::set_image(std::unique_ptr<std::basic_iostream<char>> image) {
+void SDCardSPI::set_image(std::unique_ptr<SDCardImage> image) {
   card_image_ = std::move(image);
-  // Compute the number of blocks in the file or image.
-  card_image_->seekg(0);
-  card_image_->ignore(std::numeric_limits<std::streamsize>::max());
-  block_count_ = card_image_->gcount() / kBlockSize;
-  // Clear the EOF flag.
-  card_image_->clear();
-  card_image_->seekg(0);
 }
 
 absl::StatusOr<SDCardSPI::Command> SDCardSPI::Command::create(
@@ -103,6 +108,41 @@ uint8_t SDCardSPI::handle_byte_in(uint8_t data) {
         return 0xff;
       }
       return 0xff;
+    case CardState::kReadMultiple: {
+      // The host stops the transfer by sending CMD12 while we're sending data.
+      // Command bytes always start with 0b01.
+      if (!input_buffer_.empty() || (data & 0xc0) == 0x40) {
+        input_buffer_.push_back(data);
+        if (input_buffer_.size() == 6) {
+          auto command_or = Command::create(input_buffer_);
+          input_buffer_.clear();
+          if (command_or.ok() && (command_or->command & 0x3f) == 12) {
+            handle_command(command_or.value());
+            card_state_ = CardState::kResponse;
+            return 0xff;
+          }
+          VLOG(1) << "Ignoring SD card command during multi-block read";
+        }
+      }
+      if (response_queue_.empty()) {
+        if (blocks_left_ == 0) {
+          // The block count set with CMD23 ends the transfer without CMD12.
+          blocks_left_.reset();
+          card_state_ = (enabled_ ? CardState::kReady : CardState::kIdle);
+          return 0xff;
+        }
+        if (read_error_) {
+          return 0xff;
+        }
+        queue_block(read_address_++);
+        if (blocks_left_.has_value()) {
+          --*blocks_left_;
+        }
+      }
+      uint8_t response = response_queue_.front();
+      response_queue_.pop();
+      return response;
+    }
     case CardState::kResponse:
       if (!response_queue_.empty()) {
         uint8_t response = response_queue_.front();
@@ -120,9 +160,18 @@ uint8_t SDCardSPI::handle_byte_in(uint8_t data) {
       }
       return 0xff;
     case CardState::kDataToken: {
-      if (data == 0xfe) {
+      if (!multi_block_write_ && data == kStartBlockToken) {
+        input_buffer_.clear();
+        card_state_ = CardState::kData;
+      } else if (multi_block_write_ && data == kStartBlockMultipleWriteToken) {
         input_buffer_.clear();
         card_state_ = CardState::kData;
+      } else if (multi_block_write_ && data == kStopTranToken) {
+        VLOG(1) << "SD card multi-block write stopped";
+        multi_block_write_ = false;
+        blocks_left_.reset();
+        response_queue_.push(0x00);  // Simulate busy for the duration of a byte
+        card_state_ = CardState::kResponse;
       }
       return 0xff;
     }
@@ -130,13 +179,32 @@ uint8_t SDCardSPI::handle_byte_in(uint8_t data) {
       input_buffer_.push_back(data);
       // We need to read 512 bytes of data plus two CRC bytes.
       if (input_buffer_.size() == kBlockSize + 2) {
-        card_image_->seekp(write_address_ * kBlockSize);
-        card_image_->write(reinterpret_cast<const char*>(input_buffer_.data()),
-                           kBlockSize);
+        auto status = card_image_->write_block(
+            write_address_,
+            std::span<const uint8_t>(input_buffer_.data(), kBlockSize));
         input_buffer_.clear();
-        response_queue_.push(0b0000'0101);  // Data accepted
+        if (!status.ok()) {
+          LOG(ERROR) << "Failed to write SD card block: " << status;
+          response_queue_.push(kDataResponseWriteError);
+          // A failed block aborts a multi-block write.
+          multi_block_write_ = false;
+          blocks_left_.reset();
+        } else {
+          response_queue_.push(kDataResponseAccepted);
+        }
         response_queue_.push(0x00);  // Simulate busy for the duration of a byte
         card_state_ = CardState::kResponse;
+        if (multi_block_write_) {
+          ++write_address_;
+          if (blocks_left_.has_value() && --*blocks_left_ == 0) {
+            // The block count set with CMD23 ends the transfer without a stop
+            // token.
+            multi_block_write_ = false;
+            blocks_left_.reset();
+          } else {
+            next_card_state_ = CardState::kDataToken;
+          }
+        }
       }
       return 0xff;
     }
@@ -162,6 +230,7 @@ uint8_t SDCardSPI::handle_enable(bool enabled) {
       case CardState::kResponse:
       case CardState::kDataToken:
       case CardState::kData:
+      case CardState::kReadMultiple:
         LOG(ERROR) << "Unexpected SD card state on SPI enabled: "
                    << static_cast<int>(card_state_);
         card_state_ = CardState::kCommand;
@@ -169,6 +238,10 @@ uint8_t SDCardSPI::handle_enable(bool enabled) {
     }
   } else {
     card_state_ = ready_ ? CardState::kReady : CardState::kIdle;
+    // Deselecting the card aborts any multi-block transfer.
+    multi_block_write_ = false;
+    read_error_ = false;
+    blocks_left_.reset();
   };
   // We need to pick the byte that will be shifted out while we read the first
   // input byte. We have no data to send so it doesn't matter. Real cards use
@@ -183,6 +256,12 @@ void SDCardSPI::handle_command(const Command& command) {
           << absl::Hex(command.argument, absl::kZeroPad8) << " "
           << absl::Hex(command.crc, absl::kZeroPad2);
   if (!next_is_app_command_) {
+    // A block count from CMD23 only applies to the command right after it.
+    std::optional<uint32_t> block_count;
+    if (command_number != 23) {
+      block_count = pending_block_count_;
+      pending_block_count_.reset();
+    }
     switch (command_number) {
       case 0: {  // GO_IDLE_STATE
         ready_ = false;
@@ -205,50 +284,71 @@ void SDCardSPI::handle_command(const Command& command) {
         response_queue_.push(command.argument & 0xff);
         break;
       }
+      case 12: {  // STOP_TRANSMISSION
+        // Drop whatever is left of the block being sent.
+        response_queue_ = std::queue<uint8_t>();
+        read_error_ = false;
+        blocks_left_.reset();
+        response_queue_.push(ready_ ? 0 : kR1InIdleState);
+        response_queue_.push(0x00);  // Simulate busy for the duration of a byte
+        break;
+      }
       case 17: {  // READ_SINGLE_BLOCK
         // Set up R1
-        int32_t address = command.argument;
+        uint32_t address = command.argument;
         if (!ready_) {
           response_queue_.push(kR1IllegalCommand | kR1InIdleState);
           break;
         }
-        if (address >= block_count_) {
+        if (address >= card_image_->block_count()) {
           response_queue_.push(kR1ParameterError);
           break;
         }
         response_queue_.push(0);
-
-        // Try to read the data
-        card_image_->seekg(address * kBlockSize);
-        std::array<char, kBlockSize> block;
-        card_image_->read(block.data(), kBlockSize);
-        if (card_image_->gcount() != kBlockSize) {
-          response_queue_.push(kDataErrorTokenError);
-          // Clear any EOF we might have hit.
-          card_image_->clear();
+        queue_block(address);
+        break;
+      }
+      case 18: {  // READ_MULTIPLE_BLOCK
+        // Set up R1
+        uint32_t address = command.argument;
+        if (!ready_) {
+          response_queue_.push(kR1IllegalCommand | kR1InIdleState);
           break;
         }
-        // Clear any EOF we might have hit.
-        card_image_->clear();
-        // Add a data token
-        response_queue_.push(0xfe);
-        // Then the 512 byte block
-        for (char byte : block) {
-          response_queue_.push(byte);
+        if (address >= card_image_->block_count()) {
+          response_queue_.push(kR1ParameterError);
+          break;
         }
-        // And two CRC bytes (ignored)
         response_queue_.push(0);
+
+        // Blocks are queued one at a time as the host reads them.
+        next_card_state_ = CardState::kReadMultiple;
+        read_address_ = address;
+        read_error_ = false;
+        blocks_left_ = block_count;
+        break;
+      }
+      case 23: {  // SET_BLOCK_COUNT
+        if (!ready_) {
+          response_queue_.push(kR1IllegalCommand | kR1InIdleState);
+          break;
+        }
+        if (command.argument == 0) {
+          response_queue_.push(kR1ParameterError);
+          break;
+        }
         response_queue_.push(0);
+        pending_block_count_ = command.argument;
         break;
       }
       case 24: {  // WRITE_BLOCK
         // Set up R1
-        int32_t address = command.argument;
+        uint32_t address = command.argument;
         if (!ready_) {
           response_queue_.push(kR1IllegalCommand | kR1InIdleState);
           break;
         }
-        if (address >= block_count_) {
+        if (address >= card_image_->block_count()) {
           response_queue_.push(kR1ParameterError);
           break;
         }
@@ -256,6 +356,30 @@ void SDCardSPI::handle_command(const Command& command) {
 
         next_card_state_ = CardState::kDataToken;
         write_address_ = address;
+        multi_block_write_ = false;
+        break;
+      }
+      case 25: {  // WRITE_MULTIPLE_BLOCK
+        // Set up R1
+        uint32_t address = command.argument;
+        if (!ready_) {
+          response_queue_.push(kR1IllegalCommand | kR1InIdleState);
+          break;
+        }
+        if (address >= card_image_->block_count()) {
+          response_queue_.push(kR1ParameterError);
+          break;
+        }
+        response_queue_.push(0);
+
+        next_card_state_ = CardState::kDataToken;
+        write_address_ = address;
+        multi_block_write_ = true;
+        blocks_left_ = block_count;
+        if (pre_erase_block_count_ != 0) {
+          VLOG(1) << "Pre-erase block count: " << pre_erase_block_count_;
+          pre_erase_block_count_ = 0;
+        }
         break;
       }
       case 55: {  // APP_CMD
@@ -296,6 +420,16 @@ void SDCardSPI::handle_command(const Command& command) {
   } else {
     next_is_app_command_ = false;
     switch (command_number) {
+      case 23: {  // SET_WR_BLK_ERASE_COUNT
+        if (!ready_) {
+          response_queue_.push(kR1IllegalCommand | kR1InIdleState);
+          break;
+        }
+        // Only bits 0..22 are used.
+        pre_erase_block_count_ = command.argument & 0x7f'ffff;
+        response_queue_.push(0);
+        break;
+      }
       case 41: {  // SD_SEND_OP_COND
         ready_ = true;
         response_queue_.push(0);
@@ -311,4 +445,25 @@ void SDCardSPI::handle_command(const Command& command) {
   }
 }
 
+void SDCardSPI::queue_block(uint32_t address) {
+  auto block = card_image_->read_block(address);
+  if (!block.ok()) {
+    LOG(ERROR) << "Failed to read SD card block: " << block.status();
+    response_queue_.push(address >= card_image_->block_count()
+                             ? kDataErrorTokenOutOfRange
+                             : kDataErrorTokenError);
+    read_error_ = true;
+    return;
+  }
+  // Add a data token
+  response_queue_.push(kStartBlockToken);
+  // Then the 512 byte block
+  for (uint8_t byte : *block) {
+    response_queue_.push(byte);
+  }
+  // And two CRC bytes (ignored)
+  response_queue_.push(0);
+  response_queue_.push(0);
+}
+
 }  // namespace eight_bit
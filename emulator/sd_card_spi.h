@@ -1,13 +1,14 @@
 #ifndef EIGHT_BIT_SD_CARD_SPI_H
 #define EIGHT_BIT_SD_CARD_SPI_H
 
-#include <istream>
 #include <memory>
+#include <optional>
 #include <queue>
 #include <string_view>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "sd_card_image.h"
 #include "spi.h"
 
 namespace eight_bit {
@@ -19,11 +20,11 @@ class SDCardSPI {
   ~SDCardSPI() = default;
   SDCardSPI(const SDCardSPI&) = delete;
 
-  // Create an emulated SD Card that reads and writes to the given stream.
+  // Create an emulated SD Card that reads and writes to the given image.
   static absl::StatusOr<std::unique_ptr<SDCardSPI>> create(
-      SPI* spi, std::unique_ptr<std::basic_iostream<char>> image);
+      SPI* spi, std::unique_ptr<SDCardImage> image);
 
-  void set_image(std::unique_ptr<std::basic_iostream<char>> image);
+  void set_image(std::unique_ptr<SDCardImage> image);
 
  private:
   struct Command {
@@ -42,7 +43,9 @@ class SDCardSPI {
     kCommand,
     kResponse,
     kDataToken,
-    kData
+    kData,
+    // Streaming blocks for a multi-block read until the transfer is stopped.
+    kReadMultiple
   };
 
   SDCardSPI(SPI* spi);
@@ -52,9 +55,12 @@ class SDCardSPI {
 
   void handle_command(const Command& command);
 
+  // Queue the data token, data, and CRC of the given block on the response
+  // queue. Queues a data error token instead if the block can't be read.
+  void queue_block(uint32_t address);
+
   SPI* spi_;
-  std::unique_ptr<std::basic_iostream<char>> card_image_;
-  int block_count_ = 0;
+  std::unique_ptr<SDCardImage> card_image_;
   bool enabled_ = false;
 
   // Whether or not we're considered initialized.
@@ -63,6 +69,21 @@ class SDCardSPI {
   bool next_is_app_command_ = false;
   // The address for the next write command.
   uint32_t write_address_ = 0;
+  // Whether the current write is a multi-block write.
+  bool multi_block_write_ = false;
+  // The address of the next block to send in a multi-block read.
+  uint32_t read_address_ = 0;
+  // Whether a multi-block read ran into an error. We stop sending data and
+  // wait for the host to stop the transmission.
+  bool read_error_ = false;
+  // The block count set by CMD23 for the next multi-block command.
+  std::optional<uint32_t> pending_block_count_;
+  // Number of blocks left in the current multi-block transfer. Unset if the
+  // transfer goes on until the host stops it.
+  std::optional<uint32_t> blocks_left_;
+  // The number of blocks to pre-erase before the next multi-block write, as set
+  // by ACMD23. Pre-erasing is a performance hint so it's only recorded.
+  uint32_t pre_erase_block_count_ = 0;
   // The current card state.
   CardState card_state_ = CardState::kIdle;
   // The card state we transition to after flushing the response queue.
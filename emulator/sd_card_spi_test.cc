@@ -0,0 +1,257 @@
+#include "sd_card_spi.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ioport.h"
+#include "sd_card_image.h"
+#include "spi.h"
+
+namespace eight_bit {
+namespace {
+
+class SDCardSPITest : public ::testing::Test {
+ protected:
+  static const uint8_t kPin = 0;
+  static const int kBlockCount = 8;
+
+  void SetUp() override {
+    cs_port_ = std::make_unique<IOPort>("CS");
+    clk_port_ = std::make_unique<IOPort>("CLK");
+    mosi_port_ = std::make_unique<IOPort>("MOSI");
+    miso_port_ = std::make_unique<IOPort>("MISO");
+
+    cs_port_->write_data_direction_register(1 << kPin);
+    clk_port_->write_data_direction_register(1 << kPin);
+    mosi_port_->write_data_direction_register(1 << kPin);
+
+    // CS is normally high, CLK normally low.
+    cs_port_->write_output_register(1 << kPin);
+    clk_port_->write_output_register(0);
+
+    auto spi_or = SPI::create(cs_port_.get(), kPin, clk_port_.get(), kPin,
+                              mosi_port_.get(), kPin, miso_port_.get(), kPin);
+    ASSERT_TRUE(spi_or.ok());
+    spi_ = std::move(spi_or.value());
+
+    auto image_or =
+        SDCardImage::create_empty(kBlockCount * SDCardImage::kBlockSize);
+    ASSERT_TRUE(image_or.ok());
+    image_ = image_or->get();
+    // Fill every block with its block number.
+    for (int i = 0; i < kBlockCount; ++i) {
+      std::vector<uint8_t> block(SDCardImage::kBlockSize, i);
+      ASSERT_TRUE(image_->write_block(i, block).ok());
+    }
+
+    auto sd_card_or = SDCardSPI::create(spi_.get(), std::move(*image_or));
+    ASSERT_TRUE(sd_card_or.ok());
+    sd_card_ = std::move(sd_card_or.value());
+
+    // Initialize the card.
+    EXPECT_EQ(command(0, 0, 0x95), 0x01);
+    deselect();
+    command(55, 0);
+    deselect();
+    EXPECT_EQ(command(41, 0x40000000), 0x00);
+    deselect();
+  }
+
+  // Transfer one byte in SPI mode 0, returning the byte read from MISO.
+  uint8_t transfer(uint8_t data) {
+    uint8_t result = 0;
+    for (int i = 0; i < 8; ++i) {
+      mosi_port_->write_output_register(((data & 0x80) > 0) << kPin);
+      data <<= 1;
+      result = (result << 1) | (miso_port_->read_input_register() & 1);
+      clk_port_->write_output_register(1 << kPin);
+      clk_port_->write_output_register(0);
+    }
+    return result;
+  }
+
+  // Read bytes until we get one with the top bit clear, like an R1 response.
+  uint8_t read_r1() {
+    for (int i = 0; i < 10; ++i) {
+      uint8_t response = transfer(0xff);
+      if ((response & 0x80) == 0) {
+        return response;
+      }
+    }
+    return 0xff;
+  }
+
+  // Read bytes until we get something other than 0xff.
+  uint8_t read_token() {
+    for (int i = 0; i < 100; ++i) {
+      uint8_t response = transfer(0xff);
+      if (response != 0xff) {
+        return response;
+      }
+    }
+    return 0xff;
+  }
+
+  void send_command(uint8_t command, uint32_t argument, uint8_t crc = 0xff) {
+    transfer(0x40 | command);
+    transfer(argument >> 24);
+    transfer(argument >> 16);
+    transfer(argument >> 8);
+    transfer(argument);
+    transfer(crc);
+  }
+
+  // Select the card, send a command and return its R1 response. The card stays
+  // selected.
+  uint8_t command(uint8_t command, uint32_t argument, uint8_t crc = 0xff) {
+    cs_port_->write_output_register(0);
+    send_command(command, argument, crc);
+    return read_r1();
+  }
+
+  void deselect() {
+    cs_port_->write_output_register(1 << kPin);
+    transfer(0xff);
+  }
+
+  // Read a 512 byte data block plus CRC and return the data.
+  std::vector<uint8_t> read_block() {
+    std::vector<uint8_t> data;
+    for (size_t i = 0; i < SDCardImage::kBlockSize; ++i) {
+      data.push_back(transfer(0xff));
+    }
+    transfer(0xff);
+    transfer(0xff);
+    return data;
+  }
+
+  // Send a data token, 512 bytes of `value` and CRC. Returns the data response.
+  uint8_t write_block(uint8_t token, uint8_t value) {
+    transfer(token);
+    for (size_t i = 0; i < SDCardImage::kBlockSize; ++i) {
+      transfer(value);
+    }
+    transfer(0xff);
+    transfer(0xff);
+    return read_token();
+  }
+
+  void wait_busy() {
+    for (int i = 0; i < 10 && transfer(0xff) == 0; ++i) {
+    }
+  }
+
+  std::unique_ptr<IOPort> cs_port_;
+  std::unique_ptr<IOPort> clk_port_;
+  std::unique_ptr<IOPort> mosi_port_;
+  std::unique_ptr<IOPort> miso_port_;
+  std::unique_ptr<SPI> spi_;
+  SDCardImage* image_ = nullptr;
+  std::unique_ptr<SDCardSPI> sd_card_;
+};
+
+TEST_F(SDCardSPITest, ReadSingleBlock) {
+  EXPECT_EQ(command(17, 3), 0x00);
+  EXPECT_EQ(read_token(), 0xfe);
+  EXPECT_EQ(read_block(), std::vector<uint8_t>(SDCardImage::kBlockSize, 3));
+  deselect();
+}
+
+TEST_F(SDCardSPITest, ReadMultipleBlocksUntilStopped) {
+  EXPECT_EQ(command(18, 2), 0x00);
+  for (int i = 2; i < 5; ++i) {
+    EXPECT_EQ(read_token(), 0xfe);
+    EXPECT_EQ(read_block(), std::vector<uint8_t>(SDCardImage::kBlockSize, i));
+  }
+  send_command(12, 0);
+  // Skip the stuff byte.
+  transfer(0xff);
+  EXPECT_EQ(read_r1(), 0x00);
+  wait_busy();
+  EXPECT_EQ(transfer(0xff), 0xff);
+  deselect();
+
+  // The card accepts new commands afterwards.
+  EXPECT_EQ(command(17, 1), 0x00);
+  EXPECT_EQ(read_token(), 0xfe);
+  EXPECT_EQ(read_block(), std::vector<uint8_t>(SDCardImage::kBlockSize, 1));
+  deselect();
+}
+
+TEST_F(SDCardSPITest, ReadMultipleBlocksPastTheEndReturnsErrorToken) {
+  EXPECT_EQ(command(18, kBlockCount - 1), 0x00);
+  EXPECT_EQ(read_token(), 0xfe);
+  read_block();
+  // Out of range error token.
+  EXPECT_EQ(read_token(), 0x08);
+  send_command(12, 0);
+  transfer(0xff);
+  EXPECT_EQ(read_r1(), 0x00);
+  deselect();
+}
+
+TEST_F(SDCardSPITest, SetBlockCountEndsMultipleBlockRead) {
+  EXPECT_EQ(command(23, 2), 0x00);
+  deselect();
+  EXPECT_EQ(command(18, 5), 0x00);
+  for (int i = 5; i < 7; ++i) {
+    EXPECT_EQ(read_token(), 0xfe);
+    EXPECT_EQ(read_block(), std::vector<uint8_t>(SDCardImage::kBlockSize, i));
+  }
+  // No more data after the second block.
+  EXPECT_EQ(read_token(), 0xff);
+  deselect();
+}
+
+TEST_F(SDCardSPITest, WriteMultipleBlocksUntilStopToken) {
+  EXPECT_EQ(command(25, 1), 0x00);
+  EXPECT_EQ(write_block(0xfc, 0xa1) & 0x1f, 0x05);
+  wait_busy();
+  EXPECT_EQ(write_block(0xfc, 0xa2) & 0x1f, 0x05);
+  wait_busy();
+  transfer(0xfd);
+  transfer(0xff);
+  wait_busy();
+  deselect();
+
+  EXPECT_EQ((*image_->read_block(0))[0], 0);
+  EXPECT_EQ((*image_->read_block(1))[0], 0xa1);
+  EXPECT_EQ((*image_->read_block(2))[511], 0xa2);
+  EXPECT_EQ((*image_->read_block(3))[0], 3);
+}
+
+TEST_F(SDCardSPITest, SetBlockCountEndsMultipleBlockWrite) {
+  EXPECT_EQ(command(23, 1), 0x00);
+  deselect();
+  EXPECT_EQ(command(25, 4), 0x00);
+  EXPECT_EQ(write_block(0xfc, 0xb4) & 0x1f, 0x05);
+  wait_busy();
+  // The card doesn't expect another block.
+  EXPECT_EQ(write_block(0xfc, 0xb5), 0xff);
+  deselect();
+
+  EXPECT_EQ((*image_->read_block(4))[0], 0xb4);
+  EXPECT_EQ((*image_->read_block(5))[0], 5);
+}
+
+TEST_F(SDCardSPITest, PreEraseCountIsAccepted) {
+  command(55, 0);
+  deselect();
+  EXPECT_EQ(command(23, 2), 0x00);
+  deselect();
+  EXPECT_EQ(command(25, 6), 0x00);
+  EXPECT_EQ(write_block(0xfc, 0xc6) & 0x1f, 0x05);
+  wait_busy();
+  transfer(0xfd);
+  transfer(0xff);
+  wait_busy();
+  deselect();
+
+  EXPECT_EQ((*image_->read_block(6))[0], 0xc6);
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -0,0 +1,89 @@
+#ifndef EIGHT_BIT_SEQLOCK_H
+#define EIGHT_BIT_SEQLOCK_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+namespace eight_bit {
+
+// Publishes a value from one writer thread to any number of reader threads
+// without either side ever blocking. The writer bumps a sequence number to odd
+// before it writes and back to even after. Readers copy the value and start
+// over if the sequence number changed on the way, which only happens if they
+// overlap a store().
+//
+// The value is kept in relaxed atomic words rather than plain memory, so that
+// the racing reads are well defined.
+template <typename T>
+class Seqlock {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Seqlock values are copied bytewise");
+
+ public:
+  Seqlock() : Seqlock(T{}) {}
+  explicit Seqlock(const T& value) { store(value); }
+  Seqlock(const Seqlock&) = delete;
+  Seqlock& operator=(const Seqlock&) = delete;
+
+  // Writer side.
+  void store(const T& value) {
+    store_bytes(std::span<const uint8_t, sizeof(T)>(
+        reinterpret_cast<const uint8_t*>(&value), sizeof(T)));
+  }
+
+  // Writer side. Stores 'bytes' as the value, for when they're at hand without
+  // a T, e.g. memory contents in a vector.
+  void store_bytes(std::span<const uint8_t, sizeof(T)> bytes) {
+    const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; ++i) {
+      uint64_t word = 0;
+      std::memcpy(&word, bytes.data() + i * sizeof(word), word_size(i));
+      words_[i].store(word, std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Reader side. Returns the value of the last completed store().
+  T load() const {
+    T value;
+    auto* bytes = reinterpret_cast<uint8_t*>(&value);
+    while (true) {
+      const uint32_t sequence = sequence_.load(std::memory_order_acquire);
+      if (sequence & 1) {
+        continue;
+      }
+      for (size_t i = 0; i < kWords; ++i) {
+        const uint64_t word = words_[i].load(std::memory_order_relaxed);
+        std::memcpy(bytes + i * sizeof(word), &word, word_size(i));
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == sequence) {
+        return value;
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kWords = (sizeof(T) + 7) / 8;
+
+  // The number of bytes of the value in word 'i', which is less than 8 for
+  // the last one if the size isn't a multiple of 8.
+  static constexpr size_t word_size(size_t i) {
+    return std::min<size_t>(8, sizeof(T) - i * 8);
+  }
+
+  std::atomic<uint32_t> sequence_ = 0;
+  std::array<std::atomic<uint64_t>, kWords> words_ = {};
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_SEQLOCK_H
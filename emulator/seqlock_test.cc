@@ -0,0 +1,70 @@
+#include "seqlock.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace eight_bit {
+namespace {
+
+struct Registers {
+  uint8_t a;
+  uint16_t x;
+  uint64_t cycle;
+};
+
+TEST(SeqlockTest, LoadsTheLastStore) {
+  Seqlock<Registers> seqlock;
+  EXPECT_EQ(seqlock.load().cycle, 0u);
+  seqlock.store({.a = 1, .x = 0x1234, .cycle = 99});
+  const Registers registers = seqlock.load();
+  EXPECT_EQ(registers.a, 1);
+  EXPECT_EQ(registers.x, 0x1234);
+  EXPECT_EQ(registers.cycle, 99u);
+}
+
+TEST(SeqlockTest, SizesThatArentWholeWords) {
+  Seqlock<std::array<uint8_t, 13>> seqlock;
+  std::vector<uint8_t> bytes(13);
+  for (int i = 0; i < 13; ++i) {
+    bytes[i] = i + 1;
+  }
+  seqlock.store_bytes(std::span<const uint8_t, 13>(bytes.data(), 13));
+  const auto value = seqlock.load();
+  EXPECT_EQ(value[0], 1);
+  EXPECT_EQ(value[12], 13);
+}
+
+TEST(SeqlockTest, ReadersNeverSeeTornValues) {
+  // Every element of a value is the same, so a mix of two stores shows up as
+  // a mismatch.
+  using Value = std::array<uint64_t, 64>;
+  Seqlock<Value> seqlock;
+  std::atomic<bool> done = false;
+  std::thread writer([&]() {
+    Value value;
+    for (uint64_t i = 1; i <= 20000; ++i) {
+      value.fill(i);
+      seqlock.store(value);
+    }
+    done = true;
+  });
+  uint64_t last = 0;
+  while (!done) {
+    const Value value = seqlock.load();
+    for (uint64_t element : value) {
+      ASSERT_EQ(element, value[0]);
+    }
+    EXPECT_GE(value[0], last);
+    last = value[0];
+  }
+  writer.join();
+  EXPECT_EQ(seqlock.load()[63], 20000u);
+}
+
+}  // namespace
+}  // namespace eight_bit
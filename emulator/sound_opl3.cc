@@ -2,13 +2,23 @@
 
 #include <SDL3/SDL.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "Nuked-OPL3/opl3.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "address_space.h"
 
@@ -22,25 +32,46 @@ constexpr int kBytesPerSample = 4;  // 2 channels * 16 bits per channel
 
 void SoundOPL3::AudioCallback(void* userdata, SDL_AudioStream* stream,
                               int additional_amount, int total_amount) {
-  auto* callback_data = static_cast<SoundOPL3::LockableOPL3Chip*>(userdata);
+  auto* sound = static_cast<SoundOPL3*>(userdata);
   // additional_amount is the minimum required right now, total_amount is the
-  // max we can send. Both are in bytes. OPL3_GenerateStream tracks length in
-  // samples however. We generate at least the minimum amount of samples to
-  // avoid underruns, without going over KMaxNumSamples if possible.
-  int sample_count =
-      std::max(additional_amount / kBytesPerSample,
-               std::min(total_amount / kBytesPerSample, kMaxNumSamples));
-  static char buffer[kMaxNumSamples * kBytesPerSample];
-  absl::MutexLock lock(&callback_data->mutex);
-  OPL3_GenerateStream(&callback_data->chip, reinterpret_cast<int16_t*>(buffer),
-                      sample_count);
-  SDL_PutAudioStreamData(stream, buffer, sample_count * kBytesPerSample);
+  // max we can send. Both are in bytes. We send at least the minimum amount of
+  // samples to avoid underruns, without going over KMaxNumSamples if possible.
+  int needed = additional_amount / kBytesPerSample;
+  int wanted = std::max(
+      needed, std::min(total_amount / kBytesPerSample, kMaxNumSamples));
+  std::array<Frame, kMaxNumSamples> buffer;
+  while (wanted > 0) {
+    const int chunk = std::min(wanted, kMaxNumSamples);
+    int count = sound->frames_.pop(std::span(buffer.data(), chunk));
+    if (count < needed) {
+      // The emulator is behind real time. Pad with silence as far as needed.
+      const int silence = std::min(chunk, needed) - count;
+      std::fill_n(buffer.begin() + count, silence, Frame{0, 0});
+      count += silence;
+    }
+    if (count == 0) {
+      break;
+    }
+    SDL_PutAudioStreamData(stream, buffer.data(), count * kBytesPerSample);
+    if (count < chunk) {
+      break;
+    }
+    wanted -= count;
+    needed -= count;
+  }
 }
 
-SoundOPL3::SoundOPL3(AddressSpace* address_space, uint16_t base_address)
-    : address_space_(address_space), base_address_(base_address) {
-  absl::MutexLock lock(&opl3_chip_.mutex);
-  OPL3_Reset(&opl3_chip_.chip, 44100);
+SoundOPL3::SoundOPL3(AddressSpace* address_space, uint16_t base_address,
+                     int ticks_per_second,
+                     std::function<uint64_t()> cycle_count, Output output,
+                     SpeedAudio speed_audio)
+    : address_space_(address_space),
+      base_address_(base_address),
+      ticks_per_second_(ticks_per_second),
+      cycle_count_(std::move(cycle_count)),
+      output_(output),
+      speed_audio_(speed_audio) {
+  OPL3_Reset(&chip_, kSampleRate);
   auto status = address_space_->register_write(
       base_address_, base_address_ + 3,
       [this](uint16_t address, uint8_t data) { write(address, data); });
@@ -61,12 +92,24 @@ SoundOPL3::~SoundOPL3() {
     SDL_DestroyAudioStream(sdl_audio_stream_);
     sdl_audio_stream_ = nullptr;
   }
+  if (render_thread_.joinable()) {
+    rendering_ = false;
+    target_cycle_.fetch_add(1);
+    target_cycle_.notify_one();
+    render_thread_.join();
+  }
 }
 
 absl::StatusOr<std::unique_ptr<SoundOPL3>> SoundOPL3::create(
-    AddressSpace* address_space, uint16_t base_address) {
-  auto sound_opl3 =
-      absl::WrapUnique(new SoundOPL3(address_space, base_address));
+    AddressSpace* address_space, uint16_t base_address, int ticks_per_second,
+    std::function<uint64_t()> cycle_count, Output output,
+    SpeedAudio speed_audio) {
+  if (ticks_per_second <= 0) {
+    return absl::InvalidArgumentError("ticks_per_second must be positive");
+  }
+  auto sound_opl3 = absl::WrapUnique(new SoundOPL3(
+      address_space, base_address, ticks_per_second, std::move(cycle_count),
+      output, speed_audio));
   auto status = sound_opl3->initialize();
   if (!status.ok()) {
     return status;
@@ -76,19 +119,27 @@ absl::StatusOr<std::unique_ptr<SoundOPL3>> SoundOPL3::create(
 }
 
 void SoundOPL3::write(uint16_t address, uint8_t data) {
-  static uint16_t write_address = 0;
   uint16_t opl_address = address - base_address_;
   switch (opl_address) {
     case 0:
-      write_address = data;
+      write_address_ = data;
       break;
     case 1: {
-      absl::MutexLock lock(&opl3_chip_.mutex);
-      OPL3_WriteRegBuffered(&opl3_chip_.chip, write_address, data);
+      if (output_ == Output::kNone) {
+        break;
+      }
+      const RegisterWrite register_write{
+          .cycle = cycle_count_(), .address = write_address_, .data = data};
+      while (!register_writes_.push(register_write)) {
+        // The renderer only applies writes up to the last cycle it was told
+        // about. Let it catch up to now to make room.
+        advance_to(register_write.cycle);
+        std::this_thread::yield();
+      }
       break;
     }
     case 2:
-      write_address = 0x100 | data;
+      write_address_ = 0x100 | data;
       break;
     default:
       LOG(ERROR) << absl::StreamFormat("Write to invalid OPL3 address: %x",
@@ -101,7 +152,117 @@ uint8_t SoundOPL3::read_status() {
   return 0;
 }
 
+void SoundOPL3::advance_to(uint64_t cycle) {
+  if (output_ == Output::kNone) {
+    return;
+  }
+  if (output_ == Output::kOffline) {
+    render_until(cycle);
+    return;
+  }
+  target_cycle_.store(cycle, std::memory_order_release);
+  target_cycle_.notify_one();
+}
+
+std::vector<int16_t> SoundOPL3::take_samples() {
+  std::vector<int16_t> samples;
+  samples.swap(offline_samples_);
+  return samples;
+}
+
+void SoundOPL3::set_speed(double speed) {
+  speed_.store(speed, std::memory_order_relaxed);
+  if (speed_audio_ == SpeedAudio::kResample && sdl_audio_stream_ != nullptr &&
+      std::isfinite(speed)) {
+    // SDL only takes ratios between 0.01 and 100.
+    SDL_SetAudioStreamFrequencyRatio(sdl_audio_stream_,
+                                     std::clamp(speed, 0.01, 100.0));
+  }
+}
+
+void SoundOPL3::render_until(uint64_t cycle) {
+  auto frame_at = [this](uint64_t at_cycle) {
+    return at_cycle * kSampleRate / ticks_per_second_;
+  };
+  const uint64_t target_frame = frame_at(cycle);
+  std::array<Frame, kMaxNumSamples> buffer;
+  while (true) {
+    // Apply all register writes that are due by the current frame.
+    const RegisterWrite* next_write = register_writes_.front();
+    while (next_write != nullptr &&
+           frame_at(next_write->cycle) <= rendered_frames_) {
+      OPL3_WriteReg(&chip_, next_write->address, next_write->data);
+      register_writes_.pop();
+      next_write = register_writes_.front();
+    }
+    if (rendered_frames_ >= target_frame) {
+      break;
+    }
+    // Render up to the next register write, the target, or a full buffer,
+    // whichever comes first.
+    uint64_t end_frame = target_frame;
+    if (next_write != nullptr) {
+      end_frame = std::min(end_frame, frame_at(next_write->cycle));
+    }
+    const int count = std::min<uint64_t>(end_frame - rendered_frames_,
+                                         kMaxNumSamples);
+    OPL3_GenerateStream(&chip_, reinterpret_cast<int16_t*>(buffer.data()),
+                        count);
+    rendered_frames_ += count;
+    output_frames(std::span(buffer.data(), count));
+  }
+}
+
+void SoundOPL3::output_frames(std::span<const Frame> frames) {
+  if (output_ == Output::kOffline) {
+    for (const Frame& frame : frames) {
+      offline_samples_.push_back(frame.left);
+      offline_samples_.push_back(frame.right);
+    }
+    return;
+  }
+  const double speed = speed_.load(std::memory_order_relaxed);
+  if (!std::isfinite(speed)) {
+    return;
+  }
+  switch (speed_audio_) {
+    case SpeedAudio::kMute:
+      if (speed != 1.0) {
+        return;
+      }
+      break;
+    case SpeedAudio::kResample:
+      break;
+    case SpeedAudio::kKeepPitch:
+      stretched_frames_.clear();
+      time_stretch_.process(frames, speed, &stretched_frames_);
+      frames = stretched_frames_;
+      break;
+  }
+  size_t pushed = frames_.push(frames);
+  if (pushed < frames.size()) {
+    // The emulator is ahead of real time and the audio device can't keep up.
+    VLOG(1) << "Dropping " << frames.size() - pushed << " audio samples";
+  }
+}
+
+void SoundOPL3::render_thread() {
+  uint64_t rendered_cycle = 0;
+  while (true) {
+    target_cycle_.wait(rendered_cycle, std::memory_order_acquire);
+    if (!rendering_) {
+      break;
+    }
+    rendered_cycle = target_cycle_.load(std::memory_order_acquire);
+    render_until(rendered_cycle);
+  }
+}
+
 absl::Status SoundOPL3::initialize() {
+  if (output_ != Output::kRealTime) {
+    return absl::OkStatus();
+  }
+
   // Initialize SDL
   if (!SDL_Init(SDL_INIT_AUDIO)) {
     return absl::InternalError("SDL_Init for AUDIO failed");
@@ -109,20 +270,36 @@ absl::Status SoundOPL3::initialize() {
 
   SDL_AudioSpec spec;
   SDL_memset(&spec, 0, sizeof(spec));
-  spec.freq = 44100;
+  spec.freq = kSampleRate;
   spec.format = SDL_AUDIO_S16;
   spec.channels = 2;
 
   sdl_audio_stream_ =
       SDL_OpenAudioDeviceStream(SDL_AUDIO_DEVICE_DEFAULT_PLAYBACK, &spec,
-                                &SoundOPL3::AudioCallback, &opl3_chip_);
+                                &SoundOPL3::AudioCallback, this);
   if (sdl_audio_stream_ == nullptr) {
     return absl::InternalError("SDL_OpenAudio failed");
   }
 
+  render_thread_ = std::thread(&SoundOPL3::render_thread, this);
   SDL_ResumeAudioStreamDevice(sdl_audio_stream_);
 
   return absl::OkStatus();
 }
 
+absl::StatusOr<SoundOPL3::SpeedAudio> parse_speed_audio(std::string_view name) {
+  if (name == "mute") {
+    return SoundOPL3::SpeedAudio::kMute;
+  }
+  if (name == "resample") {
+    return SoundOPL3::SpeedAudio::kResample;
+  }
+  if (name == "keep_pitch") {
+    return SoundOPL3::SpeedAudio::kKeepPitch;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown speed audio mode: ", name,
+                   ". Expected mute, resample or keep_pitch."));
+}
+
 }  // namespace eight_bit
\ No newline at end of file
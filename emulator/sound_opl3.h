@@ -3,47 +3,143 @@
 
 #include <SDL3/SDL_audio.h>
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #include "Nuked-OPL3/opl3.h"
-#include "absl/base/thread_annotations.h"
 #include "absl/status/statusor.h"
-#include "absl/synchronization/mutex.h"
 #include "address_space.h"
+#include "spsc_queue.h"
+#include "time_stretch.h"
 
 namespace eight_bit {
 
+// Emulates an OPL3 sound chip. Register writes are timestamped with the
+// emulated cycle they happen at, and samples are generated at exactly
+// kSampleRate per emulated second. That keeps the audio in sync with the
+// emulation no matter how fast it runs relative to real time.
+//
+// In kRealTime mode a render thread turns register writes into samples and
+// hands them to SDL through a ring buffer. If the emulation runs ahead of real
+// time, samples that don't fit the ring buffer are dropped. If it falls behind,
+// SDL gets silence. In kOffline mode there is no thread and no audio device:
+// samples are rendered on the emulator thread and collected for
+// take_samples(). In kNone mode register writes are accepted and dropped.
+//
+// When the emulation is deliberately run faster or slower than real time with
+// set_speed(), the SpeedAudio policy decides what kRealTime output sounds like.
+// Offline samples are always in emulated time.
 class SoundOPL3 {
  public:
+  enum class Output {
+    kRealTime,
+    kOffline,
+    kNone,
+  };
+
+  enum class SpeedAudio {
+    // Silent at any speed other than 1.
+    kMute,
+    // Plays everything, faster and higher or slower and lower.
+    kResample,
+    // Plays at the original pitch, skipping or repeating bits of audio.
+    kKeepPitch,
+  };
+
+  static constexpr int kSampleRate = 44100;
+
   SoundOPL3(const SoundOPL3&) = delete;
   SoundOPL3& operator=(const SoundOPL3&) = delete;
   ~SoundOPL3();
 
+  // 'cycle_count' returns the current emulated cycle, and is only called from
+  // the emulator thread. 'ticks_per_second' converts cycles to samples.
   static absl::StatusOr<std::unique_ptr<SoundOPL3>> create(
-      AddressSpace* address_space, uint16_t base_address);
+      AddressSpace* address_space, uint16_t base_address, int ticks_per_second,
+      std::function<uint64_t()> cycle_count,
+      Output output = Output::kRealTime,
+      SpeedAudio speed_audio = SpeedAudio::kKeepPitch);
 
   void write(uint16_t address, uint8_t data);
   static uint8_t read_status();
 
+  // Lets audio generation catch up to emulated cycle 'cycle'. Samples are only
+  // generated up to the last cycle passed here, so this needs to be called
+  // regularly, e.g. after every slice of emulation.
+  void advance_to(uint64_t cycle);
+
+  // Returns and clears all samples rendered so far in kOffline mode, as
+  // interleaved 16-bit stereo. Always empty in the other modes.
+  std::vector<int16_t> take_samples();
+
+  // How many times faster than real time the emulation runs. Audio is muted at
+  // an infinite speed. Thread safe.
+  void set_speed(double speed);
+
  private:
-  SoundOPL3(AddressSpace* address_space, uint16_t base_address);
+  struct RegisterWrite {
+    uint64_t cycle;
+    uint16_t address;
+    uint8_t data;
+  };
+  using Frame = StereoFrame;
+
+  SoundOPL3(AddressSpace* address_space, uint16_t base_address,
+            int ticks_per_second, std::function<uint64_t()> cycle_count,
+            Output output, SpeedAudio speed_audio);
   absl::Status initialize();
 
+  // Generates samples until the sample clock reaches emulated cycle 'cycle',
+  // applying queued register writes as they come due. Only called from one
+  // thread at a time: the render thread in kRealTime mode, the emulator thread
+  // in kOffline mode.
+  void render_until(uint64_t cycle);
+  void output_frames(std::span<const Frame> frames);
+  void render_thread();
+
   static void AudioCallback(void* userdata, SDL_AudioStream* stream,
                             int additional_amount, int total_amount);
 
   SDL_AudioStream* sdl_audio_stream_ = nullptr;
   AddressSpace* address_space_;
   uint16_t base_address_;
+  const int ticks_per_second_;
+  const std::function<uint64_t()> cycle_count_;
+  const Output output_;
+  const SpeedAudio speed_audio_;
+  std::atomic<double> speed_ = 1.0;
+  // The register address selected by the last address write. Only used on
+  // the emulator thread.
+  uint16_t write_address_ = 0;
 
-  struct LockableOPL3Chip {
-    absl::Mutex mutex;
-    opl3_chip chip ABSL_GUARDED_BY(mutex);
-  };
-  LockableOPL3Chip opl3_chip_;
+  // Emulator thread to renderer.
+  SpscQueue<RegisterWrite, 4096> register_writes_;
+  // The cycle that rendering may advance to. Also used to wake up the render
+  // thread.
+  std::atomic<uint64_t> target_cycle_ = 0;
+  std::atomic<bool> rendering_ = true;
+  std::thread render_thread_;
+
+  // Only touched by the renderer.
+  opl3_chip chip_;
+  uint64_t rendered_frames_ = 0;
+  std::vector<int16_t> offline_samples_;
+  TimeStretch time_stretch_;
+  std::vector<Frame> stretched_frames_;
+
+  // Renderer to the SDL audio callback. About 93ms of audio.
+  SpscQueue<Frame, 4096> frames_;
 };
 
+// "mute", "resample" or "keep_pitch".
+absl::StatusOr<SoundOPL3::SpeedAudio> parse_speed_audio(std::string_view name);
+
 }  // namespace eight_bit
 
-#endif  // EIGHT_BIT_SOUND_OPL3_H
\ No newline at end of file
+#endif  // EIGHT_BIT_SOUND_OPL3_H
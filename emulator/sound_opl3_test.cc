@@ -0,0 +1,126 @@
+#include "sound_opl3.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "address_space.h"
+
+namespace eight_bit {
+namespace {
+
+class SoundOPL3Test : public ::testing::Test {
+ protected:
+  static constexpr uint16_t kBaseAddress = 0x7f80;
+  static constexpr int kTicksPerSecond = 1000000;
+
+  void SetUp() override {
+    auto sound_or = SoundOPL3::create(
+        &address_space_, kBaseAddress, kTicksPerSecond,
+        [this]() { return cycle_; }, SoundOPL3::Output::kOffline);
+    ASSERT_TRUE(sound_or.ok());
+    sound_ = std::move(sound_or.value());
+  }
+
+  void write_register(uint8_t address, uint8_t data) {
+    address_space_.set(kBaseAddress, address);
+    address_space_.set(kBaseAddress + 1, data);
+  }
+
+  AddressSpace address_space_;
+  uint64_t cycle_ = 0;
+  std::unique_ptr<SoundOPL3> sound_;
+};
+
+TEST_F(SoundOPL3Test, RendersSampleRatePerEmulatedSecond) {
+  // Slices that don't divide evenly into samples.
+  for (int i = 0; i < 1000; ++i) {
+    cycle_ += 999;
+    sound_->advance_to(cycle_);
+  }
+  sound_->advance_to(kTicksPerSecond);
+  EXPECT_EQ(sound_->take_samples().size(), 2 * SoundOPL3::kSampleRate);
+  EXPECT_TRUE(sound_->take_samples().empty());
+}
+
+TEST_F(SoundOPL3Test, RegisterWritesTakeEffectAtTheirCycle) {
+  // A full volume sine on channel 0, going to both outputs.
+  write_register(0x23, 0x01);
+  write_register(0x43, 0x00);
+  write_register(0x63, 0xf0);
+  write_register(0x83, 0x00);
+  write_register(0xa0, 0x41);
+  write_register(0xc0, 0x30);
+  // Key on half a second in.
+  cycle_ = kTicksPerSecond / 2;
+  write_register(0xb0, 0x32);
+  sound_->advance_to(kTicksPerSecond);
+
+  std::vector<int16_t> samples = sound_->take_samples();
+  ASSERT_EQ(samples.size(), 2 * SoundOPL3::kSampleRate);
+  const int key_on_sample = SoundOPL3::kSampleRate;  // Half a second, stereo
+  bool silent_before = true;
+  for (int i = 0; i < key_on_sample; ++i) {
+    silent_before &= samples[i] == 0;
+  }
+  EXPECT_TRUE(silent_before);
+  bool sound_after = false;
+  for (size_t i = key_on_sample; i < samples.size(); ++i) {
+    sound_after |= samples[i] != 0;
+  }
+  EXPECT_TRUE(sound_after);
+}
+
+TEST_F(SoundOPL3Test, InstancesKeepTheirOwnRegisterAddress) {
+  AddressSpace other_address_space;
+  auto other = SoundOPL3::create(
+      &other_address_space, kBaseAddress, kTicksPerSecond,
+      [this]() { return cycle_; }, SoundOPL3::Output::kOffline);
+  ASSERT_TRUE(other.ok());
+
+  write_register(0x23, 0x01);
+  write_register(0x63, 0xf0);
+  write_register(0xa0, 0x41);
+  write_register(0xc0, 0x30);
+  // Select the key on register here, then a different one on the other chip
+  // before writing the data.
+  address_space_.set(kBaseAddress, 0xb0);
+  other_address_space.set(kBaseAddress, 0x20);
+  address_space_.set(kBaseAddress + 1, 0x32);
+  sound_->advance_to(kTicksPerSecond / 10);
+
+  bool sound = false;
+  for (int16_t sample : sound_->take_samples()) {
+    sound |= sample != 0;
+  }
+  EXPECT_TRUE(sound);
+}
+
+TEST_F(SoundOPL3Test, NoOutputAcceptsWritesAndRendersNothing) {
+  auto sound = SoundOPL3::create(
+      &address_space_, kBaseAddress + 4, kTicksPerSecond,
+      [this]() { return cycle_; }, SoundOPL3::Output::kNone);
+  ASSERT_TRUE(sound.ok());
+  for (int i = 0; i < 10000; ++i) {
+    ++cycle_;
+    address_space_.set(kBaseAddress + 4, 0xa0);
+    address_space_.set(kBaseAddress + 5, i);
+  }
+  (*sound)->advance_to(cycle_);
+  EXPECT_TRUE((*sound)->take_samples().empty());
+}
+
+TEST_F(SoundOPL3Test, ManyWritesBetweenAdvancesDontBlock) {
+  for (int i = 0; i < 10000; ++i) {
+    ++cycle_;
+    write_register(0xa0, i);
+  }
+  sound_->advance_to(cycle_);
+  EXPECT_EQ(sound_->take_samples().size(),
+            2 * (cycle_ * SoundOPL3::kSampleRate / kTicksPerSecond));
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -46,15 +46,35 @@ SPI::SPI(IOPort* cs_port, uint8_t cs_pin, IOPort* clk_port, uint8_t clk_pin,
       state_{.previous_cs = cs_mask_} {}
 
 absl::Status SPI::initialize() {
-  mosi_port_->register_output_change_callback(
-      [this](uint8_t data) { sub_data_in(data); });
-  clk_port_->register_output_change_callback(
-      [this](uint8_t data) { clk_data_in(data); });
-  cs_port_->register_output_change_callback(
-      [this](uint8_t data) { cs_data_in(data); });
+  mosi_port_->add_output_listener<&SPI::sub_data_in>(this, mosi_mask_);
+  clk_port_->add_output_listener<&SPI::clk_data_in>(this, clk_mask_);
+  cs_port_->add_output_listener<&SPI::cs_data_in>(this, cs_mask_);
   return absl::OkStatus();
 }
 
+uint8_t SPI::transfer_byte(uint8_t data) {
+  // The first bit is already on MISO, the rest is still in the output shift
+  // register.
+  uint8_t miso_bit = (miso_port_->read_input_register() & miso_mask_) != 0;
+  uint8_t miso_data = (miso_bit << 7) | (state_.sub_data_out >> 1);
+
+  state_.sub_data_in = data;
+  state_.mosi_bit = data & 1;
+  if (byte_received_callback_) {
+    state_.sub_data_out = byte_received_callback_(data);
+    VLOG(1) << "SPI byte received: " << absl::Hex(data)
+            << " sub response: " << absl::Hex(state_.sub_data_out);
+  } else {
+    state_.sub_data_out = 0xff;
+  }
+  // Same as the falling edge at the end of a byte: present the first bit of the
+  // next one.
+  uint8_t out_bit = state_.sub_data_out & 0x80;
+  state_.sub_data_out <<= 1;
+  miso_port_->provide_inputs(out_bit ? miso_mask_ : 0, miso_mask_);
+  return miso_data;
+}
+
 void SPI::clk_data_in(uint8_t data) {
   // Check for clock transitions.
   if ((clk_mask_ & data) != state_.previous_clock) {
@@ -37,6 +37,11 @@ class SPI {
   // the MISO line.
   void set_chip_select_callback(const chip_select_callback& callback);
 
+  // Transfer a whole byte at once. This has the same effect as the main side
+  // driving MOSI and 8 clock cycles, and returns the byte it would have sampled
+  // on MISO. Must only be called between bytes, with the clock low.
+  uint8_t transfer_byte(uint8_t data);
+
  private:
   SPI(IOPort* cs_port, uint8_t cs_pin, IOPort* clk_port, uint8_t clk_pin,
       IOPort* mosi_port, uint8_t mosi_pin, IOPort* miso_port, uint8_t miso_pin);
@@ -0,0 +1,102 @@
+#ifndef EIGHT_BIT_SPSC_QUEUE_H
+#define EIGHT_BIT_SPSC_QUEUE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <span>
+
+namespace eight_bit {
+
+// A bounded, lock-free queue for exactly one producer thread and one consumer
+// thread. Neither side ever blocks: push() fails when the queue is full and
+// front() returns nullptr when it's empty. 'kCapacity' must be a power of two.
+template <typename T, size_t kCapacity>
+class SpscQueue {
+  static_assert(std::has_single_bit(kCapacity),
+                "SpscQueue capacity must be a power of two");
+
+ public:
+  SpscQueue() = default;
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Producer side. Returns false if the queue is full.
+  bool push(const T& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kCapacity) {
+      return false;
+    }
+    buffer_[tail & kMask] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Producer side. Pushes as many of 'values' as fit and returns how many that
+  // was.
+  size_t push(std::span<const T> values) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t free =
+        kCapacity - (tail - head_.load(std::memory_order_acquire));
+    const size_t count = std::min(values.size(), free);
+    for (size_t i = 0; i < count; ++i) {
+      buffer_[(tail + i) & kMask] = values[i];
+    }
+    tail_.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  // Consumer side. Returns the oldest element without removing it, or nullptr
+  // if the queue is empty.
+  const T* front() const {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &buffer_[head & kMask];
+  }
+
+  // Consumer side. Removes the element returned by front(), which must not have
+  // been nullptr.
+  void pop() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  // Consumer side. Moves up to 'values.size()' elements into 'values' and
+  // returns how many that was.
+  size_t pop(std::span<T> values) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    const size_t available = tail_.load(std::memory_order_acquire) - head;
+    const size_t count = std::min(values.size(), available);
+    for (size_t i = 0; i < count; ++i) {
+      values[i] = buffer_[(head + i) & kMask];
+    }
+    head_.store(head + count, std::memory_order_release);
+    return count;
+  }
+
+  // Number of queued elements. Only exact when called from one of the two
+  // sides while the other one is idle.
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return kCapacity; }
+
+ private:
+  static constexpr size_t kMask = kCapacity - 1;
+
+  std::array<T, kCapacity> buffer_;
+  // Both indices only ever grow and are masked on access. They live on
+  // separate cache lines so that the two sides don't contend.
+  alignas(64) std::atomic<size_t> head_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_SPSC_QUEUE_H
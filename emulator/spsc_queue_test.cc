@@ -0,0 +1,77 @@
+#include "spsc_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace eight_bit {
+namespace {
+
+TEST(SpscQueueTest, PushAndPopInOrder) {
+  SpscQueue<int, 4> queue;
+  EXPECT_EQ(queue.front(), nullptr);
+  EXPECT_TRUE(queue.push(1));
+  EXPECT_TRUE(queue.push(2));
+  ASSERT_NE(queue.front(), nullptr);
+  EXPECT_EQ(*queue.front(), 1);
+  queue.pop();
+  EXPECT_EQ(*queue.front(), 2);
+  queue.pop();
+  EXPECT_EQ(queue.front(), nullptr);
+}
+
+TEST(SpscQueueTest, PushFailsWhenFull) {
+  SpscQueue<int, 4> queue;
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.push(i));
+  }
+  EXPECT_FALSE(queue.push(4));
+  EXPECT_EQ(queue.size(), 4);
+  queue.pop();
+  EXPECT_TRUE(queue.push(4));
+}
+
+TEST(SpscQueueTest, BulkOperationsWrapAround) {
+  SpscQueue<int, 4> queue;
+  std::array<int, 3> in = {1, 2, 3};
+  std::array<int, 4> out = {};
+  EXPECT_EQ(queue.push(std::span<const int>(in)), 3);
+  EXPECT_EQ(queue.pop(std::span(out.data(), 2)), 2);
+  // Only 3 of these fit, and they wrap around the end of the buffer.
+  EXPECT_EQ(queue.push(std::span<const int>(in)), 3);
+  EXPECT_EQ(queue.push(std::span<const int>(in)), 0);
+  EXPECT_EQ(queue.pop(std::span(out)), 4);
+  EXPECT_EQ(out, (std::array<int, 4>{3, 1, 2, 3}));
+}
+
+TEST(SpscQueueTest, TransfersAcrossThreads) {
+  constexpr uint32_t kCount = 100000;
+  SpscQueue<uint32_t, 64> queue;
+  std::thread producer([&queue]() {
+    for (uint32_t i = 0; i < kCount; ++i) {
+      while (!queue.push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+  std::vector<uint32_t> received;
+  while (received.size() < kCount) {
+    const uint32_t* value = queue.front();
+    if (value == nullptr) {
+      std::this_thread::yield();
+      continue;
+    }
+    received.push_back(*value);
+    queue.pop();
+  }
+  producer.join();
+  for (uint32_t i = 0; i < kCount; ++i) {
+    ASSERT_EQ(received[i], i);
+  }
+}
+
+}  // namespace
+}  // namespace eight_bit
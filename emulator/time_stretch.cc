@@ -0,0 +1,68 @@
+#include "time_stretch.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace eight_bit {
+namespace {
+
+int16_t mix(int16_t from, int16_t to, int step) {
+  return static_cast<int16_t>(
+      (from * (TimeStretch::kFadeFrames - step) + to * step) /
+      TimeStretch::kFadeFrames);
+}
+
+}  // namespace
+
+void TimeStretch::process(std::span<const StereoFrame> input, double speed,
+                          std::vector<StereoFrame>* output) {
+  if (speed == 1.0) {
+    // The tail is the start of the collected grain, so that's all that's left
+    // to play.
+    output->insert(output->end(), grain_.begin(),
+                   grain_.begin() + grain_size_);
+    grain_size_ = 0;
+    has_tail_ = false;
+    credit_ = 0;
+    output->insert(output->end(), input.begin(), input.end());
+    return;
+  }
+  while (!input.empty()) {
+    const int count =
+        std::min<int>(input.size(), grain_.size() - grain_size_);
+    std::copy_n(input.begin(), count, grain_.begin() + grain_size_);
+    grain_size_ += count;
+    input = input.subspan(count);
+    if (grain_size_ == static_cast<int>(grain_.size())) {
+      emit_grain(speed, output);
+      // The overlap starts the next grain.
+      std::copy(grain_.end() - kFadeFrames, grain_.end(), grain_.begin());
+      grain_size_ = kFadeFrames;
+    }
+  }
+}
+
+void TimeStretch::emit_grain(double speed, std::vector<StereoFrame>* output) {
+  // Every grain moves the input on by kGrainFrames. The output needs one
+  // grain's worth per 'speed' of those.
+  credit_ += 1.0 / speed;
+  while (credit_ >= 1.0) {
+    credit_ -= 1.0;
+    int start = 0;
+    if (has_tail_) {
+      for (int i = 0; i < kFadeFrames; ++i) {
+        output->push_back({mix(tail_[i].left, grain_[i].left, i),
+                           mix(tail_[i].right, grain_[i].right, i)});
+      }
+      start = kFadeFrames;
+    }
+    output->insert(output->end(), grain_.begin() + start,
+                   grain_.end() - kFadeFrames);
+    std::copy(grain_.end() - kFadeFrames, grain_.end(), tail_.begin());
+    has_tail_ = true;
+  }
+}
+
+}  // namespace eight_bit
@@ -0,0 +1,51 @@
+#ifndef EIGHT_BIT_TIME_STRETCH_H
+#define EIGHT_BIT_TIME_STRETCH_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace eight_bit {
+
+struct StereoFrame {
+  int16_t left;
+  int16_t right;
+};
+
+// Plays audio produced at 'speed' times real time back at real time, without
+// changing its pitch. The input is cut into short grains, and grains are
+// skipped when running fast or repeated when running slow. Each grain overlaps
+// the next by kFadeFrames, and the overlap is crossfaded so that the cuts
+// don't click.
+//
+// This is crude compared to a proper overlap-add stretcher, but it keeps notes
+// at their pitch and costs next to nothing.
+class TimeStretch {
+ public:
+  // About 20ms at 44.1kHz.
+  static constexpr int kGrainFrames = 882;
+  static constexpr int kFadeFrames = 64;
+
+  // Appends the real-time output for 'input' to 'output'. At a speed of 1 the
+  // input passes through unchanged, and at an infinite speed nothing comes
+  // out.
+  void process(std::span<const StereoFrame> input, double speed,
+               std::vector<StereoFrame>* output);
+
+ private:
+  // Emits the grain collected so far as often as the speed calls for.
+  void emit_grain(double speed, std::vector<StereoFrame>* output);
+
+  std::array<StereoFrame, kGrainFrames + kFadeFrames> grain_;
+  int grain_size_ = 0;
+  // The end of the last emitted grain, held back to fade into the next one.
+  std::array<StereoFrame, kFadeFrames> tail_;
+  bool has_tail_ = false;
+  // How many grains are owed to the output, in fractions of a grain.
+  double credit_ = 0;
+};
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_TIME_STRETCH_H
@@ -0,0 +1,88 @@
+#include "time_stretch.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace eight_bit {
+namespace {
+
+constexpr int kGrain = TimeStretch::kGrainFrames;
+constexpr int kFade = TimeStretch::kFadeFrames;
+
+// A ramp, so that every frame can be told apart.
+std::vector<StereoFrame> ramp(int frames) {
+  std::vector<StereoFrame> result;
+  for (int i = 0; i < frames; ++i) {
+    result.push_back({static_cast<int16_t>(i), static_cast<int16_t>(-i)});
+  }
+  return result;
+}
+
+// Just enough input for 'grains' whole grains, including the last overlap.
+int grains(int count) { return kFade + count * kGrain; }
+
+TEST(TimeStretchTest, PassesThroughAtNormalSpeed) {
+  TimeStretch stretch;
+  const auto input = ramp(1000);
+  std::vector<StereoFrame> output;
+  stretch.process(input, 1.0, &output);
+  ASSERT_EQ(output.size(), input.size());
+  for (size_t i = 0; i < input.size(); ++i) {
+    EXPECT_EQ(output[i].left, input[i].left) << i;
+  }
+}
+
+TEST(TimeStretchTest, SkipsGrainsWhenFast) {
+  TimeStretch stretch;
+  std::vector<StereoFrame> output;
+  stretch.process(ramp(grains(10)), 2.0, &output);
+  ASSERT_EQ(output.size(), 5u * kGrain);
+  // Every other grain is played, at its original pitch.
+  EXPECT_EQ(output[kGrain + kFade].left, 3 * kGrain + kFade);
+  EXPECT_EQ(output[kGrain + kFade + 1].left, 3 * kGrain + kFade + 1);
+}
+
+TEST(TimeStretchTest, RepeatsGrainsWhenSlow) {
+  TimeStretch stretch;
+  std::vector<StereoFrame> output;
+  stretch.process(ramp(grains(10)), 0.5, &output);
+  ASSERT_EQ(output.size(), 20u * kGrain);
+  EXPECT_EQ(output[kFade].left, kFade);
+  EXPECT_EQ(output[kGrain + kFade].left, kFade);
+}
+
+TEST(TimeStretchTest, CrossfadesBetweenGrains) {
+  TimeStretch stretch;
+  std::vector<StereoFrame> input(grains(2), StereoFrame{1000, -1000});
+  std::vector<StereoFrame> output;
+  stretch.process(input, 0.5, &output);
+  // A constant signal stays constant across the cuts.
+  ASSERT_EQ(output.size(), 4u * kGrain);
+  for (const StereoFrame& frame : output) {
+    EXPECT_EQ(frame.left, 1000);
+    EXPECT_EQ(frame.right, -1000);
+  }
+}
+
+TEST(TimeStretchTest, SilentWhenUnlimited) {
+  TimeStretch stretch;
+  std::vector<StereoFrame> output;
+  stretch.process(ramp(grains(10)),
+                  std::numeric_limits<double>::infinity(), &output);
+  EXPECT_TRUE(output.empty());
+}
+
+TEST(TimeStretchTest, ReturnsToNormalSpeedWithoutLosingInput) {
+  TimeStretch stretch;
+  std::vector<StereoFrame> output;
+  stretch.process(ramp(kGrain), 2.0, &output);
+  EXPECT_TRUE(output.empty());
+  stretch.process(ramp(10), 1.0, &output);
+  EXPECT_EQ(output.size(), kGrain + 10u);
+}
+
+}  // namespace
+}  // namespace eight_bit
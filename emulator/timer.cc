@@ -14,11 +14,15 @@ constexpr uint8_t kTimerInterruptEnable = 0x04;
 Timer::Timer(AddressSpace* address_space, Interrupt* interrupt)
     : address_space_(address_space), interrupt_(interrupt) {
   auto status = address_space_->register_read(
-      0x0008, 0x0008, [this](uint16_t) { return read_status_register(); });
+      0x0008, 0x0008, [this](uint16_t) { return read_status_register(); },
+      [this](uint16_t) { return status_register_; });
   if (!status.ok()) {
     LOG(ERROR) << "Failed to register read callback for Timer status register: "
                << status;
   }
+  // Reading the status register arms clearing the overflow flag, which reading
+  // again doesn't change. The counter changes on every tick.
+  address_space_->set_stable_reads(0x0008, 0x0008);
   status = address_space_->register_write(
       0x0008, 0x0008,
       [this](uint16_t, uint8_t data) { write_status_register(data); });
@@ -28,7 +32,8 @@ Timer::Timer(AddressSpace* address_space, Interrupt* interrupt)
         << status;
   }
   status = address_space_->register_read(
-      0x0009, 0x0009, [this](uint16_t) { return read_counter_high(); });
+      0x0009, 0x0009, [this](uint16_t) { return read_counter_high(); },
+      [this](uint16_t) -> uint8_t { return counter_ >> 8; });
   if (!status.ok()) {
     LOG(ERROR) << "Failed to register read callback for Timer counter high: "
                << status;
@@ -41,7 +46,10 @@ Timer::Timer(AddressSpace* address_space, Interrupt* interrupt)
                << status;
   }
   status = address_space_->register_read(
-      0x000a, 0x000a, [this](uint16_t) { return read_counter_low(); });
+      0x000a, 0x000a, [this](uint16_t) { return read_counter_low(); },
+      [this](uint16_t) -> uint8_t {
+        return counter_low_latched_ ? counter_low_latch_ : counter_;
+      });
   if (!status.ok()) {
     LOG(ERROR) << "Failed to register read callback for Timer counter low: "
                << status;
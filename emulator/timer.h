@@ -18,6 +18,11 @@ class Timer {
   // Increment the counter.
   void tick();
 
+  // The number of ticks until the next overflow, not counting the overflowing
+  // one. skip() advances the counter by up to that many ticks at once.
+  int idle_ticks() const { return 0xffff - counter_; }
+  void skip(int ticks) { counter_ += ticks; }
+
   // Read/write access for the status register. The top 3 bits of the status
   // register are read-only and are never changed on writes.
   uint8_t read_status_register();
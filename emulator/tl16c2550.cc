@@ -1,20 +1,24 @@
 #include "tl16c2550.h"
 
-#include <poll.h>
 #include <pty.h>
 #include <termios.h>
 #include <unistd.h>
 
-#include <chrono>
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <functional>
+#include <limits>
 #include <memory>
-#include <queue>
-#include <thread>
+#include <optional>
+#include <span>
+#include <string>
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "io_reactor.h"
 
 namespace eight_bit {
 namespace {
@@ -27,9 +31,11 @@ constexpr uint8_t kLsrDataReady = 0b00000001;
 }  // namespace
 
 TL16C2550::~TL16C2550() {
-  ::write(shutdown_fd_[1], "x", 1);
-  if (read_thread_.joinable()) {
-    read_thread_.join();
+  if (io_reactor_ != nullptr) {
+    auto status = io_reactor_->remove(our_fd_);
+    if (!status.ok()) {
+      LOG(ERROR) << status;
+    }
   }
   if (our_fd_ != 0) {
     close(our_fd_);
@@ -37,18 +43,13 @@ TL16C2550::~TL16C2550() {
   if (their_fd_ != 0) {
     close(their_fd_);
   }
-  if (shutdown_fd_[0] != 0) {
-    close(shutdown_fd_[0]);
-  }
-  if (shutdown_fd_[1] != 0) {
-    close(shutdown_fd_[1]);
-  }
 }
 
 absl::StatusOr<std::unique_ptr<TL16C2550>> TL16C2550::create(
-    AddressSpace* address_space, uint16_t base_address, Interrupt* interrupt) {
-  std::unique_ptr<TL16C2550> tl16c2550(
-      new TL16C2550(address_space, base_address, interrupt));
+    AddressSpace* address_space, uint16_t base_address, Interrupt* interrupt,
+    std::function<uint64_t()> cycle_count) {
+  std::unique_ptr<TL16C2550> tl16c2550(new TL16C2550(
+      address_space, base_address, interrupt, std::move(cycle_count)));
   auto status = tl16c2550->initialize();
   if (!status.ok()) {
     return status;
@@ -58,23 +59,33 @@ absl::StatusOr<std::unique_ptr<TL16C2550>> TL16C2550::create(
 
 uint8_t TL16C2550::read(uint16_t address) {
   uint16_t offset = address - base_address_;
+  const std::optional<uint8_t> value = register_value(offset);
+  if (!value.has_value()) {
+    LOG(ERROR) << "Read from invalid TL16C2550 address: "
+               << absl::Hex(offset, absl::kZeroPad2);
+    return 0;
+  }
+  if (offset == 0) {
+    absl::MutexLock lock(&io_mutex_);
+    if (receive_data_available_irq_id_ != 0) {
+      interrupt_->clear_interrupt(receive_data_available_irq_id_);
+      receive_data_available_irq_id_ = 0;
+    }
+    // The next byte, if any, moves in on the next tick.
+    line_status_register_ &= ~kLsrDataReady;
+  }
+  return *value;
+}
+
+uint8_t TL16C2550::peek(uint16_t address) {
+  return register_value(address - base_address_).value_or(0);
+}
+
+std::optional<uint8_t> TL16C2550::register_value(uint16_t offset) {
   switch (offset) {
     case 0: {
       absl::MutexLock lock(&io_mutex_);
-      if (receive_data_available_irq_id_ != 0) {
-        interrupt_->clear_interrupt(receive_data_available_irq_id_);
-        receive_data_available_irq_id_ = 0;
-      }
-      if (rx_fifo_.empty()) {
-        // TODO: check if we should return the last received byte instead of 0
-        return 0;
-      }
-      uint8_t data = rx_fifo_.front();
-      rx_fifo_.pop();
-      if (rx_fifo_.empty()) {
-        line_status_register_ &= ~kLsrDataReady;
-      }
-      return data;
+      return receive_buffer_register_;
     }
     case 1:
       return interrupt_ident_register_;
@@ -91,9 +102,7 @@ uint8_t TL16C2550::read(uint16_t address) {
     case 7:
       return scratch_register_;
     default:
-      LOG(ERROR) << "Read from invalid TL16C2550 address: "
-                 << absl::Hex(offset, absl::kZeroPad2);
-      return 0;
+      return std::nullopt;
   }
 }
 
@@ -102,7 +111,9 @@ void TL16C2550::write(uint16_t address, uint8_t data) {
   // TODO: this only implements one of the two UARTs in the TL16C2550
   switch (offset) {
     case 0:
-      ::write(our_fd_, &data, 1);
+      if (our_fd_ != 0) {
+        ::write(our_fd_, &data, 1);
+      }
       break;
     case 1: {
       // interrupt enable register
@@ -149,18 +160,98 @@ void TL16C2550::write(uint16_t address, uint8_t data) {
   }
 }
 
+bool TL16C2550::inject(std::span<const uint8_t> data, uint64_t cycle) {
+  absl::MutexLock lock(&inject_mutex_);
+  if (injected_rx_.capacity() - injected_rx_.size() < data.size()) {
+    return false;
+  }
+  for (uint8_t byte : data) {
+    injected_rx_.push({.cycle = cycle, .data = byte});
+  }
+  return true;
+}
+
+void TL16C2550::set_receive_callback(std::function<void(uint8_t)> callback) {
+  receive_callback_ = std::move(callback);
+}
+
+void TL16C2550::tick() {
+  if (line_status_register_ & kLsrDataReady) {
+    return;
+  }
+  uint8_t data = 0;
+  if (const uint8_t* front = rx_fifo_.front()) {
+    data = *front;
+    rx_fifo_.pop();
+    if (rx_paused_.exchange(false)) {
+      io_reactor_->resume(our_fd_);
+    }
+  } else if (injected_byte_due()) {
+    data = injected_rx_.front()->data;
+    injected_rx_.pop();
+  } else {
+    return;
+  }
+  {
+    absl::MutexLock lock(&io_mutex_);
+    receive_buffer_register_ = data;
+    signal_data_ready();
+  }
+  if (receive_callback_) {
+    receive_callback_(data);
+  }
+}
+
+int TL16C2550::idle_ticks() const {
+  if (line_status_register_ & kLsrDataReady) {
+    return std::numeric_limits<int>::max();
+  }
+  if (rx_fifo_.front() != nullptr) {
+    return 0;
+  }
+  const TimedByte* next = injected_rx_.front();
+  if (next == nullptr) {
+    return std::numeric_limits<int>::max();
+  }
+  const uint64_t cycle = cycle_count_();
+  if (next->cycle <= cycle + 1) {
+    return 0;
+  }
+  return std::min<uint64_t>(next->cycle - cycle - 1,
+                            std::numeric_limits<int>::max());
+}
+
+bool TL16C2550::injected_byte_due() const {
+  const TimedByte* next = injected_rx_.front();
+  return next != nullptr && next->cycle <= cycle_count_();
+}
+
+void TL16C2550::signal_data_ready() {
+  line_status_register_ |= kLsrDataReady;
+  if ((interrupt_enable_register_ & kIerEnableReceivedInterrupt) != 0) {
+    // There is a hierarchy of interrupts, but for now we only support the read
+    // one. TODO: implement the rest.
+    interrupt_ident_register_ = kIirReceiveInterrupt;
+    if (receive_data_available_irq_id_ == 0) {
+      receive_data_available_irq_id_ = interrupt_->set_interrupt();
+    }
+  }
+}
+
 std::string TL16C2550::get_pty_name(int uart_number) const {
-  if (uart_number != 0) {
+  if (uart_number != 0 || their_fd_ == 0) {
     return "";
   }
   return ttyname(their_fd_);
 }
 
 TL16C2550::TL16C2550(AddressSpace* address_space, uint16_t base_address,
-                     Interrupt* interrupt)
+                     Interrupt* interrupt,
+                     std::function<uint64_t()> cycle_count)
     : address_space_(address_space),
       base_address_(base_address),
-      interrupt_(interrupt) {}
+      interrupt_(interrupt),
+      cycle_count_(std::move(cycle_count)) {}
 
 absl::Status TL16C2550::initialize() {
   auto status = address_space_->register_write(
@@ -171,65 +262,52 @@ absl::Status TL16C2550::initialize() {
   }
   status = address_space_->register_read(
       base_address_, base_address_ + 15,
-      [this](uint16_t address) { return read(address); });
+      [this](uint16_t address) { return read(address); },
+      [this](uint16_t address) { return peek(address); });
   if (!status.ok()) {
     return status;
   }
+  // Everything but the receive buffer, whose reads take the byte out.
+  address_space_->set_stable_reads(base_address_ + 1, base_address_ + 7);
 
+  return absl::OkStatus();
+}
+
+absl::Status TL16C2550::connect_pty(IoReactor* io_reactor) {
+  if (our_fd_ != 0) {
+    return absl::FailedPreconditionError("PTY is already connected");
+  }
   struct termios term;
   if (openpty(&our_fd_, &their_fd_, nullptr, &term, nullptr)) {
+    our_fd_ = 0;
+    their_fd_ = 0;
     return absl::InternalError("Failed to open PTY");
   }
 
-  // Create a pipe to signal the read thread to stop.
-  if (pipe(shutdown_fd_.data()) != 0) {
-    return absl::InternalError(
-        absl::StrCat("Failed to create pipe: ", strerror(errno)));
+  auto status = io_reactor->add(our_fd_, [this]() { return receive(); });
+  if (!status.ok()) {
+    return status;
   }
-  read_thread_ =
-      std::thread([this]() { read_thread(our_fd_, shutdown_fd_[0]); });
-
+  io_reactor_ = io_reactor;
   return absl::OkStatus();
 }
 
-void TL16C2550::read_thread(int read_fd, int shutdown_fd) {
-  while (true) {
-    std::array<struct pollfd, 2> fds;
-    fds[0].fd = read_fd;
-    fds[0].events = POLLIN;
-    // The read end of the pipe for the shutdown signal.
-    fds[1].fd = shutdown_fd;
-    fds[1].events = POLLIN;
-
-    int retval = poll(fds.data(), fds.size(), -1);  // -1 means no timeout
-    if (retval == -1) {
-      perror("poll");
-      continue;
-    }
-    if (retval > 0) {
-      if (fds[0].revents & POLLIN) {
-        uint8_t data;
-        if (::read(read_fd, &data, 1) > 0) {
-          absl::MutexLock lock(&io_mutex_);
-          rx_fifo_.push(data);
-          line_status_register_ |= kLsrDataReady;
-          if ((interrupt_enable_register_ & kIerEnableReceivedInterrupt) != 0) {
-            // There is a hierarchy of interrupts, but for now we only support
-            // the read one. TODO: implement the rest.
-            interrupt_ident_register_ = kIirReceiveInterrupt;
-            if (receive_data_available_irq_id_ == 0) {
-              receive_data_available_irq_id_ = interrupt_->set_interrupt();
-            }
-          }
-        }
-      }
-      if (fds[1].revents & POLLIN) {
-        // We've been woken up by a write on the shutdown pipe. Stop the
-        // thread.
-        break;
-      }
-    }
+bool TL16C2550::receive() {
+  std::array<uint8_t, 256> buffer;
+  // Don't read more than fits. The rest stays in the PTY until tick() makes
+  // room and resumes reading.
+  const size_t space = rx_fifo_.capacity() - rx_fifo_.size();
+  if (space == 0) {
+    rx_paused_ = true;
+    return false;
+  }
+  ssize_t count =
+      ::read(our_fd_, buffer.data(), std::min(buffer.size(), space));
+  if (count <= 0) {
+    return true;
   }
+  rx_fifo_.push(std::span<const uint8_t>(buffer.data(), count));
+  return true;
 }
 
 }  // namespace eight_bit
\ No newline at end of file
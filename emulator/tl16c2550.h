@@ -1,16 +1,21 @@
 #ifndef EIGHT_BIT_TL16C2550_H
 #define EIGHT_BIT_TL16C2550_H
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
 #include <memory>
-#include <queue>
-#include <thread>
+#include <optional>
+#include <span>
+#include <string>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "address_space.h"
 #include "interrupt.h"
+#include "io_reactor.h"
+#include "spsc_queue.h"
 
 namespace eight_bit {
 
@@ -20,20 +25,60 @@ class TL16C2550 {
   TL16C2550& operator=(const TL16C2550&) = delete;
   ~TL16C2550();
 
+  // 'cycle_count' returns the current emulated cycle, and is only called from
+  // the emulator thread.
   static absl::StatusOr<std::unique_ptr<TL16C2550>> create(
-      AddressSpace* address_space, uint16_t base_address, Interrupt* interrupt);
+      AddressSpace* address_space, uint16_t base_address, Interrupt* interrupt,
+      std::function<uint64_t()> cycle_count);
 
   uint8_t read(uint16_t address);
+  // Like read(), but doesn't consume the received byte.
+  uint8_t peek(uint16_t address);
   void write(uint16_t address, uint8_t data);
 
+  // Queues 'data' to arrive at emulated cycle 'cycle', as if it had come in
+  // through the PTY at that point, but without the PTY round trip. Returns
+  // false if there isn't enough room for all of it. Thread safe.
+  bool inject(std::span<const uint8_t> data, uint64_t cycle);
+
+  // 'callback' is called on the emulator thread with every byte as it moves
+  // into the receive buffer register.
+  void set_receive_callback(std::function<void(uint8_t)> callback);
+
+  // Tick callback that moves the next received byte into the receive buffer
+  // register once the previous one has been read. PTY data is taken as soon as
+  // it's there, injected data once its cycle has come.
+  void tick();
+  // The number of upcoming ticks in which no byte is received. skip() is a
+  // no-op as there are no counters to advance. Data that arrives on the PTY
+  // during a skip is received on the first tick after it.
+  int idle_ticks() const;
+  void skip(int /*ticks*/) {}
+
+  // Empty if there's no PTY.
   std::string get_pty_name(int uart_number) const;
 
+  // Opens a PTY for the host side of the port, and starts receiving what's
+  // written to it on the reactor thread. Without a PTY, transmitted data is
+  // dropped and only injected data is received. 'io_reactor' has to outlive
+  // this object.
+  absl::Status connect_pty(IoReactor* io_reactor);
+
  private:
   TL16C2550(AddressSpace* address_space, uint16_t base_address,
-            Interrupt* interrupt);
+            Interrupt* interrupt, std::function<uint64_t()> cycle_count);
   absl::Status initialize();
 
-  void read_thread(int read_fd, int shutdown_fd);
+  // Sets the data ready bit and raises the receive interrupt if it's enabled.
+  void signal_data_ready() ABSL_EXCLUSIVE_LOCKS_REQUIRED(io_mutex_);
+  // The value of the register at 'offset', or nullopt if it isn't implemented.
+  std::optional<uint8_t> register_value(uint16_t offset);
+  // Whether the injected byte at the front of injected_rx_ is due.
+  bool injected_byte_due() const;
+
+  // Reads whatever is available on the PTY into rx_fifo_. Runs on the reactor
+  // thread. Returns false once rx_fifo_ is full.
+  bool receive();
 
   AddressSpace* address_space_;
   uint16_t base_address_;
@@ -52,16 +97,29 @@ class TL16C2550 {
   uint8_t line_status_register_ = 0b01100000;
   uint8_t modem_status_register_ = 0;
   uint8_t scratch_register_ = 0;
+  uint8_t receive_buffer_register_ = 0;
 
   // FD 0 is stdin, so it's usable here as a sentinel value for "not open".
   int our_fd_ = 0;
   int their_fd_ = 0;
 
-  // Used to signal the read thread to stop.
-  std::array<int, 2> shutdown_fd_ = {0, 0};
-  std::thread read_thread_;
-
-  std::queue<uint8_t> rx_fifo_ ABSL_GUARDED_BY(io_mutex_);
+  IoReactor* io_reactor_ = nullptr;
+
+  // Reactor thread to emulator thread.
+  SpscQueue<uint8_t, 4096> rx_fifo_;
+  // Set by receive() when rx_fifo_ was full and the reactor stopped reading.
+  std::atomic<bool> rx_paused_ = false;
+
+  const std::function<uint64_t()> cycle_count_;
+  struct TimedByte {
+    uint64_t cycle;
+    uint8_t data;
+  };
+  // Injecting threads to emulator thread. The mutex only serializes the
+  // injecting threads, the emulator thread never takes it.
+  absl::Mutex inject_mutex_;
+  SpscQueue<TimedByte, 4096> injected_rx_;
+  std::function<void(uint8_t)> receive_callback_;
 };
 
 }  // namespace eight_bit
@@ -0,0 +1,97 @@
+#include "tl16c2550.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status_matchers.h"
+#include "address_space.h"
+#include "interrupt.h"
+
+namespace eight_bit {
+namespace {
+
+using ::absl_testing::IsOk;
+
+constexpr uint16_t kBaseAddress = 0x7f40;
+constexpr uint8_t kEnableReceivedInterrupt = 0x01;
+constexpr uint8_t kDataReady = 0x01;
+
+class TL16C2550Test : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto uart = TL16C2550::create(&address_space_, kBaseAddress, &interrupt_,
+                                  [this]() { return cycle_; });
+    ASSERT_THAT(uart.status(), IsOk());
+    uart_ = std::move(uart.value());
+    uart_->write(kBaseAddress + 1, kEnableReceivedInterrupt);
+  }
+
+  // Ticks the UART like the CPU would, one cycle at a time.
+  void run_until(uint64_t cycle) {
+    while (cycle_ < cycle) {
+      ++cycle_;
+      uart_->tick();
+    }
+  }
+
+  bool data_ready() {
+    return (uart_->read(kBaseAddress + 5) & kDataReady) != 0;
+  }
+
+  uint64_t cycle_ = 0;
+  AddressSpace address_space_;
+  Interrupt interrupt_;
+  std::unique_ptr<TL16C2550> uart_;
+};
+
+TEST_F(TL16C2550Test, InjectedBytesArriveAtTheirCycle) {
+  std::vector<uint64_t> receive_cycles;
+  uart_->set_receive_callback(
+      [this, &receive_cycles](uint8_t) { receive_cycles.push_back(cycle_); });
+  const std::vector<uint8_t> message = {0x90, 0x3c, 0x40};
+  ASSERT_TRUE(uart_->inject(message, 100));
+  EXPECT_EQ(uart_->idle_ticks(), 99);
+
+  run_until(99);
+  EXPECT_FALSE(data_ready());
+  EXPECT_FALSE(interrupt_.has_interrupt());
+
+  run_until(100);
+  EXPECT_TRUE(data_ready());
+  EXPECT_TRUE(interrupt_.has_interrupt());
+  for (uint8_t byte : message) {
+    EXPECT_TRUE(data_ready());
+    EXPECT_EQ(uart_->read(kBaseAddress), byte);
+    run_until(cycle_ + 1);
+  }
+  EXPECT_FALSE(data_ready());
+  // Each byte moves in on the tick after the previous one was read.
+  EXPECT_EQ(receive_cycles, (std::vector<uint64_t>{100, 101, 102}));
+}
+
+TEST_F(TL16C2550Test, InjectRefusesWhatDoesntFit) {
+  std::vector<uint8_t> data(4096, 0xfe);
+  EXPECT_TRUE(uart_->inject(data, 0));
+  const std::vector<uint8_t> message = {0xf8};
+  EXPECT_FALSE(uart_->inject(message, 0));
+  uart_->tick();
+  EXPECT_EQ(uart_->read(kBaseAddress), 0xfe);
+  EXPECT_TRUE(uart_->inject(message, 0));
+}
+
+TEST_F(TL16C2550Test, PeekLeavesTheReceivedByteInPlace) {
+  const std::vector<uint8_t> message = {0x42};
+  ASSERT_TRUE(uart_->inject(message, 0));
+  run_until(1);
+  EXPECT_EQ(uart_->peek(kBaseAddress), 0x42);
+  EXPECT_TRUE(data_ready());
+  EXPECT_TRUE(interrupt_.has_interrupt());
+  EXPECT_EQ(uart_->read(kBaseAddress), 0x42);
+  EXPECT_FALSE(data_ready());
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -1,8 +1,11 @@
 #include "w65c22.h"
 
 #include <atomic>
+#include <algorithm>
 #include <bit>
+#include <limits>
 #include <memory>
+#include <optional>
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
@@ -58,7 +61,21 @@ void W65C22::tick() {
   if (shift_register_shifts_remaining_ > 0) {
     --shift_register_ticks_to_next_edge_;
     if (shift_register_ticks_to_next_edge_ == 0) {
-      if (port_cb_state_ & kCb1Mask) {
+      if (shift_register_byte_mode_) {
+        if (shift_register_shifts_remaining_ == 8) {
+          // This is the last falling clock edge, hand over the whole byte.
+          shift_out_callback_(shift_register_);
+          shift_register_shifts_remaining_ = 1;
+          shift_register_ticks_to_next_edge_ = 1;
+        } else {
+          // Leave CB1/CB2 as shifting bit by bit would: clock up, and the last
+          // bit out. The SR has rotated all the way around by now.
+          port_cb_state_ = kCb1Mask | ((shift_register_ & 1) << kCb2Pin);
+          port_cb_.write_output_register(port_cb_state_);
+          shift_register_shifts_remaining_ = 0;
+          set_irq_flag(kIrqShiftRegister);
+        }
+      } else if (port_cb_state_ & kCb1Mask) {
         // Clock is up, so we're at the start of a shift cycle. The actual
         // hardware first lowers the clock line (CB1), then prepares the next
         // bit (CB2). We do this here in two steps to make sure we're not
@@ -93,6 +110,33 @@ void W65C22::tick() {
   }
 }
 
+int W65C22::idle_ticks() const {
+  if (reload_timer1_latch_) {
+    return 0;
+  }
+  // A counter at 0 wraps around and takes a full 0x10000 ticks to get back.
+  auto ticks_to_zero = [](uint16_t counter) {
+    return counter == 0 ? 0x10000 : counter;
+  };
+  // Timer 1 reloads from the latch on every pass through 0, active or not.
+  int ticks = ticks_to_zero(timer1_counter_) - 1;
+  if (timer2_active_) {
+    ticks = std::min(ticks, ticks_to_zero(timer2_counter_) - 1);
+  }
+  if (shift_register_shifts_remaining_ > 0) {
+    ticks = std::min(ticks, shift_register_ticks_to_next_edge_ - 1);
+  }
+  return std::max(ticks, 0);
+}
+
+void W65C22::skip(int ticks) {
+  timer1_counter_ -= ticks;
+  timer2_counter_ -= ticks;
+  if (shift_register_shifts_remaining_ > 0) {
+    shift_register_ticks_to_next_edge_ -= ticks;
+  }
+}
+
 IOPort* W65C22::port_a() { return &port_a_; }
 
 IOPort* W65C22::port_b() { return &port_b_; }
@@ -101,6 +145,10 @@ IOPort* W65C22::port_ca() { return &port_ca_; }
 
 IOPort* W65C22::port_cb() { return &port_cb_; }
 
+void W65C22::set_shift_out_callback(std::function<void(uint8_t)> callback) {
+  shift_out_callback_ = std::move(callback);
+}
+
 W65C22::W65C22(AddressSpace* address_space, uint16_t base_address,
                Interrupt* interrupt)
     : address_space_(address_space),
@@ -115,14 +163,24 @@ absl::Status W65C22::Initialize() {
   // CA2 is output-only in our implementation. CA1 is always an input on a
   // W65C22. CB is initialized when shift register ACR bits are set.
   port_ca_.write_data_direction_register(kCa1Mask | kCa2Mask);
-  port_ca_.register_input_change_callback(
-      [this](uint8_t data) { ca1_transition(data); });
+  port_ca_.add_input_listener<&W65C22::ca1_transition>(this, kCa1Mask);
   auto status = address_space_->register_read(
       base_address_, base_address_ + 15,
-      [this](uint16_t address) { return read(address); });
+      [this](uint16_t address) { return read(address); },
+      [this](uint16_t address) { return peek(address); });
   if (!status.ok()) {
     return status;
   }
+  // Reading port A or the shift register clears interrupt flags, and the timer
+  // counters change on every tick.
+  address_space_->set_stable_reads(base_address_ + kOutputRegisterB,
+                                   base_address_ + kOutputRegisterB);
+  address_space_->set_stable_reads(base_address_ + kDataDirectionRegisterB,
+                                   base_address_ + kDataDirectionRegisterA);
+  address_space_->set_stable_reads(base_address_ + kTimer1LatchLow,
+                                   base_address_ + kTimer1LatchHigh);
+  address_space_->set_stable_reads(base_address_ + kAuxiliaryControlRegister,
+                                   base_address_ + kInterruptEnableRegister);
   status = address_space_->register_write(
       base_address_, base_address_ + 15,
       [this](uint16_t address, uint8_t value) { write(address, value); });
@@ -130,20 +188,51 @@ absl::Status W65C22::Initialize() {
 }
 
 uint8_t W65C22::read(uint16_t address) {
-  uint16_t offset = address - base_address_;
+  const uint16_t offset = address - base_address_;
+  const std::optional<uint8_t> value = register_value(offset);
+  if (!value.has_value()) {
+    LOG(ERROR) << "Read from unimplemented 65C22 register: "
+               << absl::Hex(offset, absl::kZeroPad2);
+    return 0;
+  }
+  switch (offset) {
+    case kOutputRegisterA:
+      clear_irq_flag(kIrqCA1);
+      break;
+    case kTimer1CounterLow:
+      // Reading this also clears the timer 1 IFR bit.
+      clear_irq_flag(kIrqTimer1);
+      break;
+    case kTimer2CounterLow:
+    case kTimer2CounterHigh:
+      // Clear the timer 2 IFR bit when reading the counter.
+      clear_irq_flag(kIrqTimer2);
+      break;
+    case kShiftRegister:
+      clear_irq_flag(kIrqShiftRegister);
+      break;
+    default:
+      break;
+  }
+  return *value;
+}
+
+uint8_t W65C22::peek(uint16_t address) {
+  return register_value(address - base_address_).value_or(0);
+}
+
+std::optional<uint8_t> W65C22::register_value(uint16_t offset) {
   switch (offset) {
     case kOutputRegisterB:
       return port_b_.read_input_register();
     case kOutputRegisterA:
-      clear_irq_flag(kIrqCA1);
       return port_a_.read_input_register();
     case kDataDirectionRegisterB:
       return port_b_.read_data_direction_register();
     case kDataDirectionRegisterA:
       return port_a_.read_data_direction_register();
     case kTimer1CounterLow:
-      // Reading this also clears the timer 1 IFR bit.
-      clear_irq_flag(kIrqTimer1);
+      // Timer 1 low byte
       return timer1_counter_ & 0xFF;
     case kTimer1CounterHigh:
       // Timer 1 high byte
@@ -155,15 +244,10 @@ uint8_t W65C22::read(uint16_t address) {
       // Timer 1 latch high byte
       return timer1_latch_ >> 8;
     case kTimer2CounterLow:
-      // Clear the timer 2 IFR bit when reading the counter.
-      clear_irq_flag(kIrqTimer2);
       return timer2_counter_ & 0xFF;
     case kTimer2CounterHigh:
-      // Clear the timer 2 IFR bit when reading the counter.
-      clear_irq_flag(kIrqTimer2);
       return timer2_counter_ >> 8;
     case kShiftRegister:
-      clear_irq_flag(kIrqShiftRegister);
       return shift_register_;
     case kAuxiliaryControlRegister:
       return auxiliary_control_register_;
@@ -178,9 +262,7 @@ uint8_t W65C22::read(uint16_t address) {
       return irq_flag_register_;
     }
     default:
-      LOG(ERROR) << "Read from unimplemented 65C22 register: "
-                 << absl::Hex(offset, absl::kZeroPad2);
-      return 0;
+      return std::nullopt;
   }
 }
 
@@ -242,7 +324,13 @@ void W65C22::write(uint16_t address, uint8_t value) {
           kAcrShiftRegisterOutPhi2) {
         // Shift out under phi2 control
         shift_register_shifts_remaining_ = 8;
-        shift_register_ticks_to_next_edge_ = 4;
+        shift_register_byte_mode_ = shift_out_callback_ != nullptr;
+        if (shift_register_byte_mode_) {
+          // 4 ticks to the first falling clock edge, then 2 per bit.
+          shift_register_ticks_to_next_edge_ = 4 + 7 * 2;
+        } else {
+          shift_register_ticks_to_next_edge_ = 4;
+        }
       } else {
         // Warn about a SR write while it's in an unimplemented mode.
         LOG(ERROR) << "Shift register write while in unimplemented mode. ACR: "
@@ -3,7 +3,9 @@
 
 #include <atomic>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
@@ -34,7 +36,14 @@ class W65C22 {
   // Calling this indicates that one clock cycle has passed.
   void tick();
 
+  // The number of upcoming ticks that only count down the timers and the shift
+  // register clock. skip() advances by up to that many ticks at once.
+  int idle_ticks() const;
+  void skip(int ticks);
+
   uint8_t read(uint16_t address);
+  // Like read(), but leaves the interrupt flags alone.
+  uint8_t peek(uint16_t address);
   void write(uint16_t address, uint8_t value);
 
   IOPort* port_a();
@@ -42,6 +51,12 @@ class W65C22 {
   IOPort* port_ca();
   IOPort* port_cb();
 
+  // Set a callback that takes over shifting out in phi2 mode a byte at a time.
+  // Instead of toggling CB1/CB2 for every bit, the whole byte is passed to the
+  // callback on the tick of the last falling clock edge. CB1/CB2 are updated
+  // once at the end of the byte. The timing of the IFR bit doesn't change.
+  void set_shift_out_callback(std::function<void(uint8_t)> callback);
+
   // Constants for register offsets
   static constexpr uint8_t kOutputRegisterB = 0;
   static constexpr uint8_t kOutputRegisterA = 1;
@@ -96,6 +111,8 @@ class W65C22 {
 
   void set_irq_flag(uint8_t mask);
   void clear_irq_flag(uint8_t mask);
+  // The value of the register at 'offset', or nullopt if it isn't implemented.
+  std::optional<uint8_t> register_value(uint16_t offset);
 
   // Callback for a change on the CA1 input.
   void ca1_transition(uint8_t port_data);
@@ -148,6 +165,9 @@ class W65C22 {
   uint8_t shift_register_shifts_remaining_ = 0;
   // Number of ticks until the next shift clock edge.
   uint8_t shift_register_ticks_to_next_edge_ = 0;
+  // Whether the current shift goes through shift_out_callback_.
+  bool shift_register_byte_mode_ = false;
+  std::function<void(uint8_t)> shift_out_callback_;
 };
 
 }  // namespace eight_bit
@@ -97,6 +97,18 @@ TEST_F(W65C22Test, Timer1InterruptFlagClearedWhenCounterRead) {
             0);
 }
 
+TEST_F(W65C22Test, PeekDoesntClearTheInterruptFlag) {
+  w65c22_->write(W65C22::kTimer1LatchLow, 0x01);
+  w65c22_->write(W65C22::kTimer1CounterHigh, 0x00);
+  w65c22_->tick();  // 1
+  w65c22_->tick();  // 0
+  w65c22_->peek(W65C22::kTimer1CounterLow);
+  EXPECT_EQ(w65c22_->read(W65C22::kInterruptFlagRegister) & W65C22::kIrqTimer1,
+            W65C22::kIrqTimer1);
+  EXPECT_EQ(w65c22_->peek(W65C22::kInterruptFlagRegister),
+            w65c22_->read(W65C22::kInterruptFlagRegister));
+}
+
 TEST_F(W65C22Test, IERWriteWithTopBitSetEnablesCorrepsondingFlags) {
   // At startup no interrupts are enabled
   ASSERT_EQ(w65c22_->read(W65C22::kInterruptEnableRegister), 0);
@@ -1,6 +1,8 @@
 #include "w65c22_to_spi_glue.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <memory>
 
 #include "absl/log/log.h"
@@ -38,6 +40,11 @@ void W65C22ToSPIGlue::tick() {
       keyboard_data_ = keyboard_data_queue_.front();
       keyboard_data_queue_.pop();
       keyboard_tick_countdown_ = kKeyboardByteTickInterval + 1;
+      // The output switch only updates the parallel port when it changes, so
+      // the new byte needs to go out here if the keyboard is already selected.
+      if (output_keyboard_data_) {
+        parallel_out_port_->provide_inputs(keyboard_data_);
+      }
       // Provide a short edge transition on the keyboard IRQ pin.
       keyboard_irq_port_->provide_inputs(keyboard_irq_mask_,
                                          keyboard_irq_mask_);
@@ -47,10 +54,45 @@ void W65C22ToSPIGlue::tick() {
   --keyboard_tick_countdown_;
 }
 
+int W65C22ToSPIGlue::idle_ticks() const {
+  if (clock_on_last_tick_) {
+    return 0;
+  }
+  // Once the countdown is past 0, only a new keyboard event restarts it.
+  if (keyboard_tick_countdown_ < 0) {
+    return std::numeric_limits<int>::max();
+  }
+  return keyboard_tick_countdown_;
+}
+
+void W65C22ToSPIGlue::skip(int ticks) {
+  // handle_keyboard_event() can restart the countdown at any time. Never skip
+  // past 0 so that the keyboard byte isn't lost.
+  const int countdown = keyboard_tick_countdown_;
+  if (countdown > 0) {
+    keyboard_tick_countdown_ = countdown - std::min(ticks, countdown);
+  }
+}
+
 IOPort* W65C22ToSPIGlue::clk_out_port() { return &clk_out_port_; }
 
 IOPort* W65C22ToSPIGlue::miso_port() { return &miso_port_; }
 
+void W65C22ToSPIGlue::set_spi(SPI* spi) { spi_ = spi; }
+
+void W65C22ToSPIGlue::transfer_byte(uint8_t data) {
+  if (spi_ == nullptr) {
+    LOG(ERROR) << "Byte transfer without a connected SPI sub";
+    return;
+  }
+  miso_shift_data_ = spi_->transfer_byte(data);
+  absl::MutexLock lock(&mutex_);
+  sd_card_data_ = miso_shift_data_;
+  if (!output_keyboard_data_) {
+    parallel_out_port_->provide_inputs(sd_card_data_);
+  }
+}
+
 W65C22ToSPIGlue::W65C22ToSPIGlue(IOPort* clk_in_port, uint8_t clk_in_pin,
                                  IOPort* output_switch_port,
                                  uint8_t output_switch_pin,
@@ -70,17 +112,21 @@ W65C22ToSPIGlue::W65C22ToSPIGlue(IOPort* clk_in_port, uint8_t clk_in_pin,
   miso_port_.write_data_direction_register(kMisoBitmask);
   miso_port_.register_output_change_callback(
       [this](uint8_t data) { miso_bit_in(data); });
-  clk_in_port_->register_output_change_callback(
-      [this](uint8_t data) { clk_bit_in(data); });
-  output_switch_port_->register_output_change_callback([this](uint8_t data) {
-    output_keyboard_data_ = (data & output_switch_mask_) != 0;
-    absl::MutexLock lock(&mutex_);
-    if (output_keyboard_data_) {
-      parallel_out_port_->provide_inputs(keyboard_data_);
-    } else {
-      parallel_out_port_->provide_inputs(sd_card_data_);
-    }
-  });
+  clk_in_port_->add_output_listener<&W65C22ToSPIGlue::clk_bit_in>(
+      this, clk_in_mask_);
+  output_switch_port_
+      ->add_output_listener<&W65C22ToSPIGlue::output_switch_in>(
+          this, output_switch_mask_);
+}
+
+void W65C22ToSPIGlue::output_switch_in(uint8_t data) {
+  output_keyboard_data_ = (data & output_switch_mask_) != 0;
+  absl::MutexLock lock(&mutex_);
+  if (output_keyboard_data_) {
+    parallel_out_port_->provide_inputs(keyboard_data_);
+  } else {
+    parallel_out_port_->provide_inputs(sd_card_data_);
+  }
 }
 
 void W65C22ToSPIGlue::clk_bit_in(uint8_t data) {
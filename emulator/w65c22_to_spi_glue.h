@@ -11,6 +11,7 @@
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "ioport.h"
+#include "spi.h"
 
 namespace eight_bit {
 
@@ -33,6 +34,11 @@ class W65C22ToSPIGlue {
   // Tick callback to simulate clock delay.
   void tick();
 
+  // The number of upcoming ticks that only count down to the next keyboard
+  // byte. skip() advances by up to that many ticks at once.
+  int idle_ticks() const;
+  void skip(int ticks);
+
   // Handle the keyboard event. On actual hardware this is an SLG46826 that acts
   // as a shift register for PS2 data. Once it receives a full byte it sends a
   // pulse to CA1 on the 65C22. The actual byte is multiplexed on
@@ -43,6 +49,16 @@ class W65C22ToSPIGlue {
   IOPort* clk_out_port();
   IOPort* miso_port();
 
+  // Set the SPI sub that's connected to clk_out_port() and miso_port(). This is
+  // needed for transfer_byte() only.
+  void set_spi(SPI* spi);
+
+  // Byte-level alternative to clocking the SPI bus bit by bit. Sends 'data' to
+  // the SPI sub and presents the MISO byte on the parallel out port, exactly as
+  // if the 8 clock edges had gone through clk_in_port. Call it at the tick the
+  // last clock edge would have reached the SPI sub.
+  void transfer_byte(uint8_t data);
+
   static const uint8_t kMisoPin = 0;
   static const uint8_t kMisoBitmask = 1 << kMisoPin;
   static const uint8_t kClkPin = 0;
@@ -61,6 +77,9 @@ class W65C22ToSPIGlue {
   // Callback for the clock input port. Writes the inverted bit to
   // clk_out_port_.
   void clk_bit_in(uint8_t data);
+  // Callback for the output switch port. Selects whether SD card or keyboard
+  // data is presented on parallel_out_port_.
+  void output_switch_in(uint8_t data);
   // Callback for the MISO input port. Shifts in the bits and presents them to
   // parallel_out_port_ once 8 bits are received.
   void miso_bit_in(uint8_t data);
@@ -74,6 +93,7 @@ class W65C22ToSPIGlue {
   IOPort* keyboard_irq_port_ = nullptr;
   const uint8_t keyboard_irq_mask_ = 0;
   IOPort* parallel_out_port_ = nullptr;
+  SPI* spi_ = nullptr;
 
   uint8_t miso_shift_data_ = 0;
   int shift_count_ = 0;
@@ -2,6 +2,15 @@
 
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "address_space.h"
+#include "interrupt.h"
+#include "spi.h"
+#include "w65c22.h"
+
 namespace eight_bit {
 namespace {
 
@@ -68,5 +77,86 @@ TEST_F(W65C22ToSPIGlueTest, ClkBitInWritesInvertedToClkOut) {
   EXPECT_EQ(clk_out_data, 0);  // inverted 1
 }
 
+// A W65C22 driving an SPI sub through the glue, wired up like in HD6301Thing.
+class SPIBus {
+ public:
+  explicit SPIBus(bool byte_transfers) {
+    w65c22_ = W65C22::Create(&address_space_, 0, &irq_).value();
+    glue_ = W65C22ToSPIGlue::create(w65c22_->port_cb(), W65C22::kCb1Pin,
+                                    w65c22_->port_a(), 2, w65c22_->port_ca(),
+                                    W65C22::kCa1Pin, w65c22_->port_b())
+                .value();
+    spi_ = SPI::create(w65c22_->port_ca(), W65C22::kCa2Pin,
+                       glue_->clk_out_port(), W65C22ToSPIGlue::kClkPin,
+                       w65c22_->port_cb(), W65C22::kCb2Pin,
+                       glue_->miso_port(), W65C22ToSPIGlue::kMisoPin)
+               .value();
+    // Reply with a byte derived from the input so MISO data varies.
+    spi_->set_byte_received_callback([this](uint8_t data) {
+      received_.push_back(data);
+      return static_cast<uint8_t>(data * 7 + 3);
+    });
+    spi_->set_chip_select_callback([](bool) { return 0x5a; });
+    if (byte_transfers) {
+      glue_->set_spi(spi_.get());
+      w65c22_->set_shift_out_callback(
+          [this](uint8_t data) { glue_->transfer_byte(data); });
+    }
+    w65c22_->write(W65C22::kAuxiliaryControlRegister,
+                   W65C22::kAcrShiftRegisterOutPhi2);
+    w65c22_->write(W65C22::kPeripheralControlRegister, W65C22::kPcrCA2High);
+    tick();
+    w65c22_->write(W65C22::kPeripheralControlRegister, W65C22::kPcrCA2Low);
+  }
+
+  void tick() {
+    w65c22_->tick();
+    glue_->tick();
+  }
+
+  // The observable state after each tick: port B, and the SR IFR bit.
+  std::vector<int> run_ticks(int ticks) {
+    std::vector<int> trace;
+    for (int i = 0; i < ticks; ++i) {
+      tick();
+      trace.push_back(w65c22_->read(W65C22::kOutputRegisterB) << 8 |
+                      (w65c22_->read(W65C22::kInterruptFlagRegister) &
+                       W65C22::kIrqShiftRegister));
+    }
+    return trace;
+  }
+
+  W65C22* w65c22() { return w65c22_.get(); }
+  const std::vector<uint8_t>& received() const { return received_; }
+
+ private:
+  AddressSpace address_space_;
+  Interrupt irq_;
+  std::unique_ptr<W65C22> w65c22_;
+  std::unique_ptr<W65C22ToSPIGlue> glue_;
+  std::unique_ptr<SPI> spi_;
+  std::vector<uint8_t> received_;
+};
+
+TEST(W65C22ToSPIGlueByteTransferTest, MatchesBitLevelTransfers) {
+  SPIBus bit_bus(/*byte_transfers=*/false);
+  SPIBus byte_bus(/*byte_transfers=*/true);
+
+  // Gaps between shift register writes. 19 ticks is the shortest gap that lets
+  // a byte finish, the longer ones leave the bus idle for a while.
+  const std::vector<int> gaps = {19, 19, 25, 19, 40, 20, 19};
+  const std::vector<uint8_t> data = {0xff, 0x51, 0x00, 0xa3, 0x80, 0x01, 0x7e};
+  for (size_t i = 0; i < data.size(); ++i) {
+    bit_bus.w65c22()->write(W65C22::kShiftRegister, data[i]);
+    byte_bus.w65c22()->write(W65C22::kShiftRegister, data[i]);
+    EXPECT_EQ(bit_bus.run_ticks(gaps[i]), byte_bus.run_ticks(gaps[i]))
+        << "byte " << i;
+  }
+  EXPECT_EQ(bit_bus.received(), data);
+  EXPECT_EQ(byte_bus.received(), data);
+  EXPECT_EQ(bit_bus.w65c22()->port_cb()->read_output_register(),
+            byte_bus.w65c22()->port_cb()->read_output_register());
+}
+
 }  // namespace
-}  // namespace eight_bit
\ No newline at end of file
+}  // namespace eight_bit
@@ -1,7 +1,9 @@
 #include "graphics_state.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <utility>
 
 // If this code is included in the pico_graphics project, we need to make sure
 // performance-relevant functions are put in RAM.
@@ -16,17 +18,28 @@ namespace eight_bit {
 
 GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
                                                    uint8_t data) {
+  CursorColorFlip();
+  ApplyCommand(command, data);
+  CursorColorFlip();
+}
+
+GRAPHICS_NOFLASH void GraphicsState::HandleCommands(
+    const GraphicsCommand* commands, size_t count) {
+  CursorColorFlip();
+  for (size_t i = 0; i < count; ++i) {
+    ApplyCommand(commands[i].command, commands[i].data);
+  }
+  CursorColorFlip();
+}
+
+GRAPHICS_NOFLASH void GraphicsState::ApplyCommand(uint8_t command,
+                                                  uint8_t data) {
   switch (command) {
     // Write character, advance cursor
     case 0: {
-      charbuf_[cursor_pos_] = data & 0x7f;
-      CursorColorFlip();
-      cursor_pos_ = (cursor_pos_ + 1) % kCharBufSize;
-      if (cursor_pos_ % kNumColumns == 0 &&
-          cursor_pos_ / kNumColumns == ((kNumRows - row_roll_) % kNumRows)) {
-        row_roll_ = (row_roll_ - 1) % kNumRows;
-      }
-      CursorColorFlip();
+      last_char_ = data & 0x7f;
+      charbuf_[cursor_pos_] = last_char_;
+      AdvanceCursor();
       break;
     }
     // Clear commands
@@ -36,9 +49,12 @@ GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
                    // black
           memset(charbuf_, ' ', kCharBufSize);
           memset(colorbuf_, 0x33, 3 * kColorPlaneSizeWords * sizeof(uint32_t));
+#ifdef GRAPHICS_STATE_COLOR_CACHE
+          memset(foreground_colors_, 0x3f, kCharBufSize);
+          memset(background_colors_, 0, kCharBufSize);
+#endif
           cursor_pos_ = 0;
           row_roll_ = 0;
-          CursorColorFlip();
           break;
         }
         case 1: {  // Clear current row, reset cursor to row start
@@ -48,11 +64,9 @@ GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
                ++position) {
             SetColor(position, 0xff, 0);
           }
-          CursorColorFlip();
           break;
         }
         case 2: {  // Clear next row, reset cursor to next row start
-          CursorColorFlip();
           // If the cursor is on the last logical row (taking into account
           // row_roll_) we need to roll the screen up one row.
           if (cursor_pos_ / kNumColumns ==
@@ -67,7 +81,6 @@ GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
                ++position) {
             SetColor(position, 0xff, 0);
           }
-          CursorColorFlip();
           break;
         }
       }
@@ -80,30 +93,25 @@ GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
       if (new_position < 0) {
         new_position += kCharBufSize;
       }
-      CursorColorFlip();
       cursor_pos_ = new_position;
-      CursorColorFlip();
       break;
     }
     // Same as 0 but doesn't advance cursor
     case 3: {
-      charbuf_[cursor_pos_] = data & 0x7f;
+      last_char_ = data & 0x7f;
+      charbuf_[cursor_pos_] = last_char_;
       break;
     }
     // Set cursor column
     case 4: {
-      CursorColorFlip();
       cursor_pos_ =
           cursor_pos_ - (cursor_pos_ % kNumColumns) + data % kNumColumns;
-      CursorColorFlip();
       break;
     }
     // Set cursor row
     case 5: {
-      CursorColorFlip();
       cursor_pos_ =
           (data % kNumRows) * kNumColumns + (cursor_pos_ % kNumColumns);
-      CursorColorFlip();
       break;
     }
     // Set cursor position high byte
@@ -113,18 +121,14 @@ GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
     }
     // Set cursor position low byte
     case 7: {
-      CursorColorFlip();
       cursor_pos_ = (cursor_pos_high_ << 8) + data;
-      CursorColorFlip();
       break;
     }
     // Cursor visibility. 0: shown, 1: hidden
     case 8: {
-      // If the hidden status changed only one of the flips will be done, if it
-      // hasn't we flip 0 or two times. In all cases we get the right result.
-      CursorColorFlip();
+      // The cursor was flipped away under the old setting, and is flipped back
+      // under the new one when the command is done.
       cursor_hidden_ = data;
-      CursorColorFlip();
       break;
     }
     // Set color at cursor position. Bit format is (MSB first) ABRRGGBB where if
@@ -132,7 +136,6 @@ GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
     // foreground or 1 for background. RR/GG/BB are 2-bit Red, Green, Blue
     // channel colors.
     case 9: {
-      CursorColorFlip();
       if ((data & 0x40) == 0) {
         // foreground
         SetFgColor(cursor_pos_, data & 0x3f);
@@ -143,7 +146,70 @@ GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
       if (data & 0x80) {
         cursor_pos_ = (cursor_pos_ + 1) % kCharBufSize;
       }
-      CursorColorFlip();
+      break;
+    }
+    // Set the width of the rectangle or run used by the bulk commands below.
+    case 10: {
+      width_ = data;
+      break;
+    }
+    // Set the height of the rectangle used by the bulk commands below.
+    case 11: {
+      height_ = data;
+      break;
+    }
+    // Fill the rectangle at the cursor with a character. Doesn't move the
+    // cursor.
+    case 12: {
+      FillRectChar(cursor_pos_, RectWidth(cursor_pos_),
+                   RectHeight(cursor_pos_), data & 0x7f);
+      break;
+    }
+    // Set the color of the rectangle at the cursor. Same format as command 9,
+    // except that the A bit is ignored. Doesn't move the cursor.
+    case 13: {
+      FillRectColor(cursor_pos_, RectWidth(cursor_pos_),
+                    RectHeight(cursor_pos_), data);
+      break;
+    }
+    // Write the last character written by commands 0 or 3 another 'data'
+    // times, advancing the cursor as command 0 does.
+    case 14: {
+      for (int i = 0; i < data; ++i) {
+        charbuf_[cursor_pos_] = last_char_;
+        AdvanceCursor();
+      }
+      break;
+    }
+    // Set the color of a run of 'width' cells from the cursor on, wrapping
+    // to the next rows as needed. Same format as command 9, if A is set the
+    // cursor is moved past the run.
+    case 15: {
+      for (int i = 0; i < width_; ++i) {
+        SetColorBits((cursor_pos_ + i) % kCharBufSize, data & 0x3f,
+                     (data & 0x40) ? 2 : 0);
+      }
+      if (data & 0x80) {
+        cursor_pos_ = (cursor_pos_ + width_) % kCharBufSize;
+      }
+      break;
+    }
+    // Scroll the contents of the rectangle at the cursor up by 'data' rows,
+    // or down if 'data' is negative. Rows scrolled in are cleared.
+    case 16: {
+      ScrollRect((signed char)data);
+      break;
+    }
+    // Copy the rectangle at the cursor to the position whose high byte was set
+    // with command 6 and low byte is in 'data'. The copy is clipped to the
+    // screen at the destination. Overlapping rectangles are fine.
+    case 17: {
+      const int to = (cursor_pos_high_ << 8) + data;
+      if (to < kCharBufSize) {
+        CopyRect(cursor_pos_, to,
+                 std::min(RectWidth(cursor_pos_), RectWidth(to)),
+                 std::min(RectHeight(cursor_pos_), RectHeight(to)));
+      }
       break;
     }
     default:
@@ -151,32 +217,26 @@ GRAPHICS_NOFLASH void GraphicsState::HandleCommand(uint8_t command,
   }
 }
 
-uint8_t GraphicsState::GetBackgroundColor(int position) const {
-  if (position >= kCharBufSize) {
-    return 0;
+// Moves the cursor one cell forward, rolling the screen up when it moves past
+// the last logical row.
+GRAPHICS_NOFLASH inline void GraphicsState::AdvanceCursor() {
+  cursor_pos_ = (cursor_pos_ + 1) % kCharBufSize;
+  if (cursor_pos_ % kNumColumns == 0 &&
+      cursor_pos_ / kNumColumns == ((kNumRows - row_roll_) % kNumRows)) {
+    row_roll_ = (row_roll_ - 1) % kNumRows;
   }
-  unsigned int line_padding = (position / kNumColumns) * (kNumColumns % 8);
-  unsigned int word_index = (position + line_padding) / 8;
-  unsigned int bit_index = (position + line_padding) % 8 * 4 + 2;
-  // The color is 00RRGGBB with RR/GG/BB being the 2 color bits in each plane.
-  // The planes are in G / B / R order.
-  uint8_t color = 0;
-  for (int plane = 0; plane < 3; ++plane) {
-    color |= ((colorbuf_[word_index + plane * kColorPlaneSizeWords] &
-               (0x3u << bit_index)) >>
-              bit_index)
-             << 2 * plane;
-  }
-  return color;
 }
 
-uint8_t GraphicsState::GetForegroundColor(int position) const {
+uint8_t GraphicsState::ColorFromPlanes(int position,
+                                       uint8_t bit_offset) const {
   if (position >= kCharBufSize) {
     return 0;
   }
   unsigned int line_padding = (position / kNumColumns) * (kNumColumns % 8);
   unsigned int word_index = (position + line_padding) / 8;
-  unsigned int bit_index = (position + line_padding) % 8 * 4;
+  unsigned int bit_index = (position + line_padding) % 8 * 4 + bit_offset;
+  // The color is 00RRGGBB with RR/GG/BB being the 2 color bits in each plane.
+  // The planes are in G / B / R order.
   uint8_t color = 0;
   for (int plane = 0; plane < 3; ++plane) {
     color |= ((colorbuf_[word_index + plane * kColorPlaneSizeWords] &
@@ -209,6 +269,13 @@ GRAPHICS_NOFLASH inline void GraphicsState::SetColorBits(unsigned int position,
   if (position >= kCharBufSize) {
     return;
   }
+#ifdef GRAPHICS_STATE_COLOR_CACHE
+  if (bit_offset == 0) {
+    foreground_colors_[position] = color & 0x3f;
+  } else {
+    background_colors_[position] = color & 0x3f;
+  }
+#endif
   // We need to account for some extra padding in the color plane vs the
   // character buffer. With each line we may get an extra word.
   unsigned int line_padding = (position / kNumColumns) * (kNumColumns % 8);
@@ -239,6 +306,88 @@ GRAPHICS_NOFLASH void GraphicsState::CursorColorFlip() {
     uint32_t fg = (color & (0x3u << bit_index)) << 2;
     color = (color & ~(0xfu << bit_index)) | bg | fg;
   }
+#ifdef GRAPHICS_STATE_COLOR_CACHE
+  if (cursor_pos_ < kCharBufSize) {
+    std::swap(foreground_colors_[cursor_pos_],
+              background_colors_[cursor_pos_]);
+  }
+#endif
+}
+
+GRAPHICS_NOFLASH int GraphicsState::RectWidth(int position) const {
+  if (position >= kCharBufSize) {
+    return 0;
+  }
+  return std::min(width_, kNumColumns - position % kNumColumns);
+}
+
+GRAPHICS_NOFLASH int GraphicsState::RectHeight(int position) const {
+  if (position >= kCharBufSize) {
+    return 0;
+  }
+  return std::min(height_, kNumRows - position / kNumColumns);
+}
+
+GRAPHICS_NOFLASH void GraphicsState::FillRectChar(int position, int width,
+                                                  int height, char character) {
+  for (int row = 0; row < height; ++row) {
+    memset(charbuf_ + position + row * kNumColumns, character, width);
+  }
+}
+
+GRAPHICS_NOFLASH void GraphicsState::FillRectColor(int position, int width,
+                                                   int height, uint8_t color) {
+  const uint8_t bit_offset = (color & 0x40) ? 2 : 0;
+  for (int row = 0; row < height; ++row) {
+    const int row_start = position + row * kNumColumns;
+    for (int column = 0; column < width; ++column) {
+      SetColorBits(row_start + column, color & 0x3f, bit_offset);
+    }
+  }
+}
+
+// Clears to spaces, white on black, as the clear commands do.
+GRAPHICS_NOFLASH void GraphicsState::ClearRect(int position, int width,
+                                               int height) {
+  FillRectChar(position, width, height, ' ');
+  for (int row = 0; row < height; ++row) {
+    const int row_start = position + row * kNumColumns;
+    for (int column = 0; column < width; ++column) {
+      SetColor(row_start + column, 0xff, 0);
+    }
+  }
+}
+
+GRAPHICS_NOFLASH void GraphicsState::CopyRect(int from, int to, int width,
+                                              int height) {
+  // Both rectangles have the same layout, so copying in the direction of the
+  // move never overwrites a cell before it's been read.
+  const bool backwards = to > from;
+  for (int i = 0; i < height; ++i) {
+    const int row = backwards ? height - 1 - i : i;
+    memmove(charbuf_ + to + row * kNumColumns,
+            charbuf_ + from + row * kNumColumns, width);
+    for (int j = 0; j < width; ++j) {
+      const int column = backwards ? width - 1 - j : j;
+      const int offset = row * kNumColumns + column;
+      SetColor(to + offset, GetForegroundColor(from + offset),
+               GetBackgroundColor(from + offset));
+    }
+  }
+}
+
+GRAPHICS_NOFLASH void GraphicsState::ScrollRect(int rows) {
+  const int width = RectWidth(cursor_pos_);
+  const int height = RectHeight(cursor_pos_);
+  const int distance = std::min(rows < 0 ? -rows : rows, height);
+  const int moved = height - distance;
+  if (rows > 0) {
+    CopyRect(cursor_pos_ + distance * kNumColumns, cursor_pos_, width, moved);
+    ClearRect(cursor_pos_ + moved * kNumColumns, width, distance);
+  } else if (rows < 0) {
+    CopyRect(cursor_pos_, cursor_pos_ + distance * kNumColumns, width, moved);
+    ClearRect(cursor_pos_, width, distance);
+  }
 }
 
 #undef GRAPHICS_NOFLASH
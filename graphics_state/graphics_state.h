@@ -1,6 +1,7 @@
 #ifndef EIGHT_BIT_GRAPHICS_STATE_H
 #define EIGHT_BIT_GRAPHICS_STATE_H
 
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 
@@ -26,6 +27,12 @@ inline constexpr int kColorPlaneLineWords =
     kNumColumns / 8 + (kNumColumns % 8 > 0);
 inline constexpr int kColorPlaneSizeWords = kColorPlaneLineWords * kNumRows;
 
+// One write to the graphics registers. 'command' is the register offset.
+struct GraphicsCommand {
+  uint8_t command;
+  uint8_t data;
+};
+
 class GraphicsState {
   static_assert(sizeof(uint32_t) == 4,
                 "Expecting uint32_t to be exactly 32-bit, not just 'at least' "
@@ -36,29 +43,71 @@ class GraphicsState {
   ~GraphicsState() = default;
 
   void HandleCommand(uint8_t command, uint8_t data);
+  // Same as calling HandleCommand() for each of the 'count' commands in turn,
+  // but only hides and redraws the cursor once for the whole batch.
+  void HandleCommands(const GraphicsCommand* commands, size_t count);
   const char* GetCharBuf() const { return charbuf_; }
   const uint32_t* GetColorBuf() const { return colorbuf_; }
 
-  uint8_t GetBackgroundColor(int position) const;
-  uint8_t GetForegroundColor(int position) const;
+  uint8_t GetBackgroundColor(int position) const {
+#ifdef GRAPHICS_STATE_COLOR_CACHE
+    return position < kCharBufSize ? background_colors_[position] : 0;
+#else
+    return ColorFromPlanes(position, 2);
+#endif
+  }
+  uint8_t GetForegroundColor(int position) const {
+#ifdef GRAPHICS_STATE_COLOR_CACHE
+    return position < kCharBufSize ? foreground_colors_[position] : 0;
+#else
+    return ColorFromPlanes(position, 0);
+#endif
+  }
   int GetRowRoll() const { return row_roll_; }
 
  protected:
   void SetFgColor(unsigned int position, uint8_t fg);
   void SetBgColor(unsigned int position, uint8_t bg);
   void SetColor(unsigned int position, uint8_t fg, uint8_t bg);
+  // Reads a color straight from the color planes, 'bit_offset' is 0 for the
+  // foreground and 2 for the background.
+  uint8_t ColorFromPlanes(int position, uint8_t bit_offset) const;
 
  private:
+  // Runs a single command. Expects the cursor to be hidden by the caller.
+  void ApplyCommand(uint8_t command, uint8_t data);
+  void AdvanceCursor();
   void SetColorBits(unsigned int position, uint8_t color, uint8_t bit_offset);
   void CursorColorFlip();
 
+  // Helpers for the rectangle commands. Rectangles start at the top left
+  // 'position' and are clipped to the screen.
+  int RectWidth(int position) const;
+  int RectHeight(int position) const;
+  void FillRectChar(int position, int width, int height, char character);
+  void FillRectColor(int position, int width, int height, uint8_t color);
+  void ClearRect(int position, int width, int height);
+  void CopyRect(int from, int to, int width, int height);
+  void ScrollRect(int rows);
+
   // 3 color planes, one each for B, G, R
   uint32_t colorbuf_[3 * kColorPlaneSizeWords] = {0};
   char charbuf_[kCharBufSize] = {0};
+#ifdef GRAPHICS_STATE_COLOR_CACHE
+  // A copy of the colors in colorbuf_ with one 00RRGGBB byte per cell, so
+  // that host renderers can read a color with a single load. The Pico only
+  // needs the planes and doesn't have the RAM to spare.
+  uint8_t foreground_colors_[kCharBufSize] = {0};
+  uint8_t background_colors_[kCharBufSize] = {0};
+#endif
   int cursor_pos_ = 0;
   int cursor_pos_high_ = 0;
   bool cursor_hidden_ = false;
   int row_roll_ = 0;
+  // Parameters for the bulk commands
+  int width_ = 1;
+  int height_ = 1;
+  char last_char_ = ' ';
 };
 
 }  // namespace eight_bit
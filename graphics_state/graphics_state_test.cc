@@ -1,5 +1,9 @@
 #include "graphics_state.h"
 
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -8,6 +12,7 @@ namespace {
 
 class GraphicsStateForTest : public GraphicsState {
  public:
+  using GraphicsState::ColorFromPlanes;
   using GraphicsState::SetBgColor;
   using GraphicsState::SetFgColor;
 };
@@ -28,6 +33,158 @@ TEST(GraphicsStateTest, SetBgColorIsReturnedByGetBackgroundColorIndex) {
   EXPECT_EQ(graphics_state.GetBackgroundColor(12), 0x12);
 }
 
+// Returns 'length' characters starting at 'row', 'column'.
+std::string Text(const GraphicsState& graphics_state, int row, int column,
+                 int length) {
+  return std::string(graphics_state.GetCharBuf() + row * kNumColumns + column,
+                     length);
+}
+
+// A cleared screen with a hidden cursor, so that colors can be checked
+// without the cursor getting in the way.
+void Reset(GraphicsState& graphics_state) {
+  graphics_state.HandleCommand(1, 0);
+  graphics_state.HandleCommand(8, 1);
+}
+
+void MoveTo(GraphicsState& graphics_state, int row, int column) {
+  graphics_state.HandleCommand(5, row);
+  graphics_state.HandleCommand(4, column);
+}
+
+TEST(GraphicsStateTest, HandleCommandsMatchesHandleCommand) {
+  const std::vector<GraphicsCommand> commands = {
+      {1, 0}, {5, 3}, {0, 'a'}, {0, 'b'}, {9, 0x40 | 0x12},
+      {2, 0xff}, {3, 'c'}, {10, 4}, {11, 2}, {13, 0x30},
+      {14, 5}, {8, 1}, {8, 0}, {1, 2}, {0, 'd'}};
+  GraphicsState one_by_one;
+  for (const auto& command : commands) {
+    one_by_one.HandleCommand(command.command, command.data);
+  }
+  GraphicsState batched;
+  batched.HandleCommands(commands.data(), commands.size());
+
+  EXPECT_EQ(memcmp(one_by_one.GetCharBuf(), batched.GetCharBuf(),
+                   kCharBufSize),
+            0);
+  EXPECT_EQ(memcmp(one_by_one.GetColorBuf(), batched.GetColorBuf(),
+                   3 * kColorPlaneSizeWords * sizeof(uint32_t)),
+            0);
+  EXPECT_EQ(one_by_one.GetRowRoll(), batched.GetRowRoll());
+}
+
+TEST(GraphicsStateTest, FillRectangle) {
+  GraphicsState graphics_state;
+  Reset(graphics_state);
+  MoveTo(graphics_state, 2, 97);
+  graphics_state.HandleCommand(10, 5);
+  graphics_state.HandleCommand(11, 2);
+  graphics_state.HandleCommand(12, '#');
+  graphics_state.HandleCommand(13, 0x40 | 0x03);
+
+  // Clipped at the end of the row.
+  EXPECT_EQ(Text(graphics_state, 2, 96, 4), " ###");
+  EXPECT_EQ(Text(graphics_state, 3, 96, 4), " ###");
+  EXPECT_EQ(Text(graphics_state, 4, 0, 2), "  ");
+  EXPECT_EQ(Text(graphics_state, 1, 97, 3), "   ");
+  EXPECT_EQ(graphics_state.GetBackgroundColor(3 * kNumColumns + 99), 0x03);
+  EXPECT_EQ(graphics_state.GetBackgroundColor(3 * kNumColumns + 96), 0);
+  EXPECT_EQ(graphics_state.GetForegroundColor(3 * kNumColumns + 99), 0x3f);
+}
+
+TEST(GraphicsStateTest, RepeatLastCharacter) {
+  GraphicsState graphics_state;
+  Reset(graphics_state);
+  graphics_state.HandleCommand(0, '-');
+  graphics_state.HandleCommand(14, 3);
+  graphics_state.HandleCommand(0, '>');
+  EXPECT_EQ(Text(graphics_state, 0, 0, 6), "----> ");
+}
+
+TEST(GraphicsStateTest, ColorRunWrapsAndAdvances) {
+  GraphicsState graphics_state;
+  Reset(graphics_state);
+  MoveTo(graphics_state, 0, 98);
+  graphics_state.HandleCommand(10, 3);
+  graphics_state.HandleCommand(15, 0x80 | 0x0c);
+  EXPECT_EQ(graphics_state.GetForegroundColor(97), 0x3f);
+  EXPECT_EQ(graphics_state.GetForegroundColor(98), 0x0c);
+  EXPECT_EQ(graphics_state.GetForegroundColor(99), 0x0c);
+  EXPECT_EQ(graphics_state.GetForegroundColor(100), 0x0c);
+  EXPECT_EQ(graphics_state.GetForegroundColor(101), 0x3f);
+
+  // The cursor is past the run.
+  graphics_state.HandleCommand(0, 'x');
+  EXPECT_EQ(Text(graphics_state, 1, 1, 1), "x");
+}
+
+TEST(GraphicsStateTest, ScrollRectangle) {
+  GraphicsState graphics_state;
+  Reset(graphics_state);
+  for (int row = 0; row < 4; ++row) {
+    MoveTo(graphics_state, row, 0);
+    graphics_state.HandleCommand(0, 'a' + row);
+    graphics_state.HandleCommand(0, 'a' + row);
+    graphics_state.HandleCommand(9, 0x40 | row);
+  }
+  MoveTo(graphics_state, 0, 1);
+  graphics_state.HandleCommand(10, 2);
+  graphics_state.HandleCommand(11, 4);
+  graphics_state.HandleCommand(16, 1);
+  EXPECT_EQ(Text(graphics_state, 0, 0, 2), "ab");
+  EXPECT_EQ(Text(graphics_state, 2, 0, 2), "cd");
+  EXPECT_EQ(Text(graphics_state, 3, 0, 2), "d ");
+  EXPECT_EQ(graphics_state.GetBackgroundColor(2 * kNumColumns + 2), 3);
+  EXPECT_EQ(graphics_state.GetBackgroundColor(3 * kNumColumns + 2), 0);
+
+  graphics_state.HandleCommand(16, 0xfe);  // -2
+  EXPECT_EQ(Text(graphics_state, 0, 0, 2), "a ");
+  EXPECT_EQ(Text(graphics_state, 1, 0, 2), "b ");
+  EXPECT_EQ(Text(graphics_state, 2, 0, 2), "cb");
+  EXPECT_EQ(Text(graphics_state, 3, 0, 2), "dc");
+}
+
+TEST(GraphicsStateTest, CopyOverlappingRectangle) {
+  GraphicsState graphics_state;
+  Reset(graphics_state);
+  for (const char c : std::string("abcdef")) {
+    graphics_state.HandleCommand(0, c);
+  }
+  MoveTo(graphics_state, 0, 0);
+  graphics_state.HandleCommand(10, 4);
+  graphics_state.HandleCommand(11, 1);
+  graphics_state.HandleCommand(6, 0);
+  graphics_state.HandleCommand(17, 2);
+  EXPECT_EQ(Text(graphics_state, 0, 0, 6), "ababcd");
+
+  MoveTo(graphics_state, 0, 2);
+  graphics_state.HandleCommand(17, 1);
+  EXPECT_EQ(Text(graphics_state, 0, 0, 6), "aabcdd");
+}
+
+// The colors returned by the getters need to match the color planes the Pico
+// renders from, whether they come from the per-cell cache or not.
+TEST(GraphicsStateTest, ColorsMatchColorPlanes) {
+  const std::vector<GraphicsCommand> commands = {
+      {1, 0},    {5, 39},   {4, 98},    {0, 'a'},  {0, 'b'},   {0, 'c'},
+      {9, 0x3c}, {9, 0xc1}, {9, 0x55},  {2, 0xfd}, {8, 1},     {9, 0x22},
+      {8, 0},    {10, 7},   {11, 5},    {7, 150},  {13, 0x07}, {13, 0x70},
+      {16, 2},   {16, 0xff}, {6, 0},    {17, 3},   {10, 150},  {15, 0xaa},
+      {14, 120}, {1, 1},    {1, 2},     {8, 1},    {1, 2},     {8, 0}};
+  GraphicsStateForTest graphics_state;
+  for (const auto& command : commands) {
+    graphics_state.HandleCommand(command.command, command.data);
+    for (int position = 0; position < kCharBufSize; ++position) {
+      ASSERT_EQ(graphics_state.GetForegroundColor(position),
+                graphics_state.ColorFromPlanes(position, 0))
+          << "command " << int(command.command) << " position " << position;
+      ASSERT_EQ(graphics_state.GetBackgroundColor(position),
+                graphics_state.ColorFromPlanes(position, 2))
+          << "command " << int(command.command) << " position " << position;
+    }
+  }
+}
+
 }  // namespace
 
 }  // namespace eight_bit
\ No newline at end of file
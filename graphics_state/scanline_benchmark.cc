@@ -0,0 +1,41 @@
+// Measures how long RenderScanline takes per line on the host. Run as
+// scanline_benchmark [frames].
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../pico_graphics/font.h"
+#include "graphics_state.h"
+#include "scanline_renderer.h"
+
+int main(int argc, char* argv[]) {
+  using namespace eight_bit;
+  const int frames = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+  GraphicsState state;
+  state.HandleCommand(1, 0);
+  for (int i = 0; i < kCharBufSize; ++i) {
+    state.HandleCommand(0, 32 + i % 95);
+  }
+  std::vector<uint8_t> frame(kFrameWidth * kFrameHeight);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < frames; ++i) {
+    RenderFrame(state, font, frame.data(), kFrameWidth);
+  }
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  // Keeps the compiler from dropping the rendering.
+  unsigned int checksum = 0;
+  for (uint8_t pixel : frame) {
+    checksum += pixel;
+  }
+  std::printf("%d frames, %.1f ns/line, %.3f ms/frame (checksum %u)\n",
+              frames, elapsed.count() / (double(frames) * kFrameHeight),
+              elapsed.count() / frames / 1e6, checksum);
+  return 0;
+}
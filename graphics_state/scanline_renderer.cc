@@ -0,0 +1,58 @@
+#include "scanline_renderer.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace eight_bit {
+namespace {
+
+static_assert(kFontCharWidth == 8, "A glyph line needs to fit in a byte");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "kGlyphMasks puts the leftmost pixel in the lowest byte");
+
+// For each glyph line, a mask with byte i set to 0xff if pixel i is set.
+constexpr std::array<uint64_t, 256> MakeGlyphMasks() {
+  std::array<uint64_t, 256> masks = {};
+  for (int bits = 0; bits < 256; ++bits) {
+    for (int i = 0; i < 8; ++i) {
+      if (bits & (1 << i)) {
+        masks[bits] |= uint64_t{0xff} << (8 * i);
+      }
+    }
+  }
+  return masks;
+}
+
+constexpr std::array<uint64_t, 256> kGlyphMasks = MakeGlyphMasks();
+
+// Repeats a byte 8 times
+constexpr uint64_t kBroadcast = 0x0101010101010101;
+
+}  // namespace
+
+void RenderScanline(const GraphicsState& state, const unsigned char* font,
+                    int buffer_line, uint8_t* pixels) {
+  const int first = (buffer_line / kFontCharHeight) * kNumColumns;
+  const unsigned char* glyph_line =
+      font + (buffer_line % kFontCharHeight) * kFontNumChars;
+  const char* characters = state.GetCharBuf() + first;
+  for (int column = 0; column < kNumColumns; ++column) {
+    const uint8_t character = characters[column] & 0x7f;
+    const uint64_t mask = kGlyphMasks[glyph_line[character]];
+    const uint64_t fg = state.GetForegroundColor(first + column) * kBroadcast;
+    const uint64_t bg = state.GetBackgroundColor(first + column) * kBroadcast;
+    const uint64_t line = (fg & mask) | (bg & ~mask);
+    memcpy(pixels + column * kFontCharWidth, &line, sizeof(line));
+  }
+}
+
+void RenderFrame(const GraphicsState& state, const unsigned char* font,
+                 uint8_t* pixels, int pitch) {
+  const int row_roll = state.GetRowRoll();
+  for (int y = 0; y < kFrameHeight; ++y) {
+    RenderScanline(state, font, BufferLine(y, row_roll), pixels + y * pitch);
+  }
+}
+
+}  // namespace eight_bit
@@ -0,0 +1,33 @@
+#ifndef EIGHT_BIT_SCANLINE_RENDERER_H
+#define EIGHT_BIT_SCANLINE_RENDERER_H
+
+#include <cstdint>
+
+#include "graphics_state.h"
+
+namespace eight_bit {
+
+// Returns the line of the character buffer, counted in pixels, that is shown on
+// screen line 'screen_y' with the screen rolled by 'row_roll' rows. The
+// character row is the result divided by kFontCharHeight, the line within the
+// glyphs the remainder.
+inline constexpr int BufferLine(int screen_y, int row_roll) {
+  return ((screen_y - row_roll * kFontCharHeight) % kFrameHeight +
+          kFrameHeight) %
+         kFrameHeight;
+}
+
+// Renders 'buffer_line' of 'state' into 'pixels', as kFrameWidth many 00RRGGBB
+// palette indices. 'font' is a 1bpp bitmap of kFontNumChars characters wide
+// and kFontCharHeight lines high, with the leftmost pixel in the lowest bit.
+void RenderScanline(const GraphicsState& state, const unsigned char* font,
+                    int buffer_line, uint8_t* pixels);
+
+// Renders the whole screen, with the row roll applied. Lines in 'pixels' are
+// 'pitch' bytes apart.
+void RenderFrame(const GraphicsState& state, const unsigned char* font,
+                 uint8_t* pixels, int pitch);
+
+}  // namespace eight_bit
+
+#endif  // EIGHT_BIT_SCANLINE_RENDERER_H
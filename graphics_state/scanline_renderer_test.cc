@@ -0,0 +1,74 @@
+#include "scanline_renderer.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "../pico_graphics/font.h"
+#include "gmock/gmock.h"
+#include "graphics_state.h"
+#include "gtest/gtest.h"
+
+namespace eight_bit {
+namespace {
+
+// Draws the screen one cell at a time, the way the emulator used to.
+std::vector<uint8_t> RenderCells(const GraphicsState& state) {
+  std::vector<uint8_t> frame(kFrameWidth * kFrameHeight);
+  for (int position = 0; position < kCharBufSize; ++position) {
+    const int x = (position % kNumColumns) * kFontCharWidth;
+    const int y = ((position / kNumColumns + state.GetRowRoll()) *
+                       kFontCharHeight +
+                   kFrameHeight) %
+                  kFrameHeight;
+    const unsigned char* glyph = font + state.GetCharBuf()[position];
+    for (int i = 0; i < kFontCharHeight; ++i) {
+      for (int j = 0; j < kFontCharWidth; ++j) {
+        frame[(y + i) * kFrameWidth + x + j] =
+            (glyph[i * kFontNumChars] & (1 << j))
+                ? state.GetForegroundColor(position)
+                : state.GetBackgroundColor(position);
+      }
+    }
+  }
+  return frame;
+}
+
+std::vector<uint8_t> RenderLines(const GraphicsState& state) {
+  std::vector<uint8_t> frame(kFrameWidth * kFrameHeight);
+  RenderFrame(state, font, frame.data(), kFrameWidth);
+  return frame;
+}
+
+TEST(ScanlineRendererTest, BufferLine) {
+  EXPECT_EQ(BufferLine(0, 0), 0);
+  EXPECT_EQ(BufferLine(kFrameHeight - 1, 0), kFrameHeight - 1);
+  // Rolled up by one row, the first screen line shows the second row.
+  EXPECT_EQ(BufferLine(0, -1), kFontCharHeight);
+  EXPECT_EQ(BufferLine(kFrameHeight - 1, -1), kFontCharHeight - 1);
+}
+
+TEST(ScanlineRendererTest, MatchesCellRenderer) {
+  GraphicsState state;
+  state.HandleCommand(1, 0);
+  for (int c = 0; c < 128; ++c) {
+    state.HandleCommand(0, c);
+    state.HandleCommand(9, 0x40 | (c & 0x3f));
+    state.HandleCommand(9, 0x80 | ((c * 7) & 0x3f));
+  }
+  EXPECT_EQ(RenderLines(state), RenderCells(state));
+}
+
+TEST(ScanlineRendererTest, MatchesCellRendererWithRowRoll) {
+  GraphicsState state;
+  state.HandleCommand(1, 0);
+  for (int row = 0; row < kNumRows + 3; ++row) {
+    state.HandleCommand(0, 'a' + row % 26);
+    state.HandleCommand(9, 0x80 | (row & 0x3f));
+    state.HandleCommand(1, 2);
+  }
+  ASSERT_NE(state.GetRowRoll(), 0);
+  EXPECT_EQ(RenderLines(state), RenderCells(state));
+}
+
+}  // namespace
+}  // namespace eight_bit
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -15,6 +16,7 @@
 #include "pico/multicore.h"
 #include "pico/sem.h"
 #include "pico/stdlib.h"
+#include "scanline_renderer.h"
 
 extern "C" {
 #include "dvi.h"
@@ -22,6 +24,8 @@ extern "C" {
 #include "tmds_encode_font_2bpp.h"
 }
 
+using eight_bit::BufferLine;
+using eight_bit::GraphicsCommand;
 using eight_bit::GraphicsState;
 using eight_bit::kCharBufSize;
 using eight_bit::kColorPlaneLineWords;
@@ -53,15 +57,26 @@ struct semaphore dvi_start_sem;
 
 GraphicsState* gstate = nullptr;
 
+// Bus writes waiting for the main loop. The bulk commands take much longer
+// than the gap between two 6301 writes, so the bus IRQ only queues the writes
+// and the main loop runs them. The IRQ is the only writer of the head and the
+// main loop the only writer of the tail, so neither side ever waits for the
+// other. Both run on core 0.
+constexpr uint32_t kCommandQueueSize = 256;  // Must be a power of 2
+static_assert((kCommandQueueSize & (kCommandQueueSize - 1)) == 0);
+GraphicsCommand command_queue[kCommandQueueSize];
+volatile uint32_t command_queue_head = 0;
+volatile uint32_t command_queue_tail = 0;
+
 static void __not_in_flash("main") core1_scanline_callback() {
   static uint screen_y = 0;
-  static int roll_y = 0;
+  static int row_roll = 0;
   // Only update roll at the beginning of the frame to avoid weird artifacts
   if (screen_y == 0) {
-    roll_y = gstate->GetRowRoll() * kFontCharHeight;
+    row_roll = gstate->GetRowRoll();
   }
 
-  uint logical_y = (screen_y - roll_y + kFrameHeight) % kFrameHeight;
+  uint logical_y = BufferLine(screen_y, row_roll);
 
   uint32_t* tmdsbuf;
   queue_remove_blocking(&dvi0.q_tmds_free, &tmdsbuf);
@@ -98,7 +113,17 @@ void __not_in_flash("main") bus_irq_callback(uint gpio, uint32_t event_mask) {
   // Data and address are laid out backside-front on the board
   uint8_t data = __rev((gpio_state & kDMask) >> kD7Pin) >> 24;
   uint8_t command = __rev((gpio_state & kAMask) >> kA5Pin) >> 26;
-  gstate->HandleCommand(command, data);
+  uint32_t head = command_queue_head;
+  if (head - command_queue_tail == kCommandQueueSize) {
+    // The write is lost. Turn the LED off to show it.
+    gpio_put(kLedPin, 0);
+    return;
+  }
+  command_queue[head % kCommandQueueSize] = {command, data};
+  __compiler_memory_barrier();
+  command_queue_head = head + 1;
+  // Wakes up the main loop
+  __sev();
 }
 
 int __not_in_flash("main") main() {
@@ -145,9 +170,22 @@ int __not_in_flash("main") main() {
   multicore_launch_core1(core1_main);
   sem_release(&dvi_start_sem);
 
-  // Sit around waiting for interrupts
+  // Run the writes the bus IRQ queues up, as many at once as are contiguous in
+  // the queue.
   while (true) {
-    __wfi();
+    uint32_t tail = command_queue_tail;
+    uint32_t head = command_queue_head;
+    if (head == tail) {
+      // The event the IRQ sends stays latched, so this doesn't miss a write
+      // that comes in after the check.
+      __wfe();
+      continue;
+    }
+    uint32_t start = tail % kCommandQueueSize;
+    uint32_t count = std::min(head - tail, kCommandQueueSize - start);
+    gstate->HandleCommands(&command_queue[start], count);
+    __compiler_memory_barrier();
+    command_queue_tail = tail + count;
   }
 
   __builtin_unreachable();
@@ -34,6 +34,21 @@ const uint DATA_PIN_0 = 8;
 
 const uint LED_PIN = 25;
 
+// The flash chip (SST39SF0x0) sits at 0x8000 and up on the bus. Its command
+// addresses are relative to its base.
+const uint16_t FLASH_BASE = 0x8000;
+const uint16_t FLASH_UNLOCK_1 = FLASH_BASE | 0x5555;
+const uint16_t FLASH_UNLOCK_2 = FLASH_BASE | 0x2aaa;
+// Maximum times from the datasheet, with some margin.
+const uint32_t FLASH_PROGRAM_TIMEOUT_US = 100;
+const uint32_t FLASH_ERASE_TIMEOUT_US = 100000;
+
+// Largest payload of a block write frame.
+const uint16_t MAX_BLOCK_SIZE = 1024;
+const uint8_t BLOCK_FLAG_FLASH = 1;
+// How long to wait for each byte of a command's arguments.
+const uint32_t ARGUMENT_TIMEOUT_US = 10000;
+
 const uint PIN_MASK_DATA = 0xff << DATA_PIN_0;
 
 const uint PIN_MASK_LATCH_OE = 1 << DATA_LATCH_OE_PIN |
@@ -140,7 +155,60 @@ void write_cycle() {
   busy_wait_us_32(1);
   gpio_put(CLK_PIN, 0);
   gpio_put(RW_PIN, 1);
-  busy_wait_us_32(20);
+}
+
+void write_byte(uint16_t address, uint8_t data) {
+  set_address(address);
+  set_data(data);
+  write_cycle();
+}
+
+// Data polling: while the flash is busy, reads return something other than
+// 'expected' at the address being written. Returns false on timeout.
+bool flash_wait(uint16_t address, uint8_t expected, uint32_t timeout_us) {
+  set_address(address);
+  uint32_t start = time_us_32();
+  while (read_cycle() != expected) {
+    if (time_us_32() - start > timeout_us) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool flash_program(uint16_t address, uint8_t data) {
+  // Programming can only clear bits, so writing the erased value is a no-op.
+  if (data == 0xff) {
+    return true;
+  }
+  write_byte(FLASH_UNLOCK_1, 0xaa);
+  write_byte(FLASH_UNLOCK_2, 0x55);
+  write_byte(FLASH_UNLOCK_1, 0xa0);
+  write_byte(address, data);
+  return flash_wait(address, data, FLASH_PROGRAM_TIMEOUT_US);
+}
+
+bool flash_erase_sector(uint16_t address) {
+  write_byte(FLASH_UNLOCK_1, 0xaa);
+  write_byte(FLASH_UNLOCK_2, 0x55);
+  write_byte(FLASH_UNLOCK_1, 0x80);
+  write_byte(FLASH_UNLOCK_1, 0xaa);
+  write_byte(FLASH_UNLOCK_2, 0x55);
+  write_byte(address, 0x30);
+  return flash_wait(address, 0xff, FLASH_ERASE_TIMEOUT_US);
+}
+
+// CRC-32 as used by zlib, so that the host can use zlib.crc32. Start with
+// crc = 0.
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
 }
 
 void read_data(uint16_t start, uint16_t end) {
@@ -150,6 +218,111 @@ void read_data(uint16_t start, uint16_t end) {
   }
 }
 
+// Reads 'size' bytes of command arguments into 'buffer'. Returns false if one
+// of them doesn't arrive in time.
+bool read_arguments(uint8_t* buffer, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    int c = getchar_timeout_us(ARGUMENT_TIMEOUT_US);
+    if (c == PICO_ERROR_TIMEOUT) {
+      return false;
+    }
+    buffer[i] = c;
+  }
+  return true;
+}
+
+void put_u16(uint16_t value) {
+  putchar(value & 0xff);
+  putchar(value >> 8);
+}
+
+// Block write: flags, address (2), length (2), payload, CRC-32 (4) of
+// everything after the command byte. All values are little endian. With
+// BLOCK_FLAG_FLASH set, every byte goes through the flash program sequence.
+// Replies 'k' when done, 'c' if the CRC doesn't match (nothing is written),
+// 'e' on timeout or bad length, or 'p' and the address of the first byte that
+// failed to program.
+void block_write_command() {
+  static uint8_t frame[5 + MAX_BLOCK_SIZE + 4];
+  if (!read_arguments(frame, 5)) {
+    putchar('e');
+    return;
+  }
+  uint8_t flags = frame[0];
+  uint16_t address = frame[1] | frame[2] << 8;
+  uint16_t length = frame[3] | frame[4] << 8;
+  if (length == 0 || length > MAX_BLOCK_SIZE) {
+    putchar('e');
+    return;
+  }
+  if (!read_arguments(frame + 5, length + 4)) {
+    putchar('e');
+    return;
+  }
+  const uint8_t* payload = frame + 5;
+  const uint8_t* crc_bytes = payload + length;
+  uint32_t expected_crc = crc_bytes[0] | crc_bytes[1] << 8 |
+                          crc_bytes[2] << 16 | (uint32_t)crc_bytes[3] << 24;
+  if (crc32(0, frame, 5 + length) != expected_crc) {
+    putchar('c');
+    return;
+  }
+  for (uint16_t i = 0; i < length; ++i) {
+    uint16_t byte_address = address + i;
+    if (flags & BLOCK_FLAG_FLASH) {
+      if (!flash_program(byte_address, payload[i])) {
+        putchar('p');
+        put_u16(byte_address);
+        return;
+      }
+    } else {
+      write_byte(byte_address, payload[i]);
+    }
+  }
+  putchar('k');
+}
+
+// Sector erase: address (2) of the sector. Replies 'k' when done, 'e' on
+// timeout, or 'p' and the address if the erase didn't finish in time.
+void erase_command() {
+  uint8_t arguments[2];
+  if (!read_arguments(arguments, sizeof(arguments))) {
+    putchar('e');
+    return;
+  }
+  uint16_t address = arguments[0] | arguments[1] << 8;
+  if (!flash_erase_sector(address)) {
+    putchar('p');
+    put_u16(address);
+    return;
+  }
+  putchar('k');
+}
+
+// Hash: address (2), length (2, 0 meaning 64k). Replies 'h' and the CRC-32 (4)
+// of the bytes read back, or 'e' on timeout.
+void hash_command() {
+  uint8_t arguments[4];
+  if (!read_arguments(arguments, sizeof(arguments))) {
+    putchar('e');
+    return;
+  }
+  uint16_t address = arguments[0] | arguments[1] << 8;
+  uint32_t length = arguments[2] | arguments[3] << 8;
+  if (length == 0) {
+    length = 0x10000;
+  }
+  uint32_t crc = 0;
+  for (uint32_t i = 0; i < length; ++i) {
+    set_address(address + i);
+    uint8_t data = read_cycle();
+    crc = crc32(crc, &data, 1);
+  }
+  putchar('h');
+  put_u16(crc & 0xffff);
+  put_u16(crc >> 16);
+}
+
 void init_pins() {
   gpio_set_function(UART0_TX_PIN, GPIO_FUNC_UART);
   gpio_set_function(UART0_RX_PIN, GPIO_FUNC_UART);
@@ -229,6 +402,18 @@ void programmer_task() {
       break;
     case 'w':
       write_cycle();
+      // Hosts sending single bytes may be programming flash byte by byte, and
+      // a program cycle takes up to 20us.
+      busy_wait_us_32(20);
+      break;
+    case 'W':
+      block_write_command();
+      break;
+    case 'E':
+      erase_command();
+      break;
+    case 'H':
+      hash_command();
       break;
     case 'r': {
       int addr_start_l = getchar_timeout_us(10000);
@@ -0,0 +1,362 @@
+#!/usr/bin/python3
+
+'''A host-side simulator of pico_programmer, to test programmer.py and measure
+its throughput without the board.
+
+SimulatedPico stands in for the serial port. What the host writes goes through
+the same command loop as pico_programmer.cpp, against 32k of RAM at 0x0000 and
+an SST39SF0x0 flash chip at 0x8000. Time is simulated, not measured: bus cycles
+cost what the busy waits in pico_programmer.cpp add up to, flash operations
+take their typical datasheet times, and USB costs a fixed rate per byte plus a
+frame of latency whenever the host waits for a reply. Transfer and bus time
+are added up rather than overlapped, so the numbers err on the slow side.'''
+
+import argparse
+import collections
+import contextlib
+import io
+import random
+import zlib
+
+import programmer
+
+# Microseconds per byte over USB full speed CDC, in practice.
+USB_US_PER_BYTE = 1.0
+# The host waiting for a reply costs about one USB frame.
+USB_TURNAROUND_US = 1000
+
+# Bus timings from pico_programmer.cpp.
+SET_LATCH_US = 1
+READ_CYCLE_US = 2
+WRITE_CYCLE_US = 2
+LEGACY_WRITE_WAIT_US = 20
+
+FLASH_PROGRAM_US = 14
+FLASH_ERASE_US = 18000
+FLASH_PROGRAM_TIMEOUT_US = 100
+FLASH_ERASE_TIMEOUT_US = 100000
+MAX_BLOCK_SIZE = 1024
+BLOCK_FLAG_FLASH = 1
+
+# Handed to the command loop instead of a byte when arguments time out.
+TIMEOUT = None
+# What the command loop is waiting for.
+WAITING_FOR_COMMAND = 0
+WAITING_FOR_ARGUMENT = 1
+
+
+class Flash:
+    '''An SST39SF0x0 with 4k sectors, seen through a 32k window.'''
+    SECTOR_SIZE = 4096
+    PROGRAM = [(0x5555, 0xaa), (0x2aaa, 0x55), (0x5555, 0xa0)]
+    ERASE = [(0x5555, 0xaa), (0x2aaa, 0x55), (0x5555, 0x80),
+             (0x5555, 0xaa), (0x2aaa, 0x55)]
+
+    def __init__(self):
+        self.data = bytearray([0xff] * 0x8000)
+        self.erase_count = 0
+        self.program_count = 0
+        self._cycles = []
+        self._busy_until = 0
+        self._busy_status = 0
+
+    def read(self, offset, now):
+        if now < self._busy_until:
+            # Data polling: DQ7 is inverted until the operation is done.
+            return self._busy_status
+        return self.data[offset]
+
+    def write(self, offset, value, now):
+        if now < self._busy_until:
+            return
+        self._cycles.append((offset & 0x7fff, value))
+        if self._cycles == self.PROGRAM + [(offset, value)]:
+            # Programming can only clear bits.
+            self.data[offset] &= value
+            self.program_count += 1
+            self._busy_until = now + FLASH_PROGRAM_US
+            self._busy_status = value ^ 0x80
+            self._cycles = []
+        elif self._cycles == self.ERASE + [(offset, 0x30)]:
+            start = offset - offset % self.SECTOR_SIZE
+            self.data[start:start+self.SECTOR_SIZE] = bytes(
+                [0xff] * self.SECTOR_SIZE)
+            self.erase_count += 1
+            self._busy_until = now + FLASH_ERASE_US
+            self._busy_status = 0x00
+            self._cycles = []
+        elif self._cycles not in (self.PROGRAM[:len(self._cycles)],
+                                  self.ERASE[:len(self._cycles)]):
+            # Anything unexpected resets the command sequence.
+            self._cycles = []
+
+
+class SimulatedPico:
+    '''A pyserial-like port backed by a simulated pico_programmer.'''
+
+    def __init__(self):
+        self.ram = bytearray(0x8000)
+        self.flash = Flash()
+        self.time_us = 0
+        # Corrupts the last byte of this many upcoming writes, to test retries.
+        self.corrupt_writes = 0
+        self._standby = False
+        self._address = 0
+        self._data = 0
+        self._input = collections.deque()
+        self._output = bytearray()
+        self._loop = self._command_loop()
+        self._waiting_for = next(self._loop)
+
+    # The serial port interface used by programmer.py.
+    def write(self, data):
+        data = bytearray(data)
+        if self.corrupt_writes and data:
+            self.corrupt_writes -= 1
+            data[-1] ^= 0xff
+        self.time_us += len(data) * USB_US_PER_BYTE
+        self._input.extend(data)
+        self._run()
+        return len(data)
+
+    def read(self, size=1):
+        # The host is waiting for a reply, so nothing else is coming: arguments
+        # the device still waits for time out.
+        while self._waiting_for == WAITING_FOR_ARGUMENT:
+            self._waiting_for = self._loop.send(TIMEOUT)
+        if not self._output:
+            return b''
+        data = bytes(self._output[:size])
+        del self._output[:size]
+        self.time_us += USB_TURNAROUND_US + len(data) * USB_US_PER_BYTE
+        return data
+
+    def _run(self):
+        while self._input:
+            self._waiting_for = self._loop.send(self._input.popleft())
+
+    # The bus, as driven from pico_programmer.cpp.
+    def _set_address(self, address):
+        self.time_us += 2 * SET_LATCH_US
+        self._address = address
+
+    def _set_data(self, data):
+        self.time_us += SET_LATCH_US
+        self._data = data
+
+    def _read_cycle(self):
+        self.time_us += READ_CYCLE_US
+        if not self._standby:
+            return 0xff
+        if self._address < 0x8000:
+            return self.ram[self._address]
+        return self.flash.read(self._address - 0x8000, self.time_us)
+
+    def _write_cycle(self):
+        self.time_us += WRITE_CYCLE_US
+        if not self._standby:
+            return
+        if self._address < 0x8000:
+            self.ram[self._address] = self._data
+        else:
+            self.flash.write(self._address - 0x8000, self._data, self.time_us)
+
+    def _write_byte(self, address, data):
+        self._set_address(address)
+        self._set_data(data)
+        self._write_cycle()
+
+    def _flash_wait(self, address, expected, timeout_us):
+        self._set_address(address)
+        start = self.time_us
+        while self._read_cycle() != expected:
+            if self.time_us - start > timeout_us:
+                return False
+        return True
+
+    def _flash_program(self, address, data):
+        if data == 0xff:
+            return True
+        self._write_byte(0x8000 | 0x5555, 0xaa)
+        self._write_byte(0x8000 | 0x2aaa, 0x55)
+        self._write_byte(0x8000 | 0x5555, 0xa0)
+        self._write_byte(address, data)
+        return self._flash_wait(address, data, FLASH_PROGRAM_TIMEOUT_US)
+
+    def _flash_erase_sector(self, address):
+        for offset, data in Flash.ERASE:
+            self._write_byte(0x8000 | offset, data)
+        self._write_byte(address, 0x30)
+        return self._flash_wait(address, 0xff, FLASH_ERASE_TIMEOUT_US)
+
+    # The command loop. Yields what it waits for and gets bytes, or TIMEOUT,
+    # sent in.
+    def _read_arguments(self, size):
+        arguments = bytearray()
+        for _ in range(size):
+            c = yield WAITING_FOR_ARGUMENT
+            if c is TIMEOUT:
+                return None
+            arguments.append(c)
+        return arguments
+
+    def _command_loop(self):
+        while True:
+            c = yield WAITING_FOR_COMMAND
+            if c == ord('s'):
+                self._standby = True
+            elif c == ord('x'):
+                self._standby = False
+            elif c in (ord('d'), ord('l'), ord('h')):
+                arguments = yield from self._read_arguments(1)
+                if arguments is None:
+                    self._output += b'e'
+                elif c == ord('d'):
+                    self._set_data(arguments[0])
+                elif c == ord('l'):
+                    self.time_us += SET_LATCH_US
+                    self._address = self._address & 0xff00 | arguments[0]
+                else:
+                    self.time_us += SET_LATCH_US
+                    self._address = self._address & 0xff | arguments[0] << 8
+            elif c == ord('w'):
+                self._write_cycle()
+                self.time_us += LEGACY_WRITE_WAIT_US
+            elif c == ord('r'):
+                arguments = yield from self._read_arguments(4)
+                if arguments is None:
+                    self._output += b'e'
+                    continue
+                self._output += b'r'
+                start = int.from_bytes(arguments[0:2], 'little')
+                end = int.from_bytes(arguments[2:4], 'little')
+                address = start
+                while True:
+                    self._set_address(address)
+                    self._output.append(self._read_cycle())
+                    if address == end:
+                        break
+                    address = (address + 1) & 0xffff
+            elif c == ord('W'):
+                yield from self._block_write_command()
+            elif c == ord('E'):
+                arguments = yield from self._read_arguments(2)
+                if arguments is None:
+                    self._output += b'e'
+                    continue
+                address = int.from_bytes(arguments, 'little')
+                if self._flash_erase_sector(address):
+                    self._output += b'k'
+                else:
+                    self._output += b'p' + address.to_bytes(2, 'little')
+            elif c == ord('H'):
+                arguments = yield from self._read_arguments(4)
+                if arguments is None:
+                    self._output += b'e'
+                    continue
+                address = int.from_bytes(arguments[0:2], 'little')
+                length = int.from_bytes(arguments[2:4], 'little') or 0x10000
+                crc = 0
+                for i in range(length):
+                    self._set_address((address + i) & 0xffff)
+                    crc = zlib.crc32(bytes([self._read_cycle()]), crc)
+                self._output += b'h' + crc.to_bytes(4, 'little')
+
+    def _block_write_command(self):
+        header = yield from self._read_arguments(5)
+        if header is None:
+            self._output += b'e'
+            return
+        flags = header[0]
+        address = int.from_bytes(header[1:3], 'little')
+        length = int.from_bytes(header[3:5], 'little')
+        if length == 0 or length > MAX_BLOCK_SIZE:
+            self._output += b'e'
+            return
+        rest = yield from self._read_arguments(length + 4)
+        if rest is None:
+            self._output += b'e'
+            return
+        payload = rest[:length]
+        if zlib.crc32(header + payload) != int.from_bytes(rest[length:],
+                                                          'little'):
+            self._output += b'c'
+            return
+        for i, data in enumerate(payload):
+            byte_address = (address + i) & 0xffff
+            if flags & BLOCK_FLAG_FLASH:
+                if not self._flash_program(byte_address, data):
+                    self._output += b'p' + byte_address.to_bytes(2, 'little')
+                    return
+            else:
+                self._write_byte(byte_address, data)
+        self._output += b'k'
+
+
+def legacy_flash_write(port, start_address, data):
+    '''Programs flash the way programmer.py did before block writes: every byte
+    as four separate write commands, with fixed waits.'''
+    def write_byte(address, value):
+        return bytes([ord('l'), address % 256, ord('h'), address // 256,
+                      ord('d'), value, ord('w')])
+
+    unlock = write_byte(0xd555, 0xaa) + write_byte(0xaaaa, 0x55)
+    for start in range(0, len(data), Flash.SECTOR_SIZE):
+        address = (start_address + start) | 0x8000
+        port.write(unlock + write_byte(0xd555, 0x80) + unlock +
+                   write_byte(address, 0x30))
+        # The old host slept for 25ms after each erase.
+        port.time_us += 25000
+        sector = data[start:start+Flash.SECTOR_SIZE]
+        port.write(b''.join(unlock + write_byte(0xd555, 0xa0) +
+                            write_byte(address + i, value)
+                            for i, value in enumerate(sector)))
+
+
+def benchmark(size):
+    image = bytes(random.Random(0).getrandbits(8) for _ in range(size))
+    start_address = 0x10000 - size
+
+    def report(name, port, start_us, written=size):
+        seconds = (port.time_us - start_us) / 1e6
+        print(f'{name:<28} {seconds:7.2f}s  {written / 1024 / seconds:6.1f} kB/s')
+
+    port = SimulatedPico()
+    port.write(b's')
+    legacy_flash_write(port, start_address, image)
+    assert bytes(port.flash.data[-size:]) == image
+    report('Byte commands (old)', port, 0)
+
+    port = SimulatedPico()
+    prog = programmer.Programmer(port)
+    prog.standby = True
+    port.write(b's')
+    # programmer.py reports progress per sector.
+    quiet = lambda: contextlib.redirect_stdout(io.StringIO())
+    with quiet():
+        prog.flash_write_data(start_address, image)
+    assert bytes(port.flash.data[-size:]) == image
+    report('Block writes', port, 0)
+
+    changed = bytearray(image)
+    changed[size // 2] ^= 0xff
+    start_us = port.time_us
+    with quiet():
+        prog.flash_write_data(start_address, changed)
+    assert bytes(port.flash.data[-size:]) == changed
+    report('Block writes, one change', port, start_us)
+
+    start_us = port.time_us
+    prog.ram_write_data(0x1000, image[:0x4000])
+    assert bytes(port.ram[0x1000:0x5000]) == image[:0x4000]
+    report('RAM block writes', port, start_us, 0x4000)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(
+        description='Measures programming throughput against a simulated '
+        'pico_programmer')
+    parser.add_argument('--size', type=lambda x: int(x, 0), default=0x8000,
+                        help='Size of the ROM image to write')
+    arguments = parser.parse_args()
+    benchmark(arguments.size)
@@ -1,12 +1,17 @@
 #!/usr/bin/python3
 
 import argparse
-import serial
 import sys
 import time
+import zlib
 
 class Programmer:
     SECTOR_SIZE = 4096
+    # Payload bytes per block write frame. The device accepts up to 1024.
+    BLOCK_SIZE = 256
+    BLOCK_FLAG_FLASH = 1
+    # Frames that arrive corrupted are sent again this many times.
+    BLOCK_RETRIES = 3
 
     def __init__(self, serial_port):
         self.port = serial_port
@@ -23,49 +28,78 @@ class Programmer:
             self.port.write(self.data)
         self.exit_stby()
 
-    def _write_byte(self, address, data):
+    def _read_failed_address(self):
+        return int.from_bytes(self.port.read(2), 'little')
+
+    def write_block(self, address, data, flash=False):
+        """Writes up to BLOCK_SIZE bytes in one CRC-checked frame.
+
+        With flash=True the device runs the flash program sequence for every
+        byte and polls until it's done."""
         if self.standby == False:
             raise Exception("Attempting write without being in standby")
-        self.port.write([
-            # latch low address byte
-            ord('l'), address % 256,
-            # latch high address byte
-            ord('h'), address // 256,
-            # latch data byte
-            ord('d'), data,
-            ord('w')
-        ])
-
-    def _flash_write_byte(self, address, data):
-        self._write_byte(0x5555 | 0x8000, 0xaa)
-        self._write_byte(0x2aaa | 0x8000, 0x55)
-        self._write_byte(0x5555 | 0x8000, 0xa0)
-        self._write_byte(address | 0x8000, data)
+        frame = bytes([self.BLOCK_FLAG_FLASH if flash else 0])
+        frame += address.to_bytes(2, 'little')
+        frame += len(data).to_bytes(2, 'little')
+        frame += bytes(data)
+        frame += zlib.crc32(frame).to_bytes(4, 'little')
+        for _ in range(self.BLOCK_RETRIES):
+            self.port.write(b'W' + frame)
+            reply = self.port.read(1)
+            if reply == b'k':
+                return
+            if reply == b'p':
+                raise Exception(
+                    f'Failed to program flash at {self._read_failed_address():04x}')
+            if reply != b'c':
+                raise Exception(f'Block write at {address:04x} failed: {reply}')
+            # The frame got corrupted on the way and nothing was written.
+        raise Exception(f'Block write at {address:04x} kept failing CRC checks')
+
+    def read_hash(self, address, size):
+        """Returns the CRC-32 of 'size' bytes read back from 'address'."""
+        if address + size - 1 > 0xffff:
+            raise Exception(f'Out of bounds read: address {address:04x}, size {size:04x}')
+        self.port.write(b'H' + address.to_bytes(2, 'little') +
+                        (size % 0x10000).to_bytes(2, 'little'))
+        reply = self.port.read(5)
+        if len(reply) != 5 or reply[0:1] != b'h':
+            raise Exception(f'Failed to read hash at {address:04x}: {reply}')
+        return int.from_bytes(reply[1:5], 'little')
 
     def _flash_sector_erase(self, address):
-        self._write_byte(0x5555 | 0x8000, 0xaa)
-        self._write_byte(0x2aaa | 0x8000, 0x55)
-        self._write_byte(0x5555 | 0x8000, 0x80)
-        self._write_byte(0x5555 | 0x8000, 0xaa)
-        self._write_byte(0x2aaa | 0x8000, 0x55)
-        self._write_byte(address | 0x8000, 0x30)
-        time.sleep(0.025)
-
-    def flash_write_data(self, start_address, data):
+        self.port.write(b'E' + (address | 0x8000).to_bytes(2, 'little'))
+        reply = self.port.read(1)
+        if reply == b'p':
+            raise Exception(
+                f'Failed to erase sector at {self._read_failed_address():04x}')
+        if reply != b'k':
+            raise Exception(f'Sector erase at {address:04x} failed: {reply}')
+
+    def flash_write_data(self, start_address, data, delta=True):
+        """Erases and programs the sectors covered by 'data'. With delta=True,
+        sectors that already hold their part of 'data' are left alone."""
         for start in range(0, len(data), self.SECTOR_SIZE):
             end = min(start+self.SECTOR_SIZE, len(data))
             address = start_address + start
+            sector = data[start:end]
+
+            if delta and self.read_hash(address | 0x8000, len(sector)) == zlib.crc32(bytes(sector)):
+                print(f"Sector at {address:04x} unchanged")
+                continue
 
             print(f"Erasing sector at {address:04x}")
             self._flash_sector_erase(address)
 
             print(f"Writing bytes {start} to {end-1} at {address:04x}")
-            for i in range(start, end):
-                self._flash_write_byte(start_address + i, data[i])
+            for block in range(0, len(sector), self.BLOCK_SIZE):
+                self.write_block((address + block) | 0x8000,
+                                 sector[block:block+self.BLOCK_SIZE], flash=True)
 
     def ram_write_data(self, start_address, data):
-        for index, byte in enumerate(data):
-            self._write_byte(start_address + index, byte)
+        for start in range(0, len(data), self.BLOCK_SIZE):
+            self.write_block(start_address + start,
+                             data[start:start+self.BLOCK_SIZE])
 
     def read_data(self, address, size):
         if address + size -1 > 0xffff:
@@ -103,6 +137,12 @@ class Programmer:
         self.port.write(b'x')
         self.standby = False
 
+def open_port(port, timeout=1):
+    # Imported here so that the Programmer class can be used with the simulator
+    # without pyserial.
+    import serial
+    return serial.Serial(port, 115200, timeout=timeout)
+
 def write_flash_command(args):
     with open(args.file, "rb") as input_file:
         data = input_file.read()
@@ -119,11 +159,11 @@ def write_flash_command(args):
         print("Error: write address not at sector boundary")
         sys.exit(2)
 
-    serial_port = serial.Serial(args.port, 115200)
+    serial_port = open_port(args.port)
 
     with Programmer(serial_port) as prog:
         prog.enter_stby()
-        prog.flash_write_data(base_address, data)
+        prog.flash_write_data(base_address, data, delta=not args.no_delta)
 
 def write_ram_command(args):
     with open(args.file, "rb") as input_file:
@@ -134,7 +174,7 @@ def write_ram_command(args):
         print("Error: address + data size beyond 65k")
         sys.exit(1)
 
-    serial_port = serial.Serial(args.port, 115200, timeout=1)
+    serial_port = open_port(args.port)
 
     with Programmer(serial_port) as prog:
         prog.enter_stby()
@@ -142,14 +182,14 @@ def write_ram_command(args):
         prog.ram_write_data(base_address, data)
 
 def write_byte_command(args):
-    serial_port = serial.Serial(args.port, 115200)
+    serial_port = open_port(args.port)
 
     with Programmer(serial_port) as prog:
         prog.enter_stby()
         prog.ram_write_data(args.address, [args.byte])
 
 def read_command(args):
-    serial_port = serial.Serial(args.port, 115200, timeout=0.5)
+    serial_port = open_port(args.port, timeout=0.5)
 
     with Programmer(serial_port) as prog:
         prog.enter_stby()
@@ -170,6 +210,8 @@ if __name__ == '__main__':
     write_flash_parser = subparsers.add_parser('write_flash')
     write_flash_parser.add_argument('file')
     write_flash_parser.add_argument('--address', type=lambda x: int(x, 0))
+    write_flash_parser.add_argument('--no_delta', action='store_true',
+                                    help='Rewrite sectors even if unchanged')
     write_flash_parser.set_defaults(func=write_flash_command)
 
     write_ram_parser = subparsers.add_parser('write_ram')
@@ -0,0 +1,63 @@
+#!/usr/bin/python3
+
+'''Tests programmer.py against the simulated device in pico_simulator.py.'''
+
+import contextlib
+import io
+import unittest
+
+import pico_simulator
+import programmer
+
+
+class ProgrammerTest(unittest.TestCase):
+    def setUp(self):
+        self.port = pico_simulator.SimulatedPico()
+        self.prog = programmer.Programmer(self.port)
+        self.prog.enter_stby()
+
+    def flash_write_data(self, address, data):
+        with contextlib.redirect_stdout(io.StringIO()):
+            self.prog.flash_write_data(address, data)
+
+    def test_ram_write_reads_back(self):
+        data = bytes(range(256)) * 3
+        self.prog.ram_write_data(0x1000, data)
+        self.assertEqual(self.port.ram[0x1000:0x1000 + len(data)], data)
+        with contextlib.redirect_stdout(io.StringIO()):
+            self.assertEqual(bytes(self.prog.read_data(0x1000, len(data))),
+                             data)
+
+    def test_flash_write(self):
+        data = bytes(i * 7 % 256 for i in range(0x2000))
+        self.flash_write_data(0xe000, data)
+        self.assertEqual(self.port.flash.data[0x6000:], data)
+
+    def test_flash_write_skips_unchanged_sectors(self):
+        data = bytearray(i * 7 % 256 for i in range(0x3000))
+        self.flash_write_data(0xd000, data)
+        self.assertEqual(self.port.flash.erase_count, 3)
+
+        data[0x1234] ^= 0xff
+        self.flash_write_data(0xd000, data)
+        self.assertEqual(self.port.flash.erase_count, 4)
+        self.assertEqual(self.port.flash.data[0x5000:], data)
+
+    def test_corrupted_block_is_sent_again(self):
+        self.port.corrupt_writes = 1
+        self.prog.ram_write_data(0x0100, b'\x01\x02\x03')
+        self.assertEqual(self.port.ram[0x0100:0x0103], b'\x01\x02\x03')
+
+    def test_incomplete_block_times_out(self):
+        # A 4 byte block, of which only 2 bytes arrive.
+        self.port.write(b'W\x00\x00\x01\x04\x00ab')
+        self.assertEqual(self.port.read(1), b'e')
+        self.assertEqual(self.port.ram[0x0100:0x0102], b'\x00\x00')
+
+    def test_byte_commands_still_work(self):
+        self.port.write(b'l\x34h\x12d\x56w')
+        self.assertEqual(self.port.ram[0x1234], 0x56)
+
+
+if __name__ == '__main__':
+    unittest.main()